@@ -3,6 +3,8 @@ C:\VulkanSDK\1.2.148.1\Bin\glslc.exe shader.vert 		        -o spv/vert.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe shader.frag 		        -o spv/frag.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe pbr.vert 		            -o spv/pbrvert.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe pbr.frag 		            -o spv/pbrfrag.spv
+C:\VulkanSDK\1.2.148.1\Bin\glslc.exe -DBINDLESS pbr.vert 	    -o spv/pbrvert_bindless.spv
+C:\VulkanSDK\1.2.148.1\Bin\glslc.exe -DBINDLESS pbr.frag 	    -o spv/pbrfrag_bindless.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe depth.vert			        -o spv/depthvert.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe shaderwire.vert 		    -o spv/vertwire.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe shaderwire.frag 		    -o spv/fragwire.spv
@@ -29,6 +31,8 @@ C:\VulkanSDK\1.2.148.1\Bin\glslc.exe bv.frag					-o spv/bvfrag.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe bv.vert				    -o spv/bvvert.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe VisibleClusters.comp		-o spv/visibleclusters.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe CullClusters.comp			-o spv/cullclusters.spv
+C:\VulkanSDK\1.2.148.1\Bin\glslc.exe GpuCull.comp				-o spv/gpucull.spv
+C:\VulkanSDK\1.2.148.1\Bin\glslc.exe HiZBuild.comp				-o spv/hizbuild.spv
 
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe Compute/greyscale.comp		-o spv/compgreyscale.spv
 C:\VulkanSDK\1.2.148.1\Bin\glslc.exe Compute/shader.comp		-o spv/comp.spv
@@ -1,5 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 //we use depth-prepass
 layout(early_fragment_tests) in;
@@ -146,7 +149,8 @@ layout(set = 0, binding = 11) uniform point_Buffer
   vec4 bias; //x: constant bias y: normal bias z: slope bias w: pcf option
 }pb;
 
-layout(set = 1, binding = 1) uniform MaterialBuffer
+//every material is a record in one table the MaterialLibrary keeps, the vertex shader passes along the handle of this instances one
+struct material_record
 {
 	vec4 albedo;
 
@@ -164,7 +168,38 @@ layout(set = 1, binding = 1) uniform MaterialBuffer
 	int specular_map;
 	int metal_map;
 	int normal_map;
-} Material;
+
+	uint albedo_slot;
+	uint specular_slot;
+	uint metal_slot;
+	uint normal_slot;
+};
+
+layout(location = 12) flat in uint materialID;
+
+layout(std430, set = 0, binding = 18) readonly buffer MaterialTable
+{
+	material_record records[];
+} materials;
+
+#define Material materials.records[materialID]
+
+//compiled with -DBINDLESS for devices with descriptor indexing: every map is a slot in one sampler array (BindlessTextures.h) the record points into,
+//the defines let the rest of the shader read them like the per object bindings
+#ifdef BINDLESS
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+//instances of different materials share a draw so the slot isn't uniform
+#define Albedo_Map textures[nonuniformEXT(Material.albedo_slot)]
+#define Specular_Map textures[nonuniformEXT(Material.specular_slot)]
+#define Metal_Map textures[nonuniformEXT(Material.metal_slot)]
+#define Normal_Map textures[nonuniformEXT(Material.normal_slot)]
+#else
+layout(set = 1,binding = 2) uniform sampler2D Albedo_Map;
+layout(set = 1,binding = 3) uniform sampler2D Specular_Map;
+layout(set = 1,binding = 4) uniform sampler2D Metal_Map;
+layout(set = 1,binding = 5) uniform sampler2D Normal_Map;
+#endif
 
 layout(set = 0, binding = 7) uniform AtmosphereBuffer{
 	vec4 campos; //verified
@@ -177,10 +212,6 @@ layout(set = 0, binding = 7) uniform AtmosphereBuffer{
 
 } amtosphere_info;
 
-layout(set = 1,binding = 2) uniform sampler2D Albedo_Map;
-layout(set = 1,binding = 3) uniform sampler2D Specular_Map;
-layout(set = 1,binding = 4) uniform sampler2D Metal_Map;
-layout(set = 1,binding = 5) uniform sampler2D Normal_Map;
 layout(set = 0,binding = 6) uniform sampler2D AmbientLUT;
 layout(set = 0,binding = 10) uniform sampler2D TransmittanceLUT;
 //layout(set = 0,binding = 4) uniform sampler2D sunShadowMap;
@@ -975,8 +1006,10 @@ void main() {
 
 	if(Material.normal_map == 1)
 	{
-	  vec3 normal_map = texture(Normal_Map, vec2(texCoords.x, -texCoords.y)).rgb;
-	  normal_map = normal_map * 2.0 - 1.0;
+	  //only xy is stored (BC5 has no blue), z is whatever makes it unit length
+	  vec3 normal_map;
+	  normal_map.xy = texture(Normal_Map, vec2(texCoords.x, -texCoords.y)).rg * 2.0 - 1.0;
+	  normal_map.z = sqrt(max(1.0 - dot(normal_map.xy, normal_map.xy), 0.0));
 	  normal_map = normalize(TBN * normal_map);
 
 	  N = normal_map;
@@ -1,12 +1,19 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 inPosition;
+layout(location = 0) in vec4 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inUV;
 layout(location = 3) in vec3 inT;
 layout(location = 4) in vec3 inB;
 
+//QUANTIZED meshes (see VertexFormat.h) store position as unorm relative to the meshes aabb, FULL meshes push min 0 extent 1 so this is the same for both
+layout(constant_id = 0) const bool QUANTIZED_VERTICES = false;
+layout(push_constant) uniform VertexDecode{
+	vec4 position_min;
+	vec4 position_extent;
+} decode;
+
 layout(location = 2) out vec2 texCoords;
 layout(location = 3) out vec3 fragNormal;
 layout(location = 4) out vec3 WorldPos;
@@ -16,10 +23,17 @@ layout(location = 9) out mat3 TBN;
 layout(location = 6) out vec4 sunndc;
 layout(location = 1) out vec4 clipspace;
 
-layout(	push_constant ) uniform VertexMatricesBuffer
-{
-	mat4 model;
-} ubo;
+//model matrices of every instance this frame, the draw's firstInstance points at where its batch starts
+layout(std430, set = 0, binding = 16) readonly buffer InstanceBuffer{
+	mat4 model[];
+} instances;
+
+//every instance carries the handle of its material next to its matrix, its record in the fragment shaders MaterialTable (see MaterialLibrary.h)
+layout(std430, set = 0, binding = 17) readonly buffer InstanceMaterials{
+	uint material[];
+} instance_materials;
+
+layout(location = 12) flat out uint materialID;
 
 layout(set = 0,binding = 2) uniform ProjVertexBuffer{
 	mat4 view;
@@ -31,27 +45,51 @@ layout(set = 0,binding = 2) uniform ProjVertexBuffer{
 	mat4 proj;
 } spv;
 */
+
+//octahedral decode, the inverse of EncodeOctahedral in VertexFormat.h
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0.0)
+	{
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(v);
+}
+
 void main(){
-	gl_Position = pv.proj * pv.view * ubo.model * vec4(vec3(inPosition.x, inPosition.y, inPosition.z), 1.0);
+	mat4 model = instances.model[gl_InstanceIndex];
+	materialID = instance_materials.material[gl_InstanceIndex];
+	vec3 position = decode.position_min.xyz + inPosition.xyz * decode.position_extent.xyz;
+	vec3 normal = inNormal;
+	vec3 tangent = inT;
+	vec3 bitangent = inB;
+	if (QUANTIZED_VERTICES)
+	{
+		normal = DecodeOctahedral(inNormal.xy);
+		tangent = DecodeOctahedral(inT.xy);
+		bitangent = cross(normal, tangent) * (inPosition.w * 2.0 - 1.0);
+	}
+	gl_Position = pv.proj * pv.view * model * vec4(position, 1.0);
 	gl_Position.y = -gl_Position.y;
 
 	clipspace = gl_Position;
 
-	//sunndc = spv.proj * spv.view * ubo.model * vec4(vec3(inPosition.x, inPosition.y, inPosition.z), 1.0);
+	//sunndc = spv.proj * spv.view * model * vec4(position, 1.0);
 	//sunndc.y = -sunndc.y;
 
-	mat3 inverse_model = mat3(transpose(inverse(ubo.model)));
-	WorldPos = vec3(ubo.model * vec4(inPosition, 1.0));
+	mat3 inverse_model = mat3(transpose(inverse(model)));
+	WorldPos = vec3(model * vec4(position, 1.0));
 	texCoords = inUV;
-	fragNormal = inverse_model * inNormal;
-	fragTangent = inverse_model * inT;
-	fragBiTangent = inverse_model * inB;
+	fragNormal = inverse_model * normal;
+	fragTangent = inverse_model * tangent;
+	fragBiTangent = inverse_model * bitangent;
 
 	//only do if object is doing normal mapping
     //Gram-Schmidt process
-    vec3 T = normalize(vec3(ubo.model * vec4(inT, 0.0)));
-	//vec3 B = normalize(vec3(ubo.model * vec4(inB, 0.0)));
-    vec3 N = normalize(vec3(ubo.model * vec4(inNormal, 0.0)));
+    vec3 T = normalize(vec3(model * vec4(tangent, 0.0)));
+	//vec3 B = normalize(vec3(model * vec4(inB, 0.0)));
+    vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
     T = normalize(T - dot(T,N) * N);
     vec3 B = cross(N, T);
 
@@ -1,16 +1,19 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inUV;
-layout(location = 3) in vec3 inT;
-layout(location = 4) in vec3 inB;
+//only the meshes position stream is bound for this pass
+layout(location = 0) in vec4 inPosition;
 
-layout(	push_constant ) uniform VertexMatricesBuffer
-{
-	mat4 model;
-} ubo;
+//QUANTIZED meshes (see VertexFormat.h) store position as unorm relative to the meshes aabb, FULL meshes push min 0 extent 1 so this is the same for both
+layout(push_constant) uniform VertexDecode{
+	vec4 position_min;
+	vec4 position_extent;
+} decode;
+
+//model matrices of every instance this frame, the draw's firstInstance points at where its batch starts
+layout(std430, set = 0, binding = 0) readonly buffer InstanceBuffer{
+	mat4 model[];
+} instances;
 
 layout(set = 1,binding = 2) uniform ProjVertexBuffer{
 	mat4 view;
@@ -19,6 +22,8 @@ layout(set = 1,binding = 2) uniform ProjVertexBuffer{
 
 void main()
 {
-	gl_Position = pv.proj * pv.view * ubo.model * vec4(vec3(inPosition.x, inPosition.y, inPosition.z), 1.0);
+	mat4 model = instances.model[gl_InstanceIndex];
+	vec3 position = decode.position_min.xyz + inPosition.xyz * decode.position_extent.xyz;
+	gl_Position = pv.proj * pv.view * model * vec4(position, 1.0);
 	gl_Position.y = -gl_Position.y;
 }
@@ -9,9 +9,10 @@ layout(location = 3) in vec2 inUV;
 layout(location = 1) out vec3 outColor;
 layout(location = 2) out vec2 texCoords;
 
-layout(set = 1, binding = 0) uniform UniformBufferObject{
-	mat4 model;
-} ubo;
+//model matrices of every instance this frame, the draw's firstInstance points at where its batch starts
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffer{
+	mat4 model[];
+} instances;
 
 layout(set = 0,binding = 2) uniform ProjVertexBuffer{
 	mat4 view;
@@ -20,10 +21,7 @@ layout(set = 0,binding = 2) uniform ProjVertexBuffer{
 
 void main(void)
 {
-	float xdisplacement = 3 * (gl_InstanceIndex / 20);
-	float zdisplacement = -3 * (gl_InstanceIndex % 20);
-
-	gl_Position = pv.proj * pv.view * ubo.model * vec4(inPosition + vec3(xdisplacement, 0, zdisplacement), 1.0);
+	gl_Position = pv.proj * pv.view * instances.model[gl_InstanceIndex] * vec4(inPosition, 1.0);
 	gl_Position.y = -gl_Position.y;
 
 	outColor = inColor;
@@ -0,0 +1,117 @@
+#include "../pch.h"
+#include "AssetLoader.h"
+
+namespace Gibo {
+
+	void AssetLoader::QueueMesh(const std::string& filename, VERTEX_FORMAT format)
+	{
+		if (submitted)
+		{
+			Logger::LogWarning("AssetLoader: can't queue ", filename, " while a batch is decoding, call Wait first\n");
+			return;
+		}
+
+		if (meshcacheref.HasMesh(filename)) return;
+		for (int i = 0; i < meshes.size(); i++)
+		{
+			if (meshes[i].filename == filename) return;
+		}
+
+		meshes.emplace_back();
+		meshes.back().filename = filename;
+		meshes.back().format = format;
+	}
+
+	void AssetLoader::QueueTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage)
+	{
+		if (submitted)
+		{
+			Logger::LogWarning("AssetLoader: can't queue ", filename, " while a batch is decoding, call Wait first\n");
+			return;
+		}
+
+		if (texturecacheref.HasTexture(filename, mipped, usage)) return;
+		for (int i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].filename == filename && textures[i].mipped == mipped && textures[i].usage == usage) return;
+		}
+
+		textures.emplace_back();
+		textures.back().filename = filename;
+		textures.back().mipped = mipped;
+		textures.back().usage = usage;
+		textures.back().compressed = texturecacheref.Compresses(usage);
+	}
+
+	void AssetLoader::Submit()
+	{
+		if (submitted) return;
+		submitted = true;
+
+		//one job per asset, the sizes are all over the place so a bigger grain would just leave workers idle behind one slow model.
+		//the arrays can't change size until Wait so every job owns its own element
+		mesh_decoded.assign(meshes.size(), 0);
+		uint32_t meshcount = static_cast<uint32_t>(meshes.size());
+		uint32_t count = meshcount + static_cast<uint32_t>(textures.size());
+		jobsystemref.ParallelForAsync(count, 1, [this, meshcount](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (i < meshcount)
+				{
+					std::string filename = meshes[i].filename;
+					mesh_decoded[i] = MeshCache::DecodeMesh(filename, meshes[i].format, meshes[i]);
+				}
+				else
+				{
+					TextureCache::DecodedTexture& texture = textures[i - meshcount];
+					TextureCache::DecodeTexture(texture.filename, texture.mipped, texture.usage, texture.compressed, texture);
+				}
+			}
+		}, &decode_counter);
+	}
+
+	void AssetLoader::Wait()
+	{
+		if (!submitted)
+		{
+			if (meshes.empty() && textures.empty()) return;
+			Submit();
+		}
+
+		//the calling thread helps decode instead of just blocking
+		jobsystemref.Wait(&decode_counter);
+
+		//everything gets staged into one uploader, it only submits again if the batch passes its staging limit.
+		//decoded data is copied into staging as it goes so each mesh/texture can be freed right after its added
+		AssetUploader uploader(deviceref);
+		uint32_t meshcount = 0;
+		uint32_t texturecount = 0;
+		for (int i = 0; i < meshes.size(); i++)
+		{
+			if (mesh_decoded[i] && meshcacheref.AddDecodedMesh(meshes[i], uploader))
+			{
+				meshcount++;
+			}
+			meshes[i] = MeshCache::DecodedMesh();
+		}
+		for (int i = 0; i < textures.size(); i++)
+		{
+			if (texturecacheref.AddDecodedTexture(textures[i], uploader))
+			{
+				texturecount++;
+			}
+			TextureCache::FreeDecodedTexture(textures[i]);
+		}
+		uploader.Flush();
+
+		Logger::LogInfo("AssetLoader: loaded ", meshcount, "/", meshes.size(), " meshes and ", texturecount, "/", textures.size(), " textures, ",
+			uploader.GetUploadedBytes() / 1000000, "MB in ", uploader.GetSubmitCount(), " transfer submits\n");
+
+		meshes.clear();
+		textures.clear();
+		mesh_decoded.clear();
+		submitted = false;
+	}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "AssetManager.h"
+#include "TextureCache.h"
+#include "AssetUploader.h"
+#include "../Utilities/JobSystem.h"
+
+namespace Gibo {
+
+	/*
+	 Batch loader for the mesh and texture caches. Queue up everything you want, Submit kicks off the decoding (assimp/.gmesh mapping and stb_image) on the job system
+	 workers and returns right away, then Wait finishes whatever decoding is left and uploads all of it through one AssetUploader, so a whole level goes out in a couple
+	 of transfer submits instead of one blocking submit per buffer/texture.
+
+	 The handles are just the cache keys, once Wait returns Get2DTexture(filename, mipped, usage) and SetObjectMesh(filename) hit the cache and don't load anything.
+	 IsDecoded lets you poll in between so you can keep rendering while the workers are busy. Queue/Submit/Wait all have to come from the thread that owns the device.
+	*/
+	class AssetLoader
+	{
+	public:
+		AssetLoader(vkcoreDevice& device, JobSystem& jobsystem, MeshCache& meshcache, TextureCache& texturecache)
+			: deviceref(device), jobsystemref(jobsystem), meshcacheref(meshcache), texturecacheref(texturecache) {};
+		~AssetLoader() { Wait(); }
+
+		//no copying/moving should be allowed from this class
+		AssetLoader(AssetLoader const&) = delete;
+		AssetLoader(AssetLoader&&) = delete;
+		AssetLoader& operator=(AssetLoader const&) = delete;
+		AssetLoader& operator=(AssetLoader&&) = delete;
+
+		void QueueMesh(const std::string& filename, VERTEX_FORMAT format = VERTEX_FORMAT::FULL);
+		void QueueTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage = TEXTURE_USAGE::COLOR);
+
+		void Submit();
+		bool IsDecoded() const { return decode_counter.Done(); }
+		void Wait();
+	private:
+		vkcoreDevice& deviceref;
+		JobSystem& jobsystemref;
+		MeshCache& meshcacheref;
+		TextureCache& texturecacheref;
+
+		std::vector<MeshCache::DecodedMesh> meshes;
+		std::vector<TextureCache::DecodedTexture> textures;
+		std::vector<uint8_t> mesh_decoded; //written by the workers, not vector<bool> since neighbouring bits would race
+		JobSystem::Counter decode_counter;
+		bool submitted = false;
+	};
+
+}
@@ -1,15 +1,52 @@
 #include "../pch.h"
 #include "AssetManager.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
 
 namespace Gibo {
 
-	//TODO - load in vertexdata, and indexdata directly instead of all these vectors. Also support no indexing.
-	void MeshCache::LoadMeshFromFile(std::string filename)
+	bool MeshCache::LoadMeshFromFile(std::string filename, VERTEX_FORMAT format)
 	{
 		if (meshCache.count(filename) != 0)
 		{
 			Logger::LogWarning("Loading mesh ", filename, " twice\n");
-			return;
+			return true;
+		}
+
+		DecodedMesh decoded;
+		if (!DecodeMesh(filename, format, decoded))
+		{
+			return false;
+		}
+
+		AssetUploader uploader(deviceref);
+		bool added = AddDecodedMesh(decoded, uploader);
+		uploader.Flush();
+		return added;
+	}
+
+	bool MeshCache::DecodeMesh(const std::string& filename, VERTEX_FORMAT format, DecodedMesh& mesh)
+	{
+		mesh.filename = filename;
+		mesh.format = format;
+
+		//a valid .gmesh skips assimp completely, and everything else too if it was written for this format
+		if (LoadCachedMesh(filename, mesh))
+		{
+			if (mesh.positiondata) return true;
+
+			//the cache gets written over, it can't stay mapped for that (windows won't rename over a mapped file)
+			mesh.vertices.assign(mesh.vertexdata, mesh.vertexdata + mesh.vertexfloats);
+			mesh.indices.assign(mesh.indexdata, mesh.indexdata + mesh.indexcount);
+			mesh.meshlets.assign(mesh.meshletdata, mesh.meshletdata + mesh.meshletcount);
+			mesh.cachefile.reset();
+			mesh.vertexdata = mesh.vertices.data();
+			mesh.indexdata = mesh.indices.data();
+			mesh.meshletdata = mesh.meshlets.data();
+			BuildDerivedStreams(mesh);
+			WriteCachedMesh(filename, mesh);
+			return true;
 		}
 
 		//load the vertex data from the file
@@ -22,82 +59,626 @@ namespace Gibo {
 		if (numberofmeshes != 1)
 		{
 			Logger::LogWarning("Don't support models with multiple meshes yet: ", numberofmeshes, "\n"); //TODO- append to filename a number for the mesh doomguy0, doomguy1, doomguy2
-			return;
+			return false;
+		}
+
+		mesh.vertices = std::move(vertexdata[0]);
+		mesh.indices = std::move(indexdata[0]);
+		if (OPTIMIZE_MESHES)
+		{
+			MeshOptimizer::Optimize(mesh.vertices, mesh.indices, Vertex_Attribute_Length, mesh.stats_before, mesh.stats_after);
+		}
+		else
+		{
+			mesh.stats_before = MeshOptimizer::Analyze(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size() / Vertex_Attribute_Length);
+			mesh.stats_after = mesh.stats_before;
+		}
+		mesh.sphere.Construct(mesh.vertices, Vertex_Attribute_Length);
+		mesh.box.Construct(mesh.vertices, Vertex_Attribute_Length);
+		GenerateLods(mesh);
+		GenerateMeshlets(mesh);
+		mesh.vertexdata = mesh.vertices.data();
+		mesh.vertexfloats = mesh.vertices.size();
+		mesh.indexdata = mesh.indices.data();
+		mesh.indexcount = mesh.indices.size();
+		mesh.meshletdata = mesh.meshlets.data();
+		mesh.meshletcount = mesh.meshlets.size();
+		mesh.from_cache = false;
+
+		BuildDerivedStreams(mesh);
+		WriteCachedMesh(filename, mesh);
+		return true;
+	}
+
+	void MeshCache::BuildDerivedStreams(DecodedMesh& mesh)
+	{
+		QuantizeMesh(mesh);
+		BuildPositionStream(mesh);
+		NarrowIndices(mesh);
+		BuildOccluderMesh(mesh);
+
+		bool index16 = (mesh.index_type == VK_INDEX_TYPE_UINT16);
+		mesh.quantizeddata = (mesh.quantized.empty()) ? nullptr : mesh.quantized.data();
+		mesh.indexdata16 = (index16) ? mesh.indices16.data() : nullptr;
+		mesh.positiondata = mesh.positions.data();
+		mesh.positionbytes = mesh.positions.size();
+		mesh.positionindexdata = (index16) ? static_cast<const void*>(mesh.position_indices16.data()) : static_cast<const void*>(mesh.position_indices.data());
+	}
+
+	//lod 0 is the imported mesh, every next level simplifies the previous one to about half and gets appended to the same index buffer.
+	//errors add up level to level so each ones error is an upper bound against lod 0
+	void MeshCache::GenerateLods(DecodedMesh& mesh)
+	{
+		mesh.lod_count = 1;
+		mesh.lods[0] = MeshLod{ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f };
+		if (!GENERATE_LODS) return;
+
+		size_t vertexcount = mesh.vertices.size() / Vertex_Attribute_Length;
+		float radius = std::max(mesh.sphere.r, 1e-6f);
+		std::vector<unsigned int> current(mesh.indices);
+		float error = 0.0f;
+		for (uint32_t level = 1; level < MAX_MESH_LODS; level++)
+		{
+			float levelerror;
+			std::vector<unsigned int> next = MeshSimplifier::Simplify(current, mesh.vertices.data(), vertexcount, Vertex_Attribute_Length, (current.size() / 6) * 3,
+				                                                      LOD_MAX_ERROR * radius - error, levelerror);
+			//not worth a level if the simplifier got stuck on locked seams or the error budget
+			if (next.empty() || next.size() > current.size() * LOD_MIN_REDUCTION) break;
+
+			if (OPTIMIZE_MESHES) MeshOptimizer::OptimizeVertexCache(next, vertexcount);
+			error += levelerror;
+			mesh.lods[level] = MeshLod{ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(next.size()), error / radius };
+			mesh.indices.insert(mesh.indices.end(), next.begin(), next.end());
+			mesh.lod_count++;
+			current.swap(next);
+		}
+	}
+
+	//has to run after GenerateLods, the meshlets only cover lod 0
+	void MeshCache::GenerateMeshlets(DecodedMesh& mesh)
+	{
+		mesh.meshlets.clear();
+		if (!GENERATE_MESHLETS) return;
+
+		MeshletBuilder::Build(mesh.indices.data(), mesh.lods[0].index_count, mesh.vertices.data(), mesh.vertices.size() / Vertex_Attribute_Length, Vertex_Attribute_Length, mesh.meshlets);
+	}
+
+	//the full vertex stream is always there (quantizing doesn't replace it) so this just pulls the positions the chosen lod uses out of it
+	void MeshCache::BuildOccluderMesh(DecodedMesh& mesh)
+	{
+		uint32_t lod = 0;
+		while (lod + 1 < mesh.lod_count && mesh.lods[lod].index_count / 3 > OCCLUDER_MAX_TRIANGLES) lod++;
+
+		OccluderMesh& occluder = mesh.occluder;
+		occluder.positions.clear();
+		occluder.indices.resize(mesh.lods[lod].index_count);
+		std::vector<uint32_t> remap(mesh.vertexfloats / Vertex_Attribute_Length, UINT32_MAX);
+		const unsigned int* indices = mesh.indexdata + mesh.lods[lod].first_index;
+		for (uint32_t i = 0; i < mesh.lods[lod].index_count; i++)
+		{
+			unsigned int v = indices[i];
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = static_cast<uint32_t>(occluder.positions.size() / 3);
+				const float* position = mesh.vertexdata + size_t(v) * Vertex_Attribute_Length;
+				occluder.positions.insert(occluder.positions.end(), position, position + 3);
+			}
+			occluder.indices[i] = remap[v];
+		}
+	}
+
+	void MeshCache::QuantizeMesh(DecodedMesh& mesh)
+	{
+		if (mesh.format != VERTEX_FORMAT::QUANTIZED) return;
+
+		size_t vertexcount = mesh.vertexfloats / Vertex_Attribute_Length;
+		mesh.quantized.resize(vertexcount);
+		QuantizeVertices(mesh.vertexdata, vertexcount, MakeVertexDecodeConstants(mesh.box.min, mesh.box.max), mesh.quantized.data());
+	}
+
+	//has to run after QuantizeMesh, quantized meshes weld and copy their already quantized positions
+	void MeshCache::BuildPositionStream(DecodedMesh& mesh)
+	{
+		struct PositionKey
+		{
+			uint32_t v[3];
+			bool operator==(const PositionKey& other) const { return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2]; }
+		};
+		struct PositionKeyHash
+		{
+			size_t operator()(const PositionKey& key) const { return (key.v[0] * 73856093u) ^ (key.v[1] * 19349663u) ^ (key.v[2] * 83492791u); }
+		};
+
+		bool quantized = (mesh.format == VERTEX_FORMAT::QUANTIZED);
+		size_t vertexcount = mesh.vertexfloats / Vertex_Attribute_Length;
+		uint32_t stride = PositionStride(mesh.format);
+
+		//welds on the exact stored bits so the stream holds the same values the interleaved one does
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> welded;
+		welded.reserve(vertexcount);
+		std::vector<unsigned int> remap(vertexcount);
+		mesh.positions.clear();
+		mesh.positions.reserve(vertexcount * stride);
+		for (size_t i = 0; i < vertexcount; i++)
+		{
+			PositionKey key = {};
+			if (quantized)
+			{
+				key.v[0] = mesh.quantized[i].position[0];
+				key.v[1] = mesh.quantized[i].position[1];
+				key.v[2] = mesh.quantized[i].position[2];
+			}
+			else
+			{
+				std::memcpy(key.v, mesh.vertexdata + i * Vertex_Attribute_Length, sizeof(float) * 3);
+			}
+
+			unsigned int next = static_cast<unsigned int>(welded.size());
+			auto result = welded.emplace(key, next);
+			if (result.second)
+			{
+				size_t offset = mesh.positions.size();
+				mesh.positions.resize(offset + stride);
+				if (quantized)
+				{
+					uint16_t position[4] = { mesh.quantized[i].position[0], mesh.quantized[i].position[1], mesh.quantized[i].position[2], 0 };
+					std::memcpy(mesh.positions.data() + offset, position, stride);
+				}
+				else
+				{
+					std::memcpy(mesh.positions.data() + offset, key.v, stride);
+				}
+			}
+			remap[i] = result.first->second;
+		}
+
+		mesh.position_indices.resize(mesh.indexcount);
+		for (size_t i = 0; i < mesh.indexcount; i++)
+		{
+			mesh.position_indices[i] = remap[mesh.indexdata[i]];
 		}
-		size_t previous_size = total_buffer_size;
-		for (int i = 0; i < numberofmeshes; i++)
+	}
+
+	//both index buffers fit in 16 bits when the vertex count does, the position stream never has more vertices than the full one
+	void MeshCache::NarrowIndices(DecodedMesh& mesh)
+	{
+		size_t vertexcount = mesh.vertexfloats / Vertex_Attribute_Length;
+		if (vertexcount >= 65536)
 		{
-			LoadMesh(filename, vertexdata[i], indexdata[i]);
+			mesh.index_type = VK_INDEX_TYPE_UINT32;
+			return;
 		}
 
-		Logger::Log("model ", filename, ": ", total_buffer_size - previous_size, " bytes. number of meshes ", numberofmeshes, "\n");
+		mesh.index_type = VK_INDEX_TYPE_UINT16;
+		mesh.indices16.assign(mesh.indexdata, mesh.indexdata + mesh.indexcount);
+		mesh.position_indices16.assign(mesh.position_indices.begin(), mesh.position_indices.end());
 	}
 
-	void MeshCache::LoadMesh(std::string filename, std::vector<float>& vertexdata, std::vector<unsigned int>& indexdata)
+	bool MeshCache::AddDecodedMesh(DecodedMesh& decoded, AssetUploader& uploader)
 	{
-		//create gpu buffers and store in cache
-		Mesh_internal& mesh = meshCache[filename];
-		deviceref.CreateBufferStaged(sizeof(float)*vertexdata.size(), vertexdata.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, mesh.vbo,
-			                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-		deviceref.CreateBufferStaged(sizeof(unsigned int) * indexdata.size(), indexdata.data(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, mesh.ibo,
-			                          VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-		mesh.index_size = indexdata.size();
+		if (meshCache.count(decoded.filename) != 0)
+		{
+			Logger::LogWarning("Loading mesh ", decoded.filename, " twice\n");
+			return true;
+		}
 
-		mesh.bv = new Sphere(); //AABB Sphere
-		mesh.bv->Construct(vertexdata, Vertex_Attribute_Length);
+		//suballocate out of the arena. the data only gets memcpy'd into staging so the mapped cache pages can be passed in directly
+		bool quantized = (decoded.format == VERTEX_FORMAT::QUANTIZED);
+		const void* vertexdata = (quantized) ? static_cast<const void*>(decoded.quantizeddata) : static_cast<const void*>(decoded.vertexdata);
+		size_t vertex_size = size_t(VertexStride(decoded.format)) * (decoded.vertexfloats / Vertex_Attribute_Length);
+		bool index16 = (decoded.index_type == VK_INDEX_TYPE_UINT16);
+		uint32_t index_stride = (index16) ? sizeof(uint16_t) : sizeof(unsigned int);
+		const void* indexdata = (index16) ? static_cast<const void*>(decoded.indexdata16) : static_cast<const void*>(decoded.indexdata);
+		Mesh_internal uploaded;
+		uploaded.vertices = arena.Allocate(GeometryArena::POOL_VERTEX, static_cast<uint32_t>(vertex_size), VertexStride(decoded.format));
+		uploaded.indices = arena.Allocate(GeometryArena::POOL_INDEX, static_cast<uint32_t>(index_stride * decoded.indexcount), index_stride);
+		uploaded.position_vertices = arena.Allocate(GeometryArena::POOL_VERTEX, static_cast<uint32_t>(decoded.positionbytes), PositionStride(decoded.format));
+		uploaded.position_indices = arena.Allocate(GeometryArena::POOL_INDEX, static_cast<uint32_t>(index_stride * decoded.indexcount), index_stride);
+
+		//the arena ran out, a mesh missing any of its buffers can't be drawn so it doesn't go in the cache at all. Nothing is recorded into the uploader
+		//until all four fit, so the freed ranges can go straight to the next mesh in the same batch
+		if (uploaded.vertices == GeometryArena::INVALID_HANDLE || uploaded.indices == GeometryArena::INVALID_HANDLE ||
+			uploaded.position_vertices == GeometryArena::INVALID_HANDLE || uploaded.position_indices == GeometryArena::INVALID_HANDLE)
+		{
+			FreeGeometry(uploaded);
+			Logger::LogError("couldn't allocate geometry for mesh ", decoded.filename, "\n");
+			return false;
+		}
+		RecordGeometryUpload(GeometryArena::POOL_VERTEX, uploaded.vertices, vertexdata, vertex_size, uploader);
+		RecordGeometryUpload(GeometryArena::POOL_INDEX, uploaded.indices, indexdata, index_stride * decoded.indexcount, uploader);
+		RecordGeometryUpload(GeometryArena::POOL_VERTEX, uploaded.position_vertices, decoded.positiondata, decoded.positionbytes, uploader);
+		RecordGeometryUpload(GeometryArena::POOL_INDEX, uploaded.position_indices, decoded.positionindexdata, index_stride * decoded.indexcount, uploader);
+
+		//store in cache
+		Mesh_internal& mesh = meshCache[decoded.filename];
+		mesh.vertices = uploaded.vertices;
+		mesh.indices = uploaded.indices;
+		mesh.position_vertices = uploaded.position_vertices;
+		mesh.position_indices = uploaded.position_indices;
+		mesh.index_size = decoded.lods[0].index_count;
+		mesh.index_type = decoded.index_type;
+		mesh.lod_count = decoded.lod_count;
+		std::copy(decoded.lods, decoded.lods + MAX_MESH_LODS, mesh.lods);
+		mesh.meshlets.assign(decoded.meshletdata, decoded.meshletdata + decoded.meshletcount);
+		mesh.occluder = std::move(decoded.occluder);
+		mesh.stats_before = decoded.stats_before;
+		mesh.stats_after = decoded.stats_after;
+		mesh.mesh_id = next_mesh_id++;
+		mesh.vertex_format = decoded.format;
+		mesh.decode = (quantized) ? MakeVertexDecodeConstants(decoded.box.min, decoded.box.max) : VertexDecodeConstants();
+		mesh.sphere.c = decoded.sphere.c;
+		mesh.sphere.r = decoded.sphere.r;
+		mesh.box.min = decoded.box.min;
+		mesh.box.max = decoded.box.max;
 
 		//count up memory total_buffer_size
-		total_buffer_size += sizeof(float) * vertexdata.size();
-		total_buffer_size += sizeof(unsigned int) * indexdata.size();
+		size_t mesh_size = vertex_size + index_stride * decoded.indexcount;
+		size_t position_size = decoded.positionbytes + index_stride * decoded.indexcount;
+		total_buffer_size += mesh_size + position_size;
+
+		Logger::Log("model ", decoded.filename, ": ", mesh_size, " bytes", (quantized) ? " quantized" : "", " + ", position_size, " bytes position stream (",
+			decoded.positionbytes / PositionStride(decoded.format), "/", decoded.vertexfloats / Vertex_Attribute_Length, " vertices). ",
+			(decoded.from_cache) ? "loaded from mesh cache" : "imported", "\n");
+		return true;
 	}
 
-	void MeshCache::CleanUp()
+	GeometryArena::Handle MeshCache::UploadGeometry(GeometryArena::POOL pool, const void* data, size_t size, uint32_t alignment, AssetUploader& uploader)
 	{
-		for (auto& mesh : meshCache)
+		GeometryArena::Handle handle = arena.Allocate(pool, static_cast<uint32_t>(size), alignment);
+		if (handle == GeometryArena::INVALID_HANDLE) return handle;
+
+		RecordGeometryUpload(pool, handle, data, size, uploader);
+		return handle;
+	}
+
+	void MeshCache::RecordGeometryUpload(GeometryArena::POOL pool, GeometryArena::Handle handle, const void* data, size_t size, AssetUploader& uploader)
+	{
+		bool vertex = (pool == GeometryArena::POOL_VERTEX);
+		uploader.UploadToBuffer(data, size, arena.GetBuffer(handle), arena.GetOffset(handle), (vertex) ? VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT : VK_ACCESS_INDEX_READ_BIT,
+			                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+
+	void MeshCache::FreeGeometry(Mesh_internal& mesh)
+	{
+		arena.Free(mesh.vertices);
+		arena.Free(mesh.indices);
+		arena.Free(mesh.position_vertices);
+		arena.Free(mesh.position_indices);
+		mesh.vertices = mesh.indices = mesh.position_vertices = mesh.position_indices = GeometryArena::INVALID_HANDLE;
+	}
+
+	void MeshCache::UnloadMesh(const std::string& filename)
+	{
+		auto mesh = meshCache.find(filename);
+		if (mesh == meshCache.end()) return;
+
+		const Mesh_internal& internal = mesh->second;
+		total_buffer_size -= size_t(arena.GetSize(internal.vertices)) + arena.GetSize(internal.indices) + arena.GetSize(internal.position_vertices) + arena.GetSize(internal.position_indices);
+		FreeGeometry(mesh->second);
+		meshCache.erase(mesh);
+	}
+
+	bool MeshCache::GetSourceInfo(const std::string& filename, SourceInfo& info)
+	{
+		std::error_code error;
+		info.size = std::filesystem::file_size(filename, error);
+		if (error) return false;
+		info.mtime = static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+		return !error;
+	}
+
+	bool MeshCache::HashSource(const std::string& filename, uint64_t& hash)
+	{
+		MappedFile source;
+		if (!source.Open(filename)) return false;
+		hash = HashBytes(source.Data(), source.Size());
+		return true;
+	}
+
+	bool MeshCache::LoadCachedMesh(const std::string& filename, DecodedMesh& mesh)
+	{
+		SourceInfo info;
+		if (!GetSourceInfo(filename, info)) return false;
+
+		//the mapping moves into the decoded mesh so its pages stay valid until the uploader has copied them
+		std::unique_ptr<MappedFile> mapped(new MappedFile());
+		MappedFile& file = *mapped;
+		if (!file.Open(CachedMeshPath(filename))) return false;
+		if (file.Size() < sizeof(MeshFileHeader)) return false;
+
+		//the contents were checked by ValidateMesh when it was written and the temp file rename means a file with a valid name was written whole,
+		//so loading only has to trust the header. its hash catches a damaged one before any of its counts or offsets get used
+		MeshFileHeader header;
+		std::memcpy(&header, file.Data(), sizeof(MeshFileHeader));
+		uint64_t header_hash = header.header_hash;
+		header.header_hash = 0;
+		if (header.magic != MeshFileHeader::MAGIC || header.version != MeshFileHeader::VERSION || header_hash != HashBytes(&header, sizeof(MeshFileHeader)) || header.attribute_length != static_cast<uint32_t>(Vertex_Attribute_Length) ||
+			header.import_flags != ImportFlags() || header.lod_count == 0 || header.lod_count > MAX_MESH_LODS || header.index_count == 0 ||
+			(header.vertex_format != static_cast<uint32_t>(VERTEX_FORMAT::FULL) && header.vertex_format != static_cast<uint32_t>(VERTEX_FORMAT::QUANTIZED)) ||
+			(header.index_type != VK_INDEX_TYPE_UINT16 && header.index_type != VK_INDEX_TYPE_UINT32))
 		{
-			delete mesh.second.bv;
-			deviceref.DestroyBuffer(mesh.second.vbo);
-			deviceref.DestroyBuffer(mesh.second.ibo);
+			return false;
+		}
+
+		//a truncated file (crash while writing, copied halfway) just gets rebuilt, and every section has to be the size the counts say
+		VERTEX_FORMAT format = static_cast<VERTEX_FORMAT>(header.vertex_format);
+		bool index16 = (header.index_type == VK_INDEX_TYPE_UINT16);
+		uint64_t expected[MeshFileHeader::SECTION_COUNT];
+		expected[MeshFileHeader::SECTION_VERTICES] = uint64_t(header.vertex_count) * header.attribute_length * sizeof(float);
+		expected[MeshFileHeader::SECTION_INDICES] = uint64_t(header.index_count) * sizeof(unsigned int);
+		expected[MeshFileHeader::SECTION_MESHLETS] = uint64_t(header.meshlet_count) * sizeof(Meshlet);
+		expected[MeshFileHeader::SECTION_QUANTIZED] = (format == VERTEX_FORMAT::QUANTIZED) ? uint64_t(header.vertex_count) * sizeof(QuantizedVertex) : 0;
+		expected[MeshFileHeader::SECTION_INDICES16] = (index16) ? uint64_t(header.index_count) * sizeof(uint16_t) : 0;
+		expected[MeshFileHeader::SECTION_POSITIONS] = uint64_t(header.position_vertex_count) * PositionStride(format);
+		expected[MeshFileHeader::SECTION_POSITION_INDICES] = uint64_t(header.index_count) * ((index16) ? sizeof(uint16_t) : sizeof(unsigned int));
+		expected[MeshFileHeader::SECTION_OCCLUDER_POSITIONS] = header.sections[MeshFileHeader::SECTION_OCCLUDER_POSITIONS].size - header.sections[MeshFileHeader::SECTION_OCCLUDER_POSITIONS].size % (sizeof(float) * 3);
+		expected[MeshFileHeader::SECTION_OCCLUDER_INDICES] = header.sections[MeshFileHeader::SECTION_OCCLUDER_INDICES].size - header.sections[MeshFileHeader::SECTION_OCCLUDER_INDICES].size % (sizeof(uint32_t) * 3);
+		for (uint32_t i = 0; i < MeshFileHeader::SECTION_COUNT; i++)
+		{
+			const MeshFileHeader::Section& section = header.sections[i];
+			if (section.size != expected[i] || section.offset > file.Size() || section.size > file.Size() - section.offset || section.offset % 16 != 0) return false;
+		}
+		for (uint32_t i = 0; i < header.lod_count; i++)
+		{
+			if (uint64_t(header.lods[i].first_index) + header.lods[i].index_count > header.index_count) return false;
+		}
+
+		//size and time are the cheap check. If they moved (fresh checkout, touched file) the contents decide
+		if (header.source_size != info.size || header.source_mtime != info.mtime)
+		{
+			uint64_t hash;
+			if (header.source_size != info.size || !HashSource(filename, hash) || hash != header.source_hash)
+			{
+				Logger::LogInfo("mesh cache for ", filename, " is out of date, reimporting\n");
+				return false;
+			}
+		}
+
+		auto section = [&](MeshFileHeader::SECTION s) { return file.Data() + header.sections[s].offset; };
+		mesh.sphere.c = glm::vec3(header.sphere[0], header.sphere[1], header.sphere[2]);
+		mesh.sphere.r = header.sphere[3];
+		mesh.box.min = glm::vec3(header.box_min[0], header.box_min[1], header.box_min[2]);
+		mesh.box.max = glm::vec3(header.box_max[0], header.box_max[1], header.box_max[2]);
+
+		mesh.vertexdata = reinterpret_cast<const float*>(section(MeshFileHeader::SECTION_VERTICES));
+		mesh.vertexfloats = size_t(header.vertex_count) * header.attribute_length;
+		mesh.indexdata = reinterpret_cast<const unsigned int*>(section(MeshFileHeader::SECTION_INDICES));
+		mesh.indexcount = header.index_count;
+		mesh.meshletdata = reinterpret_cast<const Meshlet*>(section(MeshFileHeader::SECTION_MESHLETS));
+		mesh.meshletcount = header.meshlet_count;
+		mesh.stats_before = header.stats_before;
+		mesh.stats_after = header.stats_after;
+		mesh.lod_count = header.lod_count;
+		std::copy(header.lods, header.lods + MAX_MESH_LODS, mesh.lods);
+
+		//written for the other format, DecodeMesh builds the rest from the full stream
+		if (format == mesh.format)
+		{
+			mesh.index_type = static_cast<VkIndexType>(header.index_type);
+			mesh.quantizeddata = (format == VERTEX_FORMAT::QUANTIZED) ? reinterpret_cast<const QuantizedVertex*>(section(MeshFileHeader::SECTION_QUANTIZED)) : nullptr;
+			mesh.indexdata16 = (index16) ? reinterpret_cast<const uint16_t*>(section(MeshFileHeader::SECTION_INDICES16)) : nullptr;
+			mesh.positiondata = section(MeshFileHeader::SECTION_POSITIONS);
+			mesh.positionbytes = header.sections[MeshFileHeader::SECTION_POSITIONS].size;
+			mesh.positionindexdata = section(MeshFileHeader::SECTION_POSITION_INDICES);
+
+			//the occluder outlives the mapping, its small enough to just copy
+			const float* occluderpositions = reinterpret_cast<const float*>(section(MeshFileHeader::SECTION_OCCLUDER_POSITIONS));
+			const uint32_t* occluderindices = reinterpret_cast<const uint32_t*>(section(MeshFileHeader::SECTION_OCCLUDER_INDICES));
+			mesh.occluder.positions.assign(occluderpositions, occluderpositions + header.sections[MeshFileHeader::SECTION_OCCLUDER_POSITIONS].size / sizeof(float));
+			mesh.occluder.indices.assign(occluderindices, occluderindices + header.sections[MeshFileHeader::SECTION_OCCLUDER_INDICES].size / sizeof(uint32_t));
+		}
+		mesh.cachefile = std::move(mapped);
+		mesh.from_cache = true;
+		return true;
+	}
+
+	bool MeshCache::ValidateMesh(const DecodedMesh& mesh)
+	{
+		size_t vertex_count = mesh.vertexfloats / Vertex_Attribute_Length;
+		for (size_t i = 0; i < mesh.indexcount; i++)
+		{
+			if (mesh.indexdata[i] >= vertex_count) return false;
+		}
+		for (size_t i = 0; i < mesh.meshletcount; i++)
+		{
+			if (uint64_t(mesh.meshletdata[i].first_index) + mesh.meshletdata[i].index_count > mesh.indexcount) return false;
+		}
+		for (uint32_t i = 0; i < mesh.lod_count; i++)
+		{
+			if (uint64_t(mesh.lods[i].first_index) + mesh.lods[i].index_count > mesh.indexcount) return false;
+		}
+
+		size_t position_count = mesh.positionbytes / PositionStride(mesh.format);
+		bool index16 = (mesh.index_type == VK_INDEX_TYPE_UINT16);
+		for (size_t i = 0; i < mesh.indexcount; i++)
+		{
+			uint32_t index = (index16) ? static_cast<const uint16_t*>(mesh.positionindexdata)[i] : static_cast<const uint32_t*>(mesh.positionindexdata)[i];
+			if (index >= position_count) return false;
+		}
+
+		size_t occluder_count = mesh.occluder.positions.size() / 3;
+		for (size_t i = 0; i < mesh.occluder.indices.size(); i++)
+		{
+			if (mesh.occluder.indices[i] >= occluder_count) return false;
+		}
+		return true;
+	}
+
+	void MeshCache::WriteCachedMesh(const std::string& filename, const DecodedMesh& mesh)
+	{
+		const Sphere& sphere = mesh.sphere;
+		const AABB& box = mesh.box;
+
+		SourceInfo info;
+		uint64_t hash;
+		if (!GetSourceInfo(filename, info) || !HashSource(filename, hash)) return;
+
+		if (!ValidateMesh(mesh))
+		{
+			Logger::LogWarning("mesh ", filename, " has indices outside its vertices, not caching it\n");
+			return;
+		}
+
+		auto align16 = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+		bool index16 = (mesh.index_type == VK_INDEX_TYPE_UINT16);
+		size_t index_stride = (index16) ? sizeof(uint16_t) : sizeof(unsigned int);
+
+		MeshFileHeader header = {};
+		header.magic = MeshFileHeader::MAGIC;
+		header.version = MeshFileHeader::VERSION;
+		header.source_size = info.size;
+		header.source_mtime = info.mtime;
+		header.source_hash = hash;
+		header.attribute_length = static_cast<uint32_t>(Vertex_Attribute_Length);
+		header.vertex_count = static_cast<uint32_t>(mesh.vertexfloats / Vertex_Attribute_Length);
+		header.index_count = static_cast<uint32_t>(mesh.indexcount);
+		header.import_flags = ImportFlags();
+		header.lod_count = mesh.lod_count;
+		std::copy(mesh.lods, mesh.lods + MAX_MESH_LODS, header.lods);
+		header.stats_before = mesh.stats_before;
+		header.stats_after = mesh.stats_after;
+		header.sphere[0] = sphere.c.x; header.sphere[1] = sphere.c.y; header.sphere[2] = sphere.c.z; header.sphere[3] = sphere.r;
+		header.box_min[0] = box.min.x; header.box_min[1] = box.min.y; header.box_min[2] = box.min.z;
+		header.box_max[0] = box.max.x; header.box_max[1] = box.max.y; header.box_max[2] = box.max.z;
+		header.meshlet_count = static_cast<uint32_t>(mesh.meshletcount);
+		header.vertex_format = static_cast<uint32_t>(mesh.format);
+		header.index_type = static_cast<uint32_t>(mesh.index_type);
+		header.position_vertex_count = static_cast<uint32_t>(mesh.positionbytes / PositionStride(mesh.format));
+
+		const void* data[MeshFileHeader::SECTION_COUNT];
+		data[MeshFileHeader::SECTION_VERTICES] = mesh.vertexdata;
+		header.sections[MeshFileHeader::SECTION_VERTICES].size = sizeof(float) * mesh.vertexfloats;
+		data[MeshFileHeader::SECTION_INDICES] = mesh.indexdata;
+		header.sections[MeshFileHeader::SECTION_INDICES].size = sizeof(unsigned int) * mesh.indexcount;
+		data[MeshFileHeader::SECTION_MESHLETS] = mesh.meshletdata;
+		header.sections[MeshFileHeader::SECTION_MESHLETS].size = sizeof(Meshlet) * mesh.meshletcount;
+		data[MeshFileHeader::SECTION_QUANTIZED] = mesh.quantizeddata;
+		header.sections[MeshFileHeader::SECTION_QUANTIZED].size = (mesh.quantizeddata) ? sizeof(QuantizedVertex) * header.vertex_count : 0;
+		data[MeshFileHeader::SECTION_INDICES16] = mesh.indexdata16;
+		header.sections[MeshFileHeader::SECTION_INDICES16].size = (index16) ? sizeof(uint16_t) * mesh.indexcount : 0;
+		data[MeshFileHeader::SECTION_POSITIONS] = mesh.positiondata;
+		header.sections[MeshFileHeader::SECTION_POSITIONS].size = mesh.positionbytes;
+		data[MeshFileHeader::SECTION_POSITION_INDICES] = mesh.positionindexdata;
+		header.sections[MeshFileHeader::SECTION_POSITION_INDICES].size = index_stride * mesh.indexcount;
+		data[MeshFileHeader::SECTION_OCCLUDER_POSITIONS] = mesh.occluder.positions.data();
+		header.sections[MeshFileHeader::SECTION_OCCLUDER_POSITIONS].size = sizeof(float) * mesh.occluder.positions.size();
+		data[MeshFileHeader::SECTION_OCCLUDER_INDICES] = mesh.occluder.indices.data();
+		header.sections[MeshFileHeader::SECTION_OCCLUDER_INDICES].size = sizeof(uint32_t) * mesh.occluder.indices.size();
+
+		uint64_t offset = sizeof(MeshFileHeader);
+		for (uint32_t i = 0; i < MeshFileHeader::SECTION_COUNT; i++)
+		{
+			header.sections[i].offset = align16(offset);
+			offset = header.sections[i].offset + header.sections[i].size;
+		}
+		header.header_hash = HashBytes(&header, sizeof(MeshFileHeader));
+
+		//write to a temp file and rename it over so a half written cache never has a valid name
+		std::string path = CachedMeshPath(filename);
+		std::string temppath = path + ".tmp";
+		{
+			std::ofstream file(temppath, std::ios::binary | std::ios::trunc);
+			if (!file)
+			{
+				Logger::LogWarning("couldn't write mesh cache ", path, "\n");
+				return;
+			}
+			const char zeros[16] = {};
+			file.write(reinterpret_cast<const char*>(&header), sizeof(MeshFileHeader));
+			uint64_t written = sizeof(MeshFileHeader);
+			for (uint32_t i = 0; i < MeshFileHeader::SECTION_COUNT; i++)
+			{
+				file.write(zeros, header.sections[i].offset - written);
+				if (header.sections[i].size > 0) file.write(static_cast<const char*>(data[i]), header.sections[i].size);
+				written = header.sections[i].offset + header.sections[i].size;
+			}
+			if (!file)
+			{
+				Logger::LogWarning("couldn't write mesh cache ", path, "\n");
+				return;
+			}
 		}
-		meshCache.clear();
 
-		if (Quad_Mesh.vbo.buffer != VK_NULL_HANDLE)
+		std::error_code error;
+		std::filesystem::rename(temppath, path, error);
+		if (error)
 		{
-			delete Quad_Mesh.bv;
-			deviceref.DestroyBuffer(Quad_Mesh.vbo);
-			deviceref.DestroyBuffer(Quad_Mesh.ibo);
+			Logger::LogWarning("couldn't write mesh cache ", path, "\n");
+			std::filesystem::remove(temppath, error);
 		}
 	}
 
+	void MeshCache::CleanUp()
+	{
+		meshCache.clear();
+		Quad_Mesh.vertices = Quad_Mesh.indices = Quad_Mesh.position_vertices = Quad_Mesh.position_indices = GeometryArena::INVALID_HANDLE;
+		Quad_Mesh.occluder = OccluderMesh();
+		arena.CleanUp();
+	}
+
 	void MeshCache::PrintMemory() const
 	{
 		Logger::Log("Total Mesh Cache buffer size: ", total_buffer_size, " bytes Total Meshes stored: ", meshCache.size(), "\n");
+		arena.PrintMemory();
+
+		//post transform cache stats of the imported order against what got uploaded. the totals are weighted by triangles/vertices so big meshes count for more
+		MeshOptimizer::Stats total_before;
+		MeshOptimizer::Stats total_after;
+		for (auto& mesh : meshCache)
+		{
+			const MeshOptimizer::Stats& before = mesh.second.stats_before;
+			const MeshOptimizer::Stats& after = mesh.second.stats_after;
+			Logger::Log("  ", mesh.first, ": ", after.triangles, " triangles ", (mesh.second.index_type == VK_INDEX_TYPE_UINT16) ? "16" : "32", " bit indices, ", mesh.second.meshlets.size(), " meshlets. ACMR ", before.ACMR(), " -> ",
+				after.ACMR(), " ATVR ", before.ATVR(), " -> ", after.ATVR(), "\n");
+			for (uint32_t lod = 1; lod < mesh.second.lod_count; lod++)
+			{
+				Logger::Log("    lod ", lod, ": ", mesh.second.lods[lod].index_count / 3, " triangles, error ", mesh.second.lods[lod].error, " of the radius\n");
+			}
+
+			total_before.triangles += before.triangles; total_before.vertices += before.vertices; total_before.misses += before.misses;
+			total_after.triangles += after.triangles; total_after.vertices += after.vertices; total_after.misses += after.misses;
+		}
+		Logger::Log("Mesh optimization (fifo ", MeshOptimizer::FIFO_CACHE_SIZE, "): ACMR ", total_before.ACMR(), " -> ", total_after.ACMR(), " ATVR ", total_before.ATVR(), " -> ",
+			total_after.ATVR(), ", ", int64_t(total_before.misses) - int64_t(total_after.misses), " fewer vertex shader invocations drawing every mesh once\n");
 	}
 
-	//copies the contents of the original generate bounding volume into a new pointer
-	void MeshCache::GetOriginalMeshBV(std::string filename, BoundingVolume*& bv)
+	void MeshCache::GetMeshBounds(const std::string& filename, Sphere& sphere, AABB& box)
 	{
 		if (filename == "Quad")
 		{
-			bv = Quad_Mesh.bv->clone();
+			sphere = Quad_Mesh.sphere;
+			box = Quad_Mesh.box;
 		}
 		else
 		{
+			//only a find so its safe to call from the job system workers while nobody is loading meshes
+			auto mesh = meshCache.find(filename);
+			if (mesh == meshCache.end())
+			{
 #ifdef _DEBUG
-			if (meshCache.count(filename) == 0) { Logger::LogWarning("Called GetMeshBV but filename isn't in cache!\n"); }
+				Logger::LogWarning("Called GetMeshBounds but filename isn't in cache!\n");
 #endif 
-			bv = meshCache[filename].bv->clone();
+				return;
+			}
+			sphere = mesh->second.sphere;
+			box = mesh->second.box;
 		}
 	}
 
+	const OccluderMesh* MeshCache::GetOccluderMesh(const std::string& filename) const
+	{
+		if (filename == "Quad") return &Quad_Mesh.occluder;
+
+		auto mesh = meshCache.find(filename);
+		return (mesh == meshCache.end()) ? nullptr : &mesh->second.occluder;
+	}
+
 	//copies contents directly into mesh
 	void MeshCache::SetObjectMesh(std::string filename, MeshCache::Mesh& mesh) 
 	{
 		if (meshCache.count(filename) == 1)
 		{
-			mesh.vbo = meshCache[filename].vbo.buffer;
-			mesh.ibo = meshCache[filename].ibo.buffer;
-			mesh.index_size = meshCache[filename].index_size;
+			CopyToMesh(meshCache[filename], mesh);
 			mesh.mesh_name = filename;
 		}
 		else
@@ -105,35 +686,101 @@ namespace Gibo {
 			Logger::LogError("Mesh: ", filename, " does not exist in the meshcache. Load it first.\n");
 			mesh.vbo = VK_NULL_HANDLE;
 			mesh.ibo = VK_NULL_HANDLE;
+			mesh.vertex_offset = 0;
+			mesh.first_index = 0;
+			mesh.position_vbo = VK_NULL_HANDLE;
+			mesh.position_ibo = VK_NULL_HANDLE;
+			mesh.position_vertex_offset = 0;
+			mesh.position_first_index = 0;
+			mesh.index_type = VK_INDEX_TYPE_UINT32;
 			mesh.index_size = 0;
+			mesh.lod_count = 1;
+			mesh.lods[0] = MeshLod{ 0, 0, 0.0f };
+			mesh.meshlets = nullptr;
+			mesh.meshlet_count = 0;
 			mesh.mesh_name = "NA";
+			mesh.mesh_id = 0;
+			mesh.vertex_format = VERTEX_FORMAT::FULL;
+			mesh.decode = VertexDecodeConstants();
+		}
+	}
+
+	void MeshCache::RefreshMesh(MeshCache::Mesh& mesh)
+	{
+		if (mesh.mesh_name == "Quad")
+		{
+			SetQuadMesh(mesh);
 		}
+		else if (mesh.mesh_name != "NA")
+		{
+			SetObjectMesh(mesh.mesh_name, mesh);
+		}
+	}
+
+	//arena offsets are in bytes, the draws want them in vertices/indices of the meshes own strides
+	void MeshCache::CopyToMesh(const Mesh_internal& internal, MeshCache::Mesh& mesh) const
+	{
+		uint32_t index_stride = (internal.index_type == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(unsigned int);
+		mesh.vbo = arena.GetBuffer(internal.vertices);
+		mesh.ibo = arena.GetBuffer(internal.indices);
+		mesh.vertex_offset = static_cast<int32_t>(arena.GetOffset(internal.vertices) / VertexStride(internal.vertex_format));
+		mesh.first_index = arena.GetOffset(internal.indices) / index_stride;
+		mesh.position_vbo = arena.GetBuffer(internal.position_vertices);
+		mesh.position_ibo = arena.GetBuffer(internal.position_indices);
+		mesh.position_vertex_offset = static_cast<int32_t>(arena.GetOffset(internal.position_vertices) / PositionStride(internal.vertex_format));
+		mesh.position_first_index = arena.GetOffset(internal.position_indices) / index_stride;
+		mesh.index_type = internal.index_type;
+		mesh.index_size = internal.index_size;
+		mesh.lod_count = internal.lod_count;
+		std::copy(internal.lods, internal.lods + MAX_MESH_LODS, mesh.lods);
+		mesh.meshlets = (internal.meshlets.empty()) ? nullptr : internal.meshlets.data();
+		mesh.meshlet_count = static_cast<uint32_t>(internal.meshlets.size());
+		mesh.mesh_id = internal.mesh_id;
+		mesh.vertex_format = internal.vertex_format;
+		mesh.decode = internal.decode;
 	}
 
 	void MeshCache::SetQuadMesh(MeshCache::Mesh& mesh)
 	{
-		if (Quad_Mesh.vbo.buffer == VK_NULL_HANDLE)
+		if (Quad_Mesh.vertices == GeometryArena::INVALID_HANDLE)
 		{
 			std::vector<float> vertexdata;
 			std::vector<unsigned int> indexdata;
 			ASSIMPLoader::LoadQuad(vertexdata, indexdata);
 
-			deviceref.CreateBufferStaged(sizeof(float)*vertexdata.size(), vertexdata.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, Quad_Mesh.vbo,
-				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-			deviceref.CreateBufferStaged(sizeof(unsigned int) * indexdata.size(), indexdata.data(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, Quad_Mesh.ibo,
-				VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+			DecodedMesh positions;
+			positions.vertexdata = vertexdata.data();
+			positions.vertexfloats = vertexdata.size();
+			positions.indexdata = indexdata.data();
+			positions.indexcount = indexdata.size();
+			positions.lods[0] = MeshLod{ 0, static_cast<uint32_t>(indexdata.size()), 0.0f };
+			BuildPositionStream(positions);
+			BuildOccluderMesh(positions);
+			Quad_Mesh.occluder = std::move(positions.occluder);
+
+			AssetUploader uploader(deviceref);
+			Quad_Mesh.vertices = UploadGeometry(GeometryArena::POOL_VERTEX, vertexdata.data(), sizeof(float) * vertexdata.size(), VertexStride(VERTEX_FORMAT::FULL), uploader);
+			Quad_Mesh.indices = UploadGeometry(GeometryArena::POOL_INDEX, indexdata.data(), sizeof(unsigned int) * indexdata.size(), sizeof(unsigned int), uploader);
+			Quad_Mesh.position_vertices = UploadGeometry(GeometryArena::POOL_VERTEX, positions.positions.data(), positions.positions.size(), PositionStride(VERTEX_FORMAT::FULL), uploader);
+			Quad_Mesh.position_indices = UploadGeometry(GeometryArena::POOL_INDEX, positions.position_indices.data(), sizeof(unsigned int) * positions.position_indices.size(),
+				                                        sizeof(unsigned int), uploader);
+			uploader.Flush();
 			Quad_Mesh.index_size = indexdata.size();
-			Quad_Mesh.bv = new Sphere(); //AABB Sphere
-			Quad_Mesh.bv->Construct(vertexdata, Vertex_Attribute_Length);
+			Quad_Mesh.index_type = VK_INDEX_TYPE_UINT32;
+			Quad_Mesh.lod_count = 1;
+			Quad_Mesh.lods[0] = MeshLod{ 0, Quad_Mesh.index_size, 0.0f };
+			Quad_Mesh.mesh_id = 0;
+			Quad_Mesh.vertex_format = VERTEX_FORMAT::FULL;
+			Quad_Mesh.sphere.Construct(vertexdata, Vertex_Attribute_Length);
+			Quad_Mesh.box.Construct(vertexdata, Vertex_Attribute_Length);
 
 			//count up memory total_buffer_size
 			total_buffer_size += sizeof(float) * vertexdata.size();
 			total_buffer_size += sizeof(unsigned int) * indexdata.size();
+			total_buffer_size += positions.positions.size() + sizeof(unsigned int) * positions.position_indices.size();
 		}
 
-		mesh.vbo = Quad_Mesh.vbo.buffer;
-		mesh.ibo = Quad_Mesh.ibo.buffer;
-		mesh.index_size = Quad_Mesh.index_size;
+		CopyToMesh(Quad_Mesh, mesh);
 		mesh.mesh_name = "Quad";
 	}
 	
@@ -205,72 +852,47 @@ namespace Gibo {
 	{
 
 		//go through every vertex and get: position, normal, and texcoords	
-		//position, normals, texcoords, tangent, bitangent 
-		bool positions = true;
-		bool normals = true;
-		bool texcoords = true;
-		bool tangentbi = true;
-		for (int i = 0; i < mesh->mNumVertices; i++) 
+		//position, normals, texcoords, tangent, bitangent. The whole stream gets sized up front and written in place, missing attributes stay 0
+		bool positions = mesh->HasPositions();
+		bool normals = mesh->HasNormals();
+		bool texcoords = mesh->mTextureCoords[0] != nullptr;
+		bool tangentbi = mesh->HasTangentsAndBitangents();
+
+		size_t first = vertexdata.size();
+		vertexdata.resize(first + size_t(mesh->mNumVertices) * Vertex_Attribute_Length, 0.0f);
+		float* vertex = vertexdata.data() + first;
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++, vertex += Vertex_Attribute_Length) 
 		{	
-			if (mesh->HasPositions()) 
-			{
-				vertexdata.push_back(mesh->mVertices[i].x);
-				vertexdata.push_back(mesh->mVertices[i].y);
-				vertexdata.push_back(mesh->mVertices[i].z);
-			}
-			else
+			if (positions) 
 			{
-				positions = false;
+				vertex[0] = mesh->mVertices[i].x;
+				vertex[1] = mesh->mVertices[i].y;
+				vertex[2] = mesh->mVertices[i].z;
 			}
 
-			if (mesh->HasNormals())
-			{
-				vertexdata.push_back(mesh->mNormals[i].x);
-				vertexdata.push_back(mesh->mNormals[i].y);
-				vertexdata.push_back(mesh->mNormals[i].z);
-			}
-			else
+			if (normals)
 			{
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				normals = false;
+				vertex[3] = mesh->mNormals[i].x;
+				vertex[4] = mesh->mNormals[i].y;
+				vertex[5] = mesh->mNormals[i].z;
 			}
 
-			if (mesh->mTextureCoords[0]) 
-			{
-				vertexdata.push_back(mesh->mTextureCoords[0][i].x);
-				vertexdata.push_back(mesh->mTextureCoords[0][i].y);
-			}
-			else
+			if (texcoords) 
 			{
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				texcoords = false;
+				vertex[6] = mesh->mTextureCoords[0][i].x;
+				vertex[7] = mesh->mTextureCoords[0][i].y;
 			}
 
-			if (mesh->HasTangentsAndBitangents())
+			if (tangentbi)
 			{
-				vertexdata.push_back(mesh->mTangents[i].x);
-				vertexdata.push_back(mesh->mTangents[i].y);
-				vertexdata.push_back(mesh->mTangents[i].z);
+				vertex[8] = mesh->mTangents[i].x;
+				vertex[9] = mesh->mTangents[i].y;
+				vertex[10] = mesh->mTangents[i].z;
 
-				vertexdata.push_back(mesh->mBitangents[i].x);
-				vertexdata.push_back(mesh->mBitangents[i].y);
-				vertexdata.push_back(mesh->mBitangents[i].z);
-			}
-			else
-			{
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				vertexdata.push_back(0);
-				tangentbi = false;
+				vertex[11] = mesh->mBitangents[i].x;
+				vertex[12] = mesh->mBitangents[i].y;
+				vertex[13] = mesh->mBitangents[i].z;
 			}
-
 		}
 
 		if (!tangentbi)
@@ -291,6 +913,7 @@ namespace Gibo {
 		}
 
 		//go through every face and get indices
+		indexdata.reserve(indexdata.size() + size_t(mesh->mNumFaces) * 3);
 		for (int i = 0; i < mesh->mNumFaces; i++) 
 		{
 			aiFace face = mesh->mFaces[i];
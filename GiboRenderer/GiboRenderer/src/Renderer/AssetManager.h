@@ -4,14 +4,71 @@
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 #include "BoundingVolumes.h"
+#include "../Utilities/MappedFile.h"
+#include "../Utilities/Hash.h"
+#include "AssetUploader.h"
+#include "vkcore/VertexFormat.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "GeometryArena.h"
+#include <memory>
 
 namespace Gibo {
 
 	static int Vertex_Attribute_Length = 14;//counts number of float in each vertex (position,normal,uv,T,B)
+
+	static const uint32_t MAX_MESH_LODS = 4;
+	//one level of a meshes lod chain, a range of its index buffer. error is how far the level strays from the full mesh relative to the meshes bounding sphere radius
+	struct MeshLod
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+		float error;
+	};
+	//cpu copy of one lod of a mesh for the software occlusion buffer (see MaskedOcclusion.h), just the positions and indices into them
+	struct OccluderMesh
+	{
+		std::vector<float> positions; //xyz
+		std::vector<uint32_t> indices;
+	};
+
 	/*
 	The point of these classes are to create the meshes and textures at start up and just cache them for when other renderobjects need them.
 	This method is very nice as long as we don't have so much data that we can't store it all on VRAM which is fine for now. But later I will
 	have to implement some dynamic gpu memory system where I load in the gpu buffers that are needed and free the ones that aren't.
+
+	Mesh cache files: the first time a mesh gets imported through assimp the final interleaved vertex stream, the indices and the model space sphere/aabb get written next to
+	the source as <source>.gmesh. Later loads memory map that file and stage straight out of the mapped pages, so assimp never runs again. The header holds a format version
+	and the source files size, modified time and hash. If the size and time match its used as is, if they don't the source gets hashed and only a different hash re-imports.
+
+	Loading is split in two so the AssetLoader can batch it: DecodeMesh does all the cpu side work (cache mapping or assimp) and touches nothing shared so any thread can run it,
+	AddDecodedMesh creates the gpu buffers, records the copies into an uploader and puts the mesh in the cache on the main thread. LoadMeshFromFile just does both for one mesh.
+
+	The vertex format (see VertexFormat.h) is picked per mesh at load time. The .gmesh always holds the FULL stream and next to it everything DecodeMesh builds out of
+	it for the format it was written with: the quantized vertices, the 16 bit indices, the welded position stream with its indices and the occluder. So a cache hit just
+	maps all of it and runs no import step at all. Loading it with the other format rebuilds those from the cached FULL stream (assimp still doesn't run) and writes
+	the cache again for that format.
+
+	Every mesh also gets a de-interleaved position only stream for the depth prepass and shadow passes (12 bytes a vertex FULL, 8 QUANTIZED) so they stop fetching the whole
+	interleaved vertex. Vertices that only differ by normal/uv/tangent get welded in that stream and it has its own index buffer (same index count) pointing into it, so
+	those passes also transform shared corners once instead of once per uv seam.
+
+	With OPTIMIZE_MESHES freshly imported meshes go through MeshOptimizer (vertex cache, overdraw and vertex fetch order) before the .gmesh is written, so the cache holds
+	the optimized order and the acmr/atvr from before and after, PrintMemory reports those. Meshes under 65536 vertices get 16 bit index buffers, index_type says which.
+
+	Lods: with GENERATE_LODS every import also builds a chain of up to MAX_MESH_LODS levels, each one MeshSimplifier run on the previous level down to about half the
+	triangles. They all share the vertex buffer, the index buffer holds the levels back to back and lods[] has their ranges and errors. The position stream index buffer
+	has the same layout so any level can be drawn from either. Culling picks the level per object per view (see SelectLod in Instancing.h).
+
+	Meshlets: with GENERATE_MESHLETS lod 0 also gets cut into meshlets (see Meshlets.h), stored after the indices in the .gmesh. Mesh points at the caches copy of them.
+
+	Every meshes streams (vertices, indices, position vertices, position indices) are suballocated out of the GeometryArena instead of being buffers of their own, so
+	vbo/ibo are the shared arena buffers and vertex_offset/first_index say where the mesh is in them. Every lod, meshlet and MeshLod first_index is relative to first_index.
+	UnloadMesh gives a meshes ranges back and Defragment compacts the arena, after that every Mesh copy is stale and has to go through RefreshMesh.
+
+	Occluders: the gpu copies are all there is of a mesh after loading, so every mesh also keeps a small cpu OccluderMesh for the software occlusion culling. It's the
+	finest lod with at most OCCLUDER_MAX_TRIANGLES triangles (or the coarsest one if none is), compacted to the vertices it uses. GetOccluderMesh hands it out.
 	*/
 
 	class MeshCache
@@ -19,14 +76,35 @@ namespace Gibo {
 	public:
 		struct Mesh
 		{
-			VkBuffer vbo;
+			VkBuffer vbo; //arena buffers, shared with other meshes
 			VkBuffer ibo;
-			uint32_t index_size;
+			int32_t vertex_offset = 0; //where this mesh starts in vbo/ibo, in vertices and indices
+			uint32_t first_index = 0;
+			VkBuffer position_vbo; //position only stream and its index buffer, drawn with the same index_size
+			VkBuffer position_ibo;
+			int32_t position_vertex_offset = 0;
+			uint32_t position_first_index = 0;
+			uint32_t index_size; //lod 0
+			VkIndexType index_type = VK_INDEX_TYPE_UINT32; //for both ibo and position_ibo
+			uint32_t lod_count = 1;
+			MeshLod lods[MAX_MESH_LODS] = {};
 			std::string mesh_name;
+			uint32_t mesh_id; //small unique number per cached mesh so draw sort keys can pack it, the quad is 0
+			VERTEX_FORMAT vertex_format = VERTEX_FORMAT::FULL; //picks the pipeline the mesh has to be drawn with
+			VertexDecodeConstants decode; //pushed before drawing so the shader can rebuild quantized positions
+			const Meshlet* meshlets = nullptr; //lod 0 only, owned by the cache
+			uint32_t meshlet_count = 0;
 		};
 
 	public:
-		MeshCache(vkcoreDevice& device) : deviceref(device), total_buffer_size(0) {};
+		static const bool OPTIMIZE_MESHES = true;
+		static const bool GENERATE_LODS = true;
+		static constexpr float LOD_MAX_ERROR = 0.1f; //a level can't stray further than this times the bounding sphere radius
+		static constexpr float LOD_MIN_REDUCTION = 0.85f; //a level has to get below this fraction of the previous levels indices to be worth keeping
+		static const bool GENERATE_MESHLETS = true;
+		static const uint32_t OCCLUDER_MAX_TRIANGLES = 4096;
+
+		MeshCache(vkcoreDevice& device) : deviceref(device), arena(device), total_buffer_size(0) {};
 		~MeshCache() = default;
 
 		//no copying/moving should be allowed from this class
@@ -36,26 +114,156 @@ namespace Gibo {
 		MeshCache& operator=(MeshCache const&) = delete;
 		MeshCache& operator=(MeshCache&&) = delete;
 
-		void LoadMeshFromFile(std::string filename);
+		//what DecodeMesh hands back. The data pointers either point into the vectors (fresh import) or into the mapped cache file
+		struct DecodedMesh
+		{
+			std::string filename;
+			VERTEX_FORMAT format = VERTEX_FORMAT::FULL;
+			std::vector<float> vertices;
+			std::vector<QuantizedVertex> quantized; //filled instead of uploading vertexdata when format is QUANTIZED
+			std::vector<unsigned int> indices;
+			std::vector<uint8_t> positions; //welded position stream, PositionStride(format) bytes a vertex
+			std::vector<unsigned int> position_indices;
+			std::vector<uint16_t> indices16; //indexdata and position_indices narrowed when index_type is UINT16
+			std::vector<uint16_t> position_indices16;
+			VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+			MeshOptimizer::Stats stats_before; //post transform cache stats of the source order and the uploaded order
+			MeshOptimizer::Stats stats_after;
+			uint32_t lod_count = 1;
+			MeshLod lods[MAX_MESH_LODS] = {};
+			std::vector<Meshlet> meshlets;
+			OccluderMesh occluder;
+			std::unique_ptr<MappedFile> cachefile;
+			const float* vertexdata = nullptr;
+			size_t vertexfloats = 0;
+			const unsigned int* indexdata = nullptr;
+			size_t indexcount = 0;
+			const Meshlet* meshletdata = nullptr;
+			size_t meshletcount = 0;
+			//what gets uploaded for format, built by BuildDerivedStreams or mapped out of the cache
+			const QuantizedVertex* quantizeddata = nullptr; //QUANTIZED only
+			const uint16_t* indexdata16 = nullptr; //UINT16 only
+			const uint8_t* positiondata = nullptr;
+			size_t positionbytes = 0;
+			const void* positionindexdata = nullptr; //indexcount indices of index_type
+			Sphere sphere;
+			AABB box;
+			bool from_cache = false;
+		};
+
+		bool LoadMeshFromFile(std::string filename, VERTEX_FORMAT format = VERTEX_FORMAT::FULL);
+		static bool DecodeMesh(const std::string& filename, VERTEX_FORMAT format, DecodedMesh& mesh);
+		//false if the arena couldn't fit it, nothing is left allocated and the mesh isn't in the cache
+		bool AddDecodedMesh(DecodedMesh& mesh, AssetUploader& uploader);
+		bool HasMesh(const std::string& filename) const { return meshCache.count(filename) != 0; }
+		//nothing can still be drawing with it, or hold its Mesh
+		void UnloadMesh(const std::string& filename);
+		//compacts the arena, device has to be idle. returns true if anything moved, then every Mesh has to be refreshed
+		bool Defragment() { return arena.Defragment(); }
+		//sets a Mesh again from whatever mesh it was set to, for after Defragment
+		void RefreshMesh(MeshCache::Mesh& mesh);
 		void CleanUp();
 		void PrintMemory() const; 
 		//Mesh GetMesh(std::string filename);
 		void SetObjectMesh(std::string filename, MeshCache::Mesh& mesh);
-		void GetOriginalMeshBV(std::string filename, BoundingVolume*& bv);
+		void GetMeshBounds(const std::string& filename, Sphere& sphere, AABB& box);
+		//nullptr if the mesh isn't loaded. Only a find so the same goes as for GetMeshBounds
+		const OccluderMesh* GetOccluderMesh(const std::string& filename) const;
 		void SetQuadMesh(MeshCache::Mesh& mesh);
 	private:
-		void LoadMesh(std::string filename, std::vector<float>& vertexdata, std::vector<unsigned int>& indexdata);
 		struct Mesh_internal
 		{
-			vkcoreBuffer vbo;
-			vkcoreBuffer ibo;
+			GeometryArena::Handle vertices = GeometryArena::INVALID_HANDLE;
+			GeometryArena::Handle indices = GeometryArena::INVALID_HANDLE;
+			GeometryArena::Handle position_vertices = GeometryArena::INVALID_HANDLE;
+			GeometryArena::Handle position_indices = GeometryArena::INVALID_HANDLE;
 			uint32_t index_size;
-			BoundingVolume* bv; //bounding volume in model space for this mesh
+			VkIndexType index_type;
+			uint32_t lod_count;
+			MeshLod lods[MAX_MESH_LODS];
+			std::vector<Meshlet> meshlets;
+			OccluderMesh occluder;
+			uint32_t mesh_id;
+			VERTEX_FORMAT vertex_format;
+			VertexDecodeConstants decode;
+			Sphere sphere; //model space sphere and aabb the culling bounds are built from
+			AABB box;
+			MeshOptimizer::Stats stats_before;
+			MeshOptimizer::Stats stats_after;
 		};
+
+		//layout of a .gmesh file. Every section follows the header at its offset, 16 byte aligned. The sections after MESHLETS are built for vertex_format,
+		//the ones a format doesn't use are empty
+		struct MeshFileHeader
+		{
+			static const uint32_t MAGIC = 0x48534D47; //"GMSH"
+			static const uint32_t VERSION = 6; //bump whenever the vertex layout or this header changes so old caches get rebuilt
+
+			enum SECTION { SECTION_VERTICES, SECTION_INDICES, SECTION_MESHLETS, SECTION_QUANTIZED, SECTION_INDICES16, SECTION_POSITIONS, SECTION_POSITION_INDICES,
+				           SECTION_OCCLUDER_POSITIONS, SECTION_OCCLUDER_INDICES, SECTION_COUNT };
+			struct Section
+			{
+				uint64_t offset;
+				uint64_t size; //bytes
+			};
+
+			uint32_t magic;
+			uint32_t version;
+			uint64_t source_size;
+			int64_t source_mtime;
+			uint64_t source_hash;
+			uint32_t attribute_length; //floats per vertex, has to match Vertex_Attribute_Length
+			uint32_t vertex_count;
+			uint32_t index_count; //every lod, back to back
+			uint32_t import_flags; //ImportFlags() when it was written, a mismatch reimports
+			uint32_t lod_count;
+			MeshLod lods[MAX_MESH_LODS];
+			MeshOptimizer::Stats stats_before;
+			MeshOptimizer::Stats stats_after;
+			float sphere[4]; //center xyz, radius
+			float box_min[4];
+			float box_max[4];
+			uint32_t meshlet_count;
+			uint32_t vertex_format; //VERTEX_FORMAT the derived sections were built for
+			uint32_t index_type; //VkIndexType of POSITION_INDICES, INDICES16 is only there for UINT16
+			uint32_t position_vertex_count;
+			Section sections[SECTION_COUNT];
+			uint64_t header_hash; //HashBytes of this header with header_hash 0
+		};
+
+		struct SourceInfo
+		{
+			uint64_t size = 0;
+			int64_t mtime = 0;
+		};
+
+		static std::string CachedMeshPath(const std::string& filename) { return filename + ".gmesh"; }
+		static bool GetSourceInfo(const std::string& filename, SourceInfo& info);
+		static bool HashSource(const std::string& filename, uint64_t& hash);
+		static bool LoadCachedMesh(const std::string& filename, DecodedMesh& mesh);
+		static void QuantizeMesh(DecodedMesh& mesh);
+		static void BuildPositionStream(DecodedMesh& mesh);
+		static void NarrowIndices(DecodedMesh& mesh);
+		static void GenerateLods(DecodedMesh& mesh);
+		static void GenerateMeshlets(DecodedMesh& mesh);
+		static void BuildOccluderMesh(DecodedMesh& mesh);
+		//everything above in order, then points the upload data at it
+		static void BuildDerivedStreams(DecodedMesh& mesh);
+		static uint32_t ImportFlags() { return static_cast<uint32_t>(OPTIMIZE_MESHES) | (static_cast<uint32_t>(GENERATE_LODS) << 1) | (static_cast<uint32_t>(GENERATE_MESHLETS) << 2); }
+		//every index, meshlet and lod points inside what it indexes. Checked once before writing so a cache hit can skip it
+		static bool ValidateMesh(const DecodedMesh& mesh);
+		static void WriteCachedMesh(const std::string& filename, const DecodedMesh& mesh);
+		//allocates alignment aligned space in the pool and records the upload into it
+		GeometryArena::Handle UploadGeometry(GeometryArena::POOL pool, const void* data, size_t size, uint32_t alignment, AssetUploader& uploader);
+		void RecordGeometryUpload(GeometryArena::POOL pool, GeometryArena::Handle handle, const void* data, size_t size, AssetUploader& uploader);
+		void FreeGeometry(Mesh_internal& mesh);
+		void CopyToMesh(const Mesh_internal& internal, MeshCache::Mesh& mesh) const;
 	private:
 		std::unordered_map<std::string, Mesh_internal> meshCache;
 		Mesh_internal Quad_Mesh;
+		GeometryArena arena;
 		size_t total_buffer_size;
+		uint32_t next_mesh_id = 1;
 		vkcoreDevice& deviceref;
 	};
 
@@ -71,7 +279,7 @@ namespace Gibo {
 	 AI_SUCCESS
 	*/
 
-	//TODO - implement multithreading when loading, even during runtime?
+	//Load is thread safe (every call gets its own importer) so the AssetLoader runs it on the job system workers
 	class ASSIMPLoader
 	{
 	public:
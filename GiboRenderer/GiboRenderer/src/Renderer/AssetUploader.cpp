@@ -0,0 +1,142 @@
+#include "../pch.h"
+#include "AssetUploader.h"
+#include "vkcore/VulkanHelpers.h"
+#include "TextureCompression.h"
+#include <cstring>
+
+namespace Gibo {
+
+	bool AssetUploader::UploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, vkcoreBuffer& dstbuffer, VkAccessFlags dstaccess, VkPipelineStageFlags dststage)
+	{
+		if (!deviceref.CreateBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, 0, dstbuffer))
+		{
+			return false;
+		}
+
+		VkBuffer stagingbuffer;
+		VkDeviceSize stagingoffset;
+		Stage(data, size, stagingbuffer, stagingoffset);
+
+		CopyBufferToBuffer(deviceref, stagingbuffer, dstbuffer.buffer, dstaccess, dststage, stagingoffset, 0, size, GetCommandBuffer());
+		return true;
+	}
+
+	void AssetUploader::UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer dstbuffer, VkDeviceSize dstoffset, VkAccessFlags dstaccess, VkPipelineStageFlags dststage)
+	{
+		VkBuffer stagingbuffer;
+		VkDeviceSize stagingoffset;
+		Stage(data, size, stagingbuffer, stagingoffset);
+
+		CopyBufferToBuffer(deviceref, stagingbuffer, dstbuffer, dstaccess, dststage, stagingoffset, dstoffset, size, GetCommandBuffer());
+	}
+
+	void AssetUploader::UploadImage(const void* pixels, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkFormat format, uint32_t miplevels, bool generatemips)
+	{
+		VkBuffer stagingbuffer;
+		VkDeviceSize stagingoffset;
+		Stage(pixels, size, stagingbuffer, stagingoffset);
+
+		VkCommandBuffer commandbuffer = GetCommandBuffer();
+
+		//transition from undefined to transfer_dst_optimal and copy, mipped images stay in transfer_dst for the blits
+		CopyBufferToImage(deviceref, image, stagingbuffer, VK_IMAGE_LAYOUT_UNDEFINED, (generatemips) ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_READ_BIT, 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, width, height, VK_IMAGE_ASPECT_COLOR_BIT, miplevels, 1, stagingoffset, commandbuffer);
+
+		if (generatemips)
+		{
+			generateMipmaps(deviceref, image, format, width, height, miplevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, commandbuffer);
+		}
+	}
+
+	void AssetUploader::UploadImageLevels(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkFormat format, uint32_t miplevels)
+	{
+		VkBuffer stagingbuffer;
+		VkDeviceSize stagingoffset;
+		Stage(data, size, stagingbuffer, stagingoffset);
+
+		VkCommandBuffer commandbuffer = GetCommandBuffer();
+
+		std::vector<VkBufferImageCopy> copies(miplevels);
+		VkDeviceSize offset = stagingoffset;
+		for (uint32_t l = 0; l < miplevels; l++)
+		{
+			copies[l] = {};
+			copies[l].bufferOffset = offset;
+			copies[l].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copies[l].imageSubresource.mipLevel = l;
+			copies[l].imageSubresource.baseArrayLayer = 0;
+			copies[l].imageSubresource.layerCount = 1;
+			copies[l].imageOffset = { 0, 0, 0 };
+			copies[l].imageExtent = { std::max(width >> l, 1u), std::max(height >> l, 1u), 1 };
+			offset += LevelSize(format, width, height, l);
+		}
+
+		TransitionImageLayout(deviceref, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, miplevels, 1, VK_IMAGE_ASPECT_COLOR_BIT, commandbuffer);
+		vkCmdCopyBufferToImage(commandbuffer, stagingbuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevels, copies.data());
+		TransitionImageLayout(deviceref, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, miplevels, 1, VK_IMAGE_ASPECT_COLOR_BIT, commandbuffer);
+	}
+
+	void AssetUploader::Flush()
+	{
+		if (cmdbuffer != VK_NULL_HANDLE)
+		{
+			deviceref.submitSingleTimeCommands(cmdbuffer, POOL_FAMILY::TRANSFER);
+			cmdbuffer = VK_NULL_HANDLE;
+			submit_count++;
+		}
+
+		for (int i = 0; i < chunks.size(); i++)
+		{
+			deviceref.DestroyBuffer(chunks[i].buffer);
+		}
+		chunks.clear();
+		batch_bytes = 0;
+	}
+
+	VkCommandBuffer AssetUploader::GetCommandBuffer()
+	{
+		if (cmdbuffer == VK_NULL_HANDLE)
+		{
+			cmdbuffer = deviceref.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		}
+		return cmdbuffer;
+	}
+
+	void AssetUploader::Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset)
+	{
+		//don't let one batch grow forever, whatever is already recorded goes out first
+		if (batch_bytes > 0 && batch_bytes + size > BATCH_LIMIT)
+		{
+			Flush();
+		}
+
+		//16 byte alignment covers buffer copy offsets and every texel size we upload
+		VkDeviceSize aligned = 0;
+		if (!chunks.empty())
+		{
+			aligned = (chunks.back().used + 15) & ~VkDeviceSize(15);
+		}
+
+		if (chunks.empty() || aligned + size > chunks.back().size)
+		{
+			StagingChunk chunk;
+			chunk.size = std::max(size, STAGING_CHUNK_SIZE);
+			chunk.used = 0;
+			deviceref.CreateBuffer(chunk.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, VMA_ALLOCATION_CREATE_MAPPED_BIT, chunk.buffer);
+			chunks.push_back(chunk);
+			aligned = 0;
+		}
+
+		StagingChunk& chunk = chunks.back();
+		std::memcpy(static_cast<uint8_t*>(chunk.buffer.mapped_data) + aligned, data, static_cast<size_t>(size));
+		chunk.used = aligned + size;
+
+		buffer = chunk.buffer.buffer;
+		offset = aligned;
+		batch_bytes += size;
+		uploaded_bytes += size;
+	}
+
+}
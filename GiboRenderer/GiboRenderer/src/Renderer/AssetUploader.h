@@ -0,0 +1,66 @@
+#pragma once
+#include "vkcore/vkcoreDevice.h"
+
+namespace Gibo {
+
+	/*
+	 Batches asset uploads into as few transfer submits as possible. Before this every mesh buffer and texture did its own staging buffer + one time submit + fence wait, so loading
+	 15 meshes and 20 textures was ~50 round trips to the gpu. Now the copies (and mip blits) all get recorded into one transfer command buffer and go out together on Flush.
+
+	 Staging memory comes out of big persistently mapped chunks that get sub allocated linearly, the data is memcpy'd in right away so the caller can free its copy as soon as
+	 the Upload call returns. Once a batch has staged BATCH_LIMIT bytes it flushes by itself so a huge load doesn't hold gigabytes of staging memory at once.
+
+	 Only the thread that owns the device should use this, decoding can happen anywhere but recording/submitting can't.
+	 Nothing written by an upload is safe to use until the Flush that submits it returns.
+	*/
+	class AssetUploader
+	{
+	public:
+		static constexpr VkDeviceSize STAGING_CHUNK_SIZE = 32 * 1024 * 1024;
+		static constexpr VkDeviceSize BATCH_LIMIT = 128 * 1024 * 1024;
+
+		AssetUploader(vkcoreDevice& device) : deviceref(device) {};
+		~AssetUploader() { Flush(); }
+
+		//no copying/moving should be allowed from this class
+		AssetUploader(AssetUploader const&) = delete;
+		AssetUploader(AssetUploader&&) = delete;
+		AssetUploader& operator=(AssetUploader const&) = delete;
+		AssetUploader& operator=(AssetUploader&&) = delete;
+
+		//creates dstbuffer as a gpu only buffer with usage | transfer_dst and records the copy into it. dstaccess/dststage are what its going to be used for after
+		bool UploadBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, vkcoreBuffer& dstbuffer, VkAccessFlags dstaccess, VkPipelineStageFlags dststage);
+		//records a copy into a range of an existing buffer (created with transfer_dst), for suballocated buffers like the GeometryArena blocks
+		void UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer dstbuffer, VkDeviceSize dstoffset, VkAccessFlags dstaccess, VkPipelineStageFlags dststage);
+		//image has to be created with transfer_dst (and transfer_src if generatemips). ends up in shader_read_only
+		void UploadImage(const void* pixels, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkFormat format, uint32_t miplevels, bool generatemips);
+		//data is every level back to back (block compressed images can't be blitted so their mips come precomputed), one copy per level. image needs transfer_dst, ends up in shader_read_only
+		void UploadImageLevels(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkFormat format, uint32_t miplevels);
+
+		//submits everything recorded so far, waits for it and frees the staging memory
+		void Flush();
+
+		uint32_t GetSubmitCount() const { return submit_count; }
+		VkDeviceSize GetUploadedBytes() const { return uploaded_bytes; }
+	private:
+		struct StagingChunk
+		{
+			vkcoreBuffer buffer;
+			VkDeviceSize size;
+			VkDeviceSize used;
+		};
+
+		VkCommandBuffer GetCommandBuffer();
+		//copies data into staging memory, returns the buffer and offset it landed at
+		void Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset);
+
+	private:
+		vkcoreDevice& deviceref;
+		VkCommandBuffer cmdbuffer = VK_NULL_HANDLE;
+		std::vector<StagingChunk> chunks;
+		VkDeviceSize batch_bytes = 0;
+		VkDeviceSize uploaded_bytes = 0;
+		uint32_t submit_count = 0;
+	};
+
+}
@@ -728,8 +728,8 @@ namespace Gibo {
 		VkBuffer buffers[] = { Sky_Mesh.GetMesh().vbo };
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(cmdbuffer, 0, 1, buffers, offsets);
-		vkCmdBindIndexBuffer(cmdbuffer, Sky_Mesh.GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindIndexBuffer(cmdbuffer, Sky_Mesh.GetMesh().ibo, 0, Sky_Mesh.GetMesh().index_type);
 
-		vkCmdDrawIndexed(cmdbuffer, static_cast<uint32_t>(Sky_Mesh.GetMesh().index_size), 1, 0, 0, 0);
+		vkCmdDrawIndexed(cmdbuffer, static_cast<uint32_t>(Sky_Mesh.GetMesh().index_size), 1, Sky_Mesh.GetMesh().first_index, Sky_Mesh.GetMesh().vertex_offset, 0);
 	}
 }
\ No newline at end of file
@@ -40,6 +40,8 @@ namespace Gibo {
 		void Create(VkExtent2D proj_extent, VkExtent2D pipeline_extent, float fov, VkRenderPass renderpass, MeshCache& mcache, int framesinflight, std::vector<vkcoreBuffer> pv_uniform, VkSampleCountFlagBits sample_count);
 		void FillLUT();
 		void Draw(VkCommandBuffer cmdbuffer, int current_frame);
+		//sky mesh has to be set again after MeshCache::Defragment
+		void RefreshMesh(MeshCache& mcache) { mcache.RefreshMesh(Sky_Mesh.GetMesh()); }
 
 		//let me do system wehre you have an update function and each of these just make it dirty
 		void Update(int framecount);
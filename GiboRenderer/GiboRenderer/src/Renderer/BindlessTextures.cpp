@@ -0,0 +1,168 @@
+#include "../pch.h"
+#include "BindlessTextures.h"
+#include "vkcore/VulkanHelpers.h"
+#include <algorithm>
+
+namespace Gibo {
+
+	bool BindlessTextures::Create(uint32_t reserved_samplers)
+	{
+		if (!deviceref.SupportsBindless()) return false;
+
+		//the array isn't update after bind so it counts against the normal per stage/set limits, which some drivers keep small
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(deviceref.GetPhysicalDevice(), &properties);
+		const VkPhysicalDeviceLimits& limits = properties.limits;
+		uint32_t room = std::min({ limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSamplers,
+			                       limits.maxDescriptorSetSampledImages, limits.maxPerStageResources });
+		room = (room > reserved_samplers) ? room - reserved_samplers : 0;
+		texture_capacity = std::min(MAX_TEXTURES, room);
+		if (texture_capacity < MIN_TEXTURES)
+		{
+			Logger::LogWarning("only room for ", texture_capacity, " bindless textures, using per object material sets\n");
+			texture_capacity = 0;
+			return false;
+		}
+
+		//layout
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = texture_capacity;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		//only the slots handed out ever get written
+		VkDescriptorBindingFlagsEXT bindingflags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsinfo = {};
+		flagsinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		flagsinfo.bindingCount = 1;
+		flagsinfo.pBindingFlags = &bindingflags;
+
+		VkDescriptorSetLayoutCreateInfo layoutinfo = {};
+		layoutinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutinfo.pNext = &flagsinfo;
+		layoutinfo.bindingCount = 1;
+		layoutinfo.pBindings = &binding;
+		VkResult result = vkCreateDescriptorSetLayout(deviceref.GetDevice(), &layoutinfo, nullptr, &layout);
+		VULKAN_CHECK(result, "create bindless descriptor layout");
+		if (result != VK_SUCCESS) return false;
+
+		//pool, one set per frame
+		VkDescriptorPoolSize poolsize = {};
+		poolsize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolsize.descriptorCount = texture_capacity * frames_in_flight;
+
+		VkDescriptorPoolCreateInfo poolinfo = {};
+		poolinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolinfo.maxSets = frames_in_flight;
+		poolinfo.poolSizeCount = 1;
+		poolinfo.pPoolSizes = &poolsize;
+		result = vkCreateDescriptorPool(deviceref.GetDevice(), &poolinfo, nullptr, &pool);
+		VULKAN_CHECK(result, "create bindless descriptor pool");
+		if (result != VK_SUCCESS) return false;
+
+		std::vector<VkDescriptorSetLayout> layouts(frames_in_flight, layout);
+		sets.resize(frames_in_flight);
+		VkDescriptorSetAllocateInfo allocinfo = {};
+		allocinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocinfo.descriptorPool = pool;
+		allocinfo.descriptorSetCount = frames_in_flight;
+		allocinfo.pSetLayouts = layouts.data();
+		result = vkAllocateDescriptorSets(deviceref.GetDevice(), &allocinfo, sets.data());
+		VULKAN_CHECK(result, "allocate bindless descriptor sets");
+		if (result != VK_SUCCESS) return false;
+
+		slots_written.resize(frames_in_flight, 0);
+		texture_serials.resize(frames_in_flight, 0);
+
+		Logger::LogInfo("bindless textures: ", texture_capacity, " slots\n");
+		return true;
+	}
+
+	void BindlessTextures::CleanUp()
+	{
+		//sets go with the pool
+		if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(deviceref.GetDevice(), pool, nullptr);
+		if (layout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(deviceref.GetDevice(), layout, nullptr);
+		pool = VK_NULL_HANDLE;
+		layout = VK_NULL_HANDLE;
+		sets.clear();
+
+		slotmap.clear();
+		slots.clear();
+	}
+
+	uint32_t BindlessTextures::TextureSlot(const vkcoreTexture& texture)
+	{
+		slotKey key;
+		key.texture = (texture.stream_id != vkcoreTexture::NOT_STREAMED) ? ((1ull << 63) | texture.stream_id) : (uint64_t)texture.view;
+		key.sampler = texture.sampler;
+
+		auto found = slotmap.find(key);
+		if (found != slotmap.end()) return found->second;
+
+		if (slots.size() == texture_capacity)
+		{
+			Logger::LogError("out of bindless texture slots (", texture_capacity, "), drawing with slot 0\n");
+			return 0;
+		}
+		uint32_t slot = static_cast<uint32_t>(slots.size());
+		slots.push_back(texture);
+		slotmap.emplace(key, slot);
+		return slot;
+	}
+
+	void BindlessTextures::Update(int current_frame)
+	{
+		//new slots plus the streamed ones that swapped views since this frame was last here
+		uint64_t serial = texturecacheref.GetResidency().GetSerial();
+		uint64_t last = texture_serials[current_frame];
+		uint32_t written = slots_written[current_frame];
+		if (serial == last && written == slots.size()) return;
+
+		std::vector<VkDescriptorImageInfo> images;
+		std::vector<uint32_t> elements;
+		images.reserve(slots.size());
+		elements.reserve(slots.size());
+		for (uint32_t s = 0; s < slots.size(); s++)
+		{
+			if (s < written && texturecacheref.GetViewSerial(slots[s]) <= last) continue;
+
+			VkDescriptorImageInfo info = {};
+			info.sampler = slots[s].sampler;
+			info.imageView = texturecacheref.GetView(slots[s]);
+			info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			images.push_back(info);
+			elements.push_back(s);
+		}
+
+		//runs of neighbouring slots go in one write, new slots are always one run at the end
+		std::vector<VkWriteDescriptorSet> writes;
+		for (uint32_t i = 0; i < elements.size(); i++)
+		{
+			if (!writes.empty() && writes.back().dstArrayElement + writes.back().descriptorCount == elements[i])
+			{
+				writes.back().descriptorCount++;
+				continue;
+			}
+
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = sets[current_frame];
+			write.dstBinding = 0;
+			write.dstArrayElement = elements[i];
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.descriptorCount = 1;
+			write.pImageInfo = &images[i];
+			writes.push_back(write);
+		}
+		if (!writes.empty())
+		{
+			vkUpdateDescriptorSets(deviceref.GetDevice(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+
+		slots_written[current_frame] = static_cast<uint32_t>(slots.size());
+		texture_serials[current_frame] = serial;
+	}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "vkcore/vkcoreDevice.h"
+#include "TextureCache.h"
+
+namespace Gibo {
+
+	/*
+	 Bindless pbr textures for devices with descriptor indexing (vkcoreDevice::SupportsBindless). Instead of every object getting its own descriptor set with its
+	 4 maps, the pbr pass binds one set per frame holding
+		binding 0  textures[]     - every map any material uses, partially bound
+	 and the materials records in the MaterialLibrary hold the slots of their maps, so the pass binds set 1 once and instances of different materials batch together.
+
+	 Texture slots are handed out the first time a texture/sampler pair shows up and are never given back, the texture cache never frees 2D textures either.
+
+	 Slots get written into a frames set in Update once that frame is done on the gpu, like the per object sets:
+		. new slots and streamed textures whose view changed since that frames last Update (TextureResidency view serials) get their descriptor rewritten
+	*/
+	class BindlessTextures
+	{
+	public:
+		static const uint32_t MAX_TEXTURES = 4096; //slots in textures[], less if the device limits don't have room
+		static const uint32_t MIN_TEXTURES = 64; //below this the device is better off with the per object sets
+
+		BindlessTextures(vkcoreDevice& device, TextureCache& texturecache, uint32_t framesinflight) : deviceref(device), texturecacheref(texturecache), frames_in_flight(framesinflight) {};
+		~BindlessTextures() = default;
+
+		//no copying/moving should be allowed from this class
+		BindlessTextures(BindlessTextures const&) = delete;
+		BindlessTextures(BindlessTextures&&) = delete;
+		BindlessTextures& operator=(BindlessTextures const&) = delete;
+		BindlessTextures& operator=(BindlessTextures&&) = delete;
+
+		//reserved_samplers is what the rest of the pipeline layout already uses in the fragment stage. False if the device can't do it, nothing is created then
+		bool Create(uint32_t reserved_samplers);
+		void CleanUp();
+
+		//slot of the texture in textures[], handing out a new one the first time it shows up. Slot 0 if they ran out
+		uint32_t TextureSlot(const vkcoreTexture& texture);
+		//wait for frame key before calling
+		void Update(int current_frame);
+
+		VkDescriptorSetLayout GetLayout() const { return layout; }
+		VkDescriptorSet& GetSet(int current_frame) { return sets[current_frame]; }
+		uint32_t GetTextureCount() const { return static_cast<uint32_t>(slots.size()); }
+		uint32_t GetTextureCapacity() const { return texture_capacity; }
+	private:
+		struct slotKey
+		{
+			uint64_t texture; //stream id for streamed textures, the view otherwise. The view of a streamed one changes as it streams
+			VkSampler sampler;
+
+			bool operator==(const slotKey& p) const
+			{
+				return texture == p.texture && sampler == p.sampler;
+			}
+		};
+		class slotHash {
+		public:
+			size_t operator()(const slotKey& p) const
+			{
+				return std::hash<uint64_t>()(p.texture) * 31 + std::hash<VkSampler>()(p.sampler);
+			}
+		};
+
+		std::unordered_map<slotKey, uint32_t, slotHash> slotmap;
+		std::vector<vkcoreTexture> slots;
+		std::vector<uint32_t> slots_written; //slots each frames set has had written
+		std::vector<uint64_t> texture_serials; //residency serial each frames set was last brought up to date with
+
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> sets;
+		uint32_t texture_capacity = 0;
+
+		vkcoreDevice& deviceref;
+		TextureCache& texturecacheref;
+		uint32_t frames_in_flight;
+	};
+
+}
@@ -112,7 +112,7 @@ namespace Gibo {
 		void Construct(std::vector<float>& vertexdata, int vertexattributelength) override
 		{
 			min = glm::vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-			max = glm::vec3(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
+			max = glm::vec3(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
 
 			for (int i = 0; i < vertexdata.size(); i+= vertexattributelength)
 			{
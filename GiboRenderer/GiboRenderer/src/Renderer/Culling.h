@@ -1,5 +1,7 @@
 #pragma once
 #include "Renderobject.h"
+#include "CullingBounds.h"
+#include <immintrin.h>
 
 namespace Gibo {
 	
@@ -66,23 +68,256 @@ namespace Gibo {
 		return p_planes;
 	}
 
-	//it loops through every object and every object not culled it stores its index into the array. That way you just loop through easily and call draw calls
-	//pass in 6 planes and list of renderobjects
-	std::vector<uint32_t> FrustrumIntersection(const std::vector<Plane>& planes, std::vector<RenderObject*>& renderobjects, std::unordered_map<uint32_t, BoundingVolume*> bvs, glm::mat4 PV)
+	//it loops through every slot in the culling bounds and every object not culled it stores its slot into the visible buffer. That way you just loop through easily and call draw calls
+	//pass in 6 planes, the bounds, a mask of which bins you want (1 << BIN_TYPE) and a buffer with at least bounds.Size() room. Returns the number of visible slots written.
+	//Its structure of arrays so we test 8 objects per instruction with AVX or 4 with SSE. Sphere first, then the aabb against the plane's positive vertex, which is the corner
+	//furthest along the plane normal, if thats behind any plane the whole box is. Since the plane is the same for every lane the positive vertex is picked with a scalar branch.
+	//The visible slots get written branchless, every lane writes its slot and only advances the count if its visible, so the buffer needs the padding.
+	uint32_t FrustrumIntersection(const std::vector<Plane>& planes, const CullingBounds& bounds, uint32_t binmask, uint32_t* visible)
 	{
-		//for each render object call its frustrum intersection if so add its index into the list
-		std::vector<uint32_t> indices;
-		indices.reserve(renderobjects.size() / 2);
+		uint32_t count = 0;
+		uint32_t size = bounds.Size();
 
-		for (int i = 0; i < renderobjects.size(); i++)
+		const float* cx = bounds.center_x.data(); const float* cy = bounds.center_y.data(); const float* cz = bounds.center_z.data(); const float* cr = bounds.radius.data();
+		const float* minx = bounds.min_x.data(); const float* miny = bounds.min_y.data(); const float* minz = bounds.min_z.data();
+		const float* maxx = bounds.max_x.data(); const float* maxy = bounds.max_y.data(); const float* maxz = bounds.max_z.data();
+		const uint32_t* flags = bounds.bin_flags.data();
+
+		const __m128i mask = _mm_set1_epi32(static_cast<int>(binmask));
+		const __m128i zeroi = _mm_setzero_si128();
+
+#if defined(__AVX__)
+		__m256 pa[6], pb[6], pc[6], pd[6];
+		for (int p = 0; p < 6; p++)
+		{
+			pa[p] = _mm256_set1_ps(planes[p].a); pb[p] = _mm256_set1_ps(planes[p].b); pc[p] = _mm256_set1_ps(planes[p].c); pd[p] = _mm256_set1_ps(planes[p].d);
+		}
+		const __m256 zero = _mm256_setzero_ps();
+
+		for (uint32_t i = 0; i < size; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(cx + i);
+			__m256 y = _mm256_loadu_ps(cy + i);
+			__m256 z = _mm256_loadu_ps(cz + i);
+			__m256 negr = _mm256_sub_ps(zero, _mm256_loadu_ps(cr + i));
+			__m256 outside = zero;
+
+			for (int p = 0; p < 6; p++)
+			{
+				//sphere, signed distance from center to plane is less than -radius its completely behind it
+				__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p], x), _mm256_mul_ps(pb[p], y)), _mm256_add_ps(_mm256_mul_ps(pc[p], z), pd[p]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negr, _CMP_LT_OQ));
+
+				//aabb positive vertex
+				__m256 px = _mm256_loadu_ps(((planes[p].a >= 0) ? maxx : minx) + i);
+				__m256 py = _mm256_loadu_ps(((planes[p].b >= 0) ? maxy : miny) + i);
+				__m256 pz = _mm256_loadu_ps(((planes[p].c >= 0) ? maxz : minz) + i);
+				__m256 pdist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p], px), _mm256_mul_ps(pb[p], py)), _mm256_add_ps(_mm256_mul_ps(pc[p], pz), pd[p]));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(pdist, zero, _CMP_LT_OQ));
+			}
+
+			//avx1 has no 256 bit integer ops so check the bin flags in two sse halves
+			__m128i flags0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), mask);
+			__m128i flags1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i + 4)), mask);
+			int rejected = _mm256_movemask_ps(outside) | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(flags0, zeroi))) | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(flags1, zeroi))) << 4);
+			int visiblebits = ~rejected & 0xFF;
+
+			for (uint32_t k = 0; k < 8; k++)
+			{
+				visible[count] = i + k;
+				count += (visiblebits >> k) & 1;
+			}
+		}
+#else
+		__m128 pa[6], pb[6], pc[6], pd[6];
+		for (int p = 0; p < 6; p++)
+		{
+			pa[p] = _mm_set1_ps(planes[p].a); pb[p] = _mm_set1_ps(planes[p].b); pc[p] = _mm_set1_ps(planes[p].c); pd[p] = _mm_set1_ps(planes[p].d);
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		for (uint32_t i = 0; i < size; i += 4)
 		{
-			if (bvs[renderobjects[i]->GetId()]->IntersectFrustrum(planes, PV) != INTERSECTION::OUTSIDE)
+			__m128 x = _mm_loadu_ps(cx + i);
+			__m128 y = _mm_loadu_ps(cy + i);
+			__m128 z = _mm_loadu_ps(cz + i);
+			__m128 negr = _mm_sub_ps(zero, _mm_loadu_ps(cr + i));
+			__m128 outside = zero;
+
+			for (int p = 0; p < 6; p++)
 			{
-				indices.push_back(i);
+				//sphere, signed distance from center to plane is less than -radius its completely behind it
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], x), _mm_mul_ps(pb[p], y)), _mm_add_ps(_mm_mul_ps(pc[p], z), pd[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negr));
+
+				//aabb positive vertex
+				__m128 px = _mm_loadu_ps(((planes[p].a >= 0) ? maxx : minx) + i);
+				__m128 py = _mm_loadu_ps(((planes[p].b >= 0) ? maxy : miny) + i);
+				__m128 pz = _mm_loadu_ps(((planes[p].c >= 0) ? maxz : minz) + i);
+				__m128 pdist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], px), _mm_mul_ps(pb[p], py)), _mm_add_ps(_mm_mul_ps(pc[p], pz), pd[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(pdist, zero));
+			}
+
+			__m128i binflags = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), mask);
+			int rejected = _mm_movemask_ps(outside) | _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(binflags, zeroi)));
+			int visiblebits = ~rejected & 0xF;
+
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				visible[count] = i + k;
+				count += (visiblebits >> k) & 1;
 			}
 		}
+#endif
+
+		return count;
+	}
+
+	//Same test as FrustrumIntersection but for up to 64 views at once (camera, cascades, every point face and spot light). The bounds for a block of objects get loaded once
+	//and tested against every view, so we walk the arrays once per frame instead of once per view. viewmasks gets a bit per view for every slot (bit v set means visible in view v)
+	//and needs bounds.Size() room. Slots whose bin flag doesn't match binmask get 0.
+	//[begin, end) lets the job system split the slots up, begin has to be a multiple of CullingBounds::SIMD_WIDTH
+	void FrustrumIntersectionMulti(const std::vector<std::vector<Plane>>& views, const CullingBounds& bounds, uint32_t binmask, uint64_t* viewmasks, uint32_t begin = 0, uint32_t end = UINT32_MAX)
+	{
+		uint32_t size = std::min(end, bounds.Size());
+		uint32_t viewcount = static_cast<uint32_t>(std::min<size_t>(views.size(), 64));
+
+		const float* cx = bounds.center_x.data(); const float* cy = bounds.center_y.data(); const float* cz = bounds.center_z.data(); const float* cr = bounds.radius.data();
+		const float* minx = bounds.min_x.data(); const float* miny = bounds.min_y.data(); const float* minz = bounds.min_z.data();
+		const float* maxx = bounds.max_x.data(); const float* maxy = bounds.max_y.data(); const float* maxz = bounds.max_z.data();
+		const uint32_t* flags = bounds.bin_flags.data();
+
+		const __m128i mask = _mm_set1_epi32(static_cast<int>(binmask));
+		const __m128i zeroi = _mm_setzero_si128();
+
+#if defined(__AVX__)
+		const __m256 zero = _mm256_setzero_ps();
+		for (uint32_t i = begin; i < size; i += 8)
+		{
+			__m128i flags0 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), mask);
+			__m128i flags1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i + 4)), mask);
+			int live = ~(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(flags0, zeroi))) | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(flags1, zeroi))) << 4)) & 0xFF;
+
+			uint64_t lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+			if (live != 0)
+			{
+				__m256 x = _mm256_loadu_ps(cx + i); __m256 y = _mm256_loadu_ps(cy + i); __m256 z = _mm256_loadu_ps(cz + i);
+				__m256 negr = _mm256_sub_ps(zero, _mm256_loadu_ps(cr + i));
+				__m256 bminx = _mm256_loadu_ps(minx + i); __m256 bminy = _mm256_loadu_ps(miny + i); __m256 bminz = _mm256_loadu_ps(minz + i);
+				__m256 bmaxx = _mm256_loadu_ps(maxx + i); __m256 bmaxy = _mm256_loadu_ps(maxy + i); __m256 bmaxz = _mm256_loadu_ps(maxz + i);
+
+				for (uint32_t v = 0; v < viewcount; v++)
+				{
+					const std::vector<Plane>& planes = views[v];
+					__m256 outside = zero;
+					for (int p = 0; p < 6; p++)
+					{
+						__m256 pa = _mm256_set1_ps(planes[p].a); __m256 pb = _mm256_set1_ps(planes[p].b); __m256 pc = _mm256_set1_ps(planes[p].c); __m256 pd = _mm256_set1_ps(planes[p].d);
+
+						__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa, x), _mm256_mul_ps(pb, y)), _mm256_add_ps(_mm256_mul_ps(pc, z), pd));
+						outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, negr, _CMP_LT_OQ));
 
-		return indices;
+						__m256 px = (planes[p].a >= 0) ? bmaxx : bminx;
+						__m256 py = (planes[p].b >= 0) ? bmaxy : bminy;
+						__m256 pz = (planes[p].c >= 0) ? bmaxz : bminz;
+						__m256 pdist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa, px), _mm256_mul_ps(pb, py)), _mm256_add_ps(_mm256_mul_ps(pc, pz), pd));
+						outside = _mm256_or_ps(outside, _mm256_cmp_ps(pdist, zero, _CMP_LT_OQ));
+					}
+
+					int visiblebits = ~_mm256_movemask_ps(outside) & live;
+					for (uint32_t k = 0; k < 8; k++)
+					{
+						lanes[k] |= static_cast<uint64_t>((visiblebits >> k) & 1) << v;
+					}
+				}
+			}
+
+			for (uint32_t k = 0; k < 8; k++)
+			{
+				viewmasks[i + k] = lanes[k];
+			}
+		}
+#else
+		const __m128 zero = _mm_setzero_ps();
+		for (uint32_t i = begin; i < size; i += 4)
+		{
+			__m128i binflags = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i)), mask);
+			int live = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(binflags, zeroi))) & 0xF;
+
+			uint64_t lanes[4] = { 0, 0, 0, 0 };
+			if (live != 0)
+			{
+				__m128 x = _mm_loadu_ps(cx + i); __m128 y = _mm_loadu_ps(cy + i); __m128 z = _mm_loadu_ps(cz + i);
+				__m128 negr = _mm_sub_ps(zero, _mm_loadu_ps(cr + i));
+				__m128 bminx = _mm_loadu_ps(minx + i); __m128 bminy = _mm_loadu_ps(miny + i); __m128 bminz = _mm_loadu_ps(minz + i);
+				__m128 bmaxx = _mm_loadu_ps(maxx + i); __m128 bmaxy = _mm_loadu_ps(maxy + i); __m128 bmaxz = _mm_loadu_ps(maxz + i);
+
+				for (uint32_t v = 0; v < viewcount; v++)
+				{
+					const std::vector<Plane>& planes = views[v];
+					__m128 outside = zero;
+					for (int p = 0; p < 6; p++)
+					{
+						__m128 pa = _mm_set1_ps(planes[p].a); __m128 pb = _mm_set1_ps(planes[p].b); __m128 pc = _mm_set1_ps(planes[p].c); __m128 pd = _mm_set1_ps(planes[p].d);
+
+						__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa, x), _mm_mul_ps(pb, y)), _mm_add_ps(_mm_mul_ps(pc, z), pd));
+						outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, negr));
+
+						__m128 px = (planes[p].a >= 0) ? bmaxx : bminx;
+						__m128 py = (planes[p].b >= 0) ? bmaxy : bminy;
+						__m128 pz = (planes[p].c >= 0) ? bmaxz : bminz;
+						__m128 pdist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa, px), _mm_mul_ps(pb, py)), _mm_add_ps(_mm_mul_ps(pc, pz), pd));
+						outside = _mm_or_ps(outside, _mm_cmplt_ps(pdist, zero));
+					}
+
+					int visiblebits = ~_mm_movemask_ps(outside) & live;
+					for (uint32_t k = 0; k < 4; k++)
+					{
+						lanes[k] |= static_cast<uint64_t>((visiblebits >> k) & 1) << v;
+					}
+				}
+			}
+
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				viewmasks[i + k] = lanes[k];
+			}
+		}
+#endif
+	}
+
+	//pulls the slots visible in one view out of the per slot bitmasks. Only touches its own list so every view can be built on a different thread.
+	void BuildViewList(const uint64_t* viewmasks, const CullingBounds& bounds, uint32_t binmask, uint32_t view, std::vector<uint32_t>& list)
+	{
+		list.clear();
+
+		uint64_t viewbit = 1ull << view;
+		for (uint32_t i = 0; i < bounds.Size(); i++)
+		{
+			if ((viewmasks[i] & viewbit) && (bounds.bin_flags[i] & binmask)) list.push_back(i);
+		}
+	}
+
+	//turns the per slot view bitmasks into one list of slots per view. Only slots in binmask get added so you can split bins out of the same masks.
+	//the lists get cleared but keep their memory so after the first frame this doesn't allocate
+	void BuildViewLists(const uint64_t* viewmasks, const CullingBounds& bounds, uint32_t binmask, std::vector<std::vector<uint32_t>>& lists)
+	{
+		for (int v = 0; v < lists.size(); v++)
+		{
+			lists[v].clear();
+		}
+
+		uint32_t viewcount = static_cast<uint32_t>(std::min<size_t>(lists.size(), 64));
+		for (uint32_t i = 0; i < bounds.Size(); i++)
+		{
+			uint64_t bits = viewmasks[i];
+			if (bits == 0 || (bounds.bin_flags[i] & binmask) == 0) continue;
+
+			for (uint32_t v = 0; v < viewcount; v++)
+			{
+				if (bits & (1ull << v)) lists[v].push_back(i);
+			}
+		}
 	}
 
 	std::vector<float> CreateFrustrumMesh(int vertexattributelength, float fov, float near_depth, float far_depth, VkExtent2D proj_extent, glm::mat4 inveyematrix)
@@ -0,0 +1,61 @@
+#pragma once
+#include "BoundingVolumes.h"
+#include <vector>
+#include <cmath>
+
+namespace Gibo {
+	/*
+	Structure of arrays for the world space bounds of every renderobject. Every renderobject owns the slot that matches its descriptor_id so the culling kernels
+	can just walk these arrays contiguously and test 4 (SSE) or 8 (AVX) objects at once, instead of chasing BoundingVolume pointers through a map and calling a virtual function per object.
+
+	Each slot holds a sphere (center/radius) and an aabb (min/max) and a bin flag. The TransformSystem writes the bounds whenever an object moves. The sphere test is the cheap early out, the aabb test catches the long thin objects the sphere lets through.
+	The flags hold 1 << BIN_TYPE for live objects and 0 for empty slots, so empty slots never pass the kernel no matter what garbage the bounds hold.
+	The size is always padded up to SIMD_WIDTH so the kernels never need a scalar tail loop.
+	*/
+	class CullingBounds
+	{
+	public:
+		static const uint32_t SIMD_WIDTH = 8;
+
+	public:
+		CullingBounds() = default;
+		~CullingBounds() = default;
+
+		void Resize(uint32_t count)
+		{
+			uint32_t padded = ((count + SIMD_WIDTH - 1) / SIMD_WIDTH) * SIMD_WIDTH;
+
+			center_x.resize(padded, 0.0f); center_y.resize(padded, 0.0f); center_z.resize(padded, 0.0f); radius.resize(padded, 0.0f);
+			min_x.resize(padded, 0.0f); min_y.resize(padded, 0.0f); min_z.resize(padded, 0.0f);
+			max_x.resize(padded, 0.0f); max_y.resize(padded, 0.0f); max_z.resize(padded, 0.0f);
+			bin_flags.resize(padded, 0);
+		}
+
+		uint32_t Size() const { return static_cast<uint32_t>(bin_flags.size()); }
+
+		glm::vec3 GetMin(uint32_t slot) const { return glm::vec3(min_x[slot], min_y[slot], min_z[slot]); }
+		glm::vec3 GetMax(uint32_t slot) const { return glm::vec3(max_x[slot], max_y[slot], max_z[slot]); }
+
+		//slot is empty now so the kernels will always reject it
+		void Clear(uint32_t slot)
+		{
+			bin_flags[slot] = 0;
+		}
+
+	public:
+		std::vector<float> center_x;
+		std::vector<float> center_y;
+		std::vector<float> center_z;
+		std::vector<float> radius;
+
+		std::vector<float> min_x;
+		std::vector<float> min_y;
+		std::vector<float> min_z;
+		std::vector<float> max_x;
+		std::vector<float> max_y;
+		std::vector<float> max_z;
+
+		std::vector<uint32_t> bin_flags;
+	};
+
+}
@@ -0,0 +1,517 @@
+#pragma once
+#include "BoundingVolumes.h"
+#include <vector>
+#include <cstdint>
+
+namespace Gibo {
+	/*
+	Dynamic AABB tree (bounding volume hierarchy) over every renderobject so frustrum culling doesn't have to look at every object when most of the scene is off screen.
+	Its the incremental kind (like box2d/bullet) instead of the top down/bottom up builders in BoundingVolumes.h, because objects get added, removed and moved every frame
+	and we never want to rebuild the whole thing.
+
+	. Insert walks down picking the child that grows the least in surface area (SAH cost) and makes a new parent for the leaf and its sibling
+	. Remove pulls the leaf and its parent out and hooks the sibling straight to the grandparent
+	. Every time something changes we walk back up, refit the boxes and do AVL style rotations so the tree stays balanced
+	. Leafs store a fattened box, so objects that wiggle a bit don't need to be reinserted. Move only reinserts if the new box leaves the fat one.
+	  They keep the tight box too, the fat one only steers the walk and a leaf that straddles a plane gets its tight box tested before its accepted.
+	. Nodes live in one vector and are referenced by index with a free list, so no new/delete per node and its a lot friendlier to the cache than pointers.
+
+	Frustrum queries go down the tree with a plane mask. Once a node is completely inside a plane every child is too so that plane stops being tested, and once a node
+	is completely inside all 6 planes we accept its whole subtree without testing any children. Completely outside means we skip the whole subtree.
+	*/
+	class DynamicAABBTree
+	{
+	public:
+		static const int32_t NULL_NODE = -1;
+
+		struct Node
+		{
+			glm::vec3 min;
+			glm::vec3 max;
+			glm::vec3 tightmin; //leafs only, the objects real box
+			glm::vec3 tightmax;
+			int32_t parent; //doubles as the next free node when its in the free list
+			int32_t left;
+			int32_t right;
+			int32_t height; //leaf is 0, free node is -1
+			uint32_t slot; //the renderobjects slot/id for leafs
+
+			bool IsLeaf() const { return left == NULL_NODE; }
+		};
+
+	public:
+		DynamicAABBTree() : root(NULL_NODE), free_list(NULL_NODE), leaf_count(0) {}
+		~DynamicAABBTree() = default;
+
+		//returns the proxy (leaf node index) you hold onto to move or remove the object later
+		int32_t Insert(uint32_t slot, glm::vec3 min, glm::vec3 max)
+		{
+			int32_t leaf = AllocateNode();
+			Fatten(min, max, nodes[leaf].min, nodes[leaf].max);
+			nodes[leaf].tightmin = min;
+			nodes[leaf].tightmax = max;
+			nodes[leaf].slot = slot;
+			nodes[leaf].height = 0;
+
+			InsertLeaf(leaf);
+			leaf_count++;
+			return leaf;
+		}
+
+		void Remove(int32_t proxy)
+		{
+			RemoveLeaf(proxy);
+			FreeNode(proxy);
+			leaf_count--;
+		}
+
+		//refits the proxy if its tight box moved out of its fat box. Returns true if it got reinserted.
+		bool Move(int32_t proxy, glm::vec3 min, glm::vec3 max)
+		{
+			Node& node = nodes[proxy];
+			node.tightmin = min;
+			node.tightmax = max;
+			if (node.min.x <= min.x && node.min.y <= min.y && node.min.z <= min.z && node.max.x >= max.x && node.max.y >= max.y && node.max.z >= max.z)
+			{
+				//still inside but if it shrank a lot the fat box would just be wasting culling so refit it anyways
+				glm::vec3 fatmin, fatmax;
+				Fatten(min, max, fatmin, fatmax);
+				if (SurfaceArea(node.min, node.max) <= 4.0f * SurfaceArea(fatmin, fatmax))
+				{
+					return false;
+				}
+			}
+
+			RemoveLeaf(proxy);
+			Fatten(min, max, nodes[proxy].min, nodes[proxy].max);
+			InsertLeaf(proxy);
+			return true;
+		}
+
+		void Clear()
+		{
+			nodes.clear();
+			root = NULL_NODE;
+			free_list = NULL_NODE;
+			leaf_count = 0;
+		}
+
+		//writes the slot of every leaf touching the frustrum whose slotflags matches binmask into visible and returns the count.
+		//visible needs room for every leaf in the tree
+		uint32_t QueryFrustrum(const std::vector<Plane>& planes, const uint32_t* slotflags, uint32_t binmask, uint32_t* visible)
+		{
+			uint32_t count = 0;
+			if (root == NULL_NODE) return count;
+
+			const uint32_t ALL_PLANES = (1u << 6) - 1;
+			stack.clear();
+			stack.push_back({ root, ALL_PLANES });
+			while (!stack.empty())
+			{
+				StackEntry entry = stack.back();
+				stack.pop_back();
+				const Node& node = nodes[entry.node];
+
+				//test only the planes the parent was intersecting
+				uint32_t mask = entry.planemask;
+				bool outside = false;
+				for (int p = 0; p < 6; p++)
+				{
+					if ((mask & (1u << p)) == 0) continue;
+
+					INTERSECTION result = IntersectPlane(planes[p], node.min, node.max);
+					if (result == INTERSECTION::OUTSIDE) { outside = true; break; }
+					if (result == INTERSECTION::INSIDE) mask &= ~(1u << p);
+				}
+				if (outside) continue;
+
+				if (mask == 0)
+				{
+					count += GatherSubtree(entry.node, slotflags, binmask, visible + count);
+				}
+				else if (node.IsLeaf())
+				{
+					//the fat box straddles, the object itself can still be outside one of those planes
+					bool tightoutside = false;
+					for (int p = 0; p < 6 && !tightoutside; p++)
+					{
+						if (mask & (1u << p)) tightoutside = (IntersectPlane(planes[p], node.tightmin, node.tightmax) == INTERSECTION::OUTSIDE);
+					}
+					if (!tightoutside && (slotflags[node.slot] & binmask)) visible[count++] = node.slot;
+				}
+				else
+				{
+					stack.push_back({ node.left, mask });
+					stack.push_back({ node.right, mask });
+				}
+			}
+
+			return count;
+		}
+
+		//multi view version of QueryFrustrum so the camera, cascades and every shadow light get culled in one walk. Each node keeps which views still straddle it
+		//and which views it is already completely inside of, views that reject it drop out, and once no view straddles it the subtree gets those inside bits without more tests.
+		//viewmasks[slot] gets OR'd with a bit per view the leaf is visible in so clear it before calling.
+		void QueryFrustrumMulti(const std::vector<std::vector<Plane>>& views, const uint32_t* slotflags, uint32_t binmask, uint64_t* viewmasks)
+		{
+			if (root == NULL_NODE) return;
+
+			uint32_t viewcount = static_cast<uint32_t>(std::min<size_t>(views.size(), 64));
+			uint64_t allviews = (viewcount == 64) ? ~0ull : ((1ull << viewcount) - 1);
+
+			multi_stack.clear();
+			multi_stack.push_back({ root, allviews, 0 });
+			while (!multi_stack.empty())
+			{
+				MultiStackEntry entry = multi_stack.back();
+				multi_stack.pop_back();
+				const Node& node = nodes[entry.node];
+
+				uint64_t testing = entry.testing;
+				uint64_t inside = entry.inside;
+				for (uint32_t v = 0; v < viewcount; v++)
+				{
+					uint64_t bit = 1ull << v;
+					if ((testing & bit) == 0) continue;
+
+					INTERSECTION result = IntersectFrustrum(views[v], node.min, node.max);
+					if (result == INTERSECTION::OUTSIDE) testing &= ~bit;
+					else if (result == INTERSECTION::INSIDE) { testing &= ~bit; inside |= bit; }
+				}
+				if ((testing | inside) == 0) continue;
+
+				if (testing == 0)
+				{
+					GatherSubtreeMulti(entry.node, inside, slotflags, binmask, viewmasks);
+				}
+				else if (node.IsLeaf())
+				{
+					//views that straddle the fat box get the tight one, the views it's inside of already contain the tight box too
+					if ((slotflags[node.slot] & binmask) == 0) continue;
+					for (uint32_t v = 0; v < viewcount; v++)
+					{
+						uint64_t bit = 1ull << v;
+						if ((testing & bit) && IntersectFrustrum(views[v], node.tightmin, node.tightmax) == INTERSECTION::OUTSIDE) testing &= ~bit;
+					}
+					viewmasks[node.slot] |= (testing | inside);
+				}
+				else
+				{
+					multi_stack.push_back({ node.left, testing, inside });
+					multi_stack.push_back({ node.right, testing, inside });
+				}
+			}
+		}
+
+		uint32_t GetLeafCount() const { return leaf_count; }
+		int32_t GetHeight() const { return (root == NULL_NODE) ? 0 : nodes[root].height; }
+
+	private:
+		struct StackEntry
+		{
+			int32_t node;
+			uint32_t planemask;
+		};
+
+		struct MultiStackEntry
+		{
+			int32_t node;
+			uint64_t testing; //views that straddle the parent
+			uint64_t inside; //views that completely contain the parent
+		};
+
+		void GatherSubtreeMulti(int32_t start, uint64_t views, const uint32_t* slotflags, uint32_t binmask, uint64_t* viewmasks)
+		{
+			gather_stack.clear();
+			gather_stack.push_back(start);
+			while (!gather_stack.empty())
+			{
+				const Node& node = nodes[gather_stack.back()];
+				gather_stack.pop_back();
+
+				if (node.IsLeaf())
+				{
+					if (slotflags[node.slot] & binmask) viewmasks[node.slot] |= views;
+				}
+				else
+				{
+					gather_stack.push_back(node.left);
+					gather_stack.push_back(node.right);
+				}
+			}
+		}
+
+		static INTERSECTION IntersectFrustrum(const std::vector<Plane>& planes, const glm::vec3& min, const glm::vec3& max)
+		{
+			INTERSECTION result = INTERSECTION::INSIDE;
+			for (int p = 0; p < 6; p++)
+			{
+				INTERSECTION planeresult = IntersectPlane(planes[p], min, max);
+				if (planeresult == INTERSECTION::OUTSIDE) return INTERSECTION::OUTSIDE;
+				if (planeresult == INTERSECTION::INTERSECTING) result = INTERSECTION::INTERSECTING;
+			}
+			return result;
+		}
+
+		//node is completely inside the frustrum so just add every leaf under it, no plane tests
+		uint32_t GatherSubtree(int32_t start, const uint32_t* slotflags, uint32_t binmask, uint32_t* visible)
+		{
+			uint32_t count = 0;
+			gather_stack.clear();
+			gather_stack.push_back(start);
+			while (!gather_stack.empty())
+			{
+				const Node& node = nodes[gather_stack.back()];
+				gather_stack.pop_back();
+
+				if (node.IsLeaf())
+				{
+					if (slotflags[node.slot] & binmask) visible[count++] = node.slot;
+				}
+				else
+				{
+					gather_stack.push_back(node.left);
+					gather_stack.push_back(node.right);
+				}
+			}
+
+			return count;
+		}
+
+		//positive vertex behind the plane is outside, negative vertex in front is completely inside, else its straddling
+		static INTERSECTION IntersectPlane(const Plane& plane, const glm::vec3& min, const glm::vec3& max)
+		{
+			glm::vec3 positive((plane.a >= 0) ? max.x : min.x, (plane.b >= 0) ? max.y : min.y, (plane.c >= 0) ? max.z : min.z);
+			glm::vec3 negative((plane.a >= 0) ? min.x : max.x, (plane.b >= 0) ? min.y : max.y, (plane.c >= 0) ? min.z : max.z);
+
+			if (plane.a * positive.x + plane.b * positive.y + plane.c * positive.z + plane.d < 0) return INTERSECTION::OUTSIDE;
+			if (plane.a * negative.x + plane.b * negative.y + plane.c * negative.z + plane.d >= 0) return INTERSECTION::INSIDE;
+			return INTERSECTION::INTERSECTING;
+		}
+
+		static float SurfaceArea(const glm::vec3& min, const glm::vec3& max)
+		{
+			glm::vec3 d = max - min;
+			return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+
+		static void Fatten(const glm::vec3& min, const glm::vec3& max, glm::vec3& fatmin, glm::vec3& fatmax)
+		{
+			glm::vec3 margin = (max - min) * FAT_FACTOR + glm::vec3(FAT_MARGIN);
+			fatmin = min - margin;
+			fatmax = max + margin;
+		}
+
+		int32_t AllocateNode()
+		{
+			int32_t index;
+			if (free_list == NULL_NODE)
+			{
+				index = static_cast<int32_t>(nodes.size());
+				nodes.emplace_back();
+			}
+			else
+			{
+				index = free_list;
+				free_list = nodes[index].parent;
+			}
+
+			Node& node = nodes[index];
+			node.parent = NULL_NODE;
+			node.left = NULL_NODE;
+			node.right = NULL_NODE;
+			node.height = 0;
+			node.slot = 0;
+			return index;
+		}
+
+		void FreeNode(int32_t index)
+		{
+			nodes[index].parent = free_list;
+			nodes[index].height = -1;
+			free_list = index;
+		}
+
+		void InsertLeaf(int32_t leaf)
+		{
+			if (root == NULL_NODE)
+			{
+				root = leaf;
+				nodes[root].parent = NULL_NODE;
+				return;
+			}
+
+			//find the best sibling. cost of making a new parent here vs pushing the leaf further down one of the children
+			glm::vec3 leafmin = nodes[leaf].min;
+			glm::vec3 leafmax = nodes[leaf].max;
+			int32_t index = root;
+			while (!nodes[index].IsLeaf())
+			{
+				const Node& node = nodes[index];
+				float area = SurfaceArea(node.min, node.max);
+				float combinedarea = SurfaceArea(glm::min(node.min, leafmin), glm::max(node.max, leafmax));
+
+				float cost = 2.0f * combinedarea;
+				float inheritancecost = 2.0f * (combinedarea - area);
+
+				float costleft = ChildCost(node.left, leafmin, leafmax) + inheritancecost;
+				float costright = ChildCost(node.right, leafmin, leafmax) + inheritancecost;
+
+				if (cost < costleft && cost < costright) break;
+
+				index = (costleft < costright) ? node.left : node.right;
+			}
+
+			int32_t sibling = index;
+			int32_t oldparent = nodes[sibling].parent;
+			int32_t newparent = AllocateNode(); //can reallocate nodes so no references held across this
+			nodes[newparent].parent = oldparent;
+			nodes[newparent].min = glm::min(leafmin, nodes[sibling].min);
+			nodes[newparent].max = glm::max(leafmax, nodes[sibling].max);
+			nodes[newparent].height = nodes[sibling].height + 1;
+
+			if (oldparent != NULL_NODE)
+			{
+				if (nodes[oldparent].left == sibling) nodes[oldparent].left = newparent;
+				else nodes[oldparent].right = newparent;
+			}
+			else
+			{
+				root = newparent;
+			}
+			nodes[newparent].left = sibling;
+			nodes[newparent].right = leaf;
+			nodes[sibling].parent = newparent;
+			nodes[leaf].parent = newparent;
+
+			Refit(nodes[leaf].parent);
+		}
+
+		float ChildCost(int32_t child, const glm::vec3& leafmin, const glm::vec3& leafmax) const
+		{
+			const Node& node = nodes[child];
+			float area = SurfaceArea(glm::min(node.min, leafmin), glm::max(node.max, leafmax));
+			if (node.IsLeaf()) return area;
+			return area - SurfaceArea(node.min, node.max);
+		}
+
+		void RemoveLeaf(int32_t leaf)
+		{
+			if (leaf == root)
+			{
+				root = NULL_NODE;
+				return;
+			}
+
+			int32_t parent = nodes[leaf].parent;
+			int32_t grandparent = nodes[parent].parent;
+			int32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+			if (grandparent != NULL_NODE)
+			{
+				if (nodes[grandparent].left == parent) nodes[grandparent].left = sibling;
+				else nodes[grandparent].right = sibling;
+				nodes[sibling].parent = grandparent;
+				FreeNode(parent);
+
+				Refit(grandparent);
+			}
+			else
+			{
+				root = sibling;
+				nodes[sibling].parent = NULL_NODE;
+				FreeNode(parent);
+			}
+		}
+
+		//walk up to the root balancing and recalculating boxes/heights
+		void Refit(int32_t index)
+		{
+			while (index != NULL_NODE)
+			{
+				index = Balance(index);
+
+				Node& node = nodes[index];
+				const Node& left = nodes[node.left];
+				const Node& right = nodes[node.right];
+				node.height = 1 + std::max(left.height, right.height);
+				node.min = glm::min(left.min, right.min);
+				node.max = glm::max(left.max, right.max);
+
+				index = node.parent;
+			}
+		}
+
+		//if one side is more than 1 level taller rotate its taller child up into a's spot. Returns the index of the node now sitting where a was.
+		int32_t Balance(int32_t a)
+		{
+			if (nodes[a].IsLeaf() || nodes[a].height < 2)
+			{
+				return a;
+			}
+
+			int32_t b = nodes[a].left;
+			int32_t c = nodes[a].right;
+			int32_t balance = nodes[c].height - nodes[b].height;
+
+			if (balance > 1) return Rotate(a, c, b);
+			if (balance < -1) return Rotate(a, b, c);
+			return a;
+		}
+
+		//up is the taller child of a and other is the other child. up takes a's place and a takes up's shorter child.
+		int32_t Rotate(int32_t a, int32_t up, int32_t other)
+		{
+			int32_t f = nodes[up].left;
+			int32_t g = nodes[up].right;
+
+			//swap a and up
+			nodes[up].left = a;
+			nodes[up].parent = nodes[a].parent;
+			nodes[a].parent = up;
+
+			if (nodes[up].parent != NULL_NODE)
+			{
+				if (nodes[nodes[up].parent].left == a) nodes[nodes[up].parent].left = up;
+				else nodes[nodes[up].parent].right = up;
+			}
+			else
+			{
+				root = up;
+			}
+
+			//the taller grandchild stays under up, the shorter one goes to a in up's old spot
+			int32_t keep = (nodes[f].height > nodes[g].height) ? f : g;
+			int32_t give = (keep == f) ? g : f;
+
+			nodes[up].right = keep;
+			if (nodes[a].left == up) nodes[a].left = give;
+			else nodes[a].right = give;
+			nodes[give].parent = a;
+
+			nodes[a].min = glm::min(nodes[other].min, nodes[give].min);
+			nodes[a].max = glm::max(nodes[other].max, nodes[give].max);
+			nodes[a].height = 1 + std::max(nodes[other].height, nodes[give].height);
+
+			nodes[up].min = glm::min(nodes[a].min, nodes[keep].min);
+			nodes[up].max = glm::max(nodes[a].max, nodes[keep].max);
+			nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+
+			return up;
+		}
+
+	private:
+		static constexpr float FAT_FACTOR = 0.1f; //fraction of the box size added to each side of a leaf
+		static constexpr float FAT_MARGIN = 0.05f;
+
+		std::vector<Node> nodes;
+		int32_t root;
+		int32_t free_list;
+		uint32_t leaf_count;
+
+		std::vector<StackEntry> stack; //kept around so queries don't allocate every frame
+		std::vector<int32_t> gather_stack;
+		std::vector<MultiStackEntry> multi_stack;
+	};
+
+}
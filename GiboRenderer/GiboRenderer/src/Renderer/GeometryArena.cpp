@@ -0,0 +1,255 @@
+#include "../pch.h"
+#include "GeometryArena.h"
+#include <algorithm>
+
+namespace Gibo {
+
+	void OffsetAllocator::Init(uint32_t totalsize)
+	{
+		free_ranges.clear();
+		size = totalsize;
+		free_bytes = totalsize;
+		if (totalsize > 0) free_ranges[0] = totalsize;
+	}
+
+	uint32_t OffsetAllocator::Allocate(uint32_t allocsize, uint32_t alignment)
+	{
+		alignment = std::max(alignment, 1u);
+		for (auto range = free_ranges.begin(); range != free_ranges.end(); range++)
+		{
+			uint64_t rangestart = range->first;
+			uint64_t rangeend = rangestart + range->second;
+			uint64_t start = ((rangestart + alignment - 1) / alignment) * alignment;
+			if (start + allocsize > rangeend) continue;
+
+			free_ranges.erase(range);
+			if (start > rangestart) free_ranges[static_cast<uint32_t>(rangestart)] = static_cast<uint32_t>(start - rangestart);
+			if (start + allocsize < rangeend) free_ranges[static_cast<uint32_t>(start + allocsize)] = static_cast<uint32_t>(rangeend - start - allocsize);
+			free_bytes -= allocsize;
+			return static_cast<uint32_t>(start);
+		}
+		return INVALID_OFFSET;
+	}
+
+	bool OffsetAllocator::AllocateAt(uint32_t offset, uint32_t allocsize)
+	{
+		//the free range starting at or before offset is the only one that can hold it
+		auto range = free_ranges.upper_bound(offset);
+		if (range == free_ranges.begin()) return false;
+		range--;
+
+		uint64_t rangestart = range->first;
+		uint64_t rangeend = rangestart + range->second;
+		if (uint64_t(offset) + allocsize > rangeend) return false;
+
+		free_ranges.erase(range);
+		if (offset > rangestart) free_ranges[static_cast<uint32_t>(rangestart)] = static_cast<uint32_t>(offset - rangestart);
+		if (offset + allocsize < rangeend) free_ranges[offset + allocsize] = static_cast<uint32_t>(rangeend - offset - allocsize);
+		free_bytes -= allocsize;
+		return true;
+	}
+
+	void OffsetAllocator::Free(uint32_t offset, uint32_t allocsize)
+	{
+		free_bytes += allocsize;
+		auto next = free_ranges.lower_bound(offset);
+
+		//merge into the range right before if it ends where this starts
+		if (next != free_ranges.begin())
+		{
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset)
+			{
+				offset = prev->first;
+				allocsize += prev->second;
+				free_ranges.erase(prev);
+			}
+		}
+		//and swallow the one right after
+		if (next != free_ranges.end() && offset + allocsize == next->first)
+		{
+			allocsize += next->second;
+			free_ranges.erase(next);
+		}
+		free_ranges[offset] = allocsize;
+	}
+
+	uint32_t OffsetAllocator::GetLargestFree() const
+	{
+		uint32_t largest = 0;
+		for (auto& range : free_ranges) largest = std::max(largest, range.second);
+		return largest;
+	}
+
+	VkBufferUsageFlags GeometryArena::PoolUsage(POOL pool)
+	{
+		//transfer src so Defragment can copy out of old blocks
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		return usage | ((pool == POOL_VERTEX) ? VK_BUFFER_USAGE_VERTEX_BUFFER_BIT : VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	}
+
+	bool GeometryArena::CreateBlock(POOL pool, VkDeviceSize size, Block& block)
+	{
+		if (!deviceref.CreateBuffer(size, PoolUsage(pool), VMA_MEMORY_USAGE_GPU_ONLY, 0, block.buffer))
+		{
+			Logger::LogError("geometry arena couldn't create a ", size, " byte block\n");
+			return false;
+		}
+		block.allocator.Init(static_cast<uint32_t>(size));
+		return true;
+	}
+
+	GeometryArena::Handle GeometryArena::Allocate(POOL pool, uint32_t size, uint32_t alignment)
+	{
+		std::vector<Block>& poolblocks = blocks[pool];
+		uint32_t block = 0;
+		uint32_t offset = OffsetAllocator::INVALID_OFFSET;
+		for (; block < poolblocks.size(); block++)
+		{
+			offset = poolblocks[block].allocator.Allocate(size, alignment);
+			if (offset != OffsetAllocator::INVALID_OFFSET) break;
+		}
+
+		//nothing fits, add a block. A mesh bigger than BLOCK_SIZE gets one of its own
+		if (offset == OffsetAllocator::INVALID_OFFSET)
+		{
+			Block newblock;
+			if (!CreateBlock(pool, std::max(BLOCK_SIZE, VkDeviceSize(size)), newblock)) return INVALID_HANDLE;
+			poolblocks.push_back(newblock);
+			block = static_cast<uint32_t>(poolblocks.size() - 1);
+			offset = poolblocks[block].allocator.Allocate(size, alignment);
+		}
+
+		Handle handle;
+		if (!free_handles.empty())
+		{
+			handle = free_handles.back();
+			free_handles.pop_back();
+		}
+		else
+		{
+			handle = static_cast<Handle>(ranges.size());
+			ranges.emplace_back();
+		}
+		ranges[handle] = Range{ static_cast<uint32_t>(pool), block, offset, size, alignment, true };
+		return handle;
+	}
+
+	void GeometryArena::Free(Handle handle)
+	{
+		if (handle == INVALID_HANDLE || !ranges[handle].live) return;
+
+		Range& range = ranges[handle];
+		blocks[range.pool][range.block].allocator.Free(range.offset, range.size);
+		range.live = false;
+		free_handles.push_back(handle);
+	}
+
+	bool GeometryArena::Defragment()
+	{
+		bool moved = false;
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		std::vector<vkcoreBuffer> retired;
+
+		for (uint32_t pool = 0; pool < POOL_COUNT; pool++)
+		{
+			for (uint32_t b = 0; b < blocks[pool].size(); b++)
+			{
+				Block& block = blocks[pool][b];
+
+				//live ranges of this block in offset order, packed from 0 keeping their alignment
+				std::vector<Handle> live;
+				for (Handle h = 0; h < ranges.size(); h++)
+				{
+					if (ranges[h].live && ranges[h].pool == pool && ranges[h].block == b) live.push_back(h);
+				}
+				std::sort(live.begin(), live.end(), [this](Handle x, Handle y) { return ranges[x].offset < ranges[y].offset; });
+
+				std::vector<uint32_t> packed(live.size());
+				uint64_t cursor = 0;
+				bool blockmoved = false;
+				for (size_t i = 0; i < live.size(); i++)
+				{
+					const Range& range = ranges[live[i]];
+					cursor = ((cursor + range.alignment - 1) / range.alignment) * range.alignment;
+					packed[i] = static_cast<uint32_t>(cursor);
+					blockmoved |= (packed[i] != range.offset);
+					cursor += range.size;
+				}
+				if (!blockmoved) continue;
+
+				//copying within one buffer can't overlap, so everything goes over into a new buffer of the same size
+				Block newblock;
+				if (!CreateBlock(static_cast<POOL>(pool), block.allocator.GetSize(), newblock)) continue;
+
+				std::vector<VkBufferCopy> copies(live.size());
+				for (size_t i = 0; i < live.size(); i++)
+				{
+					copies[i].srcOffset = ranges[live[i]].offset;
+					copies[i].dstOffset = packed[i];
+					copies[i].size = ranges[live[i]].size;
+					ranges[live[i]].offset = packed[i];
+				}
+				if (cmd == VK_NULL_HANDLE) cmd = deviceref.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+				if (!copies.empty()) vkCmdCopyBuffer(cmd, block.buffer.buffer, newblock.buffer.buffer, static_cast<uint32_t>(copies.size()), copies.data());
+
+				//every range takes its own bytes so the alignment padding between them stays free and merges back when they're freed
+				for (size_t i = 0; i < live.size(); i++)
+				{
+					newblock.allocator.AllocateAt(packed[i], ranges[live[i]].size);
+				}
+				retired.push_back(block.buffer);
+				block = newblock;
+				moved = true;
+			}
+		}
+
+		if (cmd != VK_NULL_HANDLE)
+		{
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+			deviceref.submitSingleTimeCommands(cmd, POOL_FAMILY::TRANSFER);
+		}
+		for (vkcoreBuffer& buffer : retired)
+		{
+			deviceref.DestroyBuffer(buffer);
+		}
+		return moved;
+	}
+
+	void GeometryArena::CleanUp()
+	{
+		for (uint32_t pool = 0; pool < POOL_COUNT; pool++)
+		{
+			for (Block& block : blocks[pool])
+			{
+				deviceref.DestroyBuffer(block.buffer);
+			}
+			blocks[pool].clear();
+		}
+		ranges.clear();
+		free_handles.clear();
+	}
+
+	void GeometryArena::PrintMemory() const
+	{
+		const char* names[POOL_COUNT] = { "vertex", "index" };
+		for (uint32_t pool = 0; pool < POOL_COUNT; pool++)
+		{
+			uint64_t size = 0;
+			uint64_t free = 0;
+			uint32_t largest = 0;
+			for (const Block& block : blocks[pool])
+			{
+				size += block.allocator.GetSize();
+				free += block.allocator.GetFree();
+				largest = std::max(largest, block.allocator.GetLargestFree());
+			}
+			Logger::Log("Geometry arena ", names[pool], ": ", blocks[pool].size(), " blocks, ", size - free, "/", size, " bytes used, largest free range ", largest, "\n");
+		}
+	}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "vkcore/vkcoreDevice.h"
+#include <map>
+
+namespace Gibo {
+
+	/*
+	 First fit allocator over a range of bytes. Free ranges are kept sorted by offset so a free merges with both neighbours in log n. It's only bookkeeping and never
+	 touches memory, so it works for any buffer.
+	*/
+	class OffsetAllocator
+	{
+	public:
+		static const uint32_t INVALID_OFFSET = UINT32_MAX;
+
+		void Init(uint32_t totalsize);
+		//the start gets rounded up to a multiple of alignment (any value, not just powers of 2), the padding in front stays free
+		uint32_t Allocate(uint32_t allocsize, uint32_t alignment);
+		//takes exactly [offset, offset + allocsize), false if any of it isn't free
+		bool AllocateAt(uint32_t offset, uint32_t allocsize);
+		void Free(uint32_t offset, uint32_t allocsize);
+
+		uint32_t GetSize() const { return size; }
+		uint32_t GetFree() const { return free_bytes; }
+		uint32_t GetLargestFree() const;
+	private:
+		std::map<uint32_t, uint32_t> free_ranges; //offset -> size
+		uint32_t size = 0;
+		uint32_t free_bytes = 0;
+	};
+
+	/*
+	 Geometry arena. Every mesh in the MeshCache gets suballocated out of a few big gpu buffers instead of getting its own vbo/ibo: one pool of vertex buffers holds the
+	 interleaved streams of every vertex format and the position streams, one pool of index buffers holds the 16 and 32 bit indices. Pools grow a BLOCK_SIZE buffer
+	 at a time (or one that fits, for a mesh bigger than that) and existing allocations never move when they do.
+
+	 A vertex allocation is aligned to its own stride, so its byte offset / stride is a whole vertex offset for vkCmdDrawIndexed and all the vertex formats can share
+	 one buffer. Index allocations are aligned to the index size, byte offset / index size is the first index. So drawing a mesh is binding its pools buffers (which
+	 the previous mesh almost always already did) and passing vertex_offset/first_index with the draw.
+
+	 Handles stay valid until freed. Defragment slides every live allocation of a block to the front through a fresh buffer, which changes buffers and offsets, so
+	 whatever copied them (every MeshCache::Mesh) has to be set again after it. It has to run with the device idle.
+	*/
+	class GeometryArena
+	{
+	public:
+		enum POOL : uint32_t { POOL_VERTEX = 0, POOL_INDEX = 1, POOL_COUNT };
+		static constexpr VkDeviceSize BLOCK_SIZE = 32 * 1024 * 1024;
+
+		typedef uint32_t Handle;
+		static const Handle INVALID_HANDLE = UINT32_MAX;
+
+		GeometryArena(vkcoreDevice& device) : deviceref(device) {};
+		~GeometryArena() = default;
+
+		//no copying/moving should be allowed from this class
+		GeometryArena(GeometryArena const&) = delete;
+		GeometryArena(GeometryArena&&) = delete;
+		GeometryArena& operator=(GeometryArena const&) = delete;
+		GeometryArena& operator=(GeometryArena&&) = delete;
+
+		Handle Allocate(POOL pool, uint32_t size, uint32_t alignment);
+		void Free(Handle handle);
+		//an invalid handle (a failed Allocate) reads as an empty range in no buffer
+		VkBuffer GetBuffer(Handle handle) const { return (handle == INVALID_HANDLE) ? VK_NULL_HANDLE : blocks[ranges[handle].pool][ranges[handle].block].buffer.buffer; }
+		uint32_t GetOffset(Handle handle) const { return (handle == INVALID_HANDLE) ? 0 : ranges[handle].offset; } //in bytes
+		uint32_t GetSize(Handle handle) const { return (handle == INVALID_HANDLE) ? 0 : ranges[handle].size; }
+
+		//returns true if anything moved
+		bool Defragment();
+		void CleanUp();
+		void PrintMemory() const;
+	private:
+		struct Block
+		{
+			vkcoreBuffer buffer;
+			OffsetAllocator allocator;
+		};
+
+		struct Range
+		{
+			uint32_t pool;
+			uint32_t block;
+			uint32_t offset;
+			uint32_t size;
+			uint32_t alignment;
+			bool live;
+		};
+
+		bool CreateBlock(POOL pool, VkDeviceSize size, Block& block);
+		static VkBufferUsageFlags PoolUsage(POOL pool);
+
+	private:
+		vkcoreDevice& deviceref;
+		std::vector<Block> blocks[POOL_COUNT];
+		std::vector<Range> ranges; //indexed by handle
+		std::vector<Handle> free_handles;
+	};
+
+}
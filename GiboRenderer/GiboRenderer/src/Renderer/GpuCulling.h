@@ -0,0 +1,341 @@
+#pragma once
+#include "Instancing.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+namespace Gibo {
+	/*
+	GPU driven culling. Instead of culling, sorting and batching on the cpu, every opaque object gets one draw record in a storage buffer and GpuCull.comp tests
+	all of them against the camera and every cascade, picks their lod and appends a VkDrawIndexedIndirectCommand for each survivor. The passes then draw with
+	vkCmdDrawIndexedIndirectCount, so the cpu cost per frame is copying matrices and bounds, not touching the visible lists at all.
+
+	Records only change when objects get added or removed. Record i draws with instance i, so its model matrix is at instances.model[i] and the vertex shaders
+	don't change at all. Bounds are per record too and get rewritten every frame next to the matrices.
+
+	One indirect draw can't switch buffers, pipelines or descriptors, so records are grouped into buckets: everything in a bucket has the same arena buffers, index
+	type and vertex format (and decode constants, which only differ between quantized meshes), and for the pbr pass the same material template unless textures are
+	bindless (BindlessTextures.h), then every instance reads its own material and the full stream buckets just split by mesh buffers too. Each bucket owns
+	capacity command slots starting at first, the shader appends into them with an atomic counter per bucket per pass, and a pass draws every bucket with
+	maxDrawCount capacity and the counter as the count. The depth/shadow passes draw the position stream and the pbr pass the full one, the mesh offsets and buckets
+	differ between the two so records and meshes keep both (indexed by GPU_CULL_STREAM_*).
+
+	Pass p writes its commands at p * command_stride and its counters at p * bucket_stride. Commands inside a bucket come out in whatever order the atomics hand
+	out, so GpuCullReference (the same compaction done on the cpu in record order) can only be compared with CompareGpuCull, which sorts each bucket first. Tests/GpuCullTests.cpp runs both on a hand built scene without a device.
+
+	Meshlet culling stays on the cpu path, the gpu path always draws whole lods.
+
+	Occlusion culling runs it in two phases. The early phase draws what was visible to the camera last frame (the visibility buffer, one uint per record) into the
+	depth pass, a hi-z pyramid gets built out of that depth, and the late phase tests every record against the camera and the pyramid, writes the new visibility and
+	appends the ones the early phase didn't draw to the late depth pass and the pbr pass. Shadow passes don't have a pyramid so they always take everything in the
+	frustum. What the camera passes draw depends on last frames visibility so the reference leaves those out when occlusion is on.
+	*/
+	static const uint32_t GPU_CULL_STREAM_POSITION = 0;
+	static const uint32_t GPU_CULL_STREAM_FULL = 1;
+	static const uint32_t GPU_CULL_MAX_PASSES = 8; //MAX_PASSES in GpuCull.comp
+	static const uint32_t GPU_CULL_GROUP_SIZE = 64; //local_size_x in GpuCull.comp
+
+	//world space bounds of a record, same test as the cpu kernels so both paths cull the same objects
+	struct GpuCullBounds
+	{
+		float center[3];
+		float radius;
+		float min[3];
+		float pad0;
+		float max[3];
+		float pad1;
+	};
+
+	struct GpuCullLod
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+		float error;
+		uint32_t pad;
+	};
+
+	//lod ranges are relative to the mesh, first_index/vertex_offset are where it starts in the arena for each stream
+	struct GpuMeshRecord
+	{
+		uint32_t lod_count;
+		uint32_t pad0;
+		int32_t vertex_offset[2];
+		uint32_t first_index[2];
+		uint32_t pad1[2];
+		GpuCullLod lods[MAX_MESH_LODS];
+	};
+
+	struct GpuDrawRecord
+	{
+		uint32_t mesh;
+		uint32_t pad0;
+		uint32_t bucket[2];
+		uint32_t first[2]; //command slot its buckets range starts at
+		uint32_t pad1[2];
+	};
+
+	//std140 array in the shader. lod is pixels_per_unit, perspective, max_pixel_error, info.x the stream, info.y 1 for camera passes occlusion culling applies to
+	struct GpuCullPass
+	{
+		glm::vec4 planes[6];
+		glm::vec4 lod;
+		glm::uvec4 info;
+	};
+
+	static const uint32_t GPU_CULL_PHASE_EARLY = 0;
+	static const uint32_t GPU_CULL_PHASE_LATE = 1;
+
+	//push constants
+	struct GpuCullParams
+	{
+		uint32_t draw_count;
+		uint32_t pass_count;
+		uint32_t bucket_stride;
+		uint32_t command_stride;
+
+		uint32_t phase;
+		uint32_t occlusion;
+		uint32_t late_pass; //the late phase appends to this depth pass and pbr_pass
+		uint32_t pbr_pass;
+
+		glm::mat4 viewproj; //camera with the y flip of the vertex shaders
+		glm::vec4 hiz_info; //depth width, height, pyramid levels
+	};
+
+	struct GpuDrawBucket
+	{
+		RenderObject* object; //its buffers, pipeline, decode and descriptor get bound for the whole bucket
+		uint32_t first;
+		uint32_t capacity;
+	};
+
+	struct GpuDrawList
+	{
+		std::vector<RenderObject*> objects; //objects[i] is record i and instance i
+		std::vector<GpuDrawRecord> records;
+		std::vector<GpuMeshRecord> meshes;
+		std::vector<GpuDrawBucket> buckets[2];
+
+		uint32_t BucketStride() const { return static_cast<uint32_t>(std::max(buckets[0].size(), buckets[1].size())); }
+	};
+
+	inline GpuCullPass MakeGpuCullPass(const std::vector<Plane>& planes, const LodSelectInfo& lod, uint32_t stream, bool camera)
+	{
+		GpuCullPass pass;
+		for (int p = 0; p < 6; p++) pass.planes[p] = glm::vec4(planes[p].a, planes[p].b, planes[p].c, planes[p].d);
+		pass.lod = glm::vec4(lod.pixels_per_unit, (lod.perspective) ? 1.0f : 0.0f, lod.max_pixel_error, 0.0f);
+		pass.info = glm::uvec4(stream, (camera) ? 1 : 0, 0, 0);
+		return pass;
+	}
+
+	inline GpuCullBounds MakeGpuCullBounds(const CullingBounds& bounds, uint32_t slot)
+	{
+		GpuCullBounds b;
+		b.center[0] = bounds.center_x[slot]; b.center[1] = bounds.center_y[slot]; b.center[2] = bounds.center_z[slot]; b.radius = bounds.radius[slot];
+		b.min[0] = bounds.min_x[slot]; b.min[1] = bounds.min_y[slot]; b.min[2] = bounds.min_z[slot]; b.pad0 = 0.0f;
+		b.max[0] = bounds.max_x[slot]; b.max[1] = bounds.max_y[slot]; b.max[2] = bounds.max_z[slot]; b.pad1 = 0.0f;
+		return b;
+	}
+
+	//sphere then aabb positive vertex, like FrustrumIntersection
+	inline bool GpuCullVisible(const GpuCullBounds& b, const GpuCullPass& pass)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = pass.planes[p];
+			if (plane.x * b.center[0] + plane.y * b.center[1] + plane.z * b.center[2] + plane.w < -b.radius) return false;
+
+			float px = (plane.x >= 0.0f) ? b.max[0] : b.min[0];
+			float py = (plane.y >= 0.0f) ? b.max[1] : b.min[1];
+			float pz = (plane.z >= 0.0f) ? b.max[2] : b.min[2];
+			if (plane.x * px + plane.y * py + plane.z * pz + plane.w < 0.0f) return false;
+		}
+		return true;
+	}
+
+	//SelectLod with the near plane depth of ViewDepth
+	inline uint32_t GpuCullSelectLod(const GpuMeshRecord& mesh, const GpuCullBounds& b, const GpuCullPass& pass)
+	{
+		if (pass.lod.x <= 0.0f) return 0;
+		const glm::vec4& nearplane = pass.planes[4];
+		float depth = std::max(nearplane.x * b.center[0] + nearplane.y * b.center[1] + nearplane.z * b.center[2] + nearplane.w, 0.0f);
+		float pixels = b.radius * pass.lod.x;
+		if (pass.lod.y != 0.0f) pixels /= std::max(depth, b.radius);
+
+		uint32_t lod = 0;
+		while (lod + 1 < mesh.lod_count && mesh.lods[lod + 1].error * pixels <= pass.lod.z) lod++;
+		return lod;
+	}
+
+	//everything a bucket has to share. decode constants only differ between quantized meshes so those split by mesh, the material only matters for the full stream
+	//and only when the pass binds it per bucket
+	struct GpuBucketKey
+	{
+		VkBuffer vbo;
+		VkBuffer ibo;
+		VkIndexType index_type;
+		VERTEX_FORMAT format;
+		uint32_t mesh;
+		uint64_t material; //template key, only hashed
+		const Material* template_material; //nullptr when the bucket doesn't care, else a key match still has to be the same template
+
+		bool operator==(const GpuBucketKey& other) const
+		{
+			return vbo == other.vbo && ibo == other.ibo && index_type == other.index_type && format == other.format && mesh == other.mesh && material == other.material &&
+				   (template_material == other.template_material || (template_material && other.template_material && template_material->SameTemplate(*other.template_material)));
+		}
+	};
+
+	struct GpuBucketKeyHash
+	{
+		size_t operator()(const GpuBucketKey& key) const
+		{
+			size_t hash = std::hash<VkBuffer>()(key.vbo);
+			hash = hash * 31 + std::hash<VkBuffer>()(key.ibo);
+			hash = hash * 31 + static_cast<size_t>(key.index_type);
+			hash = hash * 31 + static_cast<size_t>(key.format);
+			hash = hash * 31 + key.mesh;
+			hash = hash * 31 + std::hash<uint64_t>()(key.material);
+			return hash;
+		}
+	};
+
+	inline GpuBucketKey MakeGpuBucketKey(RenderObject* object, uint32_t stream, bool bymaterial)
+	{
+		const MeshCache::Mesh& mesh = object->GetMesh();
+		bool full = (stream == GPU_CULL_STREAM_FULL);
+		GpuBucketKey key;
+		key.vbo = (full) ? mesh.vbo : mesh.position_vbo;
+		key.ibo = (full) ? mesh.ibo : mesh.position_ibo;
+		key.index_type = mesh.index_type;
+		key.format = mesh.vertex_format;
+		key.mesh = (mesh.vertex_format == VERTEX_FORMAT::QUANTIZED) ? mesh.mesh_id : UINT32_MAX;
+		key.material = (full && bymaterial) ? object->GetMaterial().GetTemplateKey() : 0;
+		key.template_material = (full && bymaterial) ? &object->GetMaterial() : nullptr;
+		return key;
+	}
+
+	//builds the records, meshes and buckets for every object with a mesh. list gets cleared first, bymaterial splits the full stream buckets by material template
+	inline void BuildGpuDrawList(const std::vector<RenderObject*>& objects, GpuDrawList& list, bool bymaterial)
+	{
+		list.objects.clear();
+		list.records.clear();
+		list.meshes.clear();
+		list.buckets[0].clear();
+		list.buckets[1].clear();
+
+		std::unordered_map<uint32_t, uint32_t> meshes;
+		std::unordered_map<GpuBucketKey, uint32_t, GpuBucketKeyHash> buckets[2];
+		for (RenderObject* object : objects)
+		{
+			const MeshCache::Mesh& mesh = object->GetMesh();
+			if (mesh.index_size == 0) continue;
+
+			auto found = meshes.find(mesh.mesh_id);
+			if (found == meshes.end())
+			{
+				GpuMeshRecord record = {};
+				record.lod_count = mesh.lod_count;
+				record.vertex_offset[GPU_CULL_STREAM_POSITION] = mesh.position_vertex_offset;
+				record.vertex_offset[GPU_CULL_STREAM_FULL] = mesh.vertex_offset;
+				record.first_index[GPU_CULL_STREAM_POSITION] = mesh.position_first_index;
+				record.first_index[GPU_CULL_STREAM_FULL] = mesh.first_index;
+				for (uint32_t l = 0; l < mesh.lod_count; l++)
+				{
+					record.lods[l] = GpuCullLod{ mesh.lods[l].first_index, mesh.lods[l].index_count, mesh.lods[l].error, 0 };
+				}
+				found = meshes.emplace(mesh.mesh_id, static_cast<uint32_t>(list.meshes.size())).first;
+				list.meshes.push_back(record);
+			}
+
+			GpuDrawRecord record = {};
+			record.mesh = found->second;
+			for (uint32_t s = 0; s < 2; s++)
+			{
+				auto bucket = buckets[s].emplace(MakeGpuBucketKey(object, s, bymaterial), static_cast<uint32_t>(list.buckets[s].size())).first;
+				if (bucket->second == list.buckets[s].size()) list.buckets[s].push_back(GpuDrawBucket{ object, 0, 0 });
+				record.bucket[s] = bucket->second;
+				list.buckets[s][bucket->second].capacity++;
+			}
+			list.objects.push_back(object);
+			list.records.push_back(record);
+		}
+
+		//every bucket gets room for all of its records, back to back
+		for (uint32_t s = 0; s < 2; s++)
+		{
+			uint32_t first = 0;
+			for (GpuDrawBucket& bucket : list.buckets[s])
+			{
+				bucket.first = first;
+				first += bucket.capacity;
+			}
+		}
+		for (GpuDrawRecord& record : list.records)
+		{
+			for (uint32_t s = 0; s < 2; s++) record.first[s] = list.buckets[s][record.bucket[s]].first;
+		}
+	}
+
+	//camera passes draw last frames visible set and the late phases additions when occlusion is on, nothing the cpu can redo from this frames inputs alone
+	inline bool GpuCullReferenceSkips(const GpuCullPass& pass, uint32_t passindex, const GpuCullParams& params)
+	{
+		return passindex == params.late_pass || (params.occlusion != 0 && pass.info.y != 0);
+	}
+
+	//what the early phase of GpuCull.comp does, one record at a time in order. counts has to start zeroed (pass_count * bucket_stride) and commands have
+	//pass_count * command_stride room
+	inline void GpuCullReference(const GpuDrawRecord* records, const GpuCullBounds* bounds, const GpuMeshRecord* meshes, const GpuCullPass* passes, const GpuCullParams& params,
+		                         uint32_t* counts, VkDrawIndexedIndirectCommand* commands)
+	{
+		for (uint32_t p = 0; p < params.pass_count; p++)
+		{
+			if (GpuCullReferenceSkips(passes[p], p, params)) continue;
+			uint32_t stream = passes[p].info.x;
+			for (uint32_t r = 0; r < params.draw_count; r++)
+			{
+				if (!GpuCullVisible(bounds[r], passes[p])) continue;
+
+				const GpuMeshRecord& mesh = meshes[records[r].mesh];
+				const GpuCullLod& lod = mesh.lods[GpuCullSelectLod(mesh, bounds[r], passes[p])];
+				uint32_t slot = counts[p * params.bucket_stride + records[r].bucket[stream]]++;
+
+				VkDrawIndexedIndirectCommand& command = commands[p * params.command_stride + records[r].first[stream] + slot];
+				command.indexCount = lod.index_count;
+				command.instanceCount = 1;
+				command.firstIndex = mesh.first_index[stream] + lod.first_index;
+				command.vertexOffset = mesh.vertex_offset[stream];
+				command.firstInstance = r;
+			}
+		}
+	}
+
+	//true if both outputs hold the same draws in every bucket of every pass the reference handles, whatever order they were appended in
+	inline bool CompareGpuCull(const GpuDrawList& list, const GpuCullPass* passes, const GpuCullParams& params, const uint32_t* counts_a, const VkDrawIndexedIndirectCommand* commands_a,
+		                       const uint32_t* counts_b, const VkDrawIndexedIndirectCommand* commands_b)
+	{
+		auto less = [](const VkDrawIndexedIndirectCommand& x, const VkDrawIndexedIndirectCommand& y) { return x.firstInstance < y.firstInstance; };
+		std::vector<VkDrawIndexedIndirectCommand> a;
+		std::vector<VkDrawIndexedIndirectCommand> b;
+		for (uint32_t p = 0; p < params.pass_count; p++)
+		{
+			if (GpuCullReferenceSkips(passes[p], p, params)) continue;
+			const std::vector<GpuDrawBucket>& buckets = list.buckets[passes[p].info.x];
+			for (uint32_t i = 0; i < buckets.size(); i++)
+			{
+				uint32_t count = counts_a[p * params.bucket_stride + i];
+				if (count != counts_b[p * params.bucket_stride + i] || count > buckets[i].capacity) return false;
+
+				const VkDrawIndexedIndirectCommand* first_a = commands_a + p * params.command_stride + buckets[i].first;
+				const VkDrawIndexedIndirectCommand* first_b = commands_b + p * params.command_stride + buckets[i].first;
+				a.assign(first_a, first_a + count);
+				b.assign(first_b, first_b + count);
+				std::sort(a.begin(), a.end(), less);
+				std::sort(b.begin(), b.end(), less);
+				if (count > 0 && std::memcmp(a.data(), b.data(), sizeof(VkDrawIndexedIndirectCommand) * count) != 0) return false;
+			}
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "RenderObject.h"
+#include "CullingBounds.h"
+#include "../Utilities/RadixSort.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Gibo {
+	/*
+	Automatic instancing. After culling every views visible list gets grouped by mesh (and material for the passes that bind materials) and every group turns into one
+	instanced draw. The model matrices of every instance get written contiguously into the frames instance buffer and the vertex shaders read them with
+	instances.model[gl_InstanceIndex], so a batch is just vkCmdDrawIndexed(lod index_count, instance_count, lod first_index, 0, first_instance).
+
+	A batch draws with the mesh and local descriptor of its first object. Objects only end up in the same batch if they have the same vbo/ibo and (when bymaterial is set)
+	the same material template (key and then the data behind it), which means their descriptors hold the exact same material data and textures so any of them would do.
+	Every instance also gets its material handle (MaterialLibrary.h) written next to its matrix, with bindless textures (BindlessTextures.h) that is all the pbr pass
+	needs so it batches without bymaterial.
+
+	Grouping is done by sorting 64 bit draw keys, laid out from the top bit down:
+		layer    2 bits  - opaque/blend
+		pipeline 6 bits  - pass pipeline with the meshes vertex format in the low bit, so full and quantized meshes each get drawn in one run of pipeline binds
+		material 20 bits - template key folded down, 0 for passes that don't bind materials
+		mesh     16 bits - MeshCache mesh_id in the top 14, lod in the low 2
+		depth    20 bits - view depth of the bounding sphere center
+	so equal state ends up next to each other with the instances inside a batch front to back. The keys only order things, batches still compare the real mesh/material
+	so a folded material collision costs at most an extra batch, never a wrong draw.
+	For passes that only bind vertex buffers (depth prepass, shadows) state changes are cheap and early z is what matters, so their batches get sorted front to back by
+	their nearest instance afterwards. The pbr pass keeps the state order since the depth prepass already gives it perfect early z.
+
+	Lods: every instance picks its meshes lod from its projected size in the view it's drawn in, the coarsest level whose error (relative to the radius) covers at most
+	max_pixel_error pixels on screen. Instances of the same mesh at different lods draw different index ranges so they end up in different batches.
+
+	Meshlets: instances drawn at lod 0 whose mesh has at least min_meshlets meshlets get refined with MeshletBuilder::Cull and become a batch of their own that draws
+	the surviving ranges (range_count of them starting at first_range in the views range list) instead of the whole lod. If nothing survives they get no batch at all.
+	*/
+	enum DRAW_LAYER : uint32_t { DRAW_LAYER_OPAQUE = 0, DRAW_LAYER_BLEND = 1 };
+
+	static const uint64_t DRAW_KEY_DEPTH_BITS = 20;
+	static const uint64_t DRAW_KEY_DEPTH_MASK = (1ull << DRAW_KEY_DEPTH_BITS) - 1;
+
+	inline uint64_t MakeDrawKey(uint32_t layer, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+	{
+		return ((uint64_t)(layer & 0x3) << 62) | ((uint64_t)(pipeline & 0x3F) << 56) | ((uint64_t)(material & 0xFFFFF) << 36) |
+			   ((uint64_t)(mesh & 0xFFFF) << 20) | ((uint64_t)depth & DRAW_KEY_DEPTH_MASK);
+	}
+
+	inline uint32_t PipelineKeyBits(uint32_t pipeline, VERTEX_FORMAT format)
+	{
+		return (pipeline << 1) | static_cast<uint32_t>(format);
+	}
+
+	//folds the 64 bit template hash into the 20 bits the key has room for
+	inline uint32_t MaterialKeyBits(const Material& material)
+	{
+		uint64_t key = material.GetTemplateKey();
+		return static_cast<uint32_t>((key ^ (key >> 20) ^ (key >> 40)) & 0xFFFFF);
+	}
+
+	//distance from the views near plane to the slots sphere center, anything behind the plane clamps to 0
+	inline float ViewDepth(const Plane& nearplane, const CullingBounds& bounds, uint32_t slot)
+	{
+		float depth = nearplane.a * bounds.center_x[slot] + nearplane.b * bounds.center_y[slot] + nearplane.c * bounds.center_z[slot] + nearplane.d;
+		return std::max(depth, 0.0f);
+	}
+
+	//the view depth as the top bits of the float. Positive floats sort the same as their bit patterns, so this keeps about 11 bits of mantissa at any distance
+	//without needing to know the depth range
+	inline uint32_t ViewDepthBits(float depth)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(float));
+		return bits >> 11; //sign bit is always 0 so the top 21 bits fit in 20
+	}
+
+	struct LodSelectInfo
+	{
+		float pixels_per_unit = 0.0f; //perspective: pixels one unit covers at depth 1, ortho: pixels one unit covers. 0 always picks lod 0
+		bool perspective = true;
+		float max_pixel_error = 1.0f;
+	};
+
+	//viewheight is the height of the target the view gets rendered into
+	inline LodSelectInfo MakeLodSelectInfo(const glm::mat4& proj, float viewheight, float maxpixelerror)
+	{
+		LodSelectInfo info;
+		info.perspective = (proj[3][3] == 0.0f);
+		info.pixels_per_unit = std::abs(proj[1][1]) * viewheight * 0.5f;
+		info.max_pixel_error = maxpixelerror;
+		return info;
+	}
+
+	//radius is the world space bounding sphere radius, the lod errors are relative to it so the same mesh scaled up switches later
+	inline uint32_t SelectLod(const MeshCache::Mesh& mesh, const LodSelectInfo& info, float depth, float radius)
+	{
+		if (info.pixels_per_unit <= 0.0f) return 0;
+		float pixels = radius * info.pixels_per_unit;
+		if (info.perspective) pixels /= std::max(depth, radius);
+
+		uint32_t lod = 0;
+		while (lod + 1 < mesh.lod_count && mesh.lods[lod + 1].error * pixels <= info.max_pixel_error) lod++;
+		return lod;
+	}
+
+	struct InstanceBatch
+	{
+		RenderObject* object; //first object of the batch, its mesh and descriptor get used for every instance
+		uint32_t first_instance; //index into the instance buffer
+		uint32_t instance_count;
+		uint32_t depth; //depth bits of the nearest instance
+		uint32_t lod = 0; //index into the meshes lods, the range every instance draws
+		uint32_t first_range = 0; //meshlet refined batches draw range_count ranges of the views range list instead of the lod, 0 draws the lod
+		uint32_t range_count = 0;
+	};
+
+	struct InstanceSortEntry
+	{
+		uint64_t key;
+		RenderObject* object;
+		uint32_t lod;
+	};
+
+	//per thread memory BuildInstanceBatches sorts in so it doesn't allocate every frame
+	struct InstanceScratch
+	{
+		std::vector<InstanceSortEntry> entries;
+		std::vector<InstanceSortEntry> sort_scratch;
+		std::vector<InstanceBatch> batch_scratch;
+	};
+
+	struct InstanceBuildInfo
+	{
+		bool bymaterial; //split batches by material template, only for passes that bind material descriptors
+		bool sort; //sort by draw key, off keeps the visible list order and only merges neighbours
+		bool batches_front_to_back; //reorder the batches by their nearest instance after merging
+		uint32_t pipeline;
+		int current_frame;
+		LodSelectInfo lod; //default picks lod 0 for everything
+		MeshletCullInfo meshlets; //default draws every mesh whole
+	};
+
+	inline bool SameInstanceBatch(RenderObject* a, RenderObject* b, bool bymaterial)
+	{
+		//meshes share arena buffers, so the offsets are what tells them apart
+		return a->GetMesh().vbo == b->GetMesh().vbo && a->GetMesh().ibo == b->GetMesh().ibo && a->GetMesh().vertex_offset == b->GetMesh().vertex_offset &&
+			   a->GetMesh().first_index == b->GetMesh().first_index && a->GetMesh().index_size == b->GetMesh().index_size &&
+			   (!bymaterial || a->GetMaterial().SameTemplate(b->GetMaterial()));
+	}
+
+	//groups the visible slots of one view into batches. matrices gets visible.size() model matrices written starting at instance first, batches and ranges get cleared and refilled.
+	//materials gets the material handle of every instance in the same order, nullptr skips it
+	inline void BuildInstanceBatches(const std::vector<uint32_t>& visible, const std::vector<RenderObject*>& slots, const CullingBounds& bounds, const Plane& nearplane,
+		                             const InstanceBuildInfo& info, glm::mat4* matrices, uint32_t* materials, uint32_t first, std::vector<InstanceBatch>& batches,
+		                             std::vector<MeshletRange>& ranges, InstanceScratch& scratch)
+	{
+		batches.clear();
+		ranges.clear();
+		std::vector<InstanceSortEntry>& entries = scratch.entries;
+		entries.resize(visible.size());
+		for (int i = 0; i < visible.size(); i++)
+		{
+			RenderObject* object = slots[visible[i]];
+			float depth = ViewDepth(nearplane, bounds, visible[i]);
+			entries[i].object = object;
+			entries[i].lod = SelectLod(object->GetMesh(), info.lod, depth, bounds.radius[visible[i]]);
+			if (info.sort)
+			{
+				uint32_t material = (info.bymaterial) ? MaterialKeyBits(object->GetMaterial()) : 0;
+				uint32_t mesh = (object->GetMesh().mesh_id << 2) | entries[i].lod;
+				entries[i].key = MakeDrawKey(DRAW_LAYER_OPAQUE, PipelineKeyBits(info.pipeline, object->GetMesh().vertex_format), material, mesh, ViewDepthBits(depth));
+			}
+			else
+			{
+				entries[i].key = 0;
+			}
+		}
+		if (info.sort)
+		{
+			RadixSort(entries, scratch.sort_scratch, [](const InstanceSortEntry& e) { return e.key; });
+		}
+
+		//a refined or dropped instance breaks the run, the next one can't merge over it since its instances have to stay contiguous
+		bool mergeable = false;
+		for (uint32_t i = 0; i < entries.size(); i++)
+		{
+			RenderObject* object = entries[i].object;
+			const MeshCache::Mesh& mesh = object->GetMesh();
+			matrices[i] = object->GetMatrix(info.current_frame);
+			if (materials != nullptr) materials[i] = object->GetMaterial().GetHandle();
+			uint32_t depth = static_cast<uint32_t>(entries[i].key & DRAW_KEY_DEPTH_MASK);
+
+			if (info.meshlets.planes != nullptr && entries[i].lod == 0 && mesh.meshlet_count >= info.meshlets.min_meshlets)
+			{
+				uint32_t first_range = static_cast<uint32_t>(ranges.size());
+				uint32_t range_count = MeshletBuilder::Cull(mesh.meshlets, mesh.meshlet_count, matrices[i], info.meshlets, ranges);
+				if (range_count != 0) batches.push_back(InstanceBatch{ object, first + i, 1, depth, 0, first_range, range_count });
+				mergeable = false;
+				continue;
+			}
+
+			//sorted keys only cluster them, still check the mesh/material really match so a collision can't draw the wrong mesh
+			if (mergeable && batches.back().lod == entries[i].lod && SameInstanceBatch(batches.back().object, object, info.bymaterial))
+			{
+				batches.back().instance_count++;
+			}
+			else
+			{
+				batches.push_back(InstanceBatch{ object, first + i, 1, depth, entries[i].lod });
+			}
+			mergeable = true;
+		}
+
+		if (info.sort && info.batches_front_to_back)
+		{
+			scratch.batch_scratch.resize(batches.size());
+			RadixSort(batches.data(), scratch.batch_scratch.data(), static_cast<uint32_t>(batches.size()), [](const InstanceBatch& b) { return (uint64_t)b.depth; }, 3);
+		}
+	}
+
+}
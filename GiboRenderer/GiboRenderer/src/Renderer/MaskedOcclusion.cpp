@@ -0,0 +1,329 @@
+#include "../pch.h"
+#include "MaskedOcclusion.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace Gibo {
+
+	static_assert(MaskedOcclusionBuffer::TILE_WIDTH == 8 && MaskedOcclusionBuffer::TILE_HEIGHT == 4, "the coverage masks are 4 rows of 8 bits");
+	static const uint32_t FULL_MASK = 0xFFFFFFFFu;
+
+	//bit row * TILE_WIDTH + column is set for every pixel of the tile at x0, y0 whose center all three edge functions are >= 0 at. Edges step down the rows by adding b
+#if defined(__AVX__)
+	static uint32_t TileCoverage(const float a[3], const float b[3], const float c[3], float x0, float y0)
+	{
+		const __m256 columns = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 px = _mm256_add_ps(_mm256_set1_ps(x0), columns);
+		__m256 edge[3];
+		__m256 step[3];
+		for (int e = 0; e < 3; e++)
+		{
+			edge[e] = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[e]), px), _mm256_set1_ps(b[e] * (y0 + 0.5f) + c[e]));
+			step[e] = _mm256_set1_ps(b[e]);
+		}
+
+		uint32_t mask = 0;
+		for (uint32_t row = 0; row < MaskedOcclusionBuffer::TILE_HEIGHT; row++)
+		{
+			__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(edge[0], zero, _CMP_GE_OQ), _mm256_cmp_ps(edge[1], zero, _CMP_GE_OQ)), _mm256_cmp_ps(edge[2], zero, _CMP_GE_OQ));
+			mask |= uint32_t(_mm256_movemask_ps(inside)) << (row * MaskedOcclusionBuffer::TILE_WIDTH);
+			for (int e = 0; e < 3; e++) edge[e] = _mm256_add_ps(edge[e], step[e]);
+		}
+		return mask;
+	}
+#else
+	static uint32_t TileCoverage(const float a[3], const float b[3], const float c[3], float x0, float y0)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		__m128 pxlow = _mm_add_ps(_mm_set1_ps(x0), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+		__m128 pxhigh = _mm_add_ps(_mm_set1_ps(x0), _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f));
+		__m128 low[3];
+		__m128 high[3];
+		__m128 step[3];
+		for (int e = 0; e < 3; e++)
+		{
+			__m128 ae = _mm_set1_ps(a[e]);
+			__m128 rowstart = _mm_set1_ps(b[e] * (y0 + 0.5f) + c[e]);
+			low[e] = _mm_add_ps(_mm_mul_ps(ae, pxlow), rowstart);
+			high[e] = _mm_add_ps(_mm_mul_ps(ae, pxhigh), rowstart);
+			step[e] = _mm_set1_ps(b[e]);
+		}
+
+		uint32_t mask = 0;
+		for (uint32_t row = 0; row < MaskedOcclusionBuffer::TILE_HEIGHT; row++)
+		{
+			__m128 insidelow = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(low[0], zero), _mm_cmpge_ps(low[1], zero)), _mm_cmpge_ps(low[2], zero));
+			__m128 insidehigh = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(high[0], zero), _mm_cmpge_ps(high[1], zero)), _mm_cmpge_ps(high[2], zero));
+			uint32_t rowmask = uint32_t(_mm_movemask_ps(insidelow)) | (uint32_t(_mm_movemask_ps(insidehigh)) << 4);
+			mask |= rowmask << (row * MaskedOcclusionBuffer::TILE_WIDTH);
+			for (int e = 0; e < 3; e++)
+			{
+				low[e] = _mm_add_ps(low[e], step[e]);
+				high[e] = _mm_add_ps(high[e], step[e]);
+			}
+		}
+		return mask;
+	}
+#endif
+
+	void MaskedOcclusionBuffer::Resize(uint32_t newwidth, uint32_t newheight)
+	{
+		width = newwidth;
+		height = newheight;
+		tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+		tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+		zmax0.resize(size_t(tiles_x) * tiles_y);
+		zmax1.resize(size_t(tiles_x) * tiles_y);
+		masks.resize(size_t(tiles_x) * tiles_y);
+		Clear();
+	}
+
+	void MaskedOcclusionBuffer::Clear()
+	{
+		std::fill(zmax0.begin(), zmax0.end(), 1.0f);
+		std::fill(zmax1.begin(), zmax1.end(), 0.0f);
+		std::fill(masks.begin(), masks.end(), 0u);
+	}
+
+	void MaskedOcclusionBuffer::RenderTriangles(const float* positions, uint32_t vertexcount, uint32_t positionstride, const uint32_t* indices, uint32_t indexcount,
+		                                        const glm::mat4& modelviewproj)
+	{
+		if (tiles_x == 0 || tiles_y == 0) return;
+
+		//indexed meshes share most corners so every vertex gets transformed once up front
+		transformed.resize(vertexcount);
+		for (uint32_t v = 0; v < vertexcount; v++)
+		{
+			const float* p = positions + size_t(v) * positionstride;
+			transformed[v] = modelviewproj * glm::vec4(p[0], p[1], p[2], 1.0f);
+		}
+
+		glm::vec4 clipped[9];
+		ScreenVertex screen[9];
+		for (uint32_t i = 0; i + 2 < indexcount; i += 3)
+		{
+			glm::vec4 triangle[3] = { transformed[indices[i]], transformed[indices[i + 1]], transformed[indices[i + 2]] };
+			uint32_t count = ClipTriangle(triangle, clipped);
+			if (count < 3) continue;
+
+			for (uint32_t v = 0; v < count; v++)
+			{
+				float invw = 1.0f / clipped[v].w;
+				screen[v].x = (clipped[v].x * invw * 0.5f + 0.5f) * width;
+				screen[v].y = (clipped[v].y * invw * 0.5f + 0.5f) * height;
+				screen[v].z = clipped[v].z * invw;
+			}
+
+			//whats left after clipping is convex so a fan covers it
+			for (uint32_t v = 1; v + 1 < count; v++)
+			{
+				RasterizeTriangle(screen[0], screen[v], screen[v + 1]);
+			}
+		}
+	}
+
+	uint32_t MaskedOcclusionBuffer::ClipTriangle(const glm::vec4 in[3], glm::vec4 out[9])
+	{
+		//inside is dot(plane, position) >= 0. near is z >= 0, then x and y inside GUARD_BAND * w
+		const glm::vec4 planes[5] = { glm::vec4(0, 0, 1, 0), glm::vec4(-1, 0, 0, GUARD_BAND), glm::vec4(1, 0, 0, GUARD_BAND), glm::vec4(0, -1, 0, GUARD_BAND),
+			                          glm::vec4(0, 1, 0, GUARD_BAND) };
+
+		//almost everything is either all inside or all outside one plane, only clip against the planes that actually cut it
+		uint32_t cut = 0;
+		for (uint32_t p = 0; p < 5; p++)
+		{
+			uint32_t outside = 0;
+			for (int v = 0; v < 3; v++) outside += (glm::dot(planes[p], in[v]) < 0.0f) ? 1 : 0;
+			if (outside == 3) return 0;
+			if (outside > 0) cut |= 1u << p;
+		}
+
+		std::copy(in, in + 3, out);
+		if (cut == 0) return 3;
+
+		//sutherland hodgman, every plane adds at most one vertex
+		glm::vec4 scratch[9];
+		glm::vec4* source = out;
+		glm::vec4* dest = scratch;
+		uint32_t count = 3;
+		for (uint32_t p = 0; p < 5; p++)
+		{
+			if ((cut & (1u << p)) == 0) continue;
+
+			uint32_t written = 0;
+			for (uint32_t v = 0; v < count; v++)
+			{
+				const glm::vec4& a = source[v];
+				const glm::vec4& b = source[(v + 1) % count];
+				float da = glm::dot(planes[p], a);
+				float db = glm::dot(planes[p], b);
+				if (da >= 0.0f) dest[written++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f)) dest[written++] = a + (b - a) * (da / (da - db));
+			}
+			count = written;
+			std::swap(source, dest);
+			if (count < 3) return 0;
+		}
+
+		if (source != out) std::copy(source, source + count, out);
+		return count;
+	}
+
+	void MaskedOcclusionBuffer::RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& in1, const ScreenVertex& in2)
+	{
+		//counter clockwise in pixel space, the other winding just swaps two corners
+		float area = (in1.x - v0.x) * (in2.y - v0.y) - (in2.x - v0.x) * (in1.y - v0.y);
+		const ScreenVertex& v1 = (area < 0.0f) ? in2 : in1;
+		const ScreenVertex& v2 = (area < 0.0f) ? in1 : in2;
+		area = std::abs(area);
+		if (!(area > 1e-6f)) return;
+
+		//pixels whose centers are in the bbox
+		float minx = std::min(v0.x, std::min(v1.x, v2.x));
+		float maxx = std::max(v0.x, std::max(v1.x, v2.x));
+		float miny = std::min(v0.y, std::min(v1.y, v2.y));
+		float maxy = std::max(v0.y, std::max(v1.y, v2.y));
+		int px0 = std::max(static_cast<int>(std::ceil(minx - 0.5f)), 0);
+		int py0 = std::max(static_cast<int>(std::ceil(miny - 0.5f)), 0);
+		int px1 = std::min(static_cast<int>(std::floor(maxx - 0.5f)), static_cast<int>(tiles_x * TILE_WIDTH) - 1);
+		int py1 = std::min(static_cast<int>(std::floor(maxy - 0.5f)), static_cast<int>(tiles_y * TILE_HEIGHT) - 1);
+		if (px0 > px1 || py0 > py1) return;
+
+		//edge functions a * x + b * y + c, positive inside. Both triangles on a shared edge count the centers right on it so meshes don't leave cracks
+		const ScreenVertex* corners[3] = { &v0, &v1, &v2 };
+		float a[3], b[3], c[3];
+		for (int e = 0; e < 3; e++)
+		{
+			const ScreenVertex& from = *corners[e];
+			const ScreenVertex& to = *corners[(e + 1) % 3];
+			a[e] = from.y - to.y;
+			b[e] = to.x - from.x;
+			c[e] = -(a[e] * from.x + b[e] * from.y);
+		}
+
+		//depth plane z0 + dzdx * (x - x0) + dzdy * (y - y0)
+		float dx1 = v1.x - v0.x, dy1 = v1.y - v0.y, dz1 = v1.z - v0.z;
+		float dx2 = v2.x - v0.x, dy2 = v2.y - v0.y, dz2 = v2.z - v0.z;
+		float dzdx = (dz1 * dy2 - dz2 * dy1) / area;
+		float dzdy = (dx1 * dz2 - dx2 * dz1) / area;
+		float farthest = std::max(v0.z, std::max(v1.z, v2.z));
+
+		stats.triangles++;
+		for (uint32_t ty = py0 / TILE_HEIGHT; ty <= py1 / TILE_HEIGHT; ty++)
+		{
+			float y0 = static_cast<float>(ty * TILE_HEIGHT);
+			for (uint32_t tx = px0 / TILE_WIDTH; tx <= px1 / TILE_WIDTH; tx++)
+			{
+				float x0 = static_cast<float>(tx * TILE_WIDTH);
+				uint32_t mask = TileCoverage(a, b, c, x0, y0);
+				if (mask == 0) continue;
+
+				//the plane is farthest at one corner of where the tile and the triangles bbox overlap
+				float cx = (dzdx > 0.0f) ? std::min(x0 + TILE_WIDTH, maxx) : std::max(x0, minx);
+				float cy = (dzdy > 0.0f) ? std::min(y0 + TILE_HEIGHT, maxy) : std::max(y0, miny);
+				float depth = std::min(v0.z + dzdx * (cx - v0.x) + dzdy * (cy - v0.y), farthest);
+				MergeTile(ty * tiles_x + tx, mask, depth);
+			}
+		}
+	}
+
+	void MaskedOcclusionBuffer::MergeTile(uint32_t tile, uint32_t mask, float depth)
+	{
+		//the whole tile is already at least this close
+		if (depth >= zmax0[tile]) return;
+
+		//the triangle is closer to the reference layer than the working layer is, keeping the working layer would only drag its depth back so it gets dropped
+		float working = zmax1[tile];
+		uint32_t coverage = masks[tile];
+		if (working - depth > zmax0[tile] - working)
+		{
+			working = 0.0f;
+			coverage = 0;
+		}
+
+		working = std::max(working, depth);
+		coverage |= mask;
+
+		//working layer covers the whole tile, it becomes the reference
+		if (coverage == FULL_MASK)
+		{
+			zmax0[tile] = std::min(zmax0[tile], working);
+			working = 0.0f;
+			coverage = 0;
+		}
+		zmax1[tile] = working;
+		masks[tile] = coverage;
+	}
+
+	bool MaskedOcclusionBuffer::TestRect(int minx, int miny, int maxx, int maxy, float depth) const
+	{
+		minx = std::max(minx, 0);
+		miny = std::max(miny, 0);
+		maxx = std::min(maxx, static_cast<int>(width) - 1);
+		maxy = std::min(maxy, static_cast<int>(height) - 1);
+		//nothing on screen, leave it to the frustrum culling
+		if (minx > maxx || miny > maxy) return true;
+
+		for (uint32_t ty = miny / TILE_HEIGHT; ty <= maxy / TILE_HEIGHT; ty++)
+		{
+			int row0 = std::max(miny - static_cast<int>(ty * TILE_HEIGHT), 0);
+			int row1 = std::min(maxy - static_cast<int>(ty * TILE_HEIGHT), static_cast<int>(TILE_HEIGHT) - 1);
+			for (uint32_t tx = minx / TILE_WIDTH; tx <= maxx / TILE_WIDTH; tx++)
+			{
+				int column0 = std::max(minx - static_cast<int>(tx * TILE_WIDTH), 0);
+				int column1 = std::min(maxx - static_cast<int>(tx * TILE_WIDTH), static_cast<int>(TILE_WIDTH) - 1);
+				uint32_t rowmask = (0xFFu >> (TILE_WIDTH - 1 - (column1 - column0))) << column0;
+				uint32_t rectmask = 0;
+				for (int row = row0; row <= row1; row++) rectmask |= rowmask << (row * TILE_WIDTH);
+
+				//pixels outside the working mask can be as far as zmax0, the ones inside only as far as the closer of both layers
+				uint32_t tile = ty * tiles_x + tx;
+				if (depth <= zmax0[tile] && ((rectmask & ~masks[tile]) != 0 || depth <= zmax1[tile])) return true;
+			}
+		}
+		return false;
+	}
+
+	bool MaskedOcclusionBuffer::TestAABB(const glm::vec3& minp, const glm::vec3& maxp, const glm::mat4& viewproj) const
+	{
+		float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX;
+		float mindepth = FLT_MAX;
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner((i & 1) ? maxp.x : minp.x, (i & 2) ? maxp.y : minp.y, (i & 4) ? maxp.z : minp.z);
+			glm::vec4 clip = viewproj * glm::vec4(corner, 1.0f);
+			//behind the camera or crossing the near plane, can't bound it on screen
+			if (clip.w <= 0.0f || clip.z < 0.0f) return true;
+
+			float invw = 1.0f / clip.w;
+			float x = (clip.x * invw * 0.5f + 0.5f) * width;
+			float y = (clip.y * invw * 0.5f + 0.5f) * height;
+			minx = std::min(minx, x);
+			maxx = std::max(maxx, x);
+			miny = std::min(miny, y);
+			maxy = std::max(maxy, y);
+			mindepth = std::min(mindepth, clip.z * invw);
+		}
+
+		//every pixel the rect touches, clamped first so the casts can't overflow
+		float limitx = static_cast<float>(width);
+		float limity = static_cast<float>(height);
+		int px0 = static_cast<int>(std::floor(std::clamp(minx, -1.0f, limitx)));
+		int px1 = static_cast<int>(std::floor(std::clamp(maxx, -1.0f, limitx)));
+		int py0 = static_cast<int>(std::floor(std::clamp(miny, -1.0f, limity)));
+		int py1 = static_cast<int>(std::floor(std::clamp(maxy, -1.0f, limity)));
+		return TestRect(px0, py0, px1, py1, mindepth);
+	}
+
+	float MaskedOcclusionBuffer::GetPixelDepth(uint32_t x, uint32_t y) const
+	{
+		uint32_t tile = (y / TILE_HEIGHT) * tiles_x + x / TILE_WIDTH;
+		uint32_t bit = (y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH;
+		if (masks[tile] & (1u << bit)) return std::min(zmax0[tile], zmax1[tile]);
+		return zmax0[tile];
+	}
+
+}
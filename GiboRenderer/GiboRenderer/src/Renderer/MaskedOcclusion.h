@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace Gibo {
+
+	/*
+	 Software occlusion buffer for culling on the cpu, a masked depth buffer like "Masked Software Occlusion Culling" (Hasselgren, Andersson, Akenine-Moller).
+	 The big occluders (terrain, buildings, the floor) get rasterized into it at a low resolution, then every objects aabb is tested against it and the ones
+	 completely behind it get dropped from the camera view before anything gets recorded.
+
+	 The screen is cut into TILE_WIDTH x TILE_HEIGHT tiles and a tile doesn't store per pixel depth, just two layers: zmax0 is the farthest depth anything in the
+	 whole tile can have, and the working layer is a 32 bit coverage mask with zmax1, the farthest depth of the pixels in the mask. Triangles merge into the working
+	 layer and once its mask is full it gets folded into zmax0. If a new triangle is a lot closer than the working layer the working layer gets thrown away first,
+	 so the closest occluder wins. Depth is ndc z (0 near, 1 far like GLM_FORCE_DEPTH_ZERO_TO_ONE), bigger is farther.
+
+	 Coverage is sampled at pixel centers like the gpu does it, so an object can only be lost if all that shows of it is thinner than a buffer pixel along an occluders
+	 silhouette. The depths are conservative, nothing gets culled that isn't behind the occluders:
+		. a triangles depth over a tile is the farthest its plane gets over the tile, clamped to its farthest vertex
+		. throwing away the working layer only forgets occluders
+		. objects test their screen rect at every pixel it touches with the nearest depth of their aabb
+	 Triangles get clipped against the near plane and a guard band, anything crossing the near plane on the occludee side is just visible.
+
+	 Rasterizing is SIMD over a tiles pixels, one row of 8 a time with AVX and half a row with SSE. There's nothing vulkan in here, it's plain cpu code so it gets
+	 tested without a device (Tests/MaskedOcclusionTests.cpp).
+	*/
+	class MaskedOcclusionBuffer
+	{
+	public:
+		static const uint32_t TILE_WIDTH = 8;
+		static const uint32_t TILE_HEIGHT = 4; //TILE_WIDTH * TILE_HEIGHT bits of mask
+		static constexpr float GUARD_BAND = 2.0f; //triangles get clipped to this many times the screen in ndc so the edge math stays small
+
+		struct Stats
+		{
+			uint32_t triangles = 0; //rasterized after clipping/culling
+			uint32_t tested = 0;
+			uint32_t occluded = 0;
+		};
+
+		//sizes get rounded up to whole tiles, the extra pixels just never get tested. Clears it
+		void Resize(uint32_t width, uint32_t height);
+		void Clear();
+
+		//positions are vertexcount xyz floats positionstride floats apart, every 3 indices a triangle. Both windings get drawn
+		void RenderTriangles(const float* positions, uint32_t vertexcount, uint32_t positionstride, const uint32_t* indices, uint32_t indexcount, const glm::mat4& modelviewproj);
+		//true if anything of the box could be seen. Safe to call from several threads at once as long as nothing is rendering
+		bool TestAABB(const glm::vec3& minp, const glm::vec3& maxp, const glm::mat4& viewproj) const;
+		//pixel rect is inclusive and clamped to the screen, depth is the nearest depth of the object
+		bool TestRect(int minx, int miny, int maxx, int maxy, float depth) const;
+
+		//the farthest depth something at this pixel could be, 1 where nothing was drawn. For debugging and tests
+		float GetPixelDepth(uint32_t x, uint32_t y) const;
+		uint32_t GetWidth() const { return width; }
+		uint32_t GetHeight() const { return height; }
+		Stats GetStats() const { return stats; }
+		void ResetStats() { stats = Stats(); }
+		//TestAABB is const so the counters aren't touched there, the caller adds up what it tested
+		void AddTestStats(uint32_t tested, uint32_t occluded) { stats.tested += tested; stats.occluded += occluded; }
+
+	private:
+		struct ScreenVertex
+		{
+			float x, y, z; //pixels, ndc depth
+		};
+
+		void RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2);
+		void MergeTile(uint32_t tile, uint32_t mask, float depth);
+		//clips a clip space triangle against the near plane and the guard band, returns the vertex count of the polygon left in out (0, or 3 to 9)
+		static uint32_t ClipTriangle(const glm::vec4 in[3], glm::vec4 out[9]);
+
+	private:
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t tiles_x = 0;
+		uint32_t tiles_y = 0;
+		std::vector<float> zmax0; //per tile
+		std::vector<float> zmax1;
+		std::vector<uint32_t> masks;
+		std::vector<glm::vec4> transformed; //clip space positions of the mesh being rendered
+		Stats stats;
+	};
+
+}
@@ -1,35 +1,43 @@
 #include "../pch.h"
 #include "Material.h"
-#include "vkcore/VulkanHelpers.h"
+#include <cstring>
 
 namespace Gibo {
 
-	Material::~Material()
+	//hash of the material info and the map handles. Streamed maps hash their stream id, their views change as they stream and a freed views handle can come back for another texture
+	void Material::UpdateTemplateKey()
 	{
-		DestroyBuffers();
+		uint64_t hash = HashBytes(&material_info, sizeof(materialinfo));
+		const vkcoreTexture* maps[] = { &albedo_map, &specular_map, &metal_map, &normal_map };
+		for (int i = 0; i < 4; i++)
+		{
+			if (maps[i]->stream_id != vkcoreTexture::NOT_STREAMED)
+			{
+				hash = HashBytes(&maps[i]->stream_id, sizeof(uint32_t), hash);
+			}
+			else
+			{
+				hash = HashBytes(&maps[i]->view, sizeof(VkImageView), hash);
+			}
+			hash = HashBytes(&maps[i]->sampler, sizeof(VkSampler), hash);
+		}
+
+		template_key = hash;
 	}
 
-	void Material::CreateBuffer()
+	//the same fields UpdateTemplateKey hashes, compared for real
+	bool Material::SameTemplate(const Material& other) const
 	{
-		//create staging buffer
-		deviceref->CreateBuffer(sizeof(materialinfo), VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0, stagingbuffer);
-
-		//create gpu buffer
-		deviceref->CreateBuffer(sizeof(materialinfo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, 0, material_buffer);
-	}
-
-	void Material::DestroyBuffers()
-	{
-		deviceref->DestroyBuffer(stagingbuffer);
-		deviceref->DestroyBuffer(material_buffer);
-	}
-
-	void Material::BindBuffer()
-	{
-		//bind data to staging buffer
-		deviceref->BindData(stagingbuffer.allocation, &material_info, sizeof(materialinfo));
-		//copy over to gpu buffer
-		CopyBufferToBuffer(*deviceref, stagingbuffer.buffer, material_buffer.buffer, VK_ACCESS_UNIFORM_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, sizeof(materialinfo));
+		if (template_key != other.template_key || memcmp(&material_info, &other.material_info, sizeof(materialinfo)) != 0) return false;
+
+		const vkcoreTexture* maps[] = { &albedo_map, &specular_map, &metal_map, &normal_map };
+		const vkcoreTexture* othermaps[] = { &other.albedo_map, &other.specular_map, &other.metal_map, &other.normal_map };
+		for (int i = 0; i < 4; i++)
+		{
+			if (maps[i]->stream_id != othermaps[i]->stream_id || maps[i]->sampler != othermaps[i]->sampler) return false;
+			if (maps[i]->stream_id == vkcoreTexture::NOT_STREAMED && maps[i]->view != othermaps[i]->view) return false;
+		}
+		return true;
 	}
 
 	void Material::CreateMaps(vkcoreTexture defaulttexture)
@@ -1,8 +1,13 @@
 #pragma once
 #include "vkcore/vkcoreDevice.h"
 #include "TextureCache.h"
+#include "../Utilities/Hash.h"
 
 namespace Gibo {
+	//index of a record in the MaterialLibrary, NULL_MATERIAL is the default material everything draws with until it has its own
+	using MaterialHandle = uint32_t;
+	static const MaterialHandle NULL_MATERIAL = 0;
+
 	//notes
 	/*
 	. albedo - diffuse color, the color that doesnt get absorbed. This is either an rgb triplet or a map. Pretty much just color of object like a texture. Either rgb triplet or a texture.
@@ -30,15 +35,15 @@ namespace Gibo {
 	{
 	public:
 		struct materialinfo {
-			glm::vec4 albedo;    //0..1
+			glm::vec4 albedo = glm::vec4(0.0f);    //0..1
 
-			float reflectance;
-			float metal; //0..1
-			float roughness; //0..1
-			float anisotropy; //-1..1
+			float reflectance = 0.0;
+			float metal = 0.0; //0..1
+			float roughness = 0.0; //0..1
+			float anisotropy = 0.0; //-1..1
 
-			float clearcoat; //0 1
-			float clearcoatroughness; // 0 1
+			float clearcoat = 0.0; //0 1
+			float clearcoatroughness = 0.0; // 0 1
 			float anisotropy_path = 0.0;
 			float clearcoat_path = 0.0;
 
@@ -46,15 +51,14 @@ namespace Gibo {
 			int specular_map = 0;
 			int metal_map = 0;
 			int normal_map = 0;
-		}; //64 bytes
+		}; //64 bytes, every field initialized so equal materials hash and compare equal in the MaterialLibrary
 	public:
 		//TODO right now you need to create textures to add to descriptors. This is wasteful because were allocating memory even tho we might not need these
 		//however I don't know how to deal with this for now, its too advance to recreate all descriptors if you just set a texture, Though I could have a global default normalmap everything gets linked too.
 		//but then when you want to change it you will still need to change descriptor sets. its annoying.
-		Material(vkcoreDevice* device, vkcoreTexture defaulttexture) : deviceref(device) { CreateBuffer(); CreateMaps(defaulttexture); SetDefaultMaterial(); }
-		~Material();
-
-		void DestroyBuffers();
+		//the gpu side lives in the MaterialLibrary, setters only change the cpu copy and the renderer picks it up before the next frame
+		Material(vkcoreTexture defaulttexture) { CreateMaps(defaulttexture); SetDefaultMaterial(); }
+		~Material() = default;
 
 		void SetDefaultMaterial();
 		void SetBrickMaterial();
@@ -63,22 +67,22 @@ namespace Gibo {
 		void SetPlasticMaterial();
 		void SetSilverMaterial();
 
-		inline void SetMaterialInfo(materialinfo info) { material_info = info; BindBuffer(); }
-		inline void SetAlbedo(glm::vec3 val) { material_info.albedo.x = val.x; material_info.albedo.y = val.y; material_info.albedo.z = val.z; BindBuffer(); }
-		inline void SetAlpha(float val) { material_info.albedo.a = val; BindBuffer(); }
-		inline void SetReflectance(float val) { material_info.reflectance = val; BindBuffer(); }
-		inline void SetMetal(float val) { material_info.metal = val; BindBuffer(); }
-		inline void SetRoughness(float val) { material_info.roughness = val; BindBuffer(); }
-		inline void SetAnisotropy(float val) { material_info.anisotropy = val; BindBuffer(); }
-		//inline void SetShirley(float val) { material_info.shirley = val; BindBuffer(); }
-		inline void SetClearCoat(float val) { material_info.clearcoat = val; BindBuffer(); }
-		inline void SetClearCoatRoughness(float val) { material_info.clearcoatroughness = val; BindBuffer(); }
-		inline void SetRenderPath(float Anisotropy, float ClearCoat) { material_info.anisotropy_path = Anisotropy; material_info.clearcoat_path = ClearCoat; BindBuffer(); }
-
-		inline void ToggleAlbedoMap(bool val) { material_info.albedo_map = val; BindBuffer(); }
-		inline void ToggleSpecularMap(bool val) { material_info.specular_map = val; BindBuffer(); }
-		inline void ToggleMetalMap(bool val) { material_info.metal_map = val; BindBuffer(); }
-		inline void ToggleNormalMap(bool val) { material_info.normal_map = val; BindBuffer(); }
+		inline void SetMaterialInfo(materialinfo info) { material_info = info; UpdateTemplateKey(); }
+		inline void SetAlbedo(glm::vec3 val) { material_info.albedo.x = val.x; material_info.albedo.y = val.y; material_info.albedo.z = val.z; UpdateTemplateKey(); }
+		inline void SetAlpha(float val) { material_info.albedo.a = val; UpdateTemplateKey(); }
+		inline void SetReflectance(float val) { material_info.reflectance = val; UpdateTemplateKey(); }
+		inline void SetMetal(float val) { material_info.metal = val; UpdateTemplateKey(); }
+		inline void SetRoughness(float val) { material_info.roughness = val; UpdateTemplateKey(); }
+		inline void SetAnisotropy(float val) { material_info.anisotropy = val; UpdateTemplateKey(); }
+		//inline void SetShirley(float val) { material_info.shirley = val; UpdateTemplateKey(); }
+		inline void SetClearCoat(float val) { material_info.clearcoat = val; UpdateTemplateKey(); }
+		inline void SetClearCoatRoughness(float val) { material_info.clearcoatroughness = val; UpdateTemplateKey(); }
+		inline void SetRenderPath(float Anisotropy, float ClearCoat) { material_info.anisotropy_path = Anisotropy; material_info.clearcoat_path = ClearCoat; UpdateTemplateKey(); }
+
+		inline void ToggleAlbedoMap(bool val) { material_info.albedo_map = val; UpdateTemplateKey(); }
+		inline void ToggleSpecularMap(bool val) { material_info.specular_map = val; UpdateTemplateKey(); }
+		inline void ToggleMetalMap(bool val) { material_info.metal_map = val; UpdateTemplateKey(); }
+		inline void ToggleNormalMap(bool val) { material_info.normal_map = val; UpdateTemplateKey(); }
 
 		void SetAlbedoMap(vkcoreTexture texture) { albedo_map = texture; ToggleAlbedoMap(true); }
 		void SetSpecularMap(vkcoreTexture texture) { specular_map = texture; ToggleSpecularMap(true); }
@@ -86,30 +90,36 @@ namespace Gibo {
 		void SetNormalMap(vkcoreTexture texture) { normal_map = texture; ToggleNormalMap(true); }
 
 		inline materialinfo GetMaterialInfo() { return material_info; }
-		inline vkcoreBuffer GetBuffer() { return material_buffer; }
 		inline vkcoreTexture GetAlbedoMap() { return albedo_map; }
 		inline vkcoreTexture GetSpecularMap() { return specular_map; }
 		inline vkcoreTexture GetMetalMap() { return metal_map; }
 		inline vkcoreTexture GetNormalMap() { return normal_map; }
+		inline uint64_t GetTemplateKey() const { return template_key; } //hash of the material data and maps, different keys means different templates
+		//equal material data and maps so the objects can be drawn instanced. The key only rules out, this compares the data behind it
+		bool SameTemplate(const Material& other) const;
+
+		//record in the MaterialLibrary, stale until the renderer acquires one and again once the material changes
+		inline MaterialHandle GetHandle() const { return handle; }
+		inline bool HandleStale() const { return !acquired || handle_key != template_key; }
+		inline void SetHandle(MaterialHandle newhandle) { handle = newhandle; handle_key = template_key; acquired = true; }
+		inline void ClearHandle() { handle = NULL_MATERIAL; acquired = false; }
 
 	protected:
-		void CreateBuffer();
-		void BindBuffer();
 		void CreateMaps(vkcoreTexture defaulttexture);
+		void UpdateTemplateKey();
 	private:
-		//cpu data
 		materialinfo material_info;
 
-		//gpu data
-		vkcoreBuffer material_buffer;
-		vkcoreBuffer stagingbuffer;
-
 		vkcoreTexture albedo_map;
 		vkcoreTexture specular_map;
 		vkcoreTexture metal_map;
 		vkcoreTexture normal_map;
 
-		vkcoreDevice* deviceref;
+		uint64_t template_key = 0; //hash of material_info and the maps, updated whenever either changes
+
+		MaterialHandle handle = NULL_MATERIAL;
+		uint64_t handle_key = 0; //template key the handle was acquired for
+		bool acquired = false; //NULL_MATERIAL is a real handle when the library is full, this says if the renderer gave it out
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "../pch.h"
+#include "MaterialLibrary.h"
+#include <algorithm>
+
+namespace Gibo {
+
+	bool MaterialLibrary::Create(uint32_t maxmaterials)
+	{
+		capacity = maxmaterials;
+		deviceref.CreateBuffer(GetBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, 0, table_buffer);
+		staging_buffers.resize(frames_in_flight);
+		for (uint32_t i = 0; i < frames_in_flight; i++)
+		{
+			deviceref.CreateBuffer(GetBufferSize(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0, staging_buffers[i]);
+		}
+		if (table_buffer.buffer == VK_NULL_HANDLE)
+		{
+			Logger::LogError("failed to create the material table\n");
+			return false;
+		}
+
+		records.resize(capacity);
+		refcounts.resize(capacity, 0);
+		hashes.resize(capacity, 0);
+		is_dirty.resize(capacity, false);
+
+		//record 0 is the default material, it holds a reference nobody gives back. Its in the lookup like any other so default materials share it
+		Material defaults{ vkcoreTexture() };
+		materialrecord record;
+		record.info = defaults.GetMaterialInfo();
+		MaterialHandle handle = AddRecord(record);
+		hashes[handle] = HashRecord(record);
+		lookup.emplace(hashes[handle], handle);
+
+		Logger::LogInfo("material library: ", capacity, " records\n");
+		return true;
+	}
+
+	void MaterialLibrary::CleanUp()
+	{
+		deviceref.DestroyBuffer(table_buffer);
+		for (int i = 0; i < staging_buffers.size(); i++)
+		{
+			deviceref.DestroyBuffer(staging_buffers[i]);
+		}
+		staging_buffers.clear();
+
+		records.clear();
+		refcounts.clear();
+		hashes.clear();
+		freelist.clear();
+		lookup.clear();
+		dirty.clear();
+		is_dirty.clear();
+		used = 0;
+		capacity = 0;
+	}
+
+	MaterialHandle MaterialLibrary::Acquire(const materialrecord& record)
+	{
+		uint64_t hash = HashRecord(record);
+		auto found = lookup.find(hash);
+		if (found != lookup.end())
+		{
+			//a different record with the same hash just doesn't get shared
+			if (memcmp(&records[found->second], &record, sizeof(materialrecord)) == 0)
+			{
+				refcounts[found->second]++;
+				return found->second;
+			}
+		}
+
+		if (freelist.empty() && used == capacity)
+		{
+			Logger::LogError("material library is full (", capacity, "), drawing with the default material\n");
+			return NULL_MATERIAL;
+		}
+		MaterialHandle handle = AddRecord(record);
+		hashes[handle] = hash;
+		if (found == lookup.end()) lookup.emplace(hash, handle);
+		return handle;
+	}
+
+	void MaterialLibrary::Release(MaterialHandle handle)
+	{
+		if (handle == NULL_MATERIAL || handle >= used || refcounts[handle] == 0) return;
+		if (--refcounts[handle] > 0) return;
+
+		auto found = lookup.find(hashes[handle]);
+		if (found != lookup.end() && found->second == handle) lookup.erase(found);
+		freelist.push_back(handle);
+	}
+
+	MaterialHandle MaterialLibrary::AddRecord(const materialrecord& record)
+	{
+		uint32_t index;
+		if (!freelist.empty())
+		{
+			index = freelist.back();
+			freelist.pop_back();
+		}
+		else
+		{
+			index = used++;
+		}
+
+		records[index] = record;
+		refcounts[index] = 1;
+		if (!is_dirty[index])
+		{
+			is_dirty[index] = true;
+			dirty.push_back(index);
+		}
+		return index;
+	}
+
+	void MaterialLibrary::Flush(VkCommandBuffer cmd, int current_frame)
+	{
+		flushed_records = static_cast<uint32_t>(dirty.size());
+		flushed_ranges = 0;
+		if (dirty.empty()) return;
+
+		//runs of neighbouring records go in one region, packed one after the other in the staging buffer
+		std::sort(dirty.begin(), dirty.end());
+		std::vector<materialrecord> packed;
+		std::vector<VkBufferCopy> regions;
+		packed.reserve(dirty.size());
+		for (int i = 0; i < dirty.size(); i++)
+		{
+			uint32_t index = dirty[i];
+			is_dirty[index] = false;
+
+			if (!regions.empty() && regions.back().dstOffset + regions.back().size == sizeof(materialrecord) * index)
+			{
+				regions.back().size += sizeof(materialrecord);
+			}
+			else
+			{
+				VkBufferCopy region = {};
+				region.srcOffset = sizeof(materialrecord) * packed.size();
+				region.dstOffset = sizeof(materialrecord) * index;
+				region.size = sizeof(materialrecord);
+				regions.push_back(region);
+			}
+			packed.push_back(records[index]);
+		}
+		dirty.clear();
+		flushed_ranges = static_cast<uint32_t>(regions.size());
+
+		deviceref.BindData(staging_buffers[current_frame].allocation, packed.data(), sizeof(materialrecord) * packed.size());
+
+		//earlier frames on the queue might still be reading what this overwrites, then the pbr pass reads it after
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.buffer = table_buffer.buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		vkCmdCopyBuffer(cmd, staging_buffers[current_frame].buffer, table_buffer.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	MaterialLibrary::Stats MaterialLibrary::GetStats() const
+	{
+		Stats stats;
+		stats.records = used - static_cast<uint32_t>(freelist.size());
+		stats.capacity = capacity;
+		stats.flushed_records = flushed_records;
+		stats.flushed_ranges = flushed_ranges;
+		return stats;
+	}
+
+	//the whole record, every field is 4 bytes so there's no padding to trip over
+	uint64_t MaterialLibrary::HashRecord(const materialrecord& record)
+	{
+		return HashBytes(&record, sizeof(materialrecord));
+	}
+
+}
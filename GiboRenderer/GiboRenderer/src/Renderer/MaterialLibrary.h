@@ -0,0 +1,87 @@
+#pragma once
+#include "vkcore/vkcoreDevice.h"
+#include "Material.h"
+
+namespace Gibo {
+
+	/*
+	 Every materials gpu data in one table. Objects still own their Material (the cpu copy you edit) but draw with a MaterialHandle, which is just the index of its record
+	 in MaterialTable, one device local storage buffer the pbr shaders index with each instances material id (pbr.vert reads it next to the instance matrix).
+
+	 Records are deduplicated: Acquire hashes the record and hands back the one already in the table if its the same bytes, so the 200 objects sharing a material
+	 are one record and a material edit just moves the object to another handle. Records are refcounted and their index goes on a free list once nothing uses it.
+	 Record 0 (NULL_MATERIAL) is the default material and is never freed, its what you draw with before you get a handle or if the table is full.
+
+	 Nothing is uploaded when a record is made, its index just goes on the dirty list. Flush records one copy per frame into the pbr command buffer with a region
+	 for every run of neighbouring dirty records, packed into that frames staging buffer. The table is shared by all frames in flight, the barrier in front of the copy
+	 keeps it from writing over a record an earlier frame still reads (a freed index can be handed out again while that frame is on the gpu).
+	*/
+	class MaterialLibrary
+	{
+	public:
+		//std430 material_record in pbr.frag, the slots are the maps in the bindless texture array (BindlessTextures.h) and stay 0 without it
+		struct materialrecord
+		{
+			Material::materialinfo info;
+			uint32_t albedo_slot = 0;
+			uint32_t specular_slot = 0;
+			uint32_t metal_slot = 0;
+			uint32_t normal_slot = 0;
+		}; //80 bytes
+
+		struct Stats
+		{
+			uint32_t records = 0; //live records, default one included
+			uint32_t capacity = 0;
+			uint32_t flushed_records = 0; //in the last Flush
+			uint32_t flushed_ranges = 0;
+		};
+
+		MaterialLibrary(vkcoreDevice& device, uint32_t framesinflight) : deviceref(device), frames_in_flight(framesinflight) {};
+		~MaterialLibrary() = default;
+
+		//no copying/moving should be allowed from this class
+		MaterialLibrary(MaterialLibrary const&) = delete;
+		MaterialLibrary(MaterialLibrary&&) = delete;
+		MaterialLibrary& operator=(MaterialLibrary const&) = delete;
+		MaterialLibrary& operator=(MaterialLibrary&&) = delete;
+
+		bool Create(uint32_t maxmaterials);
+		void CleanUp();
+
+		//handle of a record with these bytes, adding one if there isn't. Every Acquire needs a Release, NULL_MATERIAL if the table is full
+		MaterialHandle Acquire(const materialrecord& record);
+		void Release(MaterialHandle handle);
+
+		//records the upload of everything acquired since the last Flush, call on the frames graphics command buffer outside a render pass before anything reads the table.
+		//wait for frame key before calling, the staging buffer is per frame
+		void Flush(VkCommandBuffer cmd, int current_frame);
+
+		vkcoreBuffer& GetBuffer() { return table_buffer; }
+		VkDeviceSize GetBufferSize() const { return sizeof(materialrecord) * capacity; }
+		Stats GetStats() const;
+	private:
+		MaterialHandle AddRecord(const materialrecord& record);
+		static uint64_t HashRecord(const materialrecord& record);
+	private:
+		std::vector<materialrecord> records; //same indices as the table
+		std::vector<uint32_t> refcounts;
+		std::vector<uint64_t> hashes;
+		std::vector<uint32_t> freelist;
+		std::unordered_map<uint64_t, uint32_t> lookup; //hash -> record, only the first record with a hash is in here
+		uint32_t used = 0; //records ever handed out, the table past this was never written
+		uint32_t capacity = 0;
+
+		std::vector<uint32_t> dirty;
+		std::vector<bool> is_dirty;
+		uint32_t flushed_records = 0;
+		uint32_t flushed_ranges = 0;
+
+		vkcoreBuffer table_buffer;
+		std::vector<vkcoreBuffer> staging_buffers;
+
+		vkcoreDevice& deviceref;
+		uint32_t frames_in_flight;
+	};
+
+}
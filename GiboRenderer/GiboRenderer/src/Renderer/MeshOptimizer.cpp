@@ -0,0 +1,325 @@
+#include "../pch.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Gibo {
+
+	MeshOptimizer::Stats MeshOptimizer::Analyze(const unsigned int* indices, size_t indexcount, size_t vertexcount)
+	{
+		Stats stats;
+		stats.triangles = static_cast<uint32_t>(indexcount / 3);
+		stats.vertices = static_cast<uint32_t>(vertexcount);
+
+		//fifo with timestamps, a vertex is still cached if less than FIFO_CACHE_SIZE vertices got inserted after it
+		std::vector<uint32_t> cachetime(vertexcount, 0);
+		uint32_t time = FIFO_CACHE_SIZE + 1;
+		for (size_t i = 0; i < indexcount; i++)
+		{
+			unsigned int v = indices[i];
+			if (time - cachetime[v] > FIFO_CACHE_SIZE)
+			{
+				cachetime[v] = time++;
+				stats.misses++;
+			}
+		}
+
+		return stats;
+	}
+
+	float MeshOptimizer::ForsythVertexScore(int32_t cacheposition, uint32_t remainingvalence)
+	{
+		const float CACHE_DECAY_POWER = 1.5f;
+		const float LAST_TRI_SCORE = 0.75f;
+		const float VALENCE_BOOST_SCALE = 2.0f;
+		const float VALENCE_BOOST_POWER = 0.5f;
+
+		//nothing left to draw with this vertex, never pick it
+		if (remainingvalence == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cacheposition >= 0)
+		{
+			//the last triangles vertices get a fixed score so we don't just keep fanning around one vertex
+			if (cacheposition < 3)
+			{
+				score = LAST_TRI_SCORE;
+			}
+			else
+			{
+				float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cacheposition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		//boost vertices with few triangles left so we finish them off instead of leaving lone triangles behind
+		score += VALENCE_BOOST_SCALE * std::pow(float(remainingvalence), -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexcount)
+	{
+		size_t trianglecount = indices.size() / 3;
+		if (trianglecount == 0) return;
+
+		//triangles using each vertex packed into one array, valence is how many of them haven't been emitted yet
+		std::vector<uint32_t> valence(vertexcount, 0);
+		for (size_t i = 0; i < trianglecount * 3; i++) valence[indices[i]]++;
+
+		std::vector<uint32_t> offsets(vertexcount + 1, 0);
+		for (size_t v = 0; v < vertexcount; v++) offsets[v + 1] = offsets[v] + valence[v];
+
+		std::vector<uint32_t> adjacency(trianglecount * 3);
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < trianglecount; t++)
+		{
+			for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+
+		std::vector<int32_t> cacheposition(vertexcount, -1);
+		std::vector<float> vertexscore(vertexcount);
+		for (size_t v = 0; v < vertexcount; v++) vertexscore[v] = ForsythVertexScore(-1, valence[v]);
+
+		std::vector<float> trianglescore(trianglecount);
+		std::vector<uint8_t> emitted(trianglecount, 0);
+		int64_t best = 0;
+		for (size_t t = 0; t < trianglecount; t++)
+		{
+			trianglescore[t] = vertexscore[indices[t * 3]] + vertexscore[indices[t * 3 + 1]] + vertexscore[indices[t * 3 + 2]];
+			if (trianglescore[t] > trianglescore[best]) best = t;
+		}
+
+		//lru, the +3 is room for the new triangle before the tail gets evicted
+		uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+		uint32_t cachecount = 0;
+
+		std::vector<unsigned int> result;
+		result.reserve(trianglecount * 3);
+		size_t scan = 0;
+		while (result.size() < trianglecount * 3)
+		{
+			//nothing in the cache has triangles left, start over at the next unemitted one
+			if (best < 0)
+			{
+				while (emitted[scan]) scan++;
+				best = scan;
+			}
+
+			uint32_t triangle = static_cast<uint32_t>(best);
+			emitted[triangle] = 1;
+			const unsigned int* v = &indices[triangle * 3];
+			result.push_back(v[0]);
+			result.push_back(v[1]);
+			result.push_back(v[2]);
+
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t* list = &adjacency[offsets[v[k]]];
+				for (uint32_t i = 0; i < valence[v[k]]; i++)
+				{
+					if (list[i] == triangle)
+					{
+						list[i] = list[valence[v[k]] - 1];
+						valence[v[k]]--;
+						break;
+					}
+				}
+			}
+
+			//new triangle goes in front, the old entries shift back behind it
+			uint32_t newcache[FORSYTH_CACHE_SIZE + 3];
+			uint32_t newcount = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				if (std::find(newcache, newcache + newcount, v[k]) == newcache + newcount) newcache[newcount++] = v[k];
+			}
+			for (uint32_t i = 0; i < cachecount; i++)
+			{
+				if (cache[i] != v[0] && cache[i] != v[1] && cache[i] != v[2]) newcache[newcount++] = cache[i];
+			}
+
+			//rescore everything that moved (including what just fell out) and push the change into its remaining triangles
+			for (uint32_t i = 0; i < newcount; i++)
+			{
+				uint32_t vertex = newcache[i];
+				cacheposition[vertex] = (i < FORSYTH_CACHE_SIZE) ? static_cast<int32_t>(i) : -1;
+				float score = ForsythVertexScore(cacheposition[vertex], valence[vertex]);
+				float delta = score - vertexscore[vertex];
+				vertexscore[vertex] = score;
+				for (uint32_t j = 0; j < valence[vertex]; j++) trianglescore[adjacency[offsets[vertex] + j]] += delta;
+			}
+
+			//only triangles touching the cache can have changed so the next best one is among those
+			best = -1;
+			float bestscore = -1.0f;
+			cachecount = std::min(newcount, FORSYTH_CACHE_SIZE);
+			for (uint32_t i = 0; i < cachecount; i++)
+			{
+				uint32_t vertex = newcache[i];
+				cache[i] = vertex;
+				for (uint32_t j = 0; j < valence[vertex]; j++)
+				{
+					uint32_t t = adjacency[offsets[vertex] + j];
+					if (trianglescore[t] > bestscore)
+					{
+						bestscore = trianglescore[t];
+						best = t;
+					}
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const float* vertices, size_t vertexcount, uint32_t stride, float threshold)
+	{
+		size_t trianglecount = indices.size() / 3;
+		if (trianglecount < 2) return;
+
+		std::vector<uint32_t> cachetime(vertexcount, 0);
+		uint32_t time = FIFO_CACHE_SIZE + 1;
+		auto triangle_misses = [&](size_t t)
+		{
+			uint32_t misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				if (time - cachetime[v] > FIFO_CACHE_SIZE)
+				{
+					cachetime[v] = time++;
+					misses++;
+				}
+			}
+			return misses;
+		};
+		auto reset_cache = [&]() { time += FIFO_CACHE_SIZE + 1; };
+
+		//hard boundaries: triangles where all 3 vertices missed, the cache had nothing to reuse so cutting there is free
+		std::vector<uint32_t> hard;
+		hard.push_back(0);
+		for (size_t t = 0; t < trianglecount; t++)
+		{
+			if (triangle_misses(t) == 3 && t != 0) hard.push_back(static_cast<uint32_t>(t));
+		}
+		hard.push_back(static_cast<uint32_t>(trianglecount));
+
+		//soft boundaries: inside each hard cluster cut as soon as the acmr since the last cut is within threshold of the whole clusters acmr
+		std::vector<uint32_t> clusters;
+		for (size_t h = 0; h + 1 < hard.size(); h++)
+		{
+			uint32_t start = hard[h];
+			uint32_t end = hard[h + 1];
+
+			reset_cache();
+			uint32_t total = 0;
+			for (uint32_t t = start; t < end; t++) total += triangle_misses(t);
+			float target = threshold * float(total) / float(end - start);
+
+			reset_cache();
+			clusters.push_back(start);
+			uint32_t begin = start;
+			uint32_t misses = 0;
+			for (uint32_t t = start; t < end; t++)
+			{
+				misses += triangle_misses(t);
+				if (t + 1 < end && float(misses) <= target * float(t + 1 - begin))
+				{
+					clusters.push_back(t + 1);
+					reset_cache();
+					begin = t + 1;
+					misses = 0;
+				}
+			}
+		}
+		clusters.push_back(static_cast<uint32_t>(trianglecount));
+
+		auto position = [&](unsigned int v) { const float* p = vertices + size_t(v) * stride; return glm::vec3(p[0], p[1], p[2]); };
+
+		//area weighted centroid of the whole mesh
+		glm::vec3 meshcenter(0.0f);
+		float mesharea = 0.0f;
+		for (size_t t = 0; t < trianglecount; t++)
+		{
+			glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+			float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+			meshcenter += (p0 + p1 + p2) * (area / 3.0f);
+			mesharea += area;
+		}
+		if (mesharea > 0.0f) meshcenter /= mesharea;
+
+		//clusters facing away from the center are the outer shell, drawing them first lets them occlude whatever is behind
+		struct Cluster
+		{
+			uint32_t start;
+			uint32_t end;
+			float key;
+		};
+		std::vector<Cluster> sorted(clusters.size() - 1);
+		for (size_t c = 0; c + 1 < clusters.size(); c++)
+		{
+			glm::vec3 centroid(0.0f);
+			glm::vec3 normal(0.0f);
+			float area = 0.0f;
+			for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float a = glm::length(n);
+				centroid += (p0 + p1 + p2) * (a / 3.0f);
+				normal += n;
+				area += a;
+			}
+			if (area > 0.0f) centroid /= area;
+			float length = glm::length(normal);
+
+			sorted[c].start = clusters[c];
+			sorted[c].end = clusters[c + 1];
+			sorted[c].key = (length > 0.0f) ? glm::dot(centroid - meshcenter, normal / length) : 0.0f;
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+		std::vector<unsigned int> result;
+		result.reserve(indices.size());
+		for (const Cluster& cluster : sorted)
+		{
+			result.insert(result.end(), indices.begin() + size_t(cluster.start) * 3, indices.begin() + size_t(cluster.end) * 3);
+		}
+		indices.swap(result);
+	}
+
+	void MeshOptimizer::OptimizeVertexFetch(std::vector<float>& vertices, std::vector<unsigned int>& indices, uint32_t stride)
+	{
+		size_t vertexcount = vertices.size() / stride;
+		const unsigned int UNUSED = ~0u;
+		std::vector<unsigned int> remap(vertexcount, UNUSED);
+
+		std::vector<float> result;
+		result.reserve(vertices.size());
+		unsigned int next = 0;
+		for (unsigned int& index : indices)
+		{
+			if (remap[index] == UNUSED)
+			{
+				remap[index] = next++;
+				result.insert(result.end(), vertices.begin() + size_t(index) * stride, vertices.begin() + size_t(index + 1) * stride);
+			}
+			index = remap[index];
+		}
+
+		vertices.swap(result);
+	}
+
+	void MeshOptimizer::Optimize(std::vector<float>& vertices, std::vector<unsigned int>& indices, uint32_t stride, Stats& before, Stats& after)
+	{
+		size_t vertexcount = vertices.size() / stride;
+		before = Analyze(indices.data(), indices.size(), vertexcount);
+
+		OptimizeVertexCache(indices, vertexcount);
+		OptimizeOverdraw(indices, vertices.data(), vertexcount, stride);
+		OptimizeVertexFetch(vertices, indices, stride);
+
+		after = Analyze(indices.data(), indices.size(), vertices.size() / stride);
+	}
+
+}
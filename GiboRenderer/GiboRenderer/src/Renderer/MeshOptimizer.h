@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+namespace Gibo {
+
+	/*
+	 Import time mesh optimization, runs once in MeshCache::DecodeMesh before the .gmesh gets written so loading from the cache costs nothing extra.
+
+	 OptimizeVertexCache - Forsyth's linear speed reordering. Greedily emits the triangle whose vertices score highest against a simulated LRU cache so triangles that
+	                       share vertices end up close together and the post transform cache actually gets hits.
+	 OptimizeOverdraw    - Sander/Nehab/Barczak style. The cache optimized order gets split into clusters wherever a cache reset costs little (all 3 vertices missed anyway,
+	                       or the clusters acmr is already within threshold of the whole run), then the clusters get sorted so the ones facing away from the meshes center
+	                       draw first and occlude the inner ones. threshold is how much acmr we're willing to give up for that, 1.05 = 5%.
+	 OptimizeVertexFetch - renumbers vertices in the order the indices first touch them so the vertex fetch walks memory forward, unused vertices get dropped.
+
+	 ACMR = post transform cache misses per triangle (0.5 is the best a regular grid can do, 3 is no reuse). ATVR = misses per vertex (1.0 means every vertex transformed once).
+	 Both are measured against a FIFO of FIFO_CACHE_SIZE, which is about what current hardware behaves like.
+	*/
+	class MeshOptimizer
+	{
+	public:
+		static constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+		static constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+		struct Stats
+		{
+			uint32_t triangles = 0;
+			uint32_t vertices = 0;
+			uint32_t misses = 0;
+
+			float ACMR() const { return (triangles == 0) ? 0.0f : float(misses) / float(triangles); }
+			float ATVR() const { return (vertices == 0) ? 0.0f : float(misses) / float(vertices); }
+		};
+
+		static Stats Analyze(const unsigned int* indices, size_t indexcount, size_t vertexcount);
+
+		static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexcount);
+		//vertices are stride floats each with the position in the first 3
+		static void OptimizeOverdraw(std::vector<unsigned int>& indices, const float* vertices, size_t vertexcount, uint32_t stride, float threshold = 1.05f);
+		static void OptimizeVertexFetch(std::vector<float>& vertices, std::vector<unsigned int>& indices, uint32_t stride);
+
+		//all three in order, before/after get the stats of the input and the result
+		static void Optimize(std::vector<float>& vertices, std::vector<unsigned int>& indices, uint32_t stride, Stats& before, Stats& after);
+	private:
+		static float ForsythVertexScore(int32_t cacheposition, uint32_t remainingvalence);
+	};
+
+}
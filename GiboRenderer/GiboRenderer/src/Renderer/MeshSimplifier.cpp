@@ -0,0 +1,229 @@
+#include "../pch.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+
+namespace Gibo {
+
+	void MeshSimplifier::AddPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a2 += weight * a * a; q.ab += weight * a * b; q.ac += weight * a * c; q.ad += weight * a * d;
+		q.b2 += weight * b * b; q.bc += weight * b * c; q.bd += weight * b * d;
+		q.c2 += weight * c * c; q.cd += weight * c * d;
+		q.d2 += weight * d * d;
+		q.weight += weight;
+	}
+
+	void MeshSimplifier::AddQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+		q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+		q.c2 += other.c2; q.cd += other.cd;
+		q.d2 += other.d2;
+		q.weight += other.weight;
+	}
+
+	double MeshSimplifier::Evaluate(const Quadric& q, double x, double y, double z)
+	{
+		double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+			         + q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+			         + q.c2 * z * z + 2.0 * q.cd * z
+			         + q.d2;
+		return (q.weight > 0.0) ? std::abs(error) / q.weight : 0.0;
+	}
+
+	std::vector<unsigned int> MeshSimplifier::Simplify(const std::vector<unsigned int>& indices, const float* vertices, size_t vertexcount, uint32_t stride, size_t targetindexcount,
+		                                                float maxerror, float& resulterror)
+	{
+		resulterror = 0.0f;
+		std::vector<unsigned int> result = indices;
+		if (result.size() <= targetindexcount || vertexcount == 0) return result;
+
+		auto position = [&](unsigned int v) { const float* p = vertices + size_t(v) * stride; return glm::vec3(p[0], p[1], p[2]); };
+
+		//weld by exact position, any vertex that shares its position with another one sits on a seam
+		struct PositionKey
+		{
+			uint32_t v[3];
+			bool operator==(const PositionKey& other) const { return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2]; }
+		};
+		struct PositionKeyHash
+		{
+			size_t operator()(const PositionKey& key) const { return (key.v[0] * 73856093u) ^ (key.v[1] * 19349663u) ^ (key.v[2] * 83492791u); }
+		};
+		std::unordered_map<PositionKey, unsigned int, PositionKeyHash> positions;
+		positions.reserve(vertexcount);
+		std::vector<unsigned int> welded(vertexcount);
+		std::vector<uint32_t> weldcount(vertexcount, 0);
+		for (size_t v = 0; v < vertexcount; v++)
+		{
+			PositionKey key;
+			std::memcpy(key.v, vertices + v * stride, sizeof(float) * 3);
+			welded[v] = positions.emplace(key, static_cast<unsigned int>(v)).first->second;
+			weldcount[welded[v]]++;
+		}
+
+		std::vector<uint8_t> locked(vertexcount, 0);
+		for (size_t v = 0; v < vertexcount; v++)
+		{
+			if (weldcount[welded[v]] > 1) locked[v] = 1;
+		}
+
+		//open borders, edges between welded positions that only one triangle uses
+		auto edgekey = [&](unsigned int a, unsigned int b)
+		{
+			a = welded[a];
+			b = welded[b];
+			if (a > b) std::swap(a, b);
+			return (uint64_t(a) << 32) | b;
+		};
+		std::unordered_map<uint64_t, uint32_t> edgecount;
+		edgecount.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++) edgecount[edgekey(result[i + k], result[i + (k + 1) % 3])]++;
+		}
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = result[i + k];
+				unsigned int b = result[i + (k + 1) % 3];
+				if (edgecount[edgekey(a, b)] == 1)
+				{
+					locked[a] = 1;
+					locked[b] = 1;
+				}
+			}
+		}
+
+		std::vector<Quadric> quadrics(vertexcount, Quadric{});
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			glm::vec3 p0 = position(result[i]), p1 = position(result[i + 1]), p2 = position(result[i + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			if (length <= 0.0f) continue;
+			n /= length;
+			double d = -glm::dot(n, p0);
+			for (int k = 0; k < 3; k++) AddPlane(quadrics[result[i + k]], n.x, n.y, n.z, d, length * 0.5);
+		}
+
+		struct Collapse
+		{
+			unsigned int from;
+			unsigned int to;
+			double cost;
+		};
+		auto collapse_cost = [&](unsigned int from, unsigned int to)
+		{
+			Quadric q = quadrics[from];
+			AddQuadric(q, quadrics[to]);
+			glm::vec3 p = position(to);
+			return Evaluate(q, p.x, p.y, p.z);
+		};
+
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> fill;
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> candidates;
+		std::vector<unsigned int> collapse(vertexcount);
+		std::vector<uint8_t> touched(vertexcount);
+		double maxcost = double(maxerror) * double(maxerror);
+		double worstcost = 0.0;
+
+		//moving from onto to can't flip or squash any of froms triangles that survive the collapse
+		auto flips = [&](unsigned int from, unsigned int to)
+		{
+			for (uint32_t j = offsets[from]; j < offsets[from + 1]; j++)
+			{
+				const unsigned int* tri = &result[size_t(adjacency[j]) * 3];
+				if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+				glm::vec3 p[3] = { position(tri[0]), position(tri[1]), position(tri[2]) };
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				for (int k = 0; k < 3; k++)
+				{
+					if (tri[k] == from) p[k] = position(to);
+				}
+				glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+				if (glm::dot(before, after) <= 0.0f) return true;
+			}
+			return false;
+		};
+
+		while (result.size() > targetindexcount)
+		{
+			size_t trianglecount = result.size() / 3;
+
+			offsets.assign(vertexcount + 1, 0);
+			for (unsigned int index : result) offsets[index + 1]++;
+			for (size_t v = 0; v < vertexcount; v++) offsets[v + 1] += offsets[v];
+			adjacency.resize(result.size());
+			fill.assign(offsets.begin(), offsets.end() - 1);
+			for (size_t t = 0; t < trianglecount; t++)
+			{
+				for (int k = 0; k < 3; k++) adjacency[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+			}
+
+			candidates.clear();
+			for (size_t t = 0; t < trianglecount; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int a = result[t * 3 + k];
+					unsigned int b = result[t * 3 + (k + 1) % 3];
+					if (a == b) continue;
+					if (!locked[a]) candidates.push_back(Collapse{ a, b, collapse_cost(a, b) });
+					if (!locked[b]) candidates.push_back(Collapse{ b, a, collapse_cost(b, a) });
+				}
+			}
+			if (candidates.empty()) break;
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			//every collapse touches froms whole one ring so the flip checks of later ones this pass still see the real triangles
+			std::iota(collapse.begin(), collapse.end(), 0u);
+			std::fill(touched.begin(), touched.end(), 0);
+			size_t toremove = (result.size() - targetindexcount) / 3;
+			size_t removed = 0;
+			bool collapsed = false;
+			for (const Collapse& candidate : candidates)
+			{
+				if (candidate.cost > maxcost || removed >= toremove) break;
+				if (touched[candidate.from] || touched[candidate.to]) continue;
+				if (flips(candidate.from, candidate.to)) continue;
+
+				collapse[candidate.from] = candidate.to;
+				for (uint32_t j = offsets[candidate.from]; j < offsets[candidate.from + 1]; j++)
+				{
+					const unsigned int* tri = &result[size_t(adjacency[j]) * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+					if (tri[0] == candidate.to || tri[1] == candidate.to || tri[2] == candidate.to) removed++;
+				}
+				AddQuadric(quadrics[candidate.to], quadrics[candidate.from]);
+				worstcost = std::max(worstcost, candidate.cost);
+				collapsed = true;
+			}
+			if (!collapsed) break;
+
+			size_t write = 0;
+			for (size_t t = 0; t < trianglecount; t++)
+			{
+				unsigned int a = collapse[result[t * 3]];
+				unsigned int b = collapse[result[t * 3 + 1]];
+				unsigned int c = collapse[result[t * 3 + 2]];
+				if (a == b || b == c || a == c) continue;
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+		}
+
+		resulterror = static_cast<float>(std::sqrt(worstcost));
+		return result;
+	}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+namespace Gibo {
+
+	/*
+	 Quadric error simplification (Garland/Heckbert) for the mesh lod chains. Only the index buffer changes, every collapse moves a vertex onto one of its neighbours so
+	 all the lods of a mesh keep sharing its one vertex buffer.
+
+	 Every vertex gets the area weighted sum of its triangles plane quadrics, collapsing u onto v costs (Q(u) + Q(v)) evaluated at v which is the squared distance from v
+	 to the planes u was on. Collapses go in passes: sort every candidate edge by cost, take the cheapest ones that don't share a triangle with an earlier one this pass and
+	 don't flip any triangle, rebuild the index buffer and go again until the target index count or maxerror stops it.
+	 Vertices on uv/normal seams (more than one vertex at a position) and on open borders are locked, otherwise the lods tear along the seams and shrink their outline.
+
+	 resulterror is the biggest error any accepted collapse had, as a distance in the same units as the positions.
+	*/
+	class MeshSimplifier
+	{
+	public:
+		//vertices are stride floats each with the position in the first 3
+		static std::vector<unsigned int> Simplify(const std::vector<unsigned int>& indices, const float* vertices, size_t vertexcount, uint32_t stride, size_t targetindexcount,
+			                                      float maxerror, float& resulterror);
+	private:
+		struct Quadric
+		{
+			double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+			double weight;
+		};
+
+		static void AddPlane(Quadric& q, double a, double b, double c, double d, double weight);
+		static void AddQuadric(Quadric& q, const Quadric& other);
+		//weight normalized squared distance of p to the quadrics planes
+		static double Evaluate(const Quadric& q, double x, double y, double z);
+	};
+
+}
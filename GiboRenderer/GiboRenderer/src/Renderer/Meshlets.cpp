@@ -0,0 +1,165 @@
+#include "../pch.h"
+#include "Meshlets.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Gibo {
+
+	void MeshletBuilder::Build(const unsigned int* indices, size_t indexcount, const float* vertices, size_t vertexcount, uint32_t stride, std::vector<Meshlet>& meshlets)
+	{
+		meshlets.clear();
+		if (indexcount < 3) return;
+
+		//stamp[v] == meshlets.size() means v is already in the meshlet being built
+		std::vector<uint32_t> stamp(vertexcount, UINT32_MAX);
+		uint32_t first = 0;
+		uint32_t uniquevertices = 0;
+		for (uint32_t i = 0; i + 2 < indexcount; i += 3)
+		{
+			uint32_t current = static_cast<uint32_t>(meshlets.size());
+			auto newvertices = [&]()
+			{
+				uint32_t count = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[i + k];
+					bool repeated = (k > 0 && indices[i] == v) || (k > 1 && indices[i + 1] == v);
+					if (stamp[v] != current && !repeated) count++;
+				}
+				return count;
+			};
+
+			uint32_t added = newvertices();
+			if (uniquevertices + added > MAX_VERTICES || (i - first) / 3 >= MAX_TRIANGLES)
+			{
+				meshlets.push_back(ComputeBounds(indices, first, i - first, vertices, stride));
+				current++;
+				first = i;
+				uniquevertices = 0;
+				added = newvertices();
+			}
+			for (int k = 0; k < 3; k++) stamp[indices[i + k]] = current;
+			uniquevertices += added;
+		}
+		uint32_t end = static_cast<uint32_t>(indexcount - indexcount % 3);
+		if (end > first) meshlets.push_back(ComputeBounds(indices, first, end - first, vertices, stride));
+	}
+
+	Meshlet MeshletBuilder::ComputeBounds(const unsigned int* indices, uint32_t firstindex, uint32_t indexcount, const float* vertices, uint32_t stride)
+	{
+		Meshlet meshlet = {};
+		meshlet.first_index = firstindex;
+		meshlet.index_count = indexcount;
+		auto position = [&](unsigned int v) { const float* p = vertices + size_t(v) * stride; return glm::vec3(p[0], p[1], p[2]); };
+		auto normal = [&](unsigned int v) { const float* p = vertices + size_t(v) * stride + 3; return glm::vec3(p[0], p[1], p[2]); };
+		const unsigned int* tri = indices + firstindex;
+
+		//sphere around the aabb center, a bit looser than a minimal one but it's only for culling
+		glm::vec3 minp = position(tri[0]);
+		glm::vec3 maxp = minp;
+		for (uint32_t i = 1; i < indexcount; i++)
+		{
+			minp = glm::min(minp, position(tri[i]));
+			maxp = glm::max(maxp, position(tri[i]));
+		}
+		glm::vec3 center = (minp + maxp) * 0.5f;
+		float radius2 = 0.0f;
+		for (uint32_t i = 0; i < indexcount; i++)
+		{
+			glm::vec3 d = position(tri[i]) - center;
+			radius2 = std::max(radius2, glm::dot(d, d));
+		}
+		meshlet.center[0] = center.x; meshlet.center[1] = center.y; meshlet.center[2] = center.z;
+		meshlet.radius = std::sqrt(radius2);
+
+		//face normals, turned to agree with the vertex normals so the cone doesn't depend on which winding the importer produced
+		glm::vec3 normals[MAX_TRIANGLES];
+		uint32_t normalcount = 0;
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = 0; i < indexcount; i += 3)
+		{
+			glm::vec3 p0 = position(tri[i]), p1 = position(tri[i + 1]), p2 = position(tri[i + 2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			if (length <= 0.0f) continue;
+			n /= length;
+			if (glm::dot(n, normal(tri[i]) + normal(tri[i + 1]) + normal(tri[i + 2])) < 0.0f) n = -n;
+			normals[normalcount++] = n;
+			axis += n;
+		}
+
+		meshlet.cone_cutoff = 2.0f;
+		float axislength = glm::length(axis);
+		if (normalcount > 0 && axislength > 1e-6f)
+		{
+			axis /= axislength;
+			float mindot = 1.0f;
+			for (uint32_t i = 0; i < normalcount; i++) mindot = std::min(mindot, glm::dot(normals[i], axis));
+			if (mindot > 0.0f) meshlet.cone_cutoff = std::sqrt(1.0f - mindot * mindot);
+		}
+		meshlet.cone_axis[0] = axis.x; meshlet.cone_axis[1] = axis.y; meshlet.cone_axis[2] = axis.z;
+		return meshlet;
+	}
+
+	uint32_t MeshletBuilder::Cull(const Meshlet* meshlets, uint32_t count, const glm::mat4& model, const MeshletCullInfo& info, std::vector<MeshletRange>& ranges)
+	{
+		//planes into model space, p.(M x) == (M^T p).x, renormalized so the sphere test still gets a distance
+		const std::vector<Plane>& worldplanes = *info.planes;
+		glm::mat4 transposed = glm::transpose(model);
+		glm::vec4 planes[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planes[p] = transposed * glm::vec4(worldplanes[p].a, worldplanes[p].b, worldplanes[p].c, worldplanes[p].d);
+			float length = glm::length(glm::vec3(planes[p]));
+			if (length > 0.0f) planes[p] /= length;
+		}
+
+		bool cones = (info.eye != glm::vec4(0.0f));
+		bool perspective = (info.eye.w != 0.0f);
+		glm::vec3 eye(0.0f);
+		if (cones)
+		{
+			eye = glm::vec3(glm::inverse(model) * info.eye);
+			if (!perspective) eye = glm::normalize(eye);
+		}
+
+		uint32_t appended = 0;
+		for (uint32_t m = 0; m < count; m++)
+		{
+			const Meshlet& meshlet = meshlets[m];
+			glm::vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+
+			bool visible = true;
+			for (int p = 0; p < 6 && visible; p++)
+			{
+				visible = glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -meshlet.radius;
+			}
+			if (visible && cones)
+			{
+				glm::vec3 axis(meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]);
+				if (perspective)
+				{
+					glm::vec3 d = center - eye;
+					visible = glm::dot(d, axis) < meshlet.cone_cutoff * glm::length(d) + meshlet.radius;
+				}
+				else
+				{
+					visible = glm::dot(eye, axis) < meshlet.cone_cutoff;
+				}
+			}
+			if (!visible) continue;
+
+			if (appended > 0 && ranges.back().first_index + ranges.back().index_count == meshlet.first_index)
+			{
+				ranges.back().index_count += meshlet.index_count;
+			}
+			else
+			{
+				ranges.push_back(MeshletRange{ meshlet.first_index, meshlet.index_count });
+				appended++;
+			}
+		}
+		return appended;
+	}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "BoundingVolumes.h"
+#include <vector>
+#include <cstdint>
+
+namespace Gibo {
+
+	/*
+	 Meshlets are small runs of a meshes lod 0 triangles (at most MAX_VERTICES unique vertices and MAX_TRIANGLES triangles) with their own bounding sphere and normal cone,
+	 so a big mesh that's mostly off screen or facing away doesn't have to be drawn all or nothing.
+
+	 Build walks the already vertex cache optimized index order and starts a new meshlet whenever the next triangle would go over either limit. That keeps every meshlet
+	 one contiguous range of the index buffer (and of the position streams index buffer, which has the same layout), so nothing gets reordered and the cache order survives.
+
+	 Cull runs per object per view on the cpu after the object itself passed culling. Everything happens in the objects model space: the planes go through the transposed
+	 model matrix and the eye through the inverse, which keeps both tests exact under any scale. A meshlet is dropped if its sphere is behind a plane, or if every triangle
+	 in it faces away from the eye. The ranges that survive get appended with neighbouring meshlets merged, that list is what gets drawn.
+
+	 cone_cutoff is sin of the cones half angle. With d the direction from the eye to the meshlet all triangles face away when dot(d, axis) >= cone_cutoff, the sphere
+	 version (dot(c - eye, axis) >= cone_cutoff * |c - eye| + radius) covers every point of the meshlet. Meshlets whose normals spread past 90 degrees get a cutoff
+	 above 1 so they never cone cull.
+	*/
+	struct Meshlet
+	{
+		float center[3];
+		float radius;
+		float cone_axis[3];
+		float cone_cutoff;
+		uint32_t first_index;
+		uint32_t index_count;
+	};
+
+	struct MeshletRange
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+	};
+
+	struct MeshletCullInfo
+	{
+		const std::vector<Plane>* planes = nullptr; //world space frustrum planes of the view, null turns meshlet culling off
+		glm::vec4 eye = glm::vec4(0.0f); //xyz1 eye position of a perspective view, xyz0 the direction an ortho view looks along, all 0 skips the cone test
+		uint32_t min_meshlets = 1; //meshes with fewer meshlets just draw whole
+	};
+
+	//the eye MeshletCullInfo wants for a view, ortho views look along their near planes normal
+	inline glm::vec4 MeshletViewEye(const glm::mat4& proj, const glm::mat4& view, const Plane& nearplane)
+	{
+		if (proj[3][3] == 0.0f) return glm::vec4(glm::vec3(glm::inverse(view)[3]), 1.0f);
+		return glm::vec4(nearplane.a, nearplane.b, nearplane.c, 0.0f);
+	}
+
+	class MeshletBuilder
+	{
+	public:
+		static constexpr uint32_t MAX_VERTICES = 64;
+		static constexpr uint32_t MAX_TRIANGLES = 124;
+
+		//vertices are stride floats each with the position in the first 3 and the normal in the next 3
+		static void Build(const unsigned int* indices, size_t indexcount, const float* vertices, size_t vertexcount, uint32_t stride, std::vector<Meshlet>& meshlets);
+		//appends the ranges of the meshlets that survive and returns how many ranges that was, 0 means the whole object is culled
+		static uint32_t Cull(const Meshlet* meshlets, uint32_t count, const glm::mat4& model, const MeshletCullInfo& info, std::vector<MeshletRange>& ranges);
+	private:
+		static Meshlet ComputeBounds(const unsigned int* indices, uint32_t firstindex, uint32_t indexcount, const float* vertices, uint32_t stride);
+	};
+
+}
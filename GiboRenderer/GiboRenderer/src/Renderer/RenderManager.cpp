@@ -9,6 +9,7 @@
 #include "ShadowAlgorithms.h"
 #include "Culling.h"
 #include "Clustered.h"
+#include <fstream>
 
 namespace Gibo {
 
@@ -55,6 +56,7 @@ namespace Gibo {
 		CleanUpDepth();
 		CleanUpReduce();
 		CleanUpCluster();
+		CleanUpGpuCull();
 		CleanUpShadow();
 		CleanUpPBR();
 		CleanUpBV();
@@ -79,6 +81,8 @@ namespace Gibo {
 		objectmanager->CleanUp();
 		delete objectmanager;
 
+		jobsystem.Shutdown();
+
 		Device.DestroyDevice();
 
 		WindowManager.Terminate();
@@ -97,6 +101,23 @@ namespace Gibo {
 
 		Device.DestroyBuffer(nearfar_buffer);
 
+		for (int i = 0; i < instance_material_buffers.size(); i++)
+		{
+			Device.DestroyBuffer(instance_material_buffers[i]);
+		}
+		if (bindless != nullptr)
+		{
+			bindless->CleanUp();
+			delete bindless;
+			bindless = nullptr;
+		}
+		if (materiallibrary != nullptr)
+		{
+			materiallibrary->CleanUp();
+			delete materiallibrary;
+			materiallibrary = nullptr;
+		}
+
 		program_pbr.CleanUp();
 
 		for (int i = 0; i < cmdbuffer_pbr.size(); i++)
@@ -126,6 +147,11 @@ namespace Gibo {
 			Device.DestroyBuffer(pv_uniform[i]);
 		}
 
+		for (int i = 0; i < instance_buffers.size(); i++)
+		{
+			Device.DestroyBuffer(instance_buffers[i]);
+		}
+
 		for (int i = 0; i < inFlightFences.size(); i++)
 		{
 			vkDestroyFence(Device.GetDevice(), inFlightFences[i], nullptr);
@@ -176,6 +202,21 @@ namespace Gibo {
 		Recreateswapchain();
 	}
 
+	void RenderManager::DefragmentGeometry()
+	{
+		vkDeviceWaitIdle(Device.GetDevice());
+		if (!meshCache->Defragment()) return;
+
+		for (RenderObject* object : objectmanager->GetSlots())
+		{
+			if (object != nullptr) meshCache->RefreshMesh(object->GetMesh());
+		}
+		meshCache->RefreshMesh(mesh_quad);
+		meshCache->RefreshMesh(shadowmesh_gui);
+		atmosphere->RefreshMesh(*meshCache);
+		gpu_draws_dirty = true;
+	}
+
 	/*
 	If you just change window size, you don't have to recreate everything, just everything relating to the size of the final image your displaying
 
@@ -214,6 +255,9 @@ namespace Gibo {
 		Reducedeleteimagedata();
 		Reducecreateimagedata();
 
+		GpuCulldeleteimagedata();
+		GpuCullcreateimagedata();
+
 		Clusterdeleteimagedata();
 		Clustercreateimagedata();
 
@@ -239,6 +283,7 @@ namespace Gibo {
 
 		createReducefinal();
 		createClusterfinal();
+		createGpuCullfinal();
 		createPBRfinal();
 
 		if (enable_imgui)
@@ -375,9 +420,11 @@ namespace Gibo {
 		pipelinedata.Multisamplingstate.minsampleshading = .5;
 
 		pipelinedata.Inputassembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		std::vector<VkDescriptorSetLayout> layoutsz = { program_pbr.GetGlobalLayout(), program_pbr.GetLocalLayout() };
+		std::vector<VkDescriptorSetLayout> layoutsz = { program_pbr.GetGlobalLayout(), (bindless_active) ? bindless->GetLayout() : program_pbr.GetLocalLayout() };
 
 		pipeline_pbr = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_pbr, program_pbr.GetShaderStageInfo(), program_pbr.GetPushRanges(), layoutsz.data(), layoutsz.size());
+		pipelinedata.VertexInputstate.format = VERTEX_FORMAT::QUANTIZED;
+		pipeline_pbr_quantized = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_pbr, program_pbr.GetShaderStageInfo(), program_pbr.GetPushRanges(), layoutsz.data(), layoutsz.size());
 	}
 
 	void RenderManager::PBRdeleteimagedata()
@@ -410,6 +457,8 @@ namespace Gibo {
 		framebuffer_pbr.clear();
 		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_pbr.layout, nullptr);
 		vkDestroyPipeline(Device.GetDevice(), pipeline_pbr.pipeline, nullptr);
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_pbr_quantized.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_pbr_quantized.pipeline, nullptr);
 	}
 
 	void RenderManager::CreateQuad()
@@ -547,7 +596,7 @@ namespace Gibo {
 		VkDeviceSize sizes[] = { 0 };
 		vkCmdBindVertexBuffers(cmdbuffer_quad[current_frame], 0, 1, &mesh_quad.vbo, sizes);
 		vkCmdBindIndexBuffer(cmdbuffer_quad[current_frame], mesh_quad.ibo, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmdbuffer_quad[current_frame], mesh_quad.index_size, 1, 0, 0, 0);
+		vkCmdDrawIndexed(cmdbuffer_quad[current_frame], mesh_quad.index_size, 1, mesh_quad.first_index, mesh_quad.vertex_offset, 0);
 
 		vkCmdEndRenderPass(cmdbuffer_quad[current_frame]);
 
@@ -696,8 +745,36 @@ namespace Gibo {
 		sprintf_s(overlay, "%f milliseconds", time_cpu[time_counter]);
 		ImGui::PlotLines("render cpu", time_cpu.data(), time_cpu.size(), 0, overlay, 0.0f, 32.0f, ImVec2(0, 80.0f));
 
+		sprintf_s(overlay, "%f milliseconds", time_sort[time_counter]);
+		ImGui::PlotLines("draw sort cpu", time_sort.data(), time_sort.size(), 0, overlay, 0.0f, 4.0f, ImVec2(0, 80.0f));
+
 
 		ImGui::Checkbox("Show Bounding Volumes", &Display_BV);
+		ImGui::Checkbox("Hierarchical Culling", &BVH_CULLING);
+		ImGui::Checkbox("Multithreaded Recording", &MULTITHREADED_RECORDING);
+		ImGui::Checkbox("Auto Instancing", &AUTO_INSTANCING);
+		ImGui::Checkbox("Sort Draws", &SORT_DRAWS);
+		ImGui::Checkbox("Occlusion Culling", &OCCLUSION_CULLING);
+		ImGui::Checkbox("CPU Occlusion Culling", &CPU_OCCLUSION_CULLING);
+		MaskedOcclusionBuffer::Stats occlusionstats = cpu_occlusion.GetStats();
+		ImGui::Text("cpu occlusion: %u occluder triangles, %u/%u objects occluded", occlusionstats.triangles, occlusionstats.occluded, occlusionstats.tested);
+		MaterialLibrary::Stats materialstats = materiallibrary->GetStats();
+		ImGui::Text("materials: %u/%u records, %u uploaded in %u ranges", materialstats.records, materialstats.capacity, materialstats.flushed_records, materialstats.flushed_ranges);
+		TextureResidency::Stats streamstats = textureCache->GetResidency().GetStats();
+		textureCache->GetResidency().ResetStats();
+		ImGui::Text("textures: %u/%u full, %u streaming, %u in %u out, %llu/%llu MB", streamstats.full, streamstats.textures, streamstats.streaming, streamstats.streamed_in, streamstats.evicted,
+			        streamstats.resident_bytes / (1024 * 1024), streamstats.budget_bytes / (1024 * 1024));
+		if (ImGui::SliderInt("Texture Budget MB (0 auto)", &texture_budget_mb, 0, 4096))
+		{
+			textureCache->GetResidency().SetBudgetOverride(VkDeviceSize(texture_budget_mb) * 1024 * 1024);
+		}
+		if (sort_benchmark_frame < 0 && ImGui::Button("Benchmark Draw Sorting"))
+		{
+			sort_benchmark_frame = 0;
+			SORT_DRAWS = false;
+			sort_benchmark_gpu.fill(0.0);
+			sort_benchmark_cpu.fill(0.0);
+		}
 
 		char overlaytheta[32];
 		sprintf_s(overlaytheta, "%f ", debug_theta);
@@ -825,14 +902,18 @@ namespace Gibo {
 		Logger::LogInfo("Shaders Finished-------------------\n");
 		
 		meshCache = new MeshCache(Device);
-		textureCache = new TextureCache(Device);
+		textureCache = new TextureCache(Device, jobsystem, FRAMES_IN_FLIGHT);
 		lightmanager = new LightManager(Device, FRAMES_IN_FLIGHT);
-		objectmanager = new RenderObjectManager(Device, *meshCache, FRAMES_IN_FLIGHT);
+		jobsystem.Initialize();
+		Logger::LogInfo("Job system running on ", jobsystem.GetThreadCount(), " threads\n");
+		objectmanager = new RenderObjectManager(Device, *meshCache, jobsystem, FRAMES_IN_FLIGHT);
+		Device.GetCommandPoolCache().CreateThreadPools(jobsystem.GetThreadCount(), FRAMES_IN_FLIGHT);
 
 		std::cin >> a;
 		CreateDepth();
 		CreateReduce();
 		CreateCluster();
+		CreateGpuCull();
 		CreateShadow();
 		CreatePBR();
 		CreateBV(); //after pv buffer is created
@@ -844,6 +925,7 @@ namespace Gibo {
 		createDepthfinal();
 		createReducefinal();
 		createClusterfinal();
+		createGpuCullfinal();
 		createShadowFinal();
 		createPBRfinal();
 		CreateQuad();
@@ -1219,7 +1301,7 @@ namespace Gibo {
 			VkDeviceSize sizes[] = { 0 };
 			vkCmdBindVertexBuffers(cmdbuffer_gui[current_frame], 0, 1, &mesh_quad.vbo, sizes);
 			vkCmdBindIndexBuffer(cmdbuffer_gui[current_frame], mesh_quad.ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, 0, 0, 0);
+			vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, mesh_quad.first_index, mesh_quad.vertex_offset, 0);
 		}
 
 		vkCmdBindDescriptorSets(cmdbuffer_gui[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_gui.layout, 1, 1, &program_gui.GetLocalDescriptor(1, current_frame), 0, nullptr);
@@ -1230,7 +1312,7 @@ namespace Gibo {
 		VkDeviceSize sizes[] = { 0 };
 		vkCmdBindVertexBuffers(cmdbuffer_gui[current_frame], 0, 1, &mesh_quad.vbo, sizes);
 		vkCmdBindIndexBuffer(cmdbuffer_gui[current_frame], mesh_quad.ibo, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, 0, 0, 0);
+		vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, mesh_quad.first_index, mesh_quad.vertex_offset, 0);
 
 		//draw depth prepass
 		/*vkCmdBindDescriptorSets(cmdbuffer_gui[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_gui.layout, 1, 1, &program_gui.GetLocalDescriptor(3, current_frame), 0, nullptr);
@@ -1240,7 +1322,7 @@ namespace Gibo {
 		vkCmdPushConstants(cmdbuffer_gui[current_frame], pipeline_gui.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &gui_matrix_scale);
 		vkCmdBindVertexBuffers(cmdbuffer_gui[current_frame], 0, 1, &mesh_quad.vbo, sizes);
 		vkCmdBindIndexBuffer(cmdbuffer_gui[current_frame], mesh_quad.ibo, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, 0, 0, 0);
+		vkCmdDrawIndexed(cmdbuffer_gui[current_frame], mesh_quad.index_size, 1, mesh_quad.first_index, mesh_quad.vertex_offset, 0);
 		*/
 		vkCmdEndRenderPass(cmdbuffer_gui[current_frame]);
 
@@ -1267,13 +1349,14 @@ namespace Gibo {
 			{"Shaders/spv/shadowfrag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> globalinfo1 = {
+			{"InstanceBuffer", 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> localinfo1 = {
 			{"ProjVertexBuffer", 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
 			{"nearBuffer", 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
 		};
 		std::vector<ShaderProgram::pushconstantinfo> pushconstants1 = {
-			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)}
+			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecodeConstants)}
 		};
 
 		if (!program_shadow.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info1.data(), info1.size(), globalinfo1.data(), globalinfo1.size(), localinfo1.data(), localinfo1.size(),
@@ -1288,12 +1371,13 @@ namespace Gibo {
 			{"Shaders/spv/shadowpointfrag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> globalinfo2 = {
+			{"InstanceBuffer", 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> localinfo2 = {
 			{"ProjVertexBuffer", 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
 		};
 		std::vector<ShaderProgram::pushconstantinfo> pushconstants2 = {
-			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)}
+			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecodeConstants)}
 		};
 
 		if (!program_shadowpoint.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info2.data(), info2.size(), globalinfo2.data(), globalinfo2.size(), localinfo2.data(), localinfo2.size(),
@@ -1342,6 +1426,16 @@ namespace Gibo {
 			Device.CreateBuffer(sizeof(glm::vec4) * (MAX_CASCADES - 1), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, cascade_depthbuffers[i]);
 		}
 
+		//instance buffer is the only global, the pv matrices are local per cascade/atlas slot
+		DescriptorHelper instance_descriptors(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			instance_descriptors.buffersizes[i].push_back(sizeof(glm::mat4) * INSTANCE_CAPACITY);
+			instance_descriptors.uniformbuffers[i].push_back(instance_buffers[i]);
+		}
+		program_shadow.SetGlobalDescriptor(instance_descriptors.uniformbuffers, instance_descriptors.buffersizes, instance_descriptors.imageviews, instance_descriptors.samplers, instance_descriptors.bufferviews);
+		program_shadowpoint.SetGlobalDescriptor(instance_descriptors.uniformbuffers, instance_descriptors.buffersizes, instance_descriptors.imageviews, instance_descriptors.samplers, instance_descriptors.bufferviews);
+
 		//cascade descriptors
 		for (int c = 0; c < CASCADE_COUNT; c++)
 		{
@@ -1472,7 +1566,10 @@ namespace Gibo {
 		pipelinedata.Inputassembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		std::vector<VkDescriptorSetLayout> layoutsz = { program_shadow.GetGlobalLayout(), program_shadow.GetLocalLayout() };
 
+		pipelinedata.VertexInputstate.position_only = true;
 		pipeline_shadow = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_shadow, program_shadow.GetShaderStageInfo(), program_shadow.GetPushRanges(), layoutsz.data(), layoutsz.size());
+		pipelinedata.VertexInputstate.format = VERTEX_FORMAT::QUANTIZED;
+		pipeline_shadow_quantized = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_shadow, program_shadow.GetShaderStageInfo(), program_shadow.GetPushRanges(), layoutsz.data(), layoutsz.size());
 		
 		//point pipeline
 		PipelineData pipelinedata2(shadowpoint_width, shadowpoint_height);
@@ -1500,7 +1597,10 @@ namespace Gibo {
 		pipelinedata2.Inputassembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		std::vector<VkDescriptorSetLayout> layoutsz2 = { program_shadowpoint.GetGlobalLayout(), program_shadowpoint.GetLocalLayout() };
 
+		pipelinedata2.VertexInputstate.position_only = true;
 		pipeline_shadowpoint = pipecache.GetGraphicsPipeline(pipelinedata2, Device.GetPhysicalDevice(), renderpass_shadowpoint, program_shadowpoint.GetShaderStageInfo(), program_shadowpoint.GetPushRanges(), layoutsz2.data(), layoutsz2.size());
+		pipelinedata2.VertexInputstate.format = VERTEX_FORMAT::QUANTIZED;
+		pipeline_shadowpoint_quantized = pipecache.GetGraphicsPipeline(pipelinedata2, Device.GetPhysicalDevice(), renderpass_shadowpoint, program_shadowpoint.GetShaderStageInfo(), program_shadowpoint.GetPushRanges(), layoutsz2.data(), layoutsz2.size());
 	}
 
 	void RenderManager::Shadowdeleteimagedata()
@@ -1528,6 +1628,12 @@ namespace Gibo {
 
 		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_shadowpoint.layout, nullptr);
 		vkDestroyPipeline(Device.GetDevice(), pipeline_shadowpoint.pipeline, nullptr);
+
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_shadow_quantized.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_shadow_quantized.pipeline, nullptr);
+
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_shadowpoint_quantized.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_shadowpoint_quantized.pipeline, nullptr);
 	}
 
 	void RenderManager::CleanUpShadow()
@@ -1576,19 +1682,29 @@ namespace Gibo {
 			Device.CreateBuffer(sizeof(glm::mat4) * 2, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, pv_uniform[i]);
 		}
 
+		//instance buffer, every pass reads its model matrices out of this with gl_InstanceIndex
+		instance_buffers.resize(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			Device.CreateBuffer(sizeof(glm::mat4) * INSTANCE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, instance_buffers[i]);
+		}
+		instance_data.resize(INSTANCE_CAPACITY);
+		cpu_occlusion.Resize(CPU_OCCLUSION_WIDTH, CPU_OCCLUSION_HEIGHT);
+
 		//program
 		std::vector<ShaderProgram::shadersinfo> info1 = {
 			{"Shaders/spv/depthvert.spv", VK_SHADER_STAGE_VERTEX_BIT},
 			{"Shaders/spv/depth_presspass.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> globalinfo1 = {
-			{"ProjVertexBuffer", 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
+			{"ProjVertexBuffer", 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+			{"InstanceBuffer", 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> localinfo1 = {
 				//alpha
 		};
 		std::vector<ShaderProgram::pushconstantinfo> pushconstants1 = {
-			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)}
+			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecodeConstants)}
 		};
 
 		if (!program_depth.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info1.data(), info1.size(), globalinfo1.data(), globalinfo1.size(), localinfo1.data(), localinfo1.size(),
@@ -1624,6 +1740,7 @@ namespace Gibo {
 	void RenderManager::Depthdeleteimagedata()
 	{
 		vkDestroyRenderPass(Device.GetDevice(), renderpass_depth, nullptr);
+		vkDestroyRenderPass(Device.GetDevice(), renderpass_depth_late, nullptr);
 
 		for (int i = 0; i < depthprepass_attachment.size(); i++)
 		{
@@ -1641,6 +1758,8 @@ namespace Gibo {
 
 		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_depth.layout, nullptr);
 		vkDestroyPipeline(Device.GetDevice(), pipeline_depth.pipeline, nullptr);
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_depth_quantized.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_depth_quantized.pipeline, nullptr);
 	}
 
 	void RenderManager::Depthcreateimagedata()
@@ -1666,6 +1785,12 @@ namespace Gibo {
 			renderpass_depth = rpcache.GetRenderPass(attachments.data(), attachments.size(), VK_PIPELINE_BIND_POINT_GRAPHICS);
 		}
 
+		//occlusion cullings late phase draws on top of the early depth pass. Only the load op and layouts differ so the depth framebuffers and pipelines work with it
+		RenderPassAttachment lateattachment(0, findDepthFormat(Device.GetPhysicalDevice()), multisampling_count, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, RENDERPASSTYPE::DEPTH);
+		renderpass_depth_late = rpcache.GetRenderPass(&lateattachment, 1, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
 		//depth images/views
 		depthprepass_attachment.resize(FRAMES_IN_FLIGHT);
 		depthprepass_view.resize(FRAMES_IN_FLIGHT);
@@ -1717,7 +1842,10 @@ namespace Gibo {
 		pipelinedata.Inputassembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		std::vector<VkDescriptorSetLayout> layoutsz = { program_depth.GetGlobalLayout(), program_depth.GetLocalLayout() };
 
+		pipelinedata.VertexInputstate.position_only = true;
 		pipeline_depth = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_depth, program_depth.GetShaderStageInfo(), program_depth.GetPushRanges(), layoutsz.data(), layoutsz.size());
+		pipelinedata.VertexInputstate.format = VERTEX_FORMAT::QUANTIZED;
+		pipeline_depth_quantized = pipecache.GetGraphicsPipeline(pipelinedata, Device.GetPhysicalDevice(), renderpass_depth, program_depth.GetShaderStageInfo(), program_depth.GetPushRanges(), layoutsz.data(), layoutsz.size());
 	}
 
 	void RenderManager::createDepthfinal()
@@ -1727,10 +1855,127 @@ namespace Gibo {
 		{
 			global_descriptors.buffersizes[i].push_back(sizeof(glm::mat4) * 2);
 			global_descriptors.uniformbuffers[i].push_back(pv_uniform[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(glm::mat4) * INSTANCE_CAPACITY);
+			global_descriptors.uniformbuffers[i].push_back(instance_buffers[i]);
 		}
 		program_depth.SetGlobalDescriptor(global_descriptors.uniformbuffers, global_descriptors.buffersizes, global_descriptors.imageviews, global_descriptors.samplers, global_descriptors.bufferviews);
 	}
 
+	//secondary out of the calling threads pool, begun inside renderpass/framebuffer. Secondaries inherit nothing so bind pipelines/descriptors/viewports again in them.
+	VkCommandBuffer RenderManager::BeginSecondaryCmd(int current_frame, VkRenderPass renderpass, VkFramebuffer framebuffer)
+	{
+		VkCommandBuffer secondary = Device.GetCommandPoolCache().GetSecondaryCommandBuffer(JobSystem::GetThreadIndex(), current_frame);
+
+		VkCommandBufferInheritanceInfo inheritance_info = {};
+		inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance_info.renderPass = renderpass;
+		inheritance_info.subpass = 0;
+		inheritance_info.framebuffer = framebuffer;
+
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		begin_info.pInheritanceInfo = &inheritance_info;
+
+		vkBeginCommandBuffer(secondary, &begin_info);
+		return secondary;
+	}
+
+	//splits count draws into chunks and records every chunk into its own secondary on the job system. record(cmd, begin, end) records draws [begin, end) and its own state.
+	//the secondaries get appended to secondaries in draw order so executing them keeps the same order as recording it all inline.
+	template<typename F>
+	void RenderManager::RecordSecondaryCmds(int current_frame, VkRenderPass renderpass, VkFramebuffer framebuffer, uint32_t count, std::vector<VkCommandBuffer>& secondaries, F record)
+	{
+		if (count == 0) return;
+
+		//not worth spinning up a job for a couple draws, and with threading off everything goes in one secondary
+		uint32_t grainsize = (MULTITHREADED_RECORDING) ? std::max(RECORD_GRAIN_SIZE, (count + jobsystem.GetThreadCount() - 1) / jobsystem.GetThreadCount()) : count;
+		uint32_t first = static_cast<uint32_t>(secondaries.size());
+		secondaries.resize(first + (count + grainsize - 1) / grainsize);
+
+		jobsystem.ParallelFor(count, grainsize, [&](uint32_t begin, uint32_t end)
+		{
+			VkCommandBuffer secondary = BeginSecondaryCmd(current_frame, renderpass, framebuffer);
+			record(secondary, begin, end);
+			vkEndCommandBuffer(secondary);
+			secondaries[first + begin / grainsize] = secondary;
+		});
+	}
+
+	//binds a meshes buffers and pushes its decode constants. bound is what's bound in cmd right now: if the mesh uses the other vertex format the pipeline gets switched,
+	//both pipelines of a pass share one layout so the descriptor sets stay bound through the switch. meshes live in a few shared arena buffers, so the vertex/index
+	//buffers only get rebound when the mesh sits in a different block than the last one, and its offsets into them are kept in bound for DrawBatch.
+	//position_stream binds the welded position only buffers instead, for the depth/shadow pipelines created with VertexInput::position_only
+	void RenderManager::BindMesh(VkCommandBuffer cmd, const MeshCache::Mesh& mesh, const vkcorePipeline& pipeline_full, const vkcorePipeline& pipeline_quantized, BoundMesh& bound,
+		                         bool position_stream)
+	{
+		if (mesh.vertex_format != bound.format)
+		{
+			bound.format = mesh.vertex_format;
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, (bound.format == VERTEX_FORMAT::QUANTIZED) ? pipeline_quantized.pipeline : pipeline_full.pipeline);
+		}
+		vkCmdPushConstants(cmd, pipeline_full.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecodeConstants), &mesh.decode);
+
+		const VkBuffer& vbo = (position_stream) ? mesh.position_vbo : mesh.vbo;
+		VkBuffer ibo = (position_stream) ? mesh.position_ibo : mesh.ibo;
+		if (vbo != bound.vbo)
+		{
+			VkDeviceSize sizes[] = { 0 };
+			vkCmdBindVertexBuffers(cmd, 0, 1, &vbo, sizes);
+			bound.vbo = vbo;
+		}
+		if (ibo != bound.ibo || mesh.index_type != bound.index_type)
+		{
+			vkCmdBindIndexBuffer(cmd, ibo, 0, mesh.index_type);
+			bound.ibo = ibo;
+			bound.index_type = mesh.index_type;
+		}
+		bound.first_index = (position_stream) ? mesh.position_first_index : mesh.first_index;
+		bound.vertex_offset = (position_stream) ? mesh.position_vertex_offset : mesh.vertex_offset;
+	}
+
+	//one draw for the batches lod, or one per surviving meshlet range if it got refined. lod and meshlet index ranges are relative to the mesh, bound has where it starts
+	void RenderManager::DrawBatch(VkCommandBuffer cmd, const InstanceBatch& batch, const std::vector<MeshletRange>& ranges, const BoundMesh& bound)
+	{
+		if (batch.range_count == 0)
+		{
+			const MeshLod& lod = batch.object->GetMesh().lods[batch.lod];
+			vkCmdDrawIndexed(cmd, lod.index_count, batch.instance_count, bound.first_index + lod.first_index, bound.vertex_offset, batch.first_instance);
+			return;
+		}
+		for (uint32_t r = batch.first_range; r < batch.first_range + batch.range_count; r++)
+		{
+			vkCmdDrawIndexed(cmd, ranges[r].index_count, batch.instance_count, bound.first_index + ranges[r].first_index, bound.vertex_offset, batch.first_instance);
+		}
+	}
+
+	//draws buckets [begin, end) of pass with one indirect count draw each. Every record of a bucket shares its buffers, decode constants and (for pbr without bindless
+	//textures) material so the first objects mesh and descriptor get bound for all of them, the commands carry their own lod ranges and offsets
+	void RenderManager::DrawGpuBuckets(VkCommandBuffer cmd, uint32_t pass, uint32_t begin, uint32_t end, const vkcorePipeline& pipeline_full, const vkcorePipeline& pipeline_quantized,
+		                               BoundMesh& bound, int current_frame)
+	{
+		const GpuCullParams& params = gpu_cull_params[current_frame];
+		uint32_t stream = (pass == GPU_CULL_PASS_PBR) ? GPU_CULL_STREAM_FULL : GPU_CULL_STREAM_POSITION;
+		const std::vector<GpuDrawBucket>& buckets = gpu_draws.buckets[stream];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			RenderObject* object = buckets[i].object;
+			if (pass == GPU_CULL_PASS_PBR && !bindless_active)
+			{
+				const VkDescriptorSet* set = program_pbr.FindLocalDescriptor(object->GetId(), current_frame);
+				if (set == nullptr) continue;
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, set, 0, nullptr);
+			}
+			BindMesh(cmd, object->GetMesh(), pipeline_full, pipeline_quantized, bound, stream == GPU_CULL_STREAM_POSITION);
+
+			VkDeviceSize commandoffset = sizeof(VkDrawIndexedIndirectCommand) * (VkDeviceSize(pass) * params.command_stride + buckets[i].first);
+			VkDeviceSize countoffset = sizeof(uint32_t) * (VkDeviceSize(pass) * params.bucket_stride + i);
+			Device.CmdDrawIndexedIndirectCount(cmd, gpucull_commands[current_frame].buffer, commandoffset, gpucull_counts[current_frame].buffer, countoffset, buckets[i].capacity,
+				                               sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
 	void RenderManager::RecordDepthCmd(int current_frame)
 	{
 		vkResetCommandBuffer(cmdbuffer_depth[current_frame], 0);
@@ -1758,25 +2003,45 @@ namespace Gibo {
 		begin_rp.pClearValues = clearValues.data();
 		begin_rp.clearValueCount = clearValues.size();
 
-		vkCmdBeginRenderPass(cmdbuffer_depth[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_INLINE);
+		//the indirect draws of every pass this frame get culled and written here, before anything draws with them
+		if (gpu_culling_active)
+		{
+			RecordGpuCull(current_frame);
+		}
 
-		vkCmdBindPipeline(cmdbuffer_depth[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.pipeline);
-		vkCmdBindDescriptorSets(cmdbuffer_depth[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.layout, 0, 1, &program_depth.GetGlobalDescriptor(current_frame), 0, nullptr);
+		vkCmdBeginRenderPass(cmdbuffer_depth[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 		//render all opaque objects for early z test, transparent objects need overdraw. This doesn't have min/max values for transparent objects
 		//transparent objects don't actually occlude things so its okay to not have them here for query calculations/etc
-		auto bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR];
-		std::vector<uint32_t> visible_objects = FrustrumIntersection(CalculatePlanes(proj_matrix * cam_matrix), bin, objectmanager->GetBoundingVolumes(), proj_matrix*cam_matrix);
-		for (int i = 0; i < visible_objects.size(); i++)
-		{
-			int index = visible_objects[i];
+		//with gpu culling every secondary draws a range of buckets instead of batches
+		const std::vector<InstanceBatch>& batches = view_batches[VIEW_CAMERA];
+		const std::vector<MeshletRange>& ranges = view_ranges[VIEW_CAMERA];
+		uint32_t drawcount = static_cast<uint32_t>((gpu_culling_active) ? gpu_draws.buckets[GPU_CULL_STREAM_POSITION].size() : batches.size());
+		secondary_cmds.clear();
+		RecordSecondaryCmds(current_frame, renderpass_depth, framebuffers_depth[current_frame], drawcount, secondary_cmds,
+			[&](VkCommandBuffer cmd, uint32_t begin, uint32_t end)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.pipeline);
+			BoundMesh bound;
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.layout, 0, 1, &program_depth.GetGlobalDescriptor(current_frame), 0, nullptr);
+
+			if (gpu_culling_active)
+			{
+				DrawGpuBuckets(cmd, GPU_CULL_PASS_DEPTH, begin, end, pipeline_depth, pipeline_depth_quantized, bound, current_frame);
+				return;
+			}
 
-			vkCmdPushConstants(cmdbuffer_depth[current_frame], pipeline_depth.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[index]->GetMatrix(current_frame));
+			for (uint32_t i = begin; i < end; i++)
+			{
+				RenderObject* object = batches[i].object;
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_depth[current_frame], 0, 1, &bin[index]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_depth[current_frame], bin[index]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_depth[current_frame], bin[index]->GetMesh().index_size, 1, 0, 0, 0);
+				BindMesh(cmd, object->GetMesh(), pipeline_depth, pipeline_depth_quantized, bound, true);
+				DrawBatch(cmd, batches[i], ranges, bound);
+			}
+		});
+		if (!secondary_cmds.empty())
+		{
+			vkCmdExecuteCommands(cmdbuffer_depth[current_frame], static_cast<uint32_t>(secondary_cmds.size()), secondary_cmds.data());
 		}
 
 		/*for (int j = 0; j < bin.size(); j++)
@@ -1791,6 +2056,30 @@ namespace Gibo {
 		}
 		*/
 		vkCmdEndRenderPass(cmdbuffer_depth[current_frame]);
+
+		//occlusion culling: build the pyramid of what the early phase drew, test everything against it and draw the newly visible objects on top
+		if (gpu_culling_active && gpu_cull_params[current_frame].occlusion != 0)
+		{
+			RecordHiZ(current_frame);
+			RecordGpuCullLate(current_frame);
+
+			begin_rp.renderPass = renderpass_depth_late;
+			vkCmdBeginRenderPass(cmdbuffer_depth[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			secondary_cmds.clear();
+			RecordSecondaryCmds(current_frame, renderpass_depth_late, framebuffers_depth[current_frame], drawcount, secondary_cmds,
+				[&](VkCommandBuffer cmd, uint32_t begin, uint32_t end)
+			{
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.pipeline);
+				BoundMesh bound;
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_depth.layout, 0, 1, &program_depth.GetGlobalDescriptor(current_frame), 0, nullptr);
+				DrawGpuBuckets(cmd, GpuCullPassLate(), begin, end, pipeline_depth, pipeline_depth_quantized, bound, current_frame);
+			});
+			if (!secondary_cmds.empty())
+			{
+				vkCmdExecuteCommands(cmdbuffer_depth[current_frame], static_cast<uint32_t>(secondary_cmds.size()), secondary_cmds.data());
+			}
+			vkCmdEndRenderPass(cmdbuffer_depth[current_frame]);
+		}
 		
 		//set timer here at bottom of pipeline
 		Device.GetQueryManager().WriteTimeStamp(cmdbuffer_depth[current_frame], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current_frame, QueryManager::QUERY_NAME::DEPTH, false);
@@ -2303,6 +2592,357 @@ namespace Gibo {
 		VULKAN_CHECK(vkEndCommandBuffer(cmdbuffer_cluster[current_frame]), "end cluster cmdbuffer");
 	}
 
+	void RenderManager::CreateGpuCull()
+	{
+		gpu_draws_uploaded.assign(FRAMES_IN_FLIGHT, UINT32_MAX);
+		gpu_cull_params.assign(FRAMES_IN_FLIGHT, GpuCullParams{});
+		if (!Device.SupportsDrawIndirectCount())
+		{
+			Logger::LogInfo("no draw indirect count, culling stays on the cpu\n");
+			return;
+		}
+
+		//buffers. inputs get written by the cpu every frame, the outputs only get read by the indirect draws unless we're validating them
+		uint32_t passcount = GpuCullPassLate() + 1;
+		VmaMemoryUsage outputusage = (GPU_CULL_VALIDATE) ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_GPU_ONLY;
+		gpucull_records.resize(FRAMES_IN_FLIGHT);
+		gpucull_meshes.resize(FRAMES_IN_FLIGHT);
+		gpucull_bounds.resize(FRAMES_IN_FLIGHT);
+		gpucull_passes.resize(FRAMES_IN_FLIGHT);
+		gpucull_commands.resize(FRAMES_IN_FLIGHT);
+		gpucull_counts.resize(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			Device.CreateBuffer(sizeof(GpuDrawRecord) * MAX_GPU_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, gpucull_records[i]);
+			Device.CreateBuffer(sizeof(GpuMeshRecord) * MAX_GPU_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, gpucull_meshes[i]);
+			Device.CreateBuffer(sizeof(GpuCullBounds) * MAX_GPU_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, gpucull_bounds[i]);
+			Device.CreateBuffer(sizeof(GpuCullPass) * GPU_CULL_MAX_PASSES, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, gpucull_passes[i]);
+			Device.CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_GPU_DRAWS * passcount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				                outputusage, 0, gpucull_commands[i]);
+			Device.CreateBuffer(sizeof(uint32_t) * MAX_GPU_DRAWS * passcount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				                outputusage, 0, gpucull_counts[i]);
+		}
+		Device.CreateBuffer(sizeof(uint32_t) * MAX_GPU_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY, 0, gpucull_visibility);
+
+		//program
+		std::vector<ShaderProgram::shadersinfo> info1 = {
+			{"Shaders/spv/gpucull.spv", VK_SHADER_STAGE_COMPUTE_BIT},
+		};
+		std::vector<ShaderProgram::descriptorinfo> globalinfo1 = {
+			{"DrawRecords", 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"DrawBounds", 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"MeshRecords", 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"CullPasses", 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"DrawCommands", 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"DrawCounts", 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"DrawVisibility", 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT},
+			{"hiz", 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, VK_IMAGE_LAYOUT_GENERAL}
+		};
+		std::vector<ShaderProgram::descriptorinfo> localinfo1 = {
+		};
+		std::vector<ShaderProgram::pushconstantinfo> pushconstants1 = {
+			{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullParams)}
+		};
+		if (!program_gpucull.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info1.data(), info1.size(), globalinfo1.data(), globalinfo1.size(), localinfo1.data(), localinfo1.size(),
+			pushconstants1.data(), pushconstants1.size(), 1))
+		{
+			Logger::LogError("failed to create gpu cull shaderprogram\n");
+		}
+
+		//nothing the cull pipeline uses depends on the swapchain, the hi-z does
+		pipeline_gpucull = Device.GetPipelineCache().GetComputePipeline(program_gpucull.GetShaderStageInfo()[0], &program_gpucull.GetGlobalLayout(), 1, program_gpucull.GetPushRanges());
+
+		//hi-z, one set per pyramid level
+		std::vector<ShaderProgram::shadersinfo> info2 = {
+			{"Shaders/spv/hizbuild.spv", VK_SHADER_STAGE_COMPUTE_BIT},
+		};
+		std::vector<ShaderProgram::descriptorinfo> globalinfo2 = {
+			{"depth_prepass", 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+			{"depth_prepassMS", 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+			{"input_tex", 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, VK_IMAGE_LAYOUT_GENERAL},
+			{"output_tex", 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, VK_IMAGE_LAYOUT_GENERAL}
+		};
+		std::vector<ShaderProgram::descriptorinfo> localinfo2 = {
+		};
+		std::vector<ShaderProgram::pushconstantinfo> pushconstants2 = {
+			{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * 2}
+		};
+		if (!program_hiz.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info2.data(), info2.size(), globalinfo2.data(), globalinfo2.size(), localinfo2.data(), localinfo2.size(),
+			pushconstants2.data(), pushconstants2.size(), 1, 20))
+		{
+			Logger::LogError("failed to create hi-z shaderprogram\n");
+		}
+
+		//the cull shader only uses texelFetch on it but a combined sampler still needs one
+		SamplerKey key(VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			VK_FALSE, 1.0f, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE, VK_SAMPLER_MIPMAP_MODE_NEAREST, 0.0f, 16.0f, 0.0f);
+		hiz_sampler = Device.GetSamplerCache().GetSampler(key);
+
+		GpuCullcreateimagedata();
+	}
+
+	void RenderManager::CleanUpGpuCull()
+	{
+		if (!Device.SupportsDrawIndirectCount()) return;
+
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			Device.DestroyBuffer(gpucull_records[i]);
+			Device.DestroyBuffer(gpucull_meshes[i]);
+			Device.DestroyBuffer(gpucull_bounds[i]);
+			Device.DestroyBuffer(gpucull_passes[i]);
+			Device.DestroyBuffer(gpucull_commands[i]);
+			Device.DestroyBuffer(gpucull_counts[i]);
+		}
+		Device.DestroyBuffer(gpucull_visibility);
+
+		GpuCulldeleteimagedata();
+
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_gpucull.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_gpucull.pipeline, nullptr);
+
+		program_gpucull.CleanUp();
+		program_hiz.CleanUp();
+	}
+
+	//hi-z pyramid of every frame. Level 0 is half the depth resolution rounded up and every level halves again down to 1x1, so texel t of level l is the farthest
+	//depth of pixels [t, t + 1) << (l + 1)
+	void RenderManager::GpuCullcreateimagedata()
+	{
+		if (!Device.SupportsDrawIndirectCount()) return;
+
+		hiz_extents.clear();
+		uint32_t width = Resolution.width;
+		uint32_t height = Resolution.height;
+		do
+		{
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+			hiz_extents.push_back(VkExtent2D{ width, height });
+		} while (width > 1 || height > 1);
+		uint32_t levels = static_cast<uint32_t>(hiz_extents.size());
+
+		VkFormat format = VK_FORMAT_R32_SFLOAT;
+		hiz_images.resize(FRAMES_IN_FLIGHT);
+		hiz_views.resize(FRAMES_IN_FLIGHT);
+		hiz_levelviews.resize(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			Device.CreateImage(VK_IMAGE_TYPE_2D, format, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT, hiz_extents[0].width, hiz_extents[0].height, 1,
+				levels, 1, VMA_MEMORY_USAGE_GPU_ONLY, 0, hiz_images[i]);
+
+			hiz_views[i] = CreateImageView(Device.GetDevice(), hiz_images[i].image, format, VK_IMAGE_ASPECT_COLOR_BIT, levels, 1, VK_IMAGE_VIEW_TYPE_2D);
+			hiz_levelviews[i].resize(levels);
+			for (uint32_t j = 0; j < levels; j++)
+			{
+				hiz_levelviews[i][j] = CreateImageView(Device.GetDevice(), hiz_images[i].image, format, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1, VK_IMAGE_VIEW_TYPE_2D, j);
+			}
+
+			//stays general, it gets written and sampled in the same cmdbuffer every frame
+			TransitionImageLayout(Device, hiz_images[i].image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, levels, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		pipeline_hiz = Device.GetPipelineCache().GetComputePipeline(program_hiz.GetShaderStageInfo()[0], &program_hiz.GetGlobalLayout(), 1, program_hiz.GetPushRanges());
+	}
+
+	void RenderManager::GpuCulldeleteimagedata()
+	{
+		if (!Device.SupportsDrawIndirectCount()) return;
+
+		for (int i = 0; i < hiz_images.size(); i++)
+		{
+			Device.DestroyImage(hiz_images[i]);
+			vkDestroyImageView(Device.GetDevice(), hiz_views[i], nullptr);
+			for (int j = 0; j < hiz_levelviews[i].size(); j++)
+			{
+				vkDestroyImageView(Device.GetDevice(), hiz_levelviews[i][j], nullptr);
+			}
+		}
+		hiz_images.clear();
+		hiz_views.clear();
+		hiz_levelviews.clear();
+
+		vkDestroyPipelineLayout(Device.GetDevice(), pipeline_hiz.layout, nullptr);
+		vkDestroyPipeline(Device.GetDevice(), pipeline_hiz.pipeline, nullptr);
+
+		for (int i = 0; i < hiz_descriptors.size(); i++)
+		{
+			vkFreeDescriptorSets(Device.GetDevice(), program_hiz.GetGlobalPool(), hiz_descriptors[i].size(), hiz_descriptors[i].data());
+		}
+		hiz_descriptors.clear();
+	}
+
+	void RenderManager::createGpuCullfinal()
+	{
+		if (!Device.SupportsDrawIndirectCount()) return;
+
+		uint32_t passcount = GpuCullPassLate() + 1;
+		DescriptorHelper global_descriptors(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			global_descriptors.buffersizes[i].push_back(sizeof(GpuDrawRecord) * MAX_GPU_DRAWS);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_records[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(GpuCullBounds) * MAX_GPU_DRAWS);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_bounds[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(GpuMeshRecord) * MAX_GPU_DRAWS);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_meshes[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(GpuCullPass) * GPU_CULL_MAX_PASSES);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_passes[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(VkDrawIndexedIndirectCommand) * MAX_GPU_DRAWS * passcount);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_commands[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(uint32_t) * MAX_GPU_DRAWS * passcount);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_counts[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(uint32_t) * MAX_GPU_DRAWS);
+			global_descriptors.uniformbuffers[i].push_back(gpucull_visibility);
+
+			global_descriptors.imageviews[i].push_back(hiz_views[i]);
+			global_descriptors.samplers[i].push_back(hiz_sampler);
+		}
+		program_gpucull.SetGlobalDescriptor(global_descriptors.uniformbuffers, global_descriptors.buffersizes, global_descriptors.imageviews, global_descriptors.samplers, global_descriptors.bufferviews);
+
+		//hi-z levels: depth prepass (and the dummy for whichever sampler type it isn't), the level above and the level being built. Level 0 doesn't read input_tex
+		//so it just gets its own output there
+		DescriptorHelper global_descriptors2(FRAMES_IN_FLIGHT);
+		hiz_descriptors.clear();
+		hiz_descriptors.resize(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			hiz_descriptors[i].resize(hiz_levelviews[i].size());
+			program_hiz.AllocateSets(hiz_descriptors[i].data(), hiz_descriptors[i].size(), program_hiz.GetGlobalPool(), program_hiz.GetGlobalLayout());
+
+			for (int j = 0; j < hiz_levelviews[i].size(); j++)
+			{
+				global_descriptors2.imageviews[i].clear();
+				global_descriptors2.samplers[i].clear();
+
+				global_descriptors2.imageviews[i].push_back((multisampling_count == VK_SAMPLE_COUNT_1_BIT) ? depthprepass_view[i] : dummyviewMS);
+				global_descriptors2.samplers[i].push_back(hiz_sampler);
+
+				global_descriptors2.imageviews[i].push_back((multisampling_count != VK_SAMPLE_COUNT_1_BIT) ? depthprepass_view[i] : dummyviewMS);
+				global_descriptors2.samplers[i].push_back(hiz_sampler);
+
+				global_descriptors2.imageviews[i].push_back(hiz_levelviews[i][(j > 0) ? j - 1 : 0]);
+				global_descriptors2.samplers[i].push_back(hiz_sampler);
+
+				global_descriptors2.imageviews[i].push_back(hiz_levelviews[i][j]);
+				global_descriptors2.samplers[i].push_back(hiz_sampler);
+
+				program_hiz.UpdateDescriptorSet(hiz_descriptors[i][j], program_hiz.GetGlobalDescriptorInfo(), global_descriptors2.uniformbuffers[i].data(),
+					global_descriptors2.buffersizes[i].data(), global_descriptors2.imageviews[i].data(), global_descriptors2.samplers[i].data(), global_descriptors2.bufferviews[i].data());
+			}
+		}
+	}
+
+	//recorded into the depth cmdbuffer before its renderpass. Clears the counters, culls every record against every pass and makes the commands visible to the indirect
+	//draws of the depth, shadow and pbr submits (all on the graphics queue after this one). With occlusion culling this is the early phase, the camera passes only
+	//take what was visible last frame
+	void RenderManager::RecordGpuCull(int current_frame)
+	{
+		GpuCullParams params = gpu_cull_params[current_frame];
+		if (params.draw_count == 0) return;
+		VkCommandBuffer cmd = cmdbuffer_depth[current_frame];
+
+		//last frames late phase is the last thing that touched the visibility
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdFillBuffer(cmd, gpucull_counts[current_frame].buffer, 0, sizeof(uint32_t) * params.pass_count * params.bucket_stride, 0);
+		//new records (or visibility nobody kept up while occlusion was off) start out all visible, the first frame just draws everything in the frustum
+		if (params.occlusion == 0)
+		{
+			gpu_visibility_serial = UINT32_MAX;
+		}
+		else if (gpu_visibility_serial != gpu_draws_serial)
+		{
+			vkCmdFillBuffer(cmd, gpucull_visibility.buffer, 0, sizeof(uint32_t) * params.draw_count, 1);
+			gpu_visibility_serial = gpu_draws_serial;
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		params.phase = GPU_CULL_PHASE_EARLY;
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_gpucull.pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_gpucull.layout, 0, 1, &program_gpucull.GetGlobalDescriptor(current_frame), 0, nullptr);
+		vkCmdPushConstants(cmd, pipeline_gpucull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullParams), &params);
+		vkCmdDispatch(cmd, (params.draw_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, params.pass_count, 1);
+
+		//validation reads them back on the cpu once the frames fence is signaled
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | ((GPU_CULL_VALIDATE) ? VK_ACCESS_HOST_READ_BIT : 0);
+		VkPipelineStageFlags dststage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | ((GPU_CULL_VALIDATE) ? VK_PIPELINE_STAGE_HOST_BIT : 0);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dststage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	//builds this frames pyramid out of the early depth pass, a dispatch per level each waiting on the one before
+	void RenderManager::RecordHiZ(int current_frame)
+	{
+		VkCommandBuffer cmd = cmdbuffer_depth[current_frame];
+
+		TransitionImageLayout(Device, depthprepass_attachment[current_frame].image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 1, 1,
+			VK_IMAGE_ASPECT_DEPTH_BIT, cmd);
+
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		uint32_t hizparams[2] = { 0, (multisampling_count == VK_SAMPLE_COUNT_1_BIT) ? 0u : 1u };
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_hiz.pipeline);
+		for (uint32_t j = 0; j < hiz_extents.size(); j++)
+		{
+			hizparams[0] = j;
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_hiz.layout, 0, 1, &hiz_descriptors[current_frame][j], 0, nullptr);
+			vkCmdPushConstants(cmd, pipeline_hiz.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(hizparams), hizparams);
+			vkCmdDispatch(cmd, (hiz_extents[j].width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (hiz_extents[j].height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+			//the next level reads this one, after the last one its the late cull
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+
+		TransitionImageLayout(Device, depthprepass_attachment[current_frame].image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 1, 1, VK_IMAGE_ASPECT_DEPTH_BIT, cmd);
+	}
+
+	//late phase: every record against the camera and the pyramid. Writes the visibility for next frame and appends what the early phase didn't draw to the late
+	//depth pass and the pbr pass
+	void RenderManager::RecordGpuCullLate(int current_frame)
+	{
+		GpuCullParams params = gpu_cull_params[current_frame];
+		VkCommandBuffer cmd = cmdbuffer_depth[current_frame];
+
+		//the counters the early phase left off at
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		params.phase = GPU_CULL_PHASE_LATE;
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_gpucull.pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_gpucull.layout, 0, 1, &program_gpucull.GetGlobalDescriptor(current_frame), 0, nullptr);
+		vkCmdPushConstants(cmd, pipeline_gpucull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullParams), &params);
+		vkCmdDispatch(cmd, (params.draw_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | ((GPU_CULL_VALIDATE) ? VK_ACCESS_HOST_READ_BIT : 0);
+		VkPipelineStageFlags dststage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | ((GPU_CULL_VALIDATE) ? VK_PIPELINE_STAGE_HOST_BIT : 0);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dststage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
 	void RenderManager::CreateBV()
 	{
 		std::vector<ShaderProgram::shadersinfo> info1 = {
@@ -2385,6 +3025,7 @@ namespace Gibo {
 
 	void RenderManager::CreatePBR()
 	{
+		pbr_texture_serials.resize(FRAMES_IN_FLIGHT, 0);
 		cascade_buffer.resize(FRAMES_IN_FLIGHT);
 		point_pbrbuffer.resize(FRAMES_IN_FLIGHT);
 		point_infobuffer.resize(FRAMES_IN_FLIGHT);
@@ -2401,10 +3042,26 @@ namespace Gibo {
 		std::vector<float> nf = { near_plane, far_plane };
 		Device.BindData(nearfar_buffer.allocation, nf.data(), sizeof(float) * 2);
 
+		//material table and the handle of every instance
+		materiallibrary = new MaterialLibrary(Device, FRAMES_IN_FLIGHT);
+		materiallibrary->Create(MAX_MATERIALS);
+		instance_material_buffers.resize(FRAMES_IN_FLIGHT);
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			Device.CreateBuffer(sizeof(uint32_t) * INSTANCE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0, instance_material_buffers[i]);
+		}
+		instance_materials.resize(INSTANCE_CAPACITY, NULL_MATERIAL);
+
+		//bindless needs the device features and the -DBINDLESS build of the pbr shaders (compile.bat). The global set already samples 4 textures in the fragment stage
+		bindless = new BindlessTextures(Device, *textureCache, FRAMES_IN_FLIGHT);
+		bool bindless_shaders = std::ifstream("Shaders/spv/pbrvert_bindless.spv").good() && std::ifstream("Shaders/spv/pbrfrag_bindless.spv").good();
+		bindless_active = BINDLESS_MATERIALS && bindless_shaders && bindless->Create(4);
+		Logger::LogInfo("pbr textures: ", (bindless_active) ? "bindless" : "per object sets", "\n");
+
 		//shader program/ uniform buffer
 		std::vector<ShaderProgram::shadersinfo> info1 = {
-			{"Shaders/spv/pbrvert.spv", VK_SHADER_STAGE_VERTEX_BIT},
-			{"Shaders/spv/pbrfrag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
+			{(bindless_active) ? "Shaders/spv/pbrvert_bindless.spv" : "Shaders/spv/pbrvert.spv", VK_SHADER_STAGE_VERTEX_BIT},
+			{(bindless_active) ? "Shaders/spv/pbrfrag_bindless.spv" : "Shaders/spv/pbrfrag.spv", VK_SHADER_STAGE_FRAGMENT_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> globalinfo1 = {
 			{"cascade_splits", 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
@@ -2422,21 +3079,28 @@ namespace Gibo {
 			{"indexlist", 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
 			{"Grid", 13, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
 			{"NearFarBuffer", 14, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
-			{"ActiveClusters", 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT}
+			{"ActiveClusters", 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
+			{"InstanceBuffer", 16, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+			{"InstanceMaterials", 17, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT},
+			{"MaterialTable", 18, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT}
 		};
 		std::vector<ShaderProgram::descriptorinfo> localinfo1 = {
-				{"MaterialBuffer", 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT},
 				{"Albedo_Map", 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
 				{"Specular_Map", 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
 				{"Metal_Map", 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
 				{"Normal_Map", 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}
 		};
 		std::vector<ShaderProgram::pushconstantinfo> pushconstants1 = {
-			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)}
+			{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VertexDecodeConstants)}
 		};
+		//set 1 is the bindless set instead, nothing gets a set of its own
+		if (bindless_active)
+		{
+			localinfo1.clear();
+		}
 
 		if (!program_pbr.Create(Device.GetDevice(), FRAMES_IN_FLIGHT, info1.data(), info1.size(), globalinfo1.data(), globalinfo1.size(), localinfo1.data(), localinfo1.size(), 
-			 pushconstants1.data(), pushconstants1.size(), 500))
+			 pushconstants1.data(), pushconstants1.size(), (bindless_active) ? 1 : MAX_PBR_DESCRIPTORS))
 		{
 			Logger::LogError("failed to create pbr shaderprogram\n");
 		}
@@ -2516,6 +3180,15 @@ namespace Gibo {
 			global_descriptors.buffersizes[i].push_back(sizeof(uint32_t) * CLUSTER_SIZE);
 			global_descriptors.uniformbuffers[i].push_back(visible_clusters_storage[i]);
 
+			global_descriptors.buffersizes[i].push_back(sizeof(glm::mat4) * INSTANCE_CAPACITY);
+			global_descriptors.uniformbuffers[i].push_back(instance_buffers[i]);
+
+			global_descriptors.buffersizes[i].push_back(sizeof(uint32_t) * INSTANCE_CAPACITY);
+			global_descriptors.uniformbuffers[i].push_back(instance_material_buffers[i]);
+
+			global_descriptors.buffersizes[i].push_back(materiallibrary->GetBufferSize());
+			global_descriptors.uniformbuffers[i].push_back(materiallibrary->GetBuffer());
+
 			global_descriptors.imageviews[i].push_back(shadowcascade_atlasview[i]);
 			global_descriptors.samplers[i].push_back(shadowmapsampler);
 
@@ -2572,11 +3245,8 @@ namespace Gibo {
 			begin_rp.pClearValues = clearValues.data();
 			begin_rp.clearValueCount = clearValues.size();
 
-			vkCmdBeginRenderPass(cmdbuffer_shadow[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBeginRenderPass(cmdbuffer_shadow[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-			vkCmdBindPipeline(cmdbuffer_shadow[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow.pipeline);
-			vkCmdBindDescriptorSets(cmdbuffer_shadow[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow.layout, 1, 1, 
-				                    &program_shadow.GetLocalDescriptor(c, current_frame_in_flight), 0, nullptr);
 			VkViewport viewport;
 			//upperleft corner
 			viewport.x = offsetx;
@@ -2586,11 +3256,9 @@ namespace Gibo {
 			viewport.minDepth = 0.0f;
 			viewport.maxDepth = 1.0f;
 
-			vkCmdSetViewport(cmdbuffer_shadow[current_frame], 0, 1, &viewport);
 			VkRect2D scissor{};
 			scissor.offset = { offsetx, offsety };
 			scissor.extent = { shadow_width, shadow_height };
-			vkCmdSetScissor(cmdbuffer_shadow[current_frame], 0, 1, &scissor);
 			/*
 			Result[0][0] = static_cast<T>(2) / (right - left);
 			Result[1][1] = static_cast<T>(2) / (top - bottom);
@@ -2600,28 +3268,41 @@ namespace Gibo {
 			Result[3][2] = - zNear / (zFar - zNear);
 			
 			*/
-			//float nn = cascade_p[c][3][2] / cascade_p[c][2][2];
-			//float ff = (-nn / cascade_p[c][3][2]) + nn;
-			//our cascaded shadow map near plane is very close and we pancake. So we need to set its near plane back to 0 so it includes all occluders
-			float ff = (cascade_p[c][3][2] - 1.0f) / cascade_p[c][2][2];
-			float new_n = 0;
-			cascade_p[c][3][2] = -new_n /(ff- new_n);
-			cascade_p[c][2][2] = -1.0f / (ff - new_n);
-			
-			//render all shadow casting objects
+			//render all shadow casting objects (culled with the near plane pulled back to 0 in CullViews)
 			//transparent objects don't cast shadows
-			auto bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR];
-			std::vector<uint32_t> visible_objects = FrustrumIntersection(CalculatePlanes(cascade_p[c] * cascade_v[c]), bin, objectmanager->GetBoundingVolumes(), cascade_p[c] * cascade_v[c]);
-			for (int i = 0; i < visible_objects.size(); i++)
+			const std::vector<InstanceBatch>& batches = view_batches[VIEW_CASCADE + c];
+			const std::vector<MeshletRange>& ranges = view_ranges[VIEW_CASCADE + c];
+			uint32_t drawcount = static_cast<uint32_t>((gpu_culling_active) ? gpu_draws.buckets[GPU_CULL_STREAM_POSITION].size() : batches.size());
+			secondary_cmds.clear();
+			RecordSecondaryCmds(current_frame, renderpass_shadow, framebuffer_shadowcascadesatlas[current_frame], drawcount, secondary_cmds,
+				[&](VkCommandBuffer cmd, uint32_t begin, uint32_t end)
 			{
-				int index = visible_objects[i];
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow.pipeline);
+				BoundMesh bound;
+				const VkDescriptorSet* cascadeset = program_shadow.FindLocalDescriptor(c, current_frame_in_flight);
+				if (cascadeset == nullptr) return;
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow.layout, 0, 1, &program_shadow.GetGlobalDescriptor(current_frame), 0, nullptr);
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadow.layout, 1, 1, cascadeset, 0, nullptr);
+				vkCmdSetViewport(cmd, 0, 1, &viewport);
+				vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+				if (gpu_culling_active)
+				{
+					DrawGpuBuckets(cmd, GPU_CULL_PASS_CASCADE + c, begin, end, pipeline_shadow, pipeline_shadow_quantized, bound, current_frame);
+					return;
+				}
 
-				vkCmdPushConstants(cmdbuffer_shadow[current_frame], pipeline_shadow.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[index]->GetMatrix(current_frame));
+				for (uint32_t i = begin; i < end; i++)
+				{
+					RenderObject* object = batches[i].object;
 
-				VkDeviceSize sizes[] = { 0 };
-				vkCmdBindVertexBuffers(cmdbuffer_shadow[current_frame], 0, 1, &bin[index]->GetMesh().vbo, sizes);
-				vkCmdBindIndexBuffer(cmdbuffer_shadow[current_frame], bin[index]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(cmdbuffer_shadow[current_frame], bin[index]->GetMesh().index_size, 1, 0, 0, 0);
+					BindMesh(cmd, object->GetMesh(), pipeline_shadow, pipeline_shadow_quantized, bound, true);
+					DrawBatch(cmd, batches[i], ranges, bound);
+				}
+			});
+			if (!secondary_cmds.empty())
+			{
+				vkCmdExecuteCommands(cmdbuffer_shadow[current_frame], static_cast<uint32_t>(secondary_cmds.size()), secondary_cmds.data());
 			}
 
 			/*for (int j = 0; j < bin.size(); j++)
@@ -2672,7 +3353,7 @@ namespace Gibo {
 				int32_t offsetx = shadowpoint_width * (index % slots.x);
 				int32_t offsety = shadowpoint_height * (std::floor(index / slots.y));
 
-				RecordShadowHelper(offsetx, offsety, index, current_frame, point_p[index] * point_v[index]);
+				RecordShadowHelper(offsetx, offsety, index, current_frame, view_batches[VIEW_CASCADE + CASCADE_COUNT + index], view_ranges[VIEW_CASCADE + CASCADE_COUNT + index]);
 			}
 		}
 
@@ -2684,7 +3365,7 @@ namespace Gibo {
 			int32_t offsetx = shadowpoint_width * (index % slots.x);
 			int32_t offsety = shadowpoint_height * (std::floor(index / slots.y));
 
-			RecordShadowHelper(offsetx, offsety, index, current_frame, spot_p[s] * spot_v[s]);
+			RecordShadowHelper(offsetx, offsety, index, current_frame, view_batches[VIEW_CASCADE + CASCADE_COUNT + index], view_ranges[VIEW_CASCADE + CASCADE_COUNT + index]);
 		}
 
 		//set timer here at bottom of pipeline
@@ -2693,7 +3374,8 @@ namespace Gibo {
 		vkEndCommandBuffer(cmdbuffer_shadow[current_frame]);
 	}
 
-	void RenderManager::RecordShadowHelper(int32_t offsetx, int32_t offsety, int index, int current_frame, glm::mat4 PV)
+	void RenderManager::RecordShadowHelper(int32_t offsetx, int32_t offsety, int index, int current_frame, const std::vector<InstanceBatch>& batches,
+		                                   const std::vector<MeshletRange>& ranges)
 	{
 		VkRenderPassBeginInfo begin_rp = {};
 		begin_rp.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -2706,12 +3388,7 @@ namespace Gibo {
 		begin_rp.pClearValues = clearValues.data();
 		begin_rp.clearValueCount = clearValues.size();
 
-		vkCmdBeginRenderPass(cmdbuffer_shadow[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_INLINE);
-
-		vkCmdBindPipeline(cmdbuffer_shadow[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadowpoint.pipeline);
-
-		vkCmdBindDescriptorSets(cmdbuffer_shadow[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadowpoint.layout, 1, 1,
-			&program_shadowpoint.GetLocalDescriptor(index, current_frame_in_flight), 0, nullptr);
+		vkCmdBeginRenderPass(cmdbuffer_shadow[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 		VkViewport viewport;
 		//upperleft corner
@@ -2721,26 +3398,36 @@ namespace Gibo {
 		viewport.height = shadowpoint_height;
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(cmdbuffer_shadow[current_frame], 0, 1, &viewport);
 		VkRect2D scissor{};
 		scissor.offset = { offsetx, offsety };
 		scissor.extent = { shadowpoint_width, shadowpoint_height };
-		vkCmdSetScissor(cmdbuffer_shadow[current_frame], 0, 1, &scissor);
 
 		//render all shadow casting objects
 		//transparent objects don't cast shadows
-		auto bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR];
-		std::vector<uint32_t> visible_objects = FrustrumIntersection(CalculatePlanes(PV), bin, objectmanager->GetBoundingVolumes(), PV);
-		for (int i = 0; i < visible_objects.size(); i++)
-		{
-			int index = visible_objects[i];
-
-			vkCmdPushConstants(cmdbuffer_shadow[current_frame], pipeline_shadow.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[index]->GetMatrix(current_frame));
+		secondary_cmds.clear();
+		RecordSecondaryCmds(current_frame, renderpass_shadowpoint, framebuffer_shadowpoints[current_frame], static_cast<uint32_t>(batches.size()), secondary_cmds,
+			[&](VkCommandBuffer cmd, uint32_t begin, uint32_t end)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadowpoint.pipeline);
+			BoundMesh bound;
+			const VkDescriptorSet* pointset = program_shadowpoint.FindLocalDescriptor(index, current_frame_in_flight);
+			if (pointset == nullptr) return;
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadowpoint.layout, 0, 1, &program_shadowpoint.GetGlobalDescriptor(current_frame), 0, nullptr);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_shadowpoint.layout, 1, 1, pointset, 0, nullptr);
+			vkCmdSetViewport(cmd, 0, 1, &viewport);
+			vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+			for (uint32_t i = begin; i < end; i++)
+			{
+				RenderObject* object = batches[i].object;
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_shadow[current_frame], 0, 1, &bin[index]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_shadow[current_frame], bin[index]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_shadow[current_frame], bin[index]->GetMesh().index_size, 1, 0, 0, 0);
+				BindMesh(cmd, object->GetMesh(), pipeline_shadowpoint, pipeline_shadowpoint_quantized, bound, true);
+				DrawBatch(cmd, batches[i], ranges, bound);
+			}
+		});
+		if (!secondary_cmds.empty())
+		{
+			vkCmdExecuteCommands(cmdbuffer_shadow[current_frame], static_cast<uint32_t>(secondary_cmds.size()), secondary_cmds.data());
 		}
 		
 		/*for (int j = 0; j < bin.size(); j++)
@@ -2786,89 +3473,104 @@ namespace Gibo {
 		//set timer here at top of pipeline
 		Device.GetQueryManager().WriteTimeStamp(cmdbuffer_pbr[current_frame], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current_frame, QueryManager::QUERY_NAME::MAIN_PASS, true);
 
-		vkCmdBeginRenderPass(cmdbuffer_pbr[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_INLINE);
+		//materials made since last frame go up before the pass reads the table
+		materiallibrary->Flush(cmdbuffer_pbr[current_frame], current_frame);
 
-		vkCmdBindPipeline(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.pipeline);
-		vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 0, 1, &program_pbr.GetGlobalDescriptor(current_frame), 0, nullptr);
+		vkCmdBeginRenderPass(cmdbuffer_pbr[current_frame], &begin_rp, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 		//render all opaque objects first
-		auto bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR];
-		std::vector<uint32_t> visible_objects = FrustrumIntersection(CalculatePlanes(proj_matrix * cam_matrix), bin, objectmanager->GetBoundingVolumes(), proj_matrix * cam_matrix);
-		for (int i = 0; i < visible_objects.size(); i++)
-		{
-			int index = visible_objects[i];
-
-			vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &program_pbr.GetLocalDescriptor(bin[index]->GetId(), current_frame), 0, nullptr);
-			vkCmdPushConstants(cmdbuffer_pbr[current_frame], pipeline_pbr.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[index]->GetMatrix(current_frame));
+		//batches here are split by material too so the first objects descriptor is right for the whole batch, unless textures are bindless and set 1 is bound once
+		const std::vector<InstanceBatch>& batches = view_batches[VIEW_CAMERA];
+		const std::vector<MeshletRange>& ranges = view_ranges[VIEW_CAMERA];
+		uint32_t drawcount = static_cast<uint32_t>((gpu_culling_active) ? gpu_draws.buckets[GPU_CULL_STREAM_FULL].size() : batches.size());
+		secondary_cmds.clear();
+		RecordSecondaryCmds(current_frame, renderpass_pbr, framebuffer_pbr[current_frame], drawcount, secondary_cmds,
+			[&](VkCommandBuffer cmd, uint32_t begin, uint32_t end)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.pipeline);
+			BoundMesh bound;
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 0, 1, &program_pbr.GetGlobalDescriptor(current_frame), 0, nullptr);
+			if (bindless_active)
+			{
+				vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &bindless->GetSet(current_frame), 0, nullptr);
+			}
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &bin[index]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_pbr[current_frame], bin[index]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_pbr[current_frame], bin[index]->GetMesh().index_size, 1, 0, 0, 0);
-		}
-		/*for (int j = 0; j < bin.size(); j++)
-		{
-			vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &program_pbr.GetLocalDescriptor(bin[j]->GetId(), current_frame), 0, nullptr);
-			vkCmdPushConstants(cmdbuffer_pbr[current_frame], pipeline_pbr.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[j]->GetMatrix(current_frame));
+			if (gpu_culling_active)
+			{
+				DrawGpuBuckets(cmd, GPU_CULL_PASS_PBR, begin, end, pipeline_pbr, pipeline_pbr_quantized, bound, current_frame);
+				return;
+			}
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &bin[j]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_pbr[current_frame], bin[j]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_pbr[current_frame], bin[j]->GetMesh().index_size, 1, 0, 0, 0);
-		}*/
+			for (uint32_t i = begin; i < end; i++)
+			{
+				RenderObject* object = batches[i].object;
 
-		atmosphere->Draw(cmdbuffer_pbr[current_frame], current_frame);
+				if (!bindless_active)
+				{
+					const VkDescriptorSet* set = program_pbr.FindLocalDescriptor(object->GetId(), current_frame);
+					if (set == nullptr) continue;
+					vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, set, 0, nullptr);
+				}
 
-		vkCmdBindPipeline(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.pipeline);
-		vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 0, 1, &program_pbr.GetGlobalDescriptor(current_frame), 0, nullptr);
+				BindMesh(cmd, object->GetMesh(), pipeline_pbr, pipeline_pbr_quantized, bound);
+				DrawBatch(cmd, batches[i], ranges, bound);
+			}
+		});
 
-		//render all blendable objects back to front
-		bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::BLENDABLE];
-		std::vector<uint32_t> visible_objects_blendable = FrustrumIntersection(CalculatePlanes(proj_matrix * cam_matrix), bin, objectmanager->GetBoundingVolumes(), proj_matrix * cam_matrix);
-		for (int i = 0; i < visible_objects_blendable.size(); i++)
-		{
-			int index = visible_objects_blendable[i];
+		//a subpass can't mix inline and secondary contents, so the sky, blendables and debug draws go in one more secondary recorded here that runs after the opaque ones
+		VkCommandBuffer cmd_tail = BeginSecondaryCmd(current_frame, renderpass_pbr, framebuffer_pbr[current_frame]);
 
-			vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &program_pbr.GetLocalDescriptor(bin[index]->GetId(), current_frame), 0, nullptr);
-			vkCmdPushConstants(cmdbuffer_pbr[current_frame], pipeline_pbr.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[index]->GetMatrix(current_frame));
+		atmosphere->Draw(cmd_tail, current_frame);
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &bin[index]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_pbr[current_frame], bin[index]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_pbr[current_frame], bin[index]->GetMesh().index_size, 1, 0, 0, 0);
+		vkCmdBindPipeline(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.pipeline);
+		BoundMesh bound;
+		vkCmdBindDescriptorSets(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 0, 1, &program_pbr.GetGlobalDescriptor(current_frame), 0, nullptr);
+		if (bindless_active)
+		{
+			vkCmdBindDescriptorSets(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &bindless->GetSet(current_frame), 0, nullptr);
 		}
-		/*for (int j = 0; j < bin.size(); j++)
+
+		//render all blendable objects back to front, BuildInstances already put them in sorted order one per batch
+		for (int i = 0; i < blend_batches.size(); i++)
 		{
-			vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, &program_pbr.GetLocalDescriptor(bin[j]->GetId(), current_frame), 0, nullptr);
-			vkCmdPushConstants(cmdbuffer_pbr[current_frame], pipeline_pbr.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &bin[j]->GetMatrix(current_frame));
+			RenderObject* object = blend_batches[i].object;
 
-			VkDeviceSize sizes[] = { 0 };
-			vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &bin[j]->GetMesh().vbo, sizes);
-			vkCmdBindIndexBuffer(cmdbuffer_pbr[current_frame], bin[j]->GetMesh().ibo, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cmdbuffer_pbr[current_frame], bin[j]->GetMesh().index_size, 1, 0, 0, 0);
-		}*/
+			if (!bindless_active)
+			{
+				const VkDescriptorSet* set = program_pbr.FindLocalDescriptor(object->GetId(), current_frame);
+				if (set == nullptr) continue;
+				vkCmdBindDescriptorSets(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_pbr.layout, 1, 1, set, 0, nullptr);
+			}
+
+			BindMesh(cmd_tail, object->GetMesh(), pipeline_pbr, pipeline_pbr_quantized, bound);
+			DrawBatch(cmd_tail, blend_batches[i], view_ranges[VIEW_CAMERA], bound);
+		}
 		
 		if (Display_BV)
 		{
 			//Draw bounding Volumes for debugging
-			vkCmdBindPipeline(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_bv.pipeline);
-			vkCmdBindDescriptorSets(cmdbuffer_pbr[current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_bv.layout, 0, 1, &program_bv.GetGlobalDescriptor(current_frame), 0, nullptr);
+			vkCmdBindPipeline(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_bv.pipeline);
+			vkCmdBindDescriptorSets(cmd_tail, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_bv.layout, 0, 1, &program_bv.GetGlobalDescriptor(current_frame), 0, nullptr);
 			for (int i = 0; i < bv_vbos.size(); i++)
 			{
 				VkDeviceSize sizes[] = { 0 };
-				vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &bv_vbos[i].buffer, sizes);
-				vkCmdDraw(cmdbuffer_pbr[current_frame], bv_vbosizes[i], 1, 0, 0);
+				vkCmdBindVertexBuffers(cmd_tail, 0, 1, &bv_vbos[i].buffer, sizes);
+				vkCmdDraw(cmd_tail, bv_vbosizes[i], 1, 0, 0);
 			}
 
 			//debugging frustrum
 			VkDeviceSize sizes[] = { 0 };
-			//vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &frustrum_vbo.buffer, sizes);
-			//vkCmdDraw(cmdbuffer_pbr[current_frame], 24, 1, 0, 0);
+			//vkCmdBindVertexBuffers(cmd_tail, 0, 1, &frustrum_vbo.buffer, sizes);
+			//vkCmdDraw(cmd_tail, 24, 1, 0, 0);
 
 			//debugging clusters
-			vkCmdBindVertexBuffers(cmdbuffer_pbr[current_frame], 0, 1, &cluster_vbo.buffer, sizes);
-			vkCmdDraw(cmdbuffer_pbr[current_frame], cluster_vbo_count, 1, 0, 0);
+			vkCmdBindVertexBuffers(cmd_tail, 0, 1, &cluster_vbo.buffer, sizes);
+			vkCmdDraw(cmd_tail, cluster_vbo_count, 1, 0, 0);
 		}
+
+		vkEndCommandBuffer(cmd_tail);
+		secondary_cmds.push_back(cmd_tail);
+		vkCmdExecuteCommands(cmdbuffer_pbr[current_frame], static_cast<uint32_t>(secondary_cmds.size()), secondary_cmds.data());
 		
 		vkCmdEndRenderPass(cmdbuffer_pbr[current_frame]);
 
@@ -2878,49 +3580,443 @@ namespace Gibo {
 		vkEndCommandBuffer(cmdbuffer_pbr[current_frame]);
 	}
 
-	//we want it so that if a is closer to screen it is true, if be is closerorequal to screen it is false
-	//TODO - store this somehow and reuse it
-	//store something in renderobject?
-	bool blendsort(RenderObject* a, RenderObject* b, glm::mat4 cam_matrix)
+	//culls every object against every view we render this frame in one pass over the bounds: the camera, every cascade, every point light face and every spot light.
+	//Before this every pass culled on its own so the bounds were walked like 20 times a frame. Results are a bitmask per slot (cull_viewmasks) and one list of
+	//opaque slots per view (view_visible) the passes just loop through. Blendables are only in the camera and get read straight out of the masks.
+	void RenderManager::CullViews()
 	{
-		//convert center of every object from model space to camera space then compare z value
-		glm::mat4 camera_matrix = cam_matrix;// = vkcoreShaderDescriptors::GetInstance()->GetMatrix().view;
-		glm::vec4 pos(0, 0, 0, 1);
-		glm::mat4 amatrix = a->GetSyncedMatrix();
-		glm::mat4 bmatrix = b->GetSyncedMatrix();
-		glm::vec4 apos = camera_matrix * amatrix * pos;
-		glm::vec4 bpos = camera_matrix * bmatrix * pos;
-		//compare z
-		if (apos.z > bpos.z)
+		cull_views.clear();
+		cull_views.push_back(CalculatePlanes(proj_matrix * cam_matrix));
+		view_lods.clear();
+		view_lods.push_back(MakeLodSelectInfo(proj_matrix, static_cast<float>(Resolution.height), LOD_PIXEL_ERROR));
+		view_eyes.clear();
+		view_eyes.push_back(MeshletViewEye(proj_matrix, cam_matrix, cull_views.back()[4]));
+		for (int c = 0; c < CASCADE_COUNT; c++)
 		{
-			return true;
+			//our cascaded shadow map near plane is very close and we pancake. So we need to set its near plane back to 0 so it includes all occluders
+			glm::mat4 cull_p = cascade_p[c];
+			float ff = (cull_p[3][2] - 1.0f) / cull_p[2][2];
+			float new_n = 0;
+			cull_p[3][2] = -new_n / (ff - new_n);
+			cull_p[2][2] = -1.0f / (ff - new_n);
+			cull_views.push_back(CalculatePlanes(cull_p * cascade_v[c]));
+			view_lods.push_back(MakeLodSelectInfo(cascade_p[c], static_cast<float>(shadow_height), LOD_PIXEL_ERROR * LOD_SHADOW_BIAS));
+			view_eyes.push_back(MeshletViewEye(cascade_p[c], cascade_v[c], cull_views.back()[4]));
+		}
+		for (int i = 0; i < point_current * 6; i++)
+		{
+			cull_views.push_back(CalculatePlanes(point_p[i] * point_v[i]));
+			view_lods.push_back(MakeLodSelectInfo(point_p[i], static_cast<float>(shadowpoint_height), LOD_PIXEL_ERROR * LOD_SHADOW_BIAS));
+			view_eyes.push_back(MeshletViewEye(point_p[i], point_v[i], cull_views.back()[4]));
 		}
+		for (int s = 0; s < spot_current; s++)
+		{
+			cull_views.push_back(CalculatePlanes(spot_p[s] * spot_v[s]));
+			view_lods.push_back(MakeLodSelectInfo(spot_p[s], static_cast<float>(shadowpoint_height), LOD_PIXEL_ERROR * LOD_SHADOW_BIAS));
+			view_eyes.push_back(MeshletViewEye(spot_p[s], spot_v[s], cull_views.back()[4]));
+		}
+
+		const CullingBounds& bounds = objectmanager->GetCullingBounds();
+		cull_viewmasks.resize(bounds.Size());
+		uint32_t binmask = (1u << RenderObjectManager::BIN_TYPE::REGULAR) | (1u << RenderObjectManager::BIN_TYPE::BLENDABLE);
 
-		return false;
+		//big scenes go through the tree so whole off screen subtrees are skipped, small ones are faster just brute forcing the soa arrays
+		if (BVH_CULLING)
+		{
+			std::fill(cull_viewmasks.begin(), cull_viewmasks.end(), 0);
+			objectmanager->GetTree().QueryFrustrumMulti(cull_views, bounds.bin_flags.data(), binmask, cull_viewmasks.data());
+		}
+		else
+		{
+			//every chunk writes its own range of masks so they can all run at once
+			jobsystem.ParallelFor(bounds.Size(), CULL_GRAIN_SIZE, [this, &bounds, binmask](uint32_t begin, uint32_t end)
+			{
+				FrustrumIntersectionMulti(cull_views, bounds, binmask, cull_viewmasks.data(), begin, end);
+			});
+		}
+
+		cpu_occlusion.ResetStats();
+		if (CPU_OCCLUSION_CULLING && !gpu_culling_active)
+		{
+			CpuOcclusionCull();
+		}
+
+		//one job per view list
+		view_visible.resize(cull_views.size());
+		jobsystem.ParallelFor(static_cast<uint32_t>(view_visible.size()), 1, [this, &bounds](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t v = begin; v < end; v++)
+			{
+				//the gpu culls the camera and cascades itself, their mask bits are still needed for the blendables
+				if (gpu_culling_active && v < VIEW_CASCADE + CASCADE_COUNT)
+				{
+					view_visible[v].clear();
+					continue;
+				}
+				BuildViewList(cull_viewmasks.data(), bounds, 1u << RenderObjectManager::BIN_TYPE::REGULAR, v, view_visible[v]);
+			}
+		});
 	}
 
+	//rasterizes the occluders the camera can see into the masked occlusion buffer, then clears the camera bit of everything behind them. Runs between the frustrum
+	//culling and the view lists so the camera list and the blendables both lose whats hidden
+	void RenderManager::CpuOcclusionCull()
+	{
+		const uint64_t camerabit = 1ull << VIEW_CAMERA;
+		glm::mat4 viewproj = proj_matrix * cam_matrix;
+		cpu_occlusion.Clear();
+		for (RenderObject* object : objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR])
+		{
+			if (!object->IsOccluder() || (cull_viewmasks[object->GetId()] & camerabit) == 0) continue;
+
+			const OccluderMesh* occluder = meshCache->GetOccluderMesh(object->GetMesh().mesh_name);
+			if (occluder == nullptr || occluder->indices.empty()) continue;
+			cpu_occlusion.RenderTriangles(occluder->positions.data(), static_cast<uint32_t>(occluder->positions.size() / 3), 3, occluder->indices.data(),
+				                          static_cast<uint32_t>(occluder->indices.size()), viewproj * object->GetSyncedMatrix());
+		}
+		if (cpu_occlusion.GetStats().triangles == 0) return;
+
+		//the buffer is only read from here on. every chunk clears bits in its own range of masks. occluders get tested too, one can be behind another
+		const CullingBounds& bounds = objectmanager->GetCullingBounds();
+		std::atomic<uint32_t> tested = 0;
+		std::atomic<uint32_t> occluded = 0;
+		jobsystem.ParallelFor(bounds.Size(), CULL_GRAIN_SIZE, [this, &bounds, &viewproj, &tested, &occluded, camerabit](uint32_t begin, uint32_t end)
+		{
+			uint32_t chunktested = 0;
+			uint32_t chunkoccluded = 0;
+			for (uint32_t slot = begin; slot < end; slot++)
+			{
+				if ((cull_viewmasks[slot] & camerabit) == 0) continue;
+
+				chunktested++;
+				if (!cpu_occlusion.TestAABB(bounds.GetMin(slot), bounds.GetMax(slot), viewproj))
+				{
+					cull_viewmasks[slot] &= ~camerabit;
+					chunkoccluded++;
+				}
+			}
+			tested += chunktested;
+			occluded += chunkoccluded;
+		});
+		cpu_occlusion.AddTestStats(tested, occluded);
+	}
+
+	//turns every views visible list into instanced batches and uploads all the model matrices in one go. Each view gets its own range of the instance buffer
+	//(camera, cascades, atlas slots, then the blendables) so the batches can be built in parallel without touching each others matrices.
+	void RenderManager::BuildInstances(int current_frame)
+	{
+		Timer sort_timer("draw sort");
+		auto& slots = objectmanager->GetSlots();
+		const CullingBounds& bounds = objectmanager->GetCullingBounds();
+
+		//hand out ranges after the gpu draw records matrices, anything past MAX_INSTANCES just doesn't get drawn this frame
+		uint32_t total = gpu_instance_base;
+		uint32_t limit = gpu_instance_base + MAX_INSTANCES;
+		bool overflow = false;
+		view_instance_offsets.resize(view_visible.size());
+		for (int v = 0; v < view_visible.size(); v++)
+		{
+			if (total + view_visible[v].size() > limit)
+			{
+				view_visible[v].resize(limit - total);
+				overflow = true;
+			}
+			view_instance_offsets[v] = total;
+			total += static_cast<uint32_t>(view_visible[v].size());
+		}
+
+		view_batches.resize(view_visible.size());
+		view_ranges.resize(view_visible.size());
+		batch_scratch.resize(jobsystem.GetThreadCount());
+		jobsystem.ParallelFor(static_cast<uint32_t>(view_visible.size()), 1, [this, &slots, &bounds, current_frame](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t v = begin; v < end; v++)
+			{
+				//the camera view draws the pbr pass so it binds material textures (unless they're bindless), depth and shadows can batch any objects that share a mesh and want
+				//front to back instead. every pass only has the one pipeline for now so that part of the key is always 0
+				InstanceBuildInfo info;
+				info.bymaterial = (v == VIEW_CAMERA && !bindless_active);
+				info.sort = SORT_DRAWS;
+				info.batches_front_to_back = (v != VIEW_CAMERA);
+				info.pipeline = 0;
+				info.current_frame = current_frame;
+				if (MESH_LODS) info.lod = view_lods[v];
+				if (MESHLET_CULLING)
+				{
+					info.meshlets.planes = &cull_views[v];
+					info.meshlets.eye = view_eyes[v];
+					info.meshlets.min_meshlets = MESHLET_MIN_COUNT;
+				}
+
+				glm::mat4* matrices = instance_data.data() + view_instance_offsets[v];
+				uint32_t* materials = (v == VIEW_CAMERA) ? instance_materials.data() + view_instance_offsets[v] : nullptr;
+				if (AUTO_INSTANCING)
+				{
+					BuildInstanceBatches(view_visible[v], slots, bounds, cull_views[v][4], info, matrices, materials, view_instance_offsets[v], view_batches[v], view_ranges[v],
+						                 batch_scratch[JobSystem::GetThreadIndex()]);
+				}
+				else
+				{
+					view_batches[v].clear();
+					view_ranges[v].clear();
+					for (uint32_t i = 0; i < view_visible[v].size(); i++)
+					{
+						uint32_t slot = view_visible[v][i];
+						RenderObject* object = slots[slot];
+						matrices[i] = object->GetMatrix(current_frame);
+						if (materials != nullptr) materials[i] = object->GetMaterial().GetHandle();
+						uint32_t lod = (MESH_LODS) ? SelectLod(object->GetMesh(), view_lods[v], ViewDepth(cull_views[v][4], bounds, slot), bounds.radius[slot]) : 0;
+						view_batches[v].push_back(InstanceBatch{ object, view_instance_offsets[v] + i, 1, 0, lod });
+					}
+				}
+			}
+		});
+
+		//blendables have to stay in back to front order so they never merge, walk the sorted bin and check the camera bit
+		blend_batches.clear();
+		auto& bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::BLENDABLE];
+		for (int i = 0; i < bin.size(); i++)
+		{
+			if ((cull_viewmasks[bin[i]->GetId()] & (1ull << VIEW_CAMERA)) == 0) continue;
+			if (total == limit)
+			{
+				overflow = true;
+				break;
+			}
+
+			instance_data[total] = bin[i]->GetMatrix(current_frame);
+			instance_materials[total] = bin[i]->GetMaterial().GetHandle();
+			uint32_t slot = bin[i]->GetId();
+			uint32_t lod = (MESH_LODS) ? SelectLod(bin[i]->GetMesh(), view_lods[VIEW_CAMERA], ViewDepth(cull_views[VIEW_CAMERA][4], bounds, slot), bounds.radius[slot]) : 0;
+			blend_batches.push_back(InstanceBatch{ bin[i], total, 1, 0, lod });
+			total++;
+		}
+
+		if (overflow)
+		{
+			Logger::LogWarning("instance buffer full, some objects won't be drawn this frame\n");
+		}
+
+		if (total > 0)
+		{
+			Device.BindData(instance_buffers[current_frame].allocation, instance_data.data(), sizeof(glm::mat4) * total);
+			Device.BindData(instance_material_buffers[current_frame].allocation, instance_materials.data(), sizeof(uint32_t) * total);
+		}
+
+		double sort_time;
+		sort_timer.Stop(sort_time);
+		time_sort[time_counter] = sort_time;
+	}
+
+	//decides if this frame goes through the gpu path and rebuilds the draw records when objects got added/removed, meshes moved or a material edit changed which pbr
+	//bucket an object belongs in. Has to run before CullViews so it knows which views it can skip
+	void RenderManager::UpdateGpuDrawList()
+	{
+		gpu_culling_active = false;
+		if (!GPU_CULLING || !Device.SupportsDrawIndirectCount()) return;
+
+		//bindless buckets don't care about materials
+		bool rebuild = gpu_draws_dirty || gpu_draws_version != objectmanager->GetVersion();
+		if (!rebuild && !bindless_active)
+		{
+			const std::vector<GpuDrawBucket>& buckets = gpu_draws.buckets[GPU_CULL_STREAM_FULL];
+			for (uint32_t i = 0; i < gpu_draws.objects.size() && !rebuild; i++)
+			{
+				RenderObject* first = buckets[gpu_draws.records[i].bucket[GPU_CULL_STREAM_FULL]].object;
+				rebuild = !gpu_draws.objects[i]->GetMaterial().SameTemplate(first->GetMaterial());
+			}
+		}
+
+		if (rebuild)
+		{
+			BuildGpuDrawList(objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::REGULAR], gpu_draws, !bindless_active);
+			gpu_draws_version = objectmanager->GetVersion();
+			gpu_draws_dirty = false;
+			gpu_draws_serial++;
+			if (gpu_draws.records.size() > MAX_GPU_DRAWS)
+			{
+				Logger::LogWarning("more than ", MAX_GPU_DRAWS, " draw records, culling on the cpu\n");
+			}
+		}
+		gpu_culling_active = (gpu_draws.records.size() <= MAX_GPU_DRAWS);
+	}
+
+	//per frame half of the gpu path: every records matrix goes in front of the cpu views in the instance buffer (BuildInstances uploads them together), its bounds and
+	//the pass planes/lods get uploaded, and the records themselves if this frames buffers are older than the last rebuild
+	void RenderManager::BuildGpuDraws(int current_frame)
+	{
+		gpu_cull_params[current_frame] = GpuCullParams{};
+		gpu_instance_base = 0;
+		if (!gpu_culling_active) return;
+
+		uint32_t count = static_cast<uint32_t>(gpu_draws.records.size());
+		const CullingBounds& bounds = objectmanager->GetCullingBounds();
+		gpu_cull_bounds_data.resize(count);
+		jobsystem.ParallelFor(count, UPDATE_GRAIN_SIZE, [this, &bounds, current_frame](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				RenderObject* object = gpu_draws.objects[i];
+				instance_data[i] = object->GetMatrix(current_frame);
+				instance_materials[i] = object->GetMaterial().GetHandle();
+				gpu_cull_bounds_data[i] = MakeGpuCullBounds(bounds, object->GetId());
+			}
+		});
+		gpu_instance_base = count;
+
+		//same planes and lod picks the cpu path would use for these views, depth and pbr cull the camera twice for their two streams and the late depth pass a third time
+		LodSelectInfo nolods;
+		gpu_cull_passes.clear();
+		gpu_cull_passes.push_back(MakeGpuCullPass(cull_views[VIEW_CAMERA], (MESH_LODS) ? view_lods[VIEW_CAMERA] : nolods, GPU_CULL_STREAM_POSITION, true));
+		gpu_cull_passes.push_back(MakeGpuCullPass(cull_views[VIEW_CAMERA], (MESH_LODS) ? view_lods[VIEW_CAMERA] : nolods, GPU_CULL_STREAM_FULL, true));
+		for (int c = 0; c < CASCADE_COUNT; c++)
+		{
+			gpu_cull_passes.push_back(MakeGpuCullPass(cull_views[VIEW_CASCADE + c], (MESH_LODS) ? view_lods[VIEW_CASCADE + c] : nolods, GPU_CULL_STREAM_POSITION, false));
+		}
+		gpu_cull_passes.push_back(MakeGpuCullPass(cull_views[VIEW_CAMERA], (MESH_LODS) ? view_lods[VIEW_CAMERA] : nolods, GPU_CULL_STREAM_POSITION, true));
+		if (count == 0) return;
+
+		if (gpu_draws_uploaded[current_frame] != gpu_draws_serial)
+		{
+			Device.BindData(gpucull_records[current_frame].allocation, gpu_draws.records.data(), sizeof(GpuDrawRecord) * count);
+			Device.BindData(gpucull_meshes[current_frame].allocation, gpu_draws.meshes.data(), sizeof(GpuMeshRecord) * gpu_draws.meshes.size());
+			gpu_draws_uploaded[current_frame] = gpu_draws_serial;
+		}
+		Device.BindData(gpucull_bounds[current_frame].allocation, gpu_cull_bounds_data.data(), sizeof(GpuCullBounds) * count);
+		Device.BindData(gpucull_passes[current_frame].allocation, gpu_cull_passes.data(), sizeof(GpuCullPass) * gpu_cull_passes.size());
+
+		GpuCullParams& params = gpu_cull_params[current_frame];
+		params.draw_count = count;
+		params.pass_count = static_cast<uint32_t>(gpu_cull_passes.size());
+		params.bucket_stride = gpu_draws.BucketStride();
+		params.command_stride = count;
+		params.occlusion = (OCCLUSION_CULLING) ? 1 : 0;
+		params.late_pass = GpuCullPassLate();
+		params.pbr_pass = GPU_CULL_PASS_PBR;
+		//same y flip the vertex shaders do after projecting
+		params.viewproj = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f)) * proj_matrix * cam_matrix;
+		params.hiz_info = glm::vec4(Resolution.width, Resolution.height, hiz_extents.size(), 0.0f);
+	}
+
+	//GPU_CULL_VALIDATE only. Runs GpuCullReference on exactly what the gpu read last time this frame was in flight and checks both made the same draws,
+	//has to be called right after the frames fence and before anything overwrites its buffers
+	void RenderManager::ValidateGpuCull(int current_frame)
+	{
+		const GpuCullParams params = gpu_cull_params[current_frame];
+		if (params.draw_count == 0 || gpu_draws_uploaded[current_frame] != gpu_draws_serial) return;
+
+		VmaAllocator& allocator = Device.GetAllocator();
+		auto map = [&allocator](vkcoreBuffer& buffer)
+		{
+			void* data;
+			VULKAN_CHECK(vmaMapMemory(allocator, buffer.allocation, &data), "mapping memory");
+			return data;
+		};
+		const GpuDrawRecord* records = reinterpret_cast<const GpuDrawRecord*>(map(gpucull_records[current_frame]));
+		const GpuCullBounds* culledbounds = reinterpret_cast<const GpuCullBounds*>(map(gpucull_bounds[current_frame]));
+		const GpuMeshRecord* meshes = reinterpret_cast<const GpuMeshRecord*>(map(gpucull_meshes[current_frame]));
+		const GpuCullPass* passes = reinterpret_cast<const GpuCullPass*>(map(gpucull_passes[current_frame]));
+		const uint32_t* gpucounts = reinterpret_cast<const uint32_t*>(map(gpucull_counts[current_frame]));
+		const VkDrawIndexedIndirectCommand* gpucommands = reinterpret_cast<const VkDrawIndexedIndirectCommand*>(map(gpucull_commands[current_frame]));
+
+		std::vector<uint32_t> counts(params.pass_count * params.bucket_stride, 0);
+		std::vector<VkDrawIndexedIndirectCommand> commands(params.pass_count * params.command_stride);
+		GpuCullReference(records, culledbounds, meshes, passes, params, counts.data(), commands.data());
+		if (!CompareGpuCull(gpu_draws, passes, params, gpucounts, gpucommands, counts.data(), commands.data()))
+		{
+			Logger::LogError("gpu culling doesn't match the cpu reference\n");
+		}
+
+		vmaUnmapMemory(allocator, gpucull_records[current_frame].allocation);
+		vmaUnmapMemory(allocator, gpucull_bounds[current_frame].allocation);
+		vmaUnmapMemory(allocator, gpucull_meshes[current_frame].allocation);
+		vmaUnmapMemory(allocator, gpucull_passes[current_frame].allocation);
+		vmaUnmapMemory(allocator, gpucull_counts[current_frame].allocation);
+		vmaUnmapMemory(allocator, gpucull_commands[current_frame].allocation);
+	}
+
+	//records this frames times for the sort benchmark if its going and picks the mode for next frame. first half is the unsorted path, second half sorted,
+	//then it logs both and turns sorting back on
+	void RenderManager::UpdateSortBenchmark()
+	{
+		if (sort_benchmark_frame < 0) return;
+
+		int mode = sort_benchmark_frame / SORT_BENCHMARK_FRAMES;
+		int frame = sort_benchmark_frame % SORT_BENCHMARK_FRAMES;
+		if (frame >= SORT_BENCHMARK_WARMUP)
+		{
+			//the main pass timestamp read this frame belongs to the frame recorded FRAMES_IN_FLIGHT ago, the warmup frames make sure that one was in the same mode
+			int previous = (time_counter + time_mainpass.size() - 1) % time_mainpass.size();
+			sort_benchmark_gpu[mode] += time_mainpass[previous];
+			sort_benchmark_cpu[mode] += time_sort[time_counter];
+		}
+
+		sort_benchmark_frame++;
+		if (sort_benchmark_frame == SORT_BENCHMARK_FRAMES * 2)
+		{
+			double samples = SORT_BENCHMARK_FRAMES - SORT_BENCHMARK_WARMUP;
+			Logger::Log("draw sort benchmark (", samples, " frames each)\n");
+			Logger::Log("  unsorted: main pass gpu ", sort_benchmark_gpu[0] / samples, " ms, sort cpu ", sort_benchmark_cpu[0] / samples, " ms\n");
+			Logger::Log("  sorted:   main pass gpu ", sort_benchmark_gpu[1] / samples, " ms, sort cpu ", sort_benchmark_cpu[1] / samples, " ms\n");
+			sort_benchmark_frame = -1;
+			SORT_DRAWS = true;
+			return;
+		}
+		SORT_DRAWS = (sort_benchmark_frame >= SORT_BENCHMARK_FRAMES);
+	}
+
+	//sorts the blendable bin back to front. The view depth of every objects bounding sphere center gets computed once into a key, instead of two matrix multiplies
+	//per comparison. Frame to frame the order barely changes so an insertion sort over the keys is usually all it takes, but if that starts moving too much
+	//(fast camera turn, lots of particles) it gives up and radix sorts instead, so its never worse than O(n).
 	void RenderManager::SortBlendedObjects()
 	{
-		//sort blendable objects front to back. vector size will never be that big (<100) and they will be mostly sorted so an insertion sort it perfect.
 		auto& bin = objectmanager->GetBin()[RenderObjectManager::BIN_TYPE::BLENDABLE];
-		int n = bin.size();
-		int i, j;
-		RenderObject* key;
-		for (i = 1; i < n; i++)
-		{
-			key = bin[i];
-			j = i - 1;
-
-			/* Move elements of arr[0..i-1], that are
-			greater than key, to one position ahead
-			of their current position */
-			while (j >= 0 && blendsort(bin[j], key, cam_matrix))
+		const CullingBounds& bounds = objectmanager->GetCullingBounds();
+		uint32_t n = static_cast<uint32_t>(bin.size());
+		if (n <= 1) return;
+
+		//view space z is just the third row of the view matrix, more negative is further away so ascending z is back to front
+		glm::vec4 view_z(cam_matrix[0][2], cam_matrix[1][2], cam_matrix[2][2], cam_matrix[3][2]);
+		blend_sort.resize(n);
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint32_t slot = bin[i]->GetId();
+			float z = view_z.x * bounds.center_x[slot] + view_z.y * bounds.center_y[slot] + view_z.z * bounds.center_z[slot] + view_z.w;
+			blend_sort[i].key = FloatSortKey(z);
+			blend_sort[i].object = bin[i];
+		}
+
+		//insertion sort with a budget on how many elements it can shift, strict compare so equal depths keep their order
+		uint32_t budget = n * BLEND_INSERTION_BUDGET;
+		bool sorted = true;
+		for (uint32_t i = 1; i < n && sorted; i++)
+		{
+			InstanceSortEntry entry = blend_sort[i];
+			uint32_t j = i;
+			while (j > 0 && blend_sort[j - 1].key > entry.key)
 			{
-				bin[j + 1] = bin[j];
-				j = j - 1;
+				blend_sort[j] = blend_sort[j - 1];
+				j--;
+				if (--budget == 0)
+				{
+					sorted = false;
+					break;
+				}
 			}
-			bin[j + 1] = key;
+			blend_sort[j] = entry;
+		}
+
+		//too far out of order. what's there is still a valid permutation so just radix sort it from here
+		if (!sorted)
+		{
+			RadixSort(blend_sort, blend_sort_scratch, [](const InstanceSortEntry& e) { return e.key; }, 4);
+		}
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			bin[i] = blend_sort[i].object;
 		}
+		objectmanager->RefreshBinPositions(RenderObjectManager::BIN_TYPE::BLENDABLE);
 	}
 
 	void RenderManager::Render()
@@ -2942,6 +4038,17 @@ namespace Gibo {
 		//wait for resource key. we have a resource for every frame in flight.
 		vkWaitForFences(Device.GetDevice(), 1, &inFlightFences[current_frame_in_flight], VK_TRUE, UINT32_MAX);
 
+		//gpu is done with this frames secondaries so the worker pools can be recycled
+		Device.GetCommandPoolCache().ResetThreadPools(current_frame_in_flight);
+
+		//swap in the textures that finished streaming, pick up material edits and point this frames sets at whatever views changed since it was last recorded
+		textureCache->GetResidency().Update();
+		UpdateMaterials(current_frame_in_flight);
+		if (GPU_CULL_VALIDATE)
+		{
+			ValidateGpuCull(current_frame_in_flight);
+		}
+
 		//fetch image index were going to use. semaphore tells us when we actually acquired it. acquire image time depends on presentation mode immediate its like 0 seconds it waits.
 		uint32_t imageIndex;
 		VULKAN_CHECK(vkAcquireNextImageKHR(Device.GetDevice(), Device.GetSwapChain(), UINT64_MAX, semaphore_imagefetch[current_frame_in_flight], VK_NULL_HANDLE, &imageIndex), "acquiring swapchain image");
@@ -2969,10 +4076,17 @@ namespace Gibo {
 			updateImGui(current_frame_in_flight, imageIndex);
 		}
 
-		for (int i = 0; i < objectmanager->GetVector().size(); i++) //gpu dependency/ updating model matrix data
+		//gpu dependency/ updating model matrix data. Every object only touches its own matrices so kick them off on the workers and wait before recording
+		JobSystem::Counter object_update_counter;
+		std::vector<RenderObject*>& objects = objectmanager->GetVector();
+		int update_frame = current_frame_in_flight;
+		jobsystem.ParallelForAsync(static_cast<uint32_t>(objects.size()), UPDATE_GRAIN_SIZE, [&objects, update_frame](uint32_t begin, uint32_t end)
 		{
-			objectmanager->GetVector()[i]->Update(current_frame_in_flight);
-		}
+			for (uint32_t i = begin; i < end; i++)
+			{
+				objects[i]->Update(update_frame);
+			}
+		}, &object_update_counter);
 
 		UpdateShadowLights(current_frame_in_flight);
 		point_info = glm::vec4((float)shadowpoint_width, (float)shadowpoint_height, point_current, -1);
@@ -3054,6 +4168,15 @@ namespace Gibo {
 		atmosphere->Update(current_frame_in_flight); //gpu dependency, its changing current frames shaderinfo buffer
 		UpdateBV();//its a debug feature so its only 1 gpu frame in flight so doesn't really matter where we do it
 
+		//all the view matrixes are set so cull everything once for the passes below, then batch the visible lists once the matrices are done
+		UpdateGpuDrawList();
+		CullViews();
+		MarkStreamedTextures();
+		jobsystem.Wait(&object_update_counter);
+		BuildGpuDraws(current_frame_in_flight);
+		BuildInstances(current_frame_in_flight);
+		UpdateSortBenchmark();
+
 		//lightmanager->SyncGPUBuffer();
 		//resubmit commandbuffers that need to be updated every frame
 		RecordDepthCmd(current_frame_in_flight);
@@ -3321,37 +4444,28 @@ namespace Gibo {
 		WindowManager.SetWindowTitle(title);
 	}
 
-	void RenderManager::AddRenderObject(RenderObject* object, RenderObjectManager::BIN_TYPE type)
+	RenderObjectHandle RenderManager::AddRenderObject(RenderObject* object, RenderObjectManager::BIN_TYPE type)
 	{
 		//first make sure to add it to objectmanager. This sets the objects id, and pushes it to all data-structures
-		objectmanager->AddRenderObject(object, type);
+		RenderObjectHandle handle = objectmanager->AddRenderObject(object, type);
 
 		//now add local descriptor set for every shader that needs this object
 	
-		//PBR
-		DescriptorHelper local_descriptors(FRAMES_IN_FLIGHT, 1, 4);
+		//PBR, the material record gets made in UpdateMaterials. With bindless textures thats all it needs
+		if (bindless_active)
+		{
+			return handle;
+		}
+		DescriptorHelper local_descriptors(FRAMES_IN_FLIGHT, 0, 4);
 		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
 		{
-
-			local_descriptors.buffersizes[i].emplace_back(sizeof(Material::materialinfo));
-			local_descriptors.uniformbuffers[i].emplace_back(object->GetMaterial().GetBuffer());
-
-			local_descriptors.imageviews[i].emplace_back(object->GetMaterial().GetAlbedoMap().view);
-			local_descriptors.samplers[i].emplace_back(object->GetMaterial().GetAlbedoMap().sampler);
-
-			local_descriptors.imageviews[i].emplace_back(object->GetMaterial().GetSpecularMap().view);
-			local_descriptors.samplers[i].emplace_back(object->GetMaterial().GetSpecularMap().sampler);
-
-			local_descriptors.imageviews[i].emplace_back(object->GetMaterial().GetMetalMap().view);
-			local_descriptors.samplers[i].emplace_back(object->GetMaterial().GetMetalMap().sampler);
-
-			local_descriptors.imageviews[i].emplace_back(object->GetMaterial().GetNormalMap().view);
-			local_descriptors.samplers[i].emplace_back(object->GetMaterial().GetNormalMap().sampler);
-
+			FillPBRDescriptor(object, local_descriptors, i);
 		}
 		program_pbr.AddLocalDescriptor(object->GetId(), local_descriptors.uniformbuffers, local_descriptors.buffersizes, local_descriptors.imageviews, local_descriptors.samplers, local_descriptors.bufferviews);
 		
 		//
+
+		return handle;
 	}
 
 	/*
@@ -3365,30 +4479,119 @@ namespace Gibo {
 	{
 		objectmanager->RemoveRenderObject(object, type);
 
+		//the record can go right away, frames still drawing it are ahead of the next Flush on the queue
+		materiallibrary->Release(object->GetMaterial().GetHandle());
+		object->GetMaterial().ClearHandle();
+
 		//add objects id to the descriptorgraveyard.
-		descriptorgraveyard.push_back(descriptorgraveinfo(object->GetId(), 0));
+		descriptorgraveyard.push_back(descriptorgraveinfo(object->GetId(), descriptorgraveyard_frame));
+	}
+
+	void RenderManager::FillPBRDescriptor(RenderObject* object, DescriptorHelper& descriptors, int frame)
+	{
+		Material& material = object->GetMaterial();
+
+		//streamed maps bind whatever level is resident now, UpdateStreamedDescriptors catches them up when it changes
+		vkcoreTexture maps[4] = { material.GetAlbedoMap(), material.GetSpecularMap(), material.GetMetalMap(), material.GetNormalMap() };
+		for (int m = 0; m < 4; m++)
+		{
+			descriptors.imageviews[frame].emplace_back(textureCache->GetView(maps[m]));
+			descriptors.samplers[frame].emplace_back(maps[m].sampler);
+		}
+	}
+
+	//the residency streams in what got marked since its last update, everything the camera can see (occluded ones already lost their bit). Shadows don't sample materials
+	void RenderManager::MarkStreamedTextures()
+	{
+		auto& slots = objectmanager->GetSlots();
+		for (uint32_t slot = 0; slot < cull_viewmasks.size(); slot++)
+		{
+			if ((cull_viewmasks[slot] & (1ull << VIEW_CAMERA)) == 0 || slots[slot] == nullptr) continue;
+
+			Material& material = slots[slot]->GetMaterial();
+			textureCache->MarkUsed(material.GetAlbedoMap());
+			textureCache->MarkUsed(material.GetSpecularMap());
+			textureCache->MarkUsed(material.GetMetalMap());
+			textureCache->MarkUsed(material.GetNormalMap());
+		}
+	}
+
+	//wait for frame key before calling. Old views stay alive until every frame has been through here (see TextureResidency)
+	void RenderManager::UpdateStreamedDescriptors(int current_frame)
+	{
+		uint64_t serial = textureCache->GetResidency().GetSerial();
+		uint64_t last = pbr_texture_serials[current_frame];
+		if (serial == last) return;
+
+		std::vector<RenderObject*>& objects = objectmanager->GetVector();
+		for (int i = 0; i < objects.size(); i++)
+		{
+			Material& material = objects[i]->GetMaterial();
+			if (textureCache->GetViewSerial(material.GetAlbedoMap()) <= last && textureCache->GetViewSerial(material.GetSpecularMap()) <= last &&
+				textureCache->GetViewSerial(material.GetMetalMap()) <= last && textureCache->GetViewSerial(material.GetNormalMap()) <= last)
+			{
+				continue;
+			}
+
+			DescriptorHelper local_descriptors(FRAMES_IN_FLIGHT, 0, 4);
+			FillPBRDescriptor(objects[i], local_descriptors, current_frame);
+			program_pbr.UpdateLocalDescriptor(objects[i]->GetId(), current_frame, local_descriptors.uniformbuffers[current_frame], local_descriptors.buffersizes[current_frame],
+				local_descriptors.imageviews[current_frame], local_descriptors.samplers[current_frame], local_descriptors.bufferviews[current_frame]);
+		}
+		pbr_texture_serials[current_frame] = serial;
+	}
+
+	//wait for frame key before calling. Objects added or edited since last frame move to the record of their new material, which only gets uploaded when the pbr
+	//command buffer flushes the library. Without bindless the maps stay in the objects set so the record doesn't point at them
+	void RenderManager::UpdateMaterials(int current_frame)
+	{
+		std::vector<RenderObject*>& objects = objectmanager->GetVector();
+		for (int i = 0; i < objects.size(); i++)
+		{
+			Material& material = objects[i]->GetMaterial();
+			if (!material.HandleStale()) continue;
+
+			MaterialLibrary::materialrecord record;
+			record.info = material.GetMaterialInfo();
+			if (bindless_active)
+			{
+				record.albedo_slot = bindless->TextureSlot(material.GetAlbedoMap());
+				record.specular_slot = bindless->TextureSlot(material.GetSpecularMap());
+				record.metal_slot = bindless->TextureSlot(material.GetMetalMap());
+				record.normal_slot = bindless->TextureSlot(material.GetNormalMap());
+			}
+
+			//acquire first so an edit that lands on the same record doesn't free it on the way
+			MaterialHandle handle = materiallibrary->Acquire(record);
+			materiallibrary->Release(material.GetHandle());
+			material.SetHandle(handle);
+		}
+
+		if (bindless_active)
+		{
+			bindless->Update(current_frame);
+		}
+		else
+		{
+			UpdateStreamedDescriptors(current_frame);
+		}
 	}
 
 	//wait for frame key before calling 
 	void RenderManager::UpdateDescriptorGraveYard()
 	{
 		//we assume every object goes to every one of these shaders for now.
-		for (int i = 0; i < descriptorgraveyard.size(); i++)
+		descriptorgraveyard_frame++;
+		while (!descriptorgraveyard.empty() && descriptorgraveyard_frame - descriptorgraveyard.front().removed_frame > static_cast<uint64_t>(FRAMES_IN_FLIGHT))
 		{
-			descriptorgraveyard[i].frame_count++;
-
-			if (descriptorgraveyard[i].frame_count > FRAMES_IN_FLIGHT)
-			{
-				//remove descriptor set for all frames for this renderobject because all use of the resources are done and the renderobject is being destroyed this frame as well
+			//remove descriptor set for all frames for this renderobject because all use of the resources are done and the renderobject is being destroyed this frame as well
 				
-				//PBR
-				program_pbr.RemoveLocalDescriptor(descriptorgraveyard[i].id);
+			//PBR
+			if (!bindless_active) program_pbr.RemoveLocalDescriptor(descriptorgraveyard.front().id);
 				
-				//
-
+			//
 
-				descriptorgraveyard.erase(descriptorgraveyard.begin() + i);
-			}
+			descriptorgraveyard.pop_front();
 		}
 	}
 
@@ -3458,14 +4661,18 @@ namespace Gibo {
 			bv_vbos.clear();
 			bv_vbosizes.clear();
 
-			//recreate bounding volume vbo for every object
-			auto bv_map = objectmanager->GetBoundingVolumes();
-			bv_vbos.resize(bv_map.size());
+			//recreate bounding volume vbo for every object from its world space aabb in the culling bounds
+			std::vector<RenderObject*>& objects = objectmanager->GetVector();
+			const CullingBounds& bounds = objectmanager->GetCullingBounds();
+			bv_vbos.resize(objects.size());
 
 			int counter = 0;
-			for (auto& bv : bv_map)
+			for (RenderObject* object : objects)
 			{
-				std::vector<float> points = bv.second->CreatePointMesh(Vertex_Attribute_Length);
+				AABB box;
+				box.min = bounds.GetMin(object->GetId());
+				box.max = bounds.GetMax(object->GetId());
+				std::vector<float> points = box.CreatePointMesh(Vertex_Attribute_Length);
 
 				bv_vbosizes.push_back(points.size() / Vertex_Attribute_Length);
 				Device.CreateBufferStaged(sizeof(float) * points.size(), points.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY,
@@ -5,9 +5,16 @@
 #include "../Utilities/Input.h"
 #include "AssetManager.h"
 #include "TextureCache.h"
+#include "AssetLoader.h"
 #include "Atmosphere.h"
 #include "LightManager.h"
 #include "RenderObjectManager.h"
+#include "Instancing.h"
+#include "GpuCulling.h"
+#include "MaskedOcclusion.h"
+#include "BindlessTextures.h"
+#include "MaterialLibrary.h"
+#include "../Utilities/JobSystem.h"
 
 namespace Gibo {
 
@@ -48,9 +55,9 @@ namespace Gibo {
 		struct descriptorgraveinfo
 		{
 			uint32_t id;
-			int frame_count;
+			uint64_t removed_frame;
 
-			descriptorgraveinfo(uint32_t id_, int frame_count_) : id(id_), frame_count(frame_count_) {};
+			descriptorgraveinfo(uint32_t id_, uint64_t removed_frame_) : id(id_), removed_frame(removed_frame_) {};
 		};
 
 		struct reduce_struct {
@@ -75,7 +82,7 @@ namespace Gibo {
 		RenderManager& operator=(RenderManager&&) = delete;
 		
 
-		void AddRenderObject(RenderObject* object, RenderObjectManager::BIN_TYPE type);
+		RenderObjectHandle AddRenderObject(RenderObject* object, RenderObjectManager::BIN_TYPE type);
 		void RemoveRenderObject(RenderObject* object, RenderObjectManager::BIN_TYPE type);
 
 		void Update();
@@ -94,6 +101,8 @@ namespace Gibo {
 		}
 
 		void UpdateFrustrumClusters();
+		//packs the mesh arena and points every mesh at where its geometry went, stalls the gpu so call it at a loading point not every frame
+		void DefragmentGeometry();
 		void SetResolutionFitted(bool val) { Resolution_Fitted = val; }
 		bool IsWindowOpen() const;
 		void SetWindowTitle(std::string title) const;
@@ -105,6 +114,7 @@ namespace Gibo {
 		TextureCache* GetTextureCache() { return textureCache; }
 		LightManager* GetLightManager() { return lightmanager; }
 		RenderObjectManager* GetObjectManager() { return objectmanager; }
+		JobSystem& GetJobSystem() { return jobsystem; }
 	private:
 		void CreatePBR();
 		void createPBRfinal();
@@ -156,7 +166,7 @@ namespace Gibo {
 		void Shadowdeleteimagedata();
 		void Shadowcreateimagedata();
 		void RecordShadowCmd(int current_frame);
-		void RecordShadowHelper(int32_t offsetx, int32_t offsety, int index, int current_frame, glm::mat4 PV);
+		void RecordShadowHelper(int32_t offsetx, int32_t offsety, int index, int current_frame, const std::vector<InstanceBatch>& batches, const std::vector<MeshletRange>& ranges);
 
 		void CreateQuad();
 		void CleanUpQuad();
@@ -175,8 +185,44 @@ namespace Gibo {
 		void closeImGui();
 
 		void UpdateDescriptorGraveYard();
+		void FillPBRDescriptor(RenderObject* object, DescriptorHelper& descriptors, int frame);
+		void MarkStreamedTextures();
+		void UpdateStreamedDescriptors(int current_frame);
+		void UpdateMaterials(int current_frame);
 		void UpdateShadowLights(int current_frame);
 		void SortBlendedObjects();
+		void CullViews();
+		void CpuOcclusionCull();
+		void BuildInstances(int current_frame);
+		void CreateGpuCull();
+		void CleanUpGpuCull();
+		void GpuCullcreateimagedata();
+		void GpuCulldeleteimagedata();
+		void createGpuCullfinal();
+		void UpdateGpuDrawList();
+		void BuildGpuDraws(int current_frame);
+		void RecordGpuCull(int current_frame);
+		void RecordHiZ(int current_frame);
+		void RecordGpuCullLate(int current_frame);
+		void ValidateGpuCull(int current_frame);
+		void UpdateSortBenchmark();
+		VkCommandBuffer BeginSecondaryCmd(int current_frame, VkRenderPass renderpass, VkFramebuffer framebuffer);
+		template<typename F>
+		void RecordSecondaryCmds(int current_frame, VkRenderPass renderpass, VkFramebuffer framebuffer, uint32_t count, std::vector<VkCommandBuffer>& secondaries, F record);
+		//what BindMesh last bound in a command buffer, starts out as the FULL pipeline with no buffers
+		struct BoundMesh
+		{
+			VERTEX_FORMAT format = VERTEX_FORMAT::FULL;
+			VkBuffer vbo = VK_NULL_HANDLE;
+			VkBuffer ibo = VK_NULL_HANDLE;
+			VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+			uint32_t first_index = 0;
+			int32_t vertex_offset = 0;
+		};
+		void BindMesh(VkCommandBuffer cmd, const MeshCache::Mesh& mesh, const vkcorePipeline& pipeline_full, const vkcorePipeline& pipeline_quantized, BoundMesh& bound, bool position_stream = false);
+		void DrawBatch(VkCommandBuffer cmd, const InstanceBatch& batch, const std::vector<MeshletRange>& ranges, const BoundMesh& bound);
+		void DrawGpuBuckets(VkCommandBuffer cmd, uint32_t pass, uint32_t begin, uint32_t end, const vkcorePipeline& pipeline_full, const vkcorePipeline& pipeline_quantized, BoundMesh& bound,
+			                int current_frame);
 		void SetProjectionMatrix();
 		void SetCameraMatrix();
 	private:
@@ -188,6 +234,7 @@ namespace Gibo {
 		Atmosphere* atmosphere;
 		LightManager* lightmanager;
 		RenderObjectManager* objectmanager;
+		JobSystem jobsystem; //workers for the per frame cpu work (object updates, bounds refits, culling)
 
 		bool enable_imgui = true;
 		VkExtent2D window_extent{ 800, 640 };
@@ -221,6 +268,7 @@ namespace Gibo {
 		std::vector<VkFramebuffer> framebuffer_pbr;
 		ShaderProgram program_pbr;
 		vkcorePipeline pipeline_pbr;
+		vkcorePipeline pipeline_pbr_quantized;
 		std::vector<VkCommandBuffer> cmdbuffer_pbr;
 
 		std::vector<vkcoreBuffer> cascade_buffer;
@@ -260,11 +308,13 @@ namespace Gibo {
 
 		//depth presspass
 		VkRenderPass renderpass_depth;
+		VkRenderPass renderpass_depth_late; //loads what renderpass_depth drew, for occlusion cullings late phase
 		std::vector<vkcoreImage> depthprepass_attachment;
 		std::vector<VkImageView> depthprepass_view;
 		std::vector<VkFramebuffer> framebuffers_depth;
 		ShaderProgram program_depth;
 		vkcorePipeline pipeline_depth;
+		vkcorePipeline pipeline_depth_quantized;
 		std::vector<VkCommandBuffer> cmdbuffer_depth;
 
 		//reduce
@@ -303,6 +353,8 @@ namespace Gibo {
 		ShaderProgram program_shadowpoint;
 		vkcorePipeline pipeline_shadow;
 		vkcorePipeline pipeline_shadowpoint;
+		vkcorePipeline pipeline_shadow_quantized;
+		vkcorePipeline pipeline_shadowpoint_quantized;
 		std::vector<VkCommandBuffer> cmdbuffer_shadow;
 		std::vector<float> cascade_nears; //need this to pancake everythig to each cascades orthogonalplane
 		std::vector<glm::vec4> cascade_depths;
@@ -411,7 +463,129 @@ namespace Gibo {
 		int FRAMES_IN_FLIGHT = 3; //Make sure to test with different number
 		int current_frame_in_flight = 0;
 
-		std::vector<descriptorgraveinfo> descriptorgraveyard;
+		std::deque<descriptorgraveinfo> descriptorgraveyard; //in removal order, so only the front ever needs checking
+		uint64_t descriptorgraveyard_frame = 0; //counts UpdateDescriptorGraveYard calls to stamp removals with
+		static const int MAX_PBR_DESCRIPTORS = 4096; //local descriptor sets per frame program_pbr can hold, every added object takes one
+		std::vector<uint64_t> pbr_texture_serials; //residency serial each frames pbr sets were last brought up to date with
+
+		//materials (MaterialLibrary.h). Every instance reads its material handle out of instance_material_buffers and its record out of the one material table
+		static const uint32_t MAX_MATERIALS = 4096; //distinct materials, objects sharing one share the record
+		MaterialLibrary* materiallibrary = nullptr;
+		std::vector<vkcoreBuffer> instance_material_buffers; //material handle of every instance, same indices as instance_buffers
+		std::vector<uint32_t> instance_materials;
+		//bindless textures (BindlessTextures.h). When the device has descriptor indexing and the bindless spirv is there the pbr pass binds one texture array a frame
+		//instead of a set per object and batches across materials. Decided once in CreatePBR
+		bool BINDLESS_MATERIALS = true;
+		bool bindless_active = false;
+		BindlessTextures* bindless = nullptr;
+		int texture_budget_mb = 0; //overrides the streaming budget when > 0, for testing eviction without a full card
+
+		//culling. views are laid out camera, cascades, then the point/spot shadow atlas slots in atlas order
+		static const int VIEW_CAMERA = 0;
+		static const int VIEW_CASCADE = 1;
+		bool BVH_CULLING = true; //cull through the objectmanagers aabb tree instead of testing every object
+		static const uint32_t CULL_GRAIN_SIZE = 256; //slots per culling job, multiple of CullingBounds::SIMD_WIDTH
+		static const uint32_t UPDATE_GRAIN_SIZE = 64; //renderobjects per matrix update job
+
+		//command recording. depth/shadow/pbr draws get split over the job system into secondaries and executed into the primaries
+		bool MULTITHREADED_RECORDING = true;
+		static const uint32_t RECORD_GRAIN_SIZE = 128; //minimum draws per secondary command buffer
+		std::vector<VkCommandBuffer> secondary_cmds; //secondaries of the render pass currently being recorded
+		std::vector<std::vector<Plane>> cull_views; //frustrum planes of every view this frame
+		std::vector<uint64_t> cull_viewmasks; //bit per view for every slot
+		std::vector<std::vector<uint32_t>> view_visible; //visible opaque slots for every view
+
+		//instancing. every views visible list gets batched by mesh (+material for the camera) and the model matrices go into one storage buffer per frame
+		static const uint32_t MAX_INSTANCES = 1 << 16; //matrices per frame over every view
+		bool AUTO_INSTANCING = true; //off makes every object its own batch, handy for checking the batching isn't dropping anything
+		std::vector<vkcoreBuffer> instance_buffers;
+		std::vector<glm::mat4> instance_data;
+		std::vector<uint32_t> view_instance_offsets; //where each views matrices start in the instance buffer
+		std::vector<std::vector<InstanceBatch>> view_batches;
+		std::vector<InstanceBatch> blend_batches; //one per visible blendable in back to front order
+		std::vector<InstanceScratch> batch_scratch; //sort memory per thread
+		bool SORT_DRAWS = true; //radix sort the draw keys, off draws in visible list order
+		std::array<float, 30> time_sort; //cpu time of BuildInstances
+
+		//mesh lods. every view picks the coarsest lod whose error stays under LOD_PIXEL_ERROR pixels at its own resolution, shadow maps get LOD_SHADOW_BIAS times more
+		//since a texel of shadow is blurry anyway
+		bool MESH_LODS = true; //off draws lod 0 everywhere
+		static constexpr float LOD_PIXEL_ERROR = 1.0f;
+		static constexpr float LOD_SHADOW_BIAS = 4.0f;
+		std::vector<LodSelectInfo> view_lods; //one per cull view, filled next to the planes
+
+		//meshlet culling. objects drawn at lod 0 whose mesh has at least MESHLET_MIN_COUNT meshlets get refined to their visible meshlets in every view, the surviving
+		//index ranges of each view go into its range list and the batches point into it
+		bool MESHLET_CULLING = true;
+		static const uint32_t MESHLET_MIN_COUNT = 16;
+		std::vector<glm::vec4> view_eyes; //MeshletViewEye of every cull view
+		std::vector<std::vector<MeshletRange>> view_ranges;
+
+		//gpu driven culling (GpuCulling.h). Every opaque object is a draw record and GpuCull.comp culls, lod selects and compacts them into indirect draws for the
+		//depth, pbr and cascade passes, so those views skip the visible lists and batching. Point/spot atlas views and blendables stay on the cpu path, and so does
+		//everything if the device can't do draw indirect count or there are more than MAX_GPU_DRAWS records
+		bool GPU_CULLING = true;
+		bool gpu_culling_active = false; //whether this frame went through the gpu path
+		static const bool GPU_CULL_VALIDATE = false; //reads every frames commands back and compares them with GpuCullReference, slow
+		static const uint32_t MAX_GPU_DRAWS = 1 << 16;
+		static const uint32_t INSTANCE_CAPACITY = MAX_INSTANCES + MAX_GPU_DRAWS; //matrices per instance buffer, the records take the front
+		static const uint32_t GPU_CULL_PASS_DEPTH = 0;
+		static const uint32_t GPU_CULL_PASS_PBR = 1;
+		static const uint32_t GPU_CULL_PASS_CASCADE = 2; //one per cascade after this
+		uint32_t GpuCullPassLate() const { return GPU_CULL_PASS_CASCADE + CASCADE_COUNT; } //after the cascades
+		GpuDrawList gpu_draws;
+		uint64_t gpu_draws_version = UINT64_MAX; //objectmanager version the records were built from
+		bool gpu_draws_dirty = true; //forces a rebuild, for when meshes moved or a material changed bucket
+		uint32_t gpu_draws_serial = 0; //goes up every rebuild
+		std::vector<uint32_t> gpu_draws_uploaded; //serial the records/meshes of each frame were uploaded at
+		std::vector<GpuCullParams> gpu_cull_params; //what each frame dispatched with, draw_count 0 if it went through the cpu
+		std::vector<GpuCullBounds> gpu_cull_bounds_data;
+		std::vector<GpuCullPass> gpu_cull_passes;
+		uint32_t gpu_instance_base = 0; //the cpu views matrices start after the records
+		ShaderProgram program_gpucull;
+		vkcorePipeline pipeline_gpucull;
+		std::vector<vkcoreBuffer> gpucull_records;
+		std::vector<vkcoreBuffer> gpucull_meshes;
+		std::vector<vkcoreBuffer> gpucull_bounds;
+		std::vector<vkcoreBuffer> gpucull_passes;
+		std::vector<vkcoreBuffer> gpucull_commands;
+		std::vector<vkcoreBuffer> gpucull_counts;
+
+		//two phase occlusion culling on top of the gpu path. The hi-z pyramid (max depth, one per frame like the depth images) gets built from the early depth pass
+		//in the depth cmdbuffer, the late phase culls against it and draws the newly visible objects into the same depth image. Visibility is one buffer for every
+		//frame, the cull dispatches all go through the graphics queue in order so a frame always reads what the previous one wrote
+		bool OCCLUSION_CULLING = true;
+		static const uint32_t HIZ_GROUP_SIZE = 8; //LOCAL_WORKGROUP_SIZE in HiZBuild.comp
+		vkcoreBuffer gpucull_visibility;
+		uint32_t gpu_visibility_serial = UINT32_MAX; //records serial the visibility buffer was reset for, UINT32_MAX when it wasn't kept up
+		std::vector<vkcoreImage> hiz_images;
+		std::vector<VkImageView> hiz_views; //every level, what the cull shader samples
+		std::vector<std::vector<VkImageView>> hiz_levelviews;
+		std::vector<VkExtent2D> hiz_extents;
+		std::vector<std::vector<VkDescriptorSet>> hiz_descriptors; //one per level
+		VkSampler hiz_sampler;
+		ShaderProgram program_hiz;
+		vkcorePipeline pipeline_hiz;
+
+		//software occlusion culling for the cpu path (MaskedOcclusion.h). Objects marked SetOccluder get rasterized into a small masked depth buffer from the camera and
+		//everything behind it loses its camera bit before the view lists get built. The gpu path has the hi-z for that so this only runs when a frame doesn't go through it
+		bool CPU_OCCLUSION_CULLING = true;
+		static const uint32_t CPU_OCCLUSION_WIDTH = 320;
+		static const uint32_t CPU_OCCLUSION_HEIGHT = 180;
+		MaskedOcclusionBuffer cpu_occlusion;
+
+		//sort benchmark: SORT_BENCHMARK_FRAMES unsorted then SORT_BENCHMARK_FRAMES sorted, logs the average main pass gpu time and sort cpu time of both.
+		//the first SORT_BENCHMARK_WARMUP frames of each half get thrown out since the timestamps we read are from FRAMES_IN_FLIGHT frames ago
+		static const int SORT_BENCHMARK_FRAMES = 300;
+		static const int SORT_BENCHMARK_WARMUP = 10;
+		int sort_benchmark_frame = -1; //-1 when it isn't running
+		std::array<double, 2> sort_benchmark_gpu;
+		std::array<double, 2> sort_benchmark_cpu;
+
+		//blend sort. keys are the view depth of each blendable, the budget is how many shifts per object the insertion sort gets before it falls back to the radix sort
+		static const uint32_t BLEND_INSERTION_BUDGET = 4;
+		std::vector<InstanceSortEntry> blend_sort;
+		std::vector<InstanceSortEntry> blend_sort_scratch;
 
 	};
 }
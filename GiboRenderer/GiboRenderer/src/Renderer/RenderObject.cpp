@@ -1,13 +1,12 @@
 #include "../pch.h"
 #include "RenderObject.h"
+#include "TransformSystem.h"
 
 namespace Gibo {
 
 
 	void RenderObject::SetTransformation(glm::vec3 position, glm::vec3 scale, ROTATE_DIMENSION dimension, float indegrees)
 	{
-		glm::mat4 scalez = glm::scale(glm::mat4(1.0), scale);
-
 		glm::vec3 rotatedim = glm::vec3(0, 0, 0);
 		switch (dimension)
 		{
@@ -16,20 +15,29 @@ namespace Gibo {
 		case ROTATE_DIMENSION::ZANGLE: rotatedim.z = 1; break;
 		}
 
-		glm::mat4 rotate = glm::rotate(glm::mat4(1.0), glm::radians(indegrees), rotatedim);
-
-		glm::mat4 translate = glm::translate(glm::mat4(1.0), position);
+		this->position = position;
+		this->rotation = glm::angleAxis(glm::radians(indegrees), rotatedim);
+		this->scale = scale;
 
-		internal_matrix = translate * rotate * scalez;
+		//once its added the matrix and bounds get rebuilt with every other moved object in the transform systems refit
+		if (transforms)
+		{
+			transforms->Set(descriptor_id, this->position, this->rotation, this->scale);
+		}
 
 		NotifyUpdate();
 	}
 
+	glm::mat4 RenderObject::GetSyncedMatrix() const
+	{
+		return (transforms) ? transforms->GetWorld(descriptor_id) : TransformSystem::ComposeTRS(position, rotation, scale);
+	}
+
 	void RenderObject::Update(int framecount)
 	{
 		if (needs_updated)
 		{
-			model_matrix[framecount] = internal_matrix;
+			model_matrix[framecount] = GetSyncedMatrix();
 
 			frames_updated++;
 			if (frames_updated >= model_matrix.size())
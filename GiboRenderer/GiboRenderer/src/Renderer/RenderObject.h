@@ -2,8 +2,12 @@
 #include "AssetManager.h"
 #include "Material.h"
 #include "BoundingVolumes.h"
+#include "../Utilities/SlotMap.h"
+#include <glm/gtc/quaternion.hpp>
 
 namespace Gibo {
+	using RenderObjectHandle = SlotHandle;
+	class TransformSystem;
 
 	class RenderObject
 	{
@@ -11,7 +15,7 @@ namespace Gibo {
 		friend class RenderObjectManager;
 		enum class ROTATE_DIMENSION : uint8_t {XANGLE,YANGLE,ZANGLE};
 	public:
-		RenderObject(vkcoreDevice* device, vkcoreTexture defaulttexture, int framesinflight) : material(device, defaulttexture), model_matrix(framesinflight){};
+		RenderObject(vkcoreDevice* device, vkcoreTexture defaulttexture, int framesinflight) : material(defaulttexture), model_matrix(framesinflight){};
 		~RenderObject() = default;
 		 
 		//void SetMesh(MeshCache::Mesh Mesh) { mesh = Mesh; }
@@ -28,22 +32,31 @@ namespace Gibo {
 		Material& GetMaterial() { return material; }
 		MeshCache::Mesh& GetMesh() { return mesh; }
 		glm::mat4& GetMatrix(int frame_count) { return model_matrix[frame_count]; }
-		glm::mat4& GetSyncedMatrix() { return internal_matrix; }
+		glm::mat4 GetSyncedMatrix() const; //latest world matrix, not the one a frame in flight is using
 		uint32_t GetId() { return descriptor_id; }
-		bool Moved() { return (needs_updated && frames_updated == 0); } //have to call this before the renderobject update function
+		RenderObjectHandle GetHandle() const { return handle; } //null until its added to the objectmanager
+		//occluders get rasterized into the cpu occlusion buffer every frame (MaskedOcclusion.h), meant for big static things like terrain, buildings and floors
+		void SetOccluder(bool isoccluder) { occluder = isoccluder; }
+		bool IsOccluder() const { return occluder; }
 
 	private:
 		void NotifyUpdate() { needs_updated = true; frames_updated = 0; }
 	private:
 		std::vector<glm::mat4> model_matrix;
-		glm::mat4 internal_matrix;
-		Material material; // TODO: Materials should be static so should just have a material library adn you have a pointer to it, or a SOA of materials because this is a big class in bytess
+		//local trs, the objectmanagers TransformSystem owns the real copy and builds the world matrix once the object is added
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		glm::vec3 scale = glm::vec3(1.0f);
+		TransformSystem* transforms = nullptr;
+		Material material; //cpu copy, the renderer dedups it into a MaterialLibrary record and draws with its handle
 		MeshCache::Mesh mesh;
 		//std::unique_ptr<BoundingVolume> bv;
 
 		uint32_t descriptor_id; //this is the id all the shaderprograms use when they add this renderobjects descriptor to its map
+		RenderObjectHandle handle; //objectmanager handle, descriptor_id is its slot index
 		bool needs_updated = false;
 		int frames_updated = 0;
+		bool occluder = false;
 	};
 
 }
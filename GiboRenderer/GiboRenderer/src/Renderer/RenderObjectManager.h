@@ -1,7 +1,13 @@
 #pragma once
 #include "RenderObject.h"
 #include "AssetManager.h"
+#include "CullingBounds.h"
+#include "TransformSystem.h"
+#include "DynamicAABBTree.h"
 #include "../Utilities/memorypractice.h"
+#include "../Utilities/JobSystem.h"
+#include "../Utilities/SlotMap.h"
+#include <deque>
 #include <array>
 
 namespace Gibo {
@@ -22,8 +28,9 @@ namespace Gibo {
 	deletion is handled based off frames in flight. You need to set a bit to destroyed on the renderobject so the things looping through data structures know they are gone while things using
 	them still have the memory. Then after k frames in flight you can finally delete it from the data structure.
 
-	TODO- maybe just hold all the objects in a conitguous array as the source data, then everything grabs from that so if we need to loop trhough everything contiguously its in the arry.
-	Check if looping through pointers is fine that point to contiguous memory
+	The objects live in a generational slot map. Its sparse index is the objects descriptor_id/slot, which every index keyed array (culling bounds, tree leaves, descriptors) uses,
+	and its dense array is the contiguous vector of every live object. Adding and removing are O(1): the dense array and the bins swap-and-pop, and the slot index isn't recycled until
+	the graveyard lets the object go so nothing in flight ever sees it reused. The index keyed arrays just double whenever a slot past the end gets handed out so there's no object limit.
 	*/
 
 	class RenderObjectManager
@@ -31,51 +38,23 @@ namespace Gibo {
 	public:
 		enum BIN_TYPE : int { REGULAR, BLENDABLE };
 		static const int BIN_SIZE = 2;
-		static const int MAX_OBJECTS_ALLOWED = 200; //this is the number of max objects allowed so we can preallocate for some data-structures
+		static const uint32_t INITIAL_OBJECT_CAPACITY = 256; //what the slot arrays start out sized for, they double whenever they run out
+		static const uint32_t REFIT_GRAIN_SIZE = 64; //moved objects per job when refitting bounds
 		
 		struct graveyardinfo 
 		{
 			RenderObject* object;
-			int frame_count;
+			uint64_t removed_frame;
 
-			graveyardinfo(RenderObject* a, int b) : object(a), frame_count(b) {};
-		};
-		//just a quick way to hand out id's. counter will increment and repeat at IDHELPERSIZE and the slots just represent if that id is taken or not
-		//static constexpr int IDHELPERSIZE = 1000;
-		struct idhelper
-		{
-			std::array<bool, MAX_OBJECTS_ALLOWED>slots;
-			uint32_t counter;
-
-			idhelper()
-			{
-				slots.fill(false);
-				counter = 0;
-			}
-
-			uint32_t GetNextID()//assumes every slot will never all be true
-			{
-				while (slots[counter] == true)
-				{
-					counter = (counter + 1) % slots.size();
-				}
-				uint32_t returncounter = counter;
-				slots[returncounter] = true;
-				counter = (counter + 1) % slots.size();
-				return returncounter;
-			}
-
-			void FreeID(uint32_t id)
-			{
-				slots[id] = false;
-			}
+			graveyardinfo(RenderObject* a, uint64_t b) : object(a), removed_frame(b) {};
 		};
 
 	public:
-		RenderObjectManager(vkcoreDevice& device, MeshCache& Meshcache, int framesinflight) : deviceref(device), meshcache(Meshcache), maxframesinflight(framesinflight), 
-			               object_pool(MAX_OBJECTS_ALLOWED)
+		RenderObjectManager(vkcoreDevice& device, MeshCache& Meshcache, JobSystem& Jobs, int framesinflight) : deviceref(device), meshcache(Meshcache), jobs(Jobs), maxframesinflight(framesinflight), 
+			               object_pool(INITIAL_OBJECT_CAPACITY)
 		{
-			graveyard.reserve(MAX_OBJECTS_ALLOWED); Object_Bin[0].reserve(MAX_OBJECTS_ALLOWED); Object_Bin[1].reserve(MAX_OBJECTS_ALLOWED); Object_vector.reserve(MAX_OBJECTS_ALLOWED);
+			Object_Bin[0].reserve(INITIAL_OBJECT_CAPACITY); Object_Bin[1].reserve(INITIAL_OBJECT_CAPACITY); Object_map.Reserve(INITIAL_OBJECT_CAPACITY);
+			GrowSlots(INITIAL_OBJECT_CAPACITY);
 		};
 		~RenderObjectManager() = default;
 
@@ -94,87 +73,115 @@ namespace Gibo {
 			object_pool.deallocate(object);
 		}
 
-		void AddRenderObject(RenderObject* object, BIN_TYPE type)
+		RenderObjectHandle AddRenderObject(RenderObject* object, BIN_TYPE type)
 		{
-			
-			//give object an id
-			object->descriptor_id = idmanager.GetNextID();
+			//give object a handle, the slot index is its id
+			object->handle = Object_map.Insert(object);
+			object->descriptor_id = object->handle.index;
+			uint32_t id = object->descriptor_id;
+			if (id >= Object_slots.size())
+			{
+				GrowSlots(static_cast<uint32_t>(Object_slots.size()) * 2);
+			}
 
 			//add render object to data-structures
 
 			//BIN
+			Object_binpositions[id] = static_cast<uint32_t>(Object_Bin[type].size());
 			Object_Bin[type].push_back(object);
 
-			//VECTOR
-			Object_vector.push_back(object);
+			//SLOTS/transforms/culling bounds (local trs and mesh bounds go in the transform system, which writes the world matrix and the world space sphere and aabb at the objects slot)
+			Object_slots[id] = object;
+			Sphere sphere;
+			AABB box;
+			meshcache.GetMeshBounds(object->GetMesh().mesh_name, sphere, box);
+			Object_transforms.Add(id, object->position, object->rotation, object->scale, sphere, box, Object_bounds);
+			Object_bounds.bin_flags[id] = 1u << type;
+			object->transforms = &Object_transforms;
 
-			//bounding volumes (Copy orginal bounding volume for mesh into new pointer, then transform it to current models model matrix)
-			meshcache.GetOriginalMeshBV(object->GetMesh().mesh_name, Object_bvs[object->descriptor_id]);
-			Object_bvs[object->descriptor_id]->Transform(object->internal_matrix);
+			//TREE
+			Object_proxies[id] = Object_tree.Insert(id, Object_bounds.GetMin(id), Object_bounds.GetMax(id));
 
 			//other data structures
+			version++;
+
+			return object->handle;
 		}
 
 		//when you pass this in you surrender the memory you must not use renderobject anymore. The memory can't just be released because frames are in flight. but we can remove them from data structure
 		void RemoveRenderObject(RenderObject* object, BIN_TYPE type)
 		{
-			graveyard.push_back(graveyardinfo(object, 0));
+			uint32_t id = object->descriptor_id;
+			graveyard.push_back(graveyardinfo(object, frame_number));
 
 			//remove from every data-structure
-			//BIN
-			for (int i = 0; i < Object_Bin[type].size(); i++)
-			{
-				if (Object_Bin[type][i] == object)
-				{
-					Object_Bin[type].erase(Object_Bin[type].begin() + i);
-				}
-			}
+			//BIN (swap the last one into the hole)
+			std::vector<RenderObject*>& bin = Object_Bin[type];
+			uint32_t position = Object_binpositions[id];
+			bin[position] = bin.back();
+			Object_binpositions[bin[position]->descriptor_id] = position;
+			bin.pop_back();
+
+			//VECTOR/handle (the generation moves on now so the handle goes stale right away, but the index stays taken until the graveyard deletes it)
+			Object_map.Remove(object->handle, false);
+
+			//SLOTS/transforms/culling bounds (the id isn't freed until the graveyard is done but culling should stop seeing it right away)
+			Object_slots[id] = nullptr;
+			Object_transforms.Remove(id);
+			Object_bounds.Clear(id);
+			object->transforms = nullptr;
+
+			//TREE
+			Object_tree.Remove(Object_proxies[id]);
+			Object_proxies[id] = DynamicAABBTree::NULL_NODE;
+			version++;
+		}
+
+		//nullptr if the object was removed
+		RenderObject* GetRenderObject(RenderObjectHandle handle)
+		{
+			RenderObject** object = Object_map.Get(handle);
+			return (object) ? *object : nullptr;
+		}
 
-			//VECTOR
-			for (int i = 0; i < Object_vector.size(); i++)
+		//call after reordering a bin in place (blend sorting) so removing still knows where everything is
+		void RefreshBinPositions(BIN_TYPE type)
+		{
+			std::vector<RenderObject*>& bin = Object_Bin[type];
+			for (uint32_t i = 0; i < bin.size(); i++)
 			{
-				if (object == Object_vector[i])
-				{
-					Object_vector.erase(Object_vector.begin() + i);
-				}
+				Object_binpositions[bin[i]->descriptor_id] = i;
 			}
-
-			//bounding volume (remove bounding volume pointer and erase from data structure)
-			delete Object_bvs[object->descriptor_id];
-			Object_bvs.erase(object->descriptor_id);
 		}
 
 		void Update()
 		{
-			//check to see if any renderobject has moved so we can delete volume, get original, move it to new spot
-			for (int i = 0; i < Object_vector.size(); i++)
+			frame_number++;
+
+			//rebuild the world matrices and culling bounds of only the objects that called SetTransformation, on the job system. every object only writes its own slot so the chunks never touch the same memory
+			Object_transforms.Refit(jobs, Object_bounds, REFIT_GRAIN_SIZE);
+
+			//the tree isn't thread safe so the leaves get moved after on this thread. most moves stay inside the fat aabb and return right away anyway
+			const std::vector<uint32_t>& moved = Object_transforms.GetRefitted();
+			for (int i = 0; i < moved.size(); i++)
 			{
-				if (Object_vector[i]->Moved())
-				{
-					delete Object_bvs[Object_vector[i]->descriptor_id];
-					meshcache.GetOriginalMeshBV(Object_vector[i]->GetMesh().mesh_name, Object_bvs[Object_vector[i]->descriptor_id]);
-					Object_bvs[Object_vector[i]->descriptor_id]->Transform(Object_vector[i]->internal_matrix);
-				}
+				uint32_t id = moved[i];
+				Object_tree.Move(Object_proxies[id], Object_bounds.GetMin(id), Object_bounds.GetMax(id));
 			}
 
-			//loop through graveyard objects and increment timer once it gets to frames in flight you can safely remove it from all data structures
-			for (int i = 0; i < graveyard.size(); i++)
+			//graveyard is in removal order so only the front can be old enough. once its been there more than frames in flight you can safely delete it
+			///if you update at cpu no dependency stage you need framesinflight + 1, else if you wait for image it can just be framesinflight
+			while (!graveyard.empty() && frame_number - graveyard.front().removed_frame > static_cast<uint64_t>(maxframesinflight))
 			{
-				graveyard[i].frame_count++;
-
-				///if you update at cpu no dependency stage you need framesinflight + 1, else if you wait for image it can just be framesinflight
-				if (graveyard[i].frame_count > maxframesinflight)
-				{
-					DeleteObject(graveyard[i].object);
-					graveyard.erase(graveyard.begin() + i);
-				}
+				DeleteObject(graveyard.front().object);
+				graveyard.pop_front();
 			}
 		}
 
 		void CleanUp()
 		{
 #ifdef _DEBUG
-			if (Object_vector.size() != 0) { Logger::LogError("Not all renderobjects were removed from renderobject manager!\n"); }
+			if (Object_map.Size() != 0) { Logger::LogError("Not all renderobjects were removed from renderobject manager!\n"); }
 #endif
 			//cleanup data structures and anything left in the graveyard
 			for (int i = 0; i < graveyard.size(); i++)
@@ -187,24 +194,46 @@ namespace Gibo {
 			Object_Bin[0].clear();
 			Object_Bin[1].clear();
 
-			Object_vector.clear();
+			for (RenderObject* object : Object_map.Dense())
+			{
+				object->transforms = nullptr;
+			}
+			Object_map.Clear();
+			Object_transforms.Clear();
 
-			for (auto boundingvolume : Object_bvs)
+			std::fill(Object_slots.begin(), Object_slots.end(), nullptr);
+			for (uint32_t i = 0; i < Object_bounds.Size(); i++)
 			{
-				delete boundingvolume.second;
+				Object_bounds.Clear(i);
 			}
-			Object_bvs.clear();
+			Object_tree.Clear();
+			std::fill(Object_proxies.begin(), Object_proxies.end(), DynamicAABBTree::NULL_NODE);
+			version++;
 		}
 
 		std::array<std::vector<RenderObject*>, BIN_SIZE>& GetBin() { return Object_Bin; };
-		std::vector<RenderObject*>& GetVector() { return Object_vector; }
-		std::unordered_map<uint32_t, BoundingVolume*>& GetBoundingVolumes() { return Object_bvs; }
+		std::vector<RenderObject*>& GetVector() { return Object_map.Dense(); }
+		std::vector<RenderObject*>& GetSlots() { return Object_slots; }
+		const CullingBounds& GetCullingBounds() const { return Object_bounds; }
+		DynamicAABBTree& GetTree() { return Object_tree; }
+		//goes up whenever an object is added or removed, for anything that caches per object data (the gpu draw records)
+		uint64_t GetVersion() const { return version; }
 
 	private:
+		//every slot indexed array gets resized together, new slots start empty
+		void GrowSlots(uint32_t count)
+		{
+			Object_slots.resize(count, nullptr);
+			Object_bounds.Resize(count);
+			Object_transforms.Resize(count);
+			Object_proxies.resize(count, DynamicAABBTree::NULL_NODE);
+			Object_binpositions.resize(count, 0);
+		}
+
 		void DeleteObject(RenderObject* object)
 		{
 			//free id
-			idmanager.FreeID(object->descriptor_id);
+			Object_map.Recycle(object->descriptor_id);
 
 			//gpu is not using memory anymore so we are free to delete it
 			object->~RenderObject();//need to explicilty call deconstructor because deallocate doesn't destroy the memory
@@ -215,18 +244,24 @@ namespace Gibo {
 		}
 
 	private:
-		std::vector<graveyardinfo> graveyard; //data-structure for holding removed objects. since frames are in flight it must wait x amount of frames before actually deleting the memory
+		std::deque<graveyardinfo> graveyard; //data-structure for holding removed objects. since frames are in flight it must wait x amount of frames before actually deleting the memory
 		std::array<std::vector<RenderObject*>, BIN_SIZE> Object_Bin; //a bin structure with holds vectors in each bin, and bins are used for different rendering purposes to group objects
-		std::vector<RenderObject*> Object_vector; //a simple contiguous data structure if you need to loop through every object quickly
-		std::unordered_map<uint32_t, BoundingVolume*> Object_bvs; //holds bounding volumes for renderobjects. I didn't want to store this data in the main renderobject because memory coherency.
+		SlotMap<RenderObject*> Object_map; //every live object. the dense array is the simple contiguous data structure if you need to loop through every object quickly
+		TransformSystem Object_transforms; //local trs, world matrices and model space bounds as structure of arrays indexed by id, with the dirty list of what moved
+		std::vector<RenderObject*> Object_slots; //renderobject for every id, so the visible slots the culling kernels spit out can be turned back into objects
+		CullingBounds Object_bounds; //world space spheres/aabbs as structure of arrays indexed by id. This is what the culling kernels actually loop through.
+		DynamicAABBTree Object_tree; //aabb tree over every object for hierarchical culling. It gets insert/remove/move incrementally so its never rebuilt.
+		std::vector<int32_t> Object_proxies; //tree leaf of every id
+		std::vector<uint32_t> Object_binpositions; //where every id sits in its bin so removing doesn't have to search
+		uint64_t frame_number = 0; //counts Update calls, graveyard entries are stamped with it
+		uint64_t version = 0;
 
 		vkcoreDevice& deviceref;
 		MeshCache& meshcache;
+		JobSystem& jobs;
 		int maxframesinflight;
 
 		PoolAllocator<RenderObject> object_pool;
-
-		idhelper idmanager; //dishes out ids to renderobjects submitted and frees id when object is delete.
 	};
 
 }
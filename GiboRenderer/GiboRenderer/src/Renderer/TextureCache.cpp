@@ -7,12 +7,8 @@ namespace Gibo {
 
 	void TextureCache::CleanUp()
 	{
-		for (auto& texture : texture2dcache)
-		{
-			deviceref.DestroyImage(texture.second.image);
-			vkDestroyImageView(deviceref.GetDevice(), texture.second.view, nullptr);
-			//sampler is handled by samplercache
-		}
+		//sampler is handled by samplercache
+		residency.CleanUp();
 		texture2dcache.clear();
 
 		for (int i = 0; i < cubemaparray.size(); i++)
@@ -24,32 +20,118 @@ namespace Gibo {
 
 	void TextureCache::PrintInfo() const
 	{
-		Logger::Log("total memory size ", gpumemory_size / 1000000, "MB", "2D texture count: ", texture2dcache.size(), "cube array count: ", cubemaparray.size(), "\n");
+		TextureResidency::Stats stats = residency.GetStats();
+		Logger::Log("total memory size ", (gpumemory_size + stats.resident_bytes) / 1000000, "MB", "2D texture count: ", texture2dcache.size(), "cube array count: ", cubemaparray.size(), "\n");
+		Logger::Log("2D textures resident ", stats.resident_bytes / 1000000, "MB of a ", stats.budget_bytes / 1000000, "MB budget, ", stats.full, " at full resolution\n");
 	}
 
-	//TODO - research more about image format loading higher precision like 16 bit. also dont enforce alpha for saving memory.
-	TextureCache::internaltexture TextureCache::Create2DTexture(std::string filename, bool mipped)
+	bool TextureCache::DecodeTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage, bool compress, DecodedTexture& texture)
 	{
-		internaltexture texture;
+		texture.filename = filename;
+		texture.mipped = mipped;
+		texture.usage = usage;
+		texture.compressed = compress;
+
+		//out of the .dds cache if its there, otherwise decoded, mipped and encoded here
+		if (compress)
+		{
+			return ImportCompressed(filename, usage, mipped, texture.image);
+		}
 
 		//load texture
-		int texWidth, texHeight, texChannels;
-		unsigned char* pixels = stbi_load(filename.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);//last parameter will load pixels with that many channels
+		int texChannels;
+		texture.pixels = stbi_load(filename.c_str(), &texture.width, &texture.height, &texChannels, STBI_rgb_alpha);//last parameter will load pixels with that many channels
 
-		if (!pixels)
+		if (!texture.pixels)
 		{
 			const char* message = stbi_failure_reason();
-			printf("STBI MESSAGE: %s  %s\n", message, filename);
+			printf("STBI MESSAGE: %s  %s\n", message, filename.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void TextureCache::FreeDecodedTexture(DecodedTexture& texture)
+	{
+		if (texture.pixels)
+		{
+			stbi_image_free(texture.pixels);
+			texture.pixels = nullptr;
+		}
+		texture.image = CompressedImage();
+	}
+
+	//TODO - research more about image format loading higher precision like 16 bit. also dont enforce alpha for saving memory.
+	bool TextureCache::AddDecodedTexture(DecodedTexture& decoded, AssetUploader& uploader)
+	{
+		textureKey key(decoded.filename, decoded.mipped, decoded.usage);
+		if (texture2dcache.count(key) != 0)
+		{
+			FreeDecodedTexture(decoded);
+			return true;
+		}
+		bool pinned = (decoded.filename == PLACEHOLDER_TEXTURE);
+
+		if (decoded.compressed)
+		{
+			if (decoded.image.data.empty())
+			{
+				return false;
+			}
+			Logger::Log(decoded.filename, " width: ", decoded.image.width, " height: ", decoded.image.height, " mipped: ", decoded.mipped, " compressed ", decoded.image.data.size() / 1000000, "MB", "\n");
+			texture2dcache[key] = residency.AddCompressed(decoded.filename, decoded.usage, decoded.mipped, pinned, decoded.image, uploader);
+			FreeDecodedTexture(decoded);
+			return true;
+		}
+		if (!decoded.pixels)
+		{
+			return false;
+		}
+
+		VkDeviceSize imageSize = decoded.width * decoded.height * STBI_rgb_alpha;
+		Logger::Log(decoded.filename, " width: ", decoded.width, " height: ", decoded.height, " mipped: ", decoded.mipped, " ", imageSize / 1000000, "MB", "\n");
+
+		VkFormat format = Pick2DFormat(decoded.mipped, decoded.usage);
+
+		//the residency makes the image at whatever level fits the budget, pixels get copied into staging right away and the copy and mip blits go out with the uploaders next flush
+		//todo- check if format is supported VK_FORMAT_FEATURE_BLIT_DST_BIT
+		texture2dcache[key] = residency.Add(decoded.filename, format, decoded.mipped, pinned, decoded.pixels, decoded.width, decoded.height, uploader);
+		FreeDecodedTexture(decoded);
+		return true;
+	}
+
+	bool TextureCache::Load2DTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage)
+	{
+		DecodedTexture decoded;
+		if (!DecodeTexture(filename, mipped, usage, Compresses(usage), decoded))
+		{
+			return false;
+		}
+
+		AssetUploader uploader(deviceref);
+		bool added = AddDecodedTexture(decoded, uploader);
+		uploader.Flush();
+		return added;
+	}
+
+	bool TextureCache::GetPlaceholder(uint32_t& id)
+	{
+		textureKey key(PLACEHOLDER_TEXTURE, true, TEXTURE_USAGE::COLOR);
+		if (texture2dcache.count(key) == 0 && !Load2DTexture(PLACEHOLDER_TEXTURE, true, TEXTURE_USAGE::COLOR))
+		{
+			return false;
 		}
+		id = texture2dcache[key];
+		return true;
+	}
 
-		VkDeviceSize imageSize = texWidth * texHeight * STBI_rgb_alpha;
-		uint32_t miplevels = 1;
-		if (mipped)
+	VkFormat TextureCache::Pick2DFormat(bool mipped, TEXTURE_USAGE usage) const
+	{
+		//normals and masks are data, srgb would bend them. rgba8 unorm has to support sampling and linear filtering so theres nothing to check
+		if (usage == TEXTURE_USAGE::NORMAL || usage == TEXTURE_USAGE::GRAYSCALE)
 		{
-			miplevels = static_cast<uint32_t>(std::floor(std::log2((texWidth > texHeight) ? texWidth : texHeight))) + 1;
+			return VK_FORMAT_R8G8B8A8_UNORM;
 		}
-		texture.miplevels = miplevels;
-		Logger::Log(filename, " width: ", texWidth, " height: ", texHeight, " miplevels: ", miplevels, " ", imageSize / 1000000, "MB", "\n");
 
 		//TODO - find formats that have to be support and try 16 bit textures?
 		//we need to pick a format supported by linear sampling if we are going to mip-map 
@@ -72,36 +154,7 @@ namespace Gibo {
 			format = desired_format[i];
 			break;
 		}
-
-		//create image, imageview
-		deviceref.CreateImage(VK_IMAGE_TYPE_2D, format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT, texWidth,
-			texHeight, 1, miplevels, 1, VMA_MEMORY_USAGE_GPU_ONLY, 0, texture.image);
-		texture.view = CreateImageView(deviceref.GetDevice(), texture.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, miplevels, 1, VK_IMAGE_VIEW_TYPE_2D);
-
-		//create staging buffer, bind pixels to it, copy to image
-		vkcoreBuffer stagingbuffer;
-		deviceref.CreateBuffer(imageSize, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0, stagingbuffer);
-
-		deviceref.BindData(stagingbuffer.allocation, pixels, imageSize);
-
-		//transition from undefined to transfer_dst_optimal
-		//copy
-		CopyBufferToImage(deviceref, texture.image.image, stagingbuffer.buffer, VK_IMAGE_LAYOUT_UNDEFINED, (mipped) ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_ACCESS_TRANSFER_READ_BIT, 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, texWidth, texHeight, VK_IMAGE_ASPECT_COLOR_BIT, miplevels, 1);
-
-		//generate mip maps and transition it to shader_read_only
-		if (mipped)
-		{
-			//todo- check if format is supported VK_FORMAT_FEATURE_BLIT_DST_BIT
-			//generate mipmaps
-			generateMipmaps(deviceref, texture.image.image, format, texWidth, texHeight, miplevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		}
-
-		deviceref.DestroyBuffer(stagingbuffer);
-		stbi_image_free(pixels);
-
-		gpumemory_size += imageSize;
-		return texture;
+		return format;
 	}
 
 	//layout(binding = X) uniform samplerCube cubeMapTexture;
@@ -193,29 +246,34 @@ namespace Gibo {
 		return texture;
 	}
 
-	vkcoreTexture TextureCache::Get2DTexture(std::string filename, bool mipped, VkFilter magfilter, VkFilter minfilter, float maxanisotropy, VkSamplerAddressMode addressmode)
+	vkcoreTexture TextureCache::Get2DTexture(std::string filename, bool mipped, TEXTURE_USAGE usage, VkFilter magfilter, VkFilter minfilter, float maxanisotropy, VkSamplerAddressMode addressmode)
 	{
 		vkcoreTexture texture;
 
-		textureKey key(filename, mipped);
-		if (texture2dcache.count(key) == 1)
-		{
-			//its in cache get values
-			texture.image = texture2dcache[key].image.image;
-			texture.view = texture2dcache[key].view;
-		}
-		else
+		textureKey key(filename, mipped, usage);
+		//not in the cache (and not batch loaded by an AssetLoader) so the workers decode it and it shows the placeholder until then. If theres no placeholder load it by itself now
+		if (texture2dcache.count(key) == 0)
 		{
-			//its not in cache create it, store in cache, and set values
-			internaltexture internaltex = Create2DTexture(filename, mipped);
-			texture2dcache[key] = internaltex;
-			texture.image = internaltex.image.image;
-			texture.view = internaltex.view;
+			uint32_t placeholder;
+			if (filename != PLACEHOLDER_TEXTURE && GetPlaceholder(placeholder))
+			{
+				texture2dcache[key] = residency.AddDeferred(filename, Pick2DFormat(mipped, usage), mipped, placeholder, (Compresses(usage)) ? usage : TEXTURE_USAGE::UNCOMPRESSED);
+			}
+			else if (!Load2DTexture(filename, mipped, usage))
+			{
+				Logger::LogError("couldn't load texture ", filename, "\n");
+				return texture;
+			}
 		}
 
+		texture.stream_id = texture2dcache[key];
+		texture.image = residency.GetImage(texture.stream_id);
+		texture.view = residency.GetView(texture.stream_id);
+
+		//the view decides how many levels there are as they stream in and out, so the sampler doesn't clamp them
 		bool anisotropy_supported = PhysicalDeviceQuery::GetDeviceFeatures(deviceref.GetPhysicalDevice()).samplerAnisotropy;
 		SamplerKey sampler_data(magfilter, minfilter, addressmode, addressmode, addressmode, anisotropy_supported, maxanisotropy, VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
-			VK_SAMPLER_MIPMAP_MODE_LINEAR, 0.0, texture2dcache[key].miplevels, 0.0);
+			VK_SAMPLER_MIPMAP_MODE_LINEAR, 0.0, VK_LOD_CLAMP_NONE, 0.0);
 
 		texture.sampler = deviceref.GetSamplerCache().GetSampler(sampler_data);
 
@@ -1,26 +1,42 @@
 #pragma once
 #include "vkcore/vkcoreDevice.h"
+#include "AssetUploader.h"
+#include "TextureResidency.h"
 
 namespace Gibo {
 
 	struct vkcoreTexture
 	{
+		static const uint32_t NOT_STREAMED = UINT32_MAX;
+
 		VkImage image;
-		VkImageView view;
+		VkImageView view; //for streamed textures its whatever was resident when you got it, bind TextureCache::GetView instead
 		VkSampler sampler;
+		uint32_t stream_id; //id in the TextureResidency, NOT_STREAMED for cubemaps
 
-		vkcoreTexture() : image(VK_NULL_HANDLE), view(VK_NULL_HANDLE), sampler(VK_NULL_HANDLE) {}
+		vkcoreTexture() : image(VK_NULL_HANDLE), view(VK_NULL_HANDLE), sampler(VK_NULL_HANDLE), stream_id(NOT_STREAMED) {}
 	};
 
 	/*
 	Stores all the textures so you never have to reload one again as well as its stored on vram once unless you want it mipped and nonmipped.
 	The sampler is taken from the samplercache. You fill out your texturekey and it returns a texture.
 	cubemaps don't have a cache.
+
+	2D textures load in two steps like the meshes: DecodeTexture runs stb_image and is safe on any thread, AddDecodedTexture makes the image, records the upload and mips into
+	an uploader and caches it on the main thread. The AssetLoader uses the two halves to decode a whole list on the workers and upload it in a couple of submits.
+
+	Every 2D texture lives in the TextureResidency, which streams its mips in and out to stay in the vram budget. Asking for one that was never loaded doesn't block anymore,
+	it gets decoded on the workers and shows PLACEHOLDER_TEXTURE until then (which is loaded right away and never streams).
+
+	The TEXTURE_USAGE you ask for picks its block compressed format and the same file asked for with two usages is two textures, see TextureCompression.h. If the device
+	can't sample BC everything stays rgba8, srgb for color and unorm for normals/grayscale.
 	*/
 	class TextureCache
 	{
 	public:
-		TextureCache(vkcoreDevice& device) : deviceref(device), gpumemory_size(0) {};
+		static constexpr const char* PLACEHOLDER_TEXTURE = "Images/missingtexture.png";
+
+		TextureCache(vkcoreDevice& device, JobSystem& jobsystem, uint32_t framesinflight) : deviceref(device), residency(device, jobsystem, framesinflight), gpumemory_size(0) {};
 		~TextureCache() = default;
 
 		//no copying/moving should be allowed from this class
@@ -30,11 +46,37 @@ namespace Gibo {
 		TextureCache& operator=(TextureCache const&) = delete;
 		TextureCache& operator=(TextureCache&&) = delete;
 
+		//rgba8 pixels straight out of stb_image, freed by AddDecodedTexture (or FreeDecodedTexture if it never gets added). Compressed ones are in image instead
+		struct DecodedTexture
+		{
+			std::string filename;
+			bool mipped = false;
+			TEXTURE_USAGE usage = TEXTURE_USAGE::COLOR;
+			bool compressed = false;
+			unsigned char* pixels = nullptr;
+			int width = 0;
+			int height = 0;
+			CompressedImage image;
+		};
+
 		void CleanUp();
 		void PrintInfo() const;
 
-		vkcoreTexture Get2DTexture(std::string filename, bool mipped, VkFilter magfilter = VK_FILTER_LINEAR, VkFilter minfilter = VK_FILTER_LINEAR, float maxanisotropy = 4.0f, VkSamplerAddressMode addressmode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+		//compress comes from Compresses(usage), a first import encodes the whole chain so it can take a while
+		static bool DecodeTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage, bool compress, DecodedTexture& texture);
+		static void FreeDecodedTexture(DecodedTexture& texture);
+		bool AddDecodedTexture(DecodedTexture& texture, AssetUploader& uploader);
+		bool HasTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage = TEXTURE_USAGE::COLOR) const { return texture2dcache.count(textureKey(filename, mipped, usage)) != 0; }
+		bool Compresses(TEXTURE_USAGE usage) const { return usage != TEXTURE_USAGE::UNCOMPRESSED && deviceref.SupportsBC(); }
+
+		vkcoreTexture Get2DTexture(std::string filename, bool mipped, TEXTURE_USAGE usage = TEXTURE_USAGE::COLOR, VkFilter magfilter = VK_FILTER_LINEAR, VkFilter minfilter = VK_FILTER_LINEAR, float maxanisotropy = 4.0f, VkSamplerAddressMode addressmode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
 		vkcoreTexture GetCubeMapTexture(std::string* paths, int path_count, VkFilter magfilter = VK_FILTER_LINEAR, VkFilter minfilter = VK_FILTER_LINEAR, float maxanisotropy = 4.0f, VkSamplerAddressMode addressmode = VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+		//the view to bind right now and the serial of its last swap, see TextureResidency
+		VkImageView GetView(const vkcoreTexture& texture) const { return (texture.stream_id != vkcoreTexture::NOT_STREAMED) ? residency.GetView(texture.stream_id) : texture.view; }
+		uint64_t GetViewSerial(const vkcoreTexture& texture) const { return (texture.stream_id != vkcoreTexture::NOT_STREAMED) ? residency.GetViewSerial(texture.stream_id) : 0; }
+		void MarkUsed(const vkcoreTexture& texture) { if (texture.stream_id != vkcoreTexture::NOT_STREAMED) residency.MarkUsed(texture.stream_id); }
+		TextureResidency& GetResidency() { return residency; }
 	private:
 		struct internaltexture
 		{
@@ -43,19 +85,24 @@ namespace Gibo {
 			uint32_t miplevels;
 		};
 
-		internaltexture Create2DTexture(std::string filename, bool mipped);
+		bool Load2DTexture(const std::string& filename, bool mipped, TEXTURE_USAGE usage);
+		//loads the placeholder if it isn't yet, false if it can't be
+		bool GetPlaceholder(uint32_t& id);
+		//the rgba8 format when it isn't compressed
+		VkFormat Pick2DFormat(bool mipped, TEXTURE_USAGE usage) const;
 		internaltexture CreateCubeMap(std::string* paths, int path_count);
 	private:
 		struct textureKey
 		{
 			std::string filename;
 			bool mipped;	
+			TEXTURE_USAGE usage;
 
-			textureKey(std::string name, bool mipped_) : filename(name), mipped(mipped_) {};
+			textureKey(std::string name, bool mipped_, TEXTURE_USAGE usage_) : filename(name), mipped(mipped_), usage(usage_) {};
 
 			bool operator==(const textureKey& p) const
 			{
-				return filename == p.filename && mipped == p.mipped;
+				return filename == p.filename && mipped == p.mipped && usage == p.usage;
 			}
 		};
 		class MyHashFunction {
@@ -72,11 +119,12 @@ namespace Gibo {
 		};
 	
 
-		std::unordered_map<textureKey, internaltexture, MyHashFunction> texture2dcache;
+		std::unordered_map<textureKey, uint32_t, MyHashFunction> texture2dcache; //id in the residency
 		std::vector<internaltexture> cubemaparray;
 
 		vkcoreDevice& deviceref;
-		size_t gpumemory_size;
+		TextureResidency residency;
+		size_t gpumemory_size; //cubemaps, the residency tracks the 2D textures
 	};
 }
 
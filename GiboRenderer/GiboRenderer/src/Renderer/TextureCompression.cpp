@@ -0,0 +1,668 @@
+#include "../pch.h"
+#include "TextureCompression.h"
+#include "TextureResidency.h"
+#include "../ThirdParty/stb_image.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+namespace Gibo {
+
+	static const uint32_t DDS_MAGIC = 0x20534444; //"DDS "
+	static const uint32_t DDS_DX10 = 0x30315844; //"DX10"
+	static const uint32_t DDS_GIBO = 0x4F424947; //"GIBO" in dwReserved1[0], the rest of it is the version and the source stamp
+	static const uint32_t DDS_HEADER_WORDS = 31; //the 124 byte DDS_HEADER
+	static const uint32_t DDS_DX10_WORDS = 5;
+	static const uint32_t DDS_DATA_OFFSET = 4 + DDS_HEADER_WORDS * 4 + DDS_DX10_WORDS * 4;
+
+	struct DXGIFormat
+	{
+		VkFormat format;
+		uint32_t dxgi;
+	};
+	static const DXGIFormat DXGI_FORMATS[] = {
+		{ VK_FORMAT_BC1_RGB_UNORM_BLOCK, 71 }, { VK_FORMAT_BC1_RGB_SRGB_BLOCK, 72 },
+		{ VK_FORMAT_BC3_UNORM_BLOCK, 77 }, { VK_FORMAT_BC3_SRGB_BLOCK, 78 },
+		{ VK_FORMAT_BC4_UNORM_BLOCK, 80 }, { VK_FORMAT_BC5_UNORM_BLOCK, 83 },
+		{ VK_FORMAT_BC7_UNORM_BLOCK, 98 }, { VK_FORMAT_BC7_SRGB_BLOCK, 99 }
+	};
+
+	//bc7 mode 6 interpolation weights out of 64
+	static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	static uint32_t BlockBytes(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			return 8;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	bool IsBlockCompressed(VkFormat format)
+	{
+		return BlockBytes(format) != 0;
+	}
+
+	VkDeviceSize LevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level)
+	{
+		VkDeviceSize levelwidth = std::max(width >> level, 1u);
+		VkDeviceSize levelheight = std::max(height >> level, 1u);
+		uint32_t blockbytes = BlockBytes(format);
+		if (blockbytes == 0)
+		{
+			return levelwidth * levelheight * 4;
+		}
+		return ((levelwidth + 3) / 4) * ((levelheight + 3) / 4) * blockbytes;
+	}
+
+	VkDeviceSize ChainSize(VkFormat format, uint32_t width, uint32_t height, uint32_t first, uint32_t last)
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t l = first; l < last; l++)
+		{
+			size += LevelSize(format, width, height, l);
+		}
+		return size;
+	}
+
+	uint32_t MipLevelCount(uint32_t width, uint32_t height)
+	{
+		uint32_t levels = 1;
+		uint32_t size = std::max(width, height);
+		while (size > 1)
+		{
+			size >>= 1;
+			levels++;
+		}
+		return levels;
+	}
+
+	VkFormat PickCompressedFormat(TEXTURE_USAGE usage, const unsigned char* pixels, uint32_t width, uint32_t height)
+	{
+		switch (usage)
+		{
+		case TEXTURE_USAGE::COLOR:
+			return VK_FORMAT_BC7_SRGB_BLOCK;
+		case TEXTURE_USAGE::COLOR_COMPACT:
+			for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+			{
+				if (pixels[i * 4 + 3] != 255) return VK_FORMAT_BC3_SRGB_BLOCK;
+			}
+			return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		case TEXTURE_USAGE::NORMAL:
+			return VK_FORMAT_BC5_UNORM_BLOCK;
+		case TEXTURE_USAGE::GRAYSCALE:
+			return VK_FORMAT_BC4_UNORM_BLOCK;
+		default:
+			return VK_FORMAT_UNDEFINED;
+		}
+	}
+
+	//---------------------------------------------------------- encoders ----------------------------------------------------------//
+
+	//4x4 texels as floats, blocks off the edge of the image repeat the last row/column
+	static void LoadBlock(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t blockx, uint32_t blocky, float block[16][4])
+	{
+		for (uint32_t y = 0; y < 4; y++)
+		{
+			uint32_t py = std::min(blocky * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++)
+			{
+				uint32_t px = std::min(blockx * 4 + x, width - 1);
+				const unsigned char* texel = pixels + (static_cast<size_t>(py) * width + px) * 4;
+				for (int c = 0; c < 4; c++)
+				{
+					block[y * 4 + x][c] = texel[c];
+				}
+			}
+		}
+	}
+
+	//fits a line through the first channels of the block along its principal axis, ends are the furthest any texel projects onto it
+	static void FitLine(const float block[16][4], int channels, float end0[4], float end1[4])
+	{
+		float mean[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < channels; c++) mean[c] += block[i][c] / 16.0f;
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++)
+				{
+					covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+				}
+			}
+		}
+
+		//power iteration, a handful of steps is plenty for a 3x3/4x4
+		float axis[4] = { 1, 1, 1, 1 };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = { 0, 0, 0, 0 };
+			float length = 0;
+			for (int a = 0; a < channels; a++)
+			{
+				for (int b = 0; b < channels; b++) next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::abs(next[a]));
+			}
+			if (length == 0.0f) break;
+			for (int a = 0; a < channels; a++) axis[a] = next[a] / length;
+		}
+		float length = 0;
+		for (int c = 0; c < channels; c++) length += axis[c] * axis[c];
+		length = std::sqrt(length);
+
+		float tmin = 0, tmax = 0;
+		if (length > 0.0f)
+		{
+			for (int c = 0; c < channels; c++) axis[c] /= length;
+			tmin = FLT_MAX;
+			tmax = -FLT_MAX;
+			for (int i = 0; i < 16; i++)
+			{
+				float t = 0;
+				for (int c = 0; c < channels; c++) t += (block[i][c] - mean[c]) * axis[c];
+				tmin = std::min(tmin, t);
+				tmax = std::max(tmax, t);
+			}
+		}
+
+		for (int c = 0; c < channels; c++)
+		{
+			end0[c] = std::clamp(mean[c] + axis[c] * tmin, 0.0f, 255.0f);
+			end1[c] = std::clamp(mean[c] + axis[c] * tmax, 0.0f, 255.0f);
+		}
+	}
+
+	//least squares endpoints for fixed indices, weights[i] is how much of end1 index i is. False if every texel picked the same weight
+	static bool RefineLine(const float block[16][4], int channels, const uint8_t indices[16], const float* weights, float end0[4], float end1[4])
+	{
+		float aa = 0, bb = 0, ab = 0;
+		float ax[4] = { 0, 0, 0, 0 };
+		float bx[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			float b = weights[indices[i]];
+			float a = 1.0f - b;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for (int c = 0; c < channels; c++)
+			{
+				ax[c] += a * block[i][c];
+				bx[c] += b * block[i][c];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (std::abs(determinant) < 1e-6f) return false;
+		for (int c = 0; c < channels; c++)
+		{
+			end0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+			end1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	//nearest palette entry for every texel, returns the squared error
+	static float PickIndices(const float block[16][4], int channels, const float palette[][4], int palettesize, uint8_t indices[16])
+	{
+		float total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = FLT_MAX;
+			for (int p = 0; p < palettesize; p++)
+			{
+				float error = 0;
+				for (int c = 0; c < channels; c++)
+				{
+					float d = block[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < best)
+				{
+					best = error;
+					indices[i] = static_cast<uint8_t>(p);
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	static void PutBits(unsigned char* out, uint32_t& position, uint32_t value, uint32_t count)
+	{
+		for (uint32_t b = 0; b < count; b++, position++)
+		{
+			if (value & (1u << b)) out[position / 8] |= static_cast<unsigned char>(1u << (position % 8));
+		}
+	}
+
+	static uint16_t To565(const float color[4])
+	{
+		uint32_t r = static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f);
+		uint32_t g = static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f);
+		uint32_t b = static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	static void From565(uint16_t value, float color[4])
+	{
+		uint32_t r = (value >> 11) & 31;
+		uint32_t g = (value >> 5) & 63;
+		uint32_t b = value & 31;
+		color[0] = static_cast<float>((r << 3) | (r >> 2));
+		color[1] = static_cast<float>((g << 2) | (g >> 4));
+		color[2] = static_cast<float>((b << 3) | (b >> 2));
+		color[3] = 255.0f;
+	}
+
+	//always the 4 color mode (color0 > color1) so the same block works inside BC3 where thats the only mode
+	static float EvaluateBC1(const float block[16][4], uint16_t& color0, uint16_t& color1, uint8_t indices[16])
+	{
+		if (color0 < color1) std::swap(color0, color1);
+
+		float palette[4][4];
+		From565(color0, palette[0]);
+		From565(color1, palette[1]);
+		if (color0 == color1)
+		{
+			//3 color mode in BC1, index 0 is still color0 so just use that
+			return PickIndices(block, 3, palette, 1, indices);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		return PickIndices(block, 3, palette, 4, indices);
+	}
+
+	static void EncodeBC1(const float block[16][4], unsigned char* out)
+	{
+		static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f }; //how much of color1 each index is
+
+		float end0[4], end1[4];
+		FitLine(block, 3, end0, end1);
+		uint16_t color0 = To565(end1);
+		uint16_t color1 = To565(end0);
+		uint8_t indices[16];
+		float error = EvaluateBC1(block, color0, color1, indices);
+
+		if (color0 != color1 && RefineLine(block, 3, indices, weights, end0, end1))
+		{
+			uint16_t refined0 = To565(end0);
+			uint16_t refined1 = To565(end1);
+			uint8_t refinedindices[16];
+			if (EvaluateBC1(block, refined0, refined1, refinedindices) < error)
+			{
+				color0 = refined0;
+				color1 = refined1;
+				std::copy(refinedindices, refinedindices + 16, indices);
+			}
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++) bits |= static_cast<uint32_t>(indices[i]) << (i * 2);
+		out[0] = static_cast<unsigned char>(color0 & 0xFF);
+		out[1] = static_cast<unsigned char>(color0 >> 8);
+		out[2] = static_cast<unsigned char>(color1 & 0xFF);
+		out[3] = static_cast<unsigned char>(color1 >> 8);
+		for (int b = 0; b < 4; b++) out[4 + b] = static_cast<unsigned char>(bits >> (b * 8));
+	}
+
+	//one channel of the block, 8 value mode (alpha0 > alpha1). Also the alpha half of BC3 and both halves of BC5
+	static void EncodeBC4(const float block[16][4], int channel, unsigned char* out)
+	{
+		float low = 255.0f, high = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			low = std::min(low, block[i][channel]);
+			high = std::max(high, block[i][channel]);
+		}
+		uint32_t alpha0 = static_cast<uint32_t>(high + 0.5f);
+		uint32_t alpha1 = static_cast<uint32_t>(low + 0.5f);
+
+		std::fill(out, out + 8, static_cast<unsigned char>(0));
+		out[0] = static_cast<unsigned char>(alpha0);
+		out[1] = static_cast<unsigned char>(alpha1);
+		if (alpha0 == alpha1) return; //every index 0
+
+		float palette[8][4] = {};
+		palette[0][0] = static_cast<float>(alpha0);
+		palette[1][0] = static_cast<float>(alpha1);
+		for (int p = 2; p < 8; p++)
+		{
+			palette[p][0] = static_cast<float>(((8 - p) * alpha0 + (p - 1) * alpha1) / 7);
+		}
+
+		float values[16][4] = {};
+		for (int i = 0; i < 16; i++) values[i][0] = block[i][channel];
+		uint8_t indices[16];
+		PickIndices(values, 1, palette, 8, indices);
+
+		uint32_t position = 16;
+		for (int i = 0; i < 16; i++) PutBits(out, position, indices[i], 3);
+	}
+
+	//endpoint values are 7 bits + a shared lsb (the p bit), picks the p bit thats closer
+	static void QuantizeBC7(const float end[4], uint32_t quantized[4], uint32_t& pbit)
+	{
+		float besterror = FLT_MAX;
+		for (uint32_t p = 0; p < 2; p++)
+		{
+			uint32_t candidate[4];
+			float error = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				int q = static_cast<int>(std::floor((end[c] - p) / 2.0f + 0.5f));
+				candidate[c] = static_cast<uint32_t>(std::clamp(q, 0, 127));
+				float d = static_cast<float>((candidate[c] << 1) | p) - end[c];
+				error += d * d;
+			}
+			if (error < besterror)
+			{
+				besterror = error;
+				pbit = p;
+				std::copy(candidate, candidate + 4, quantized);
+			}
+		}
+	}
+
+	static float EvaluateBC7(const float block[16][4], const uint32_t end0[4], uint32_t pbit0, const uint32_t end1[4], uint32_t pbit1, uint8_t indices[16])
+	{
+		float palette[16][4];
+		for (int p = 0; p < 16; p++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				uint32_t e0 = (end0[c] << 1) | pbit0;
+				uint32_t e1 = (end1[c] << 1) | pbit1;
+				palette[p][c] = static_cast<float>(((64 - BC7_WEIGHTS[p]) * e0 + BC7_WEIGHTS[p] * e1 + 32) >> 6);
+			}
+		}
+		return PickIndices(block, 4, palette, 16, indices);
+	}
+
+	//mode 6 only: one subset, rgba 7.1 endpoints, 4 bit indices
+	static void EncodeBC7(const float block[16][4], unsigned char* out)
+	{
+		float weights[16];
+		for (int i = 0; i < 16; i++) weights[i] = BC7_WEIGHTS[i] / 64.0f;
+
+		float end0[4], end1[4];
+		FitLine(block, 4, end0, end1);
+		uint32_t q0[4], q1[4], p0, p1;
+		QuantizeBC7(end0, q0, p0);
+		QuantizeBC7(end1, q1, p1);
+		uint8_t indices[16];
+		float error = EvaluateBC7(block, q0, p0, q1, p1, indices);
+
+		if (RefineLine(block, 4, indices, weights, end0, end1))
+		{
+			uint32_t r0[4], r1[4], rp0, rp1;
+			QuantizeBC7(end0, r0, rp0);
+			QuantizeBC7(end1, r1, rp1);
+			uint8_t refinedindices[16];
+			if (EvaluateBC7(block, r0, rp0, r1, rp1, refinedindices) < error)
+			{
+				std::copy(r0, r0 + 4, q0);
+				std::copy(r1, r1 + 4, q1);
+				p0 = rp0;
+				p1 = rp1;
+				std::copy(refinedindices, refinedindices + 16, indices);
+			}
+		}
+
+		//the first index only gets 3 bits so its top bit has to be 0, flip the endpoints around if it isn't
+		if (indices[0] & 8)
+		{
+			std::swap(q0, q1);
+			std::swap(p0, p1);
+			for (int i = 0; i < 16; i++) indices[i] = static_cast<uint8_t>(15 - indices[i]);
+		}
+
+		std::fill(out, out + 16, static_cast<unsigned char>(0));
+		uint32_t position = 0;
+		PutBits(out, position, 1u << 6, 7); //mode 6
+		for (int c = 0; c < 4; c++)
+		{
+			PutBits(out, position, q0[c], 7);
+			PutBits(out, position, q1[c], 7);
+		}
+		PutBits(out, position, p0, 1);
+		PutBits(out, position, p1, 1);
+		PutBits(out, position, indices[0], 3);
+		for (int i = 1; i < 16; i++) PutBits(out, position, indices[i], 4);
+	}
+
+	void EncodeBlocks(VkFormat format, const unsigned char* pixels, uint32_t width, uint32_t height, std::vector<unsigned char>& out)
+	{
+		uint32_t blockbytes = BlockBytes(format);
+		uint32_t blockswide = (width + 3) / 4;
+		uint32_t blockshigh = (height + 3) / 4;
+		out.assign(static_cast<size_t>(blockswide) * blockshigh * blockbytes, 0);
+
+		float block[16][4];
+		for (uint32_t by = 0; by < blockshigh; by++)
+		{
+			for (uint32_t bx = 0; bx < blockswide; bx++)
+			{
+				LoadBlock(pixels, width, height, bx, by, block);
+				unsigned char* dst = out.data() + (static_cast<size_t>(by) * blockswide + bx) * blockbytes;
+				switch (format)
+				{
+				case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+				case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+					EncodeBC1(block, dst);
+					break;
+				case VK_FORMAT_BC3_UNORM_BLOCK:
+				case VK_FORMAT_BC3_SRGB_BLOCK:
+					EncodeBC4(block, 3, dst);
+					EncodeBC1(block, dst + 8);
+					break;
+				case VK_FORMAT_BC4_UNORM_BLOCK:
+					EncodeBC4(block, 0, dst);
+					break;
+				case VK_FORMAT_BC5_UNORM_BLOCK:
+					EncodeBC4(block, 0, dst);
+					EncodeBC4(block, 1, dst + 8);
+					break;
+				case VK_FORMAT_BC7_UNORM_BLOCK:
+				case VK_FORMAT_BC7_SRGB_BLOCK:
+					EncodeBC7(block, dst);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+	//---------------------------------------------------------- dds cache ----------------------------------------------------------//
+
+	std::string CompressedCachePath(const std::string& filename, TEXTURE_USAGE usage, bool mipped)
+	{
+		static const char* const suffixes[] = { "_color", "_compact", "_normal", "_gray", "_rgba" };
+
+		std::string name = filename;
+		for (int i = 0; i < name.size(); i++)
+		{
+			if (name[i] == '/' || name[i] == '\\' || name[i] == ':' || name[i] == '.') name[i] = '_';
+		}
+		return std::string(TEXTURE_CACHE_DIRECTORY) + name + suffixes[static_cast<int>(usage)] + ((mipped) ? "" : "_nomip") + ".dds";
+	}
+
+	//size and write time of the source, so a cache made from an older version of the image doesn't get used
+	static bool SourceStamp(const std::string& sourcefile, uint64_t& size, uint64_t& time)
+	{
+		std::error_code error;
+		size = static_cast<uint64_t>(std::filesystem::file_size(sourcefile, error));
+		if (error) return false;
+		time = static_cast<uint64_t>(std::filesystem::last_write_time(sourcefile, error).time_since_epoch().count());
+		return !error;
+	}
+
+	bool ReadCompressedCache(const std::string& path, const std::string& sourcefile, bool mipped, uint32_t first_level, CompressedImage& image)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) return false;
+
+		uint32_t words[1 + DDS_HEADER_WORDS + DDS_DX10_WORDS];
+		if (!file.read(reinterpret_cast<char*>(words), sizeof(words))) return false;
+		const uint32_t* header = words + 1;
+		const uint32_t* dx10 = words + 1 + DDS_HEADER_WORDS;
+		if (words[0] != DDS_MAGIC || header[0] != 124 || header[20] != DDS_DX10 || header[7] != DDS_GIBO || header[8] != TEXTURE_CACHE_VERSION)
+		{
+			return false;
+		}
+
+		//no source around (shipped without it) means the cache is all there is, so trust it
+		uint64_t size, time;
+		if (SourceStamp(sourcefile, size, time) && (header[9] != static_cast<uint32_t>(size) || header[10] != static_cast<uint32_t>(size >> 32) ||
+			header[11] != static_cast<uint32_t>(time) || header[12] != static_cast<uint32_t>(time >> 32)))
+		{
+			return false;
+		}
+
+		image.format = VK_FORMAT_UNDEFINED;
+		for (int i = 0; i < sizeof(DXGI_FORMATS) / sizeof(DXGIFormat); i++)
+		{
+			if (DXGI_FORMATS[i].dxgi == dx10[0]) image.format = DXGI_FORMATS[i].format;
+		}
+		image.width = header[3];
+		image.height = header[2];
+		image.levels = header[6];
+		if (image.format == VK_FORMAT_UNDEFINED || image.width == 0 || image.height == 0 || image.levels != ((mipped) ? MipLevelCount(image.width, image.height) : 1) || first_level >= image.levels)
+		{
+			return false;
+		}
+
+		image.first_level = first_level;
+		image.data.resize(static_cast<size_t>(ChainSize(image.format, image.width, image.height, first_level, image.levels)));
+		file.seekg(DDS_DATA_OFFSET + ChainSize(image.format, image.width, image.height, 0, first_level));
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(image.data.data()), image.data.size()));
+	}
+
+	bool WriteCompressedCache(const std::string& path, const std::string& sourcefile, const CompressedImage& image)
+	{
+		uint32_t dxgi = 0;
+		for (int i = 0; i < sizeof(DXGI_FORMATS) / sizeof(DXGIFormat); i++)
+		{
+			if (DXGI_FORMATS[i].format == image.format) dxgi = DXGI_FORMATS[i].dxgi;
+		}
+		if (dxgi == 0 || image.first_level != 0)
+		{
+			return false;
+		}
+
+		uint32_t words[1 + DDS_HEADER_WORDS + DDS_DX10_WORDS] = {};
+		uint32_t* header = words + 1;
+		uint32_t* dx10 = words + 1 + DDS_HEADER_WORDS;
+		words[0] = DDS_MAGIC;
+		header[0] = 124;
+		header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; //caps, height, width, pixelformat, mipmapcount, linearsize
+		header[2] = image.height;
+		header[3] = image.width;
+		header[4] = static_cast<uint32_t>(LevelSize(image.format, image.width, image.height, 0));
+		header[6] = image.levels;
+		header[7] = DDS_GIBO;
+		header[8] = TEXTURE_CACHE_VERSION;
+		uint64_t size = 0, time = 0;
+		SourceStamp(sourcefile, size, time);
+		header[9] = static_cast<uint32_t>(size);
+		header[10] = static_cast<uint32_t>(size >> 32);
+		header[11] = static_cast<uint32_t>(time);
+		header[12] = static_cast<uint32_t>(time >> 32);
+		header[18] = 32; //pixel format size
+		header[19] = 0x4; //fourcc
+		header[20] = DDS_DX10;
+		header[26] = 0x1000 | 0x400000 | 0x8; //texture, mipmap, complex
+		dx10[0] = dxgi;
+		dx10[1] = 3; //texture2d
+		dx10[3] = 1; //array size
+
+		//written next to it and renamed so a crash halfway never leaves a cache that looks good
+		std::error_code error;
+		std::filesystem::create_directories(TEXTURE_CACHE_DIRECTORY, error);
+		std::string temp = path + ".tmp";
+		{
+			std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) return false;
+			file.write(reinterpret_cast<const char*>(words), sizeof(words));
+			file.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+			if (!file) return false;
+		}
+		std::filesystem::rename(temp, path, error);
+		return !error;
+	}
+
+	bool ImportCompressed(const std::string& filename, TEXTURE_USAGE usage, bool mipped, CompressedImage& image)
+	{
+		std::string path = CompressedCachePath(filename, usage, mipped);
+		if (ReadCompressedCache(path, filename, mipped, 0, image))
+		{
+			return true;
+		}
+
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			printf("STBI MESSAGE: %s  %s\n", stbi_failure_reason(), filename.c_str());
+			return false;
+		}
+
+		image.format = PickCompressedFormat(usage, pixels, width, height);
+		image.width = static_cast<uint32_t>(width);
+		image.height = static_cast<uint32_t>(height);
+		image.levels = (mipped) ? MipLevelCount(image.width, image.height) : 1;
+		image.first_level = 0;
+		image.data.clear();
+		image.data.reserve(static_cast<size_t>(ChainSize(image.format, image.width, image.height, 0, image.levels)));
+
+		//each level is a box filter of the one before it, same as the tails and the streamed levels. Srgb bytes get averaged as linear light or the mips come out darker
+		bool srgb = TextureResidency::IsSRGB(image.format);
+		std::vector<unsigned char> level;
+		std::vector<unsigned char> blocks;
+		const unsigned char* source = pixels;
+		uint32_t levelwidth = image.width;
+		uint32_t levelheight = image.height;
+		for (uint32_t l = 0; l < image.levels; l++)
+		{
+			EncodeBlocks(image.format, source, levelwidth, levelheight, blocks);
+			image.data.insert(image.data.end(), blocks.begin(), blocks.end());
+			if (l + 1 < image.levels)
+			{
+				level = TextureResidency::Downsample(source, levelwidth, levelheight, 1, srgb, levelwidth, levelheight);
+				source = level.data();
+			}
+		}
+		stbi_image_free(pixels);
+
+		if (!WriteCompressedCache(path, filename, image))
+		{
+			Logger::LogWarning("couldn't write texture cache ", path, "\n");
+		}
+		return true;
+	}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace Gibo {
+
+	/*
+	 Import stage for 2D textures. What a texture is used for picks its block compressed format:
+		COLOR          BC7 (srgb), 8 bits a texel with alpha
+		COLOR_COMPACT  BC1 (srgb) when every texel is opaque, BC3 if it has alpha. 4/8 bits a texel
+		NORMAL         BC5, just x and y, the shader rebuilds z
+		GRAYSCALE      BC4 from the red channel, for specular/roughness/metal maps
+		UNCOMPRESSED   rgba8 like before, mips get blitted on the gpu
+	 The first time a texture is imported its decoded with stb_image, its mip chain gets box filtered on the cpu (in linear space for the srgb formats), encoded and
+	 written to TEXTURE_CACHE_DIRECTORY as a .dds (dx10 header so other tools open it too). Textures that aren't mipped only get level 0, they have their own cache file. Later runs read the levels straight out of the file and upload them as is,
+	 no decoding at all. The source files size and write time go in the dds headers reserved words so an edited image gets imported again.
+
+	 The encoders are simple and fast rather than best quality: BC1/BC3 color and BC7 fit their endpoints along the blocks principal axis, BC7 only uses mode 6
+	 (one subset, 4 bit indices, rgba endpoints). Good enough to not be the thing you notice, and a first run over a level doesn't take minutes.
+	 Everything here is plain cpu code and safe on any thread.
+	*/
+	enum class TEXTURE_USAGE { COLOR, COLOR_COMPACT, NORMAL, GRAYSCALE, UNCOMPRESSED };
+
+	static const char* const TEXTURE_CACHE_DIRECTORY = "Cache/Textures/";
+	static const uint32_t TEXTURE_CACHE_VERSION = 2; //bump when an encoder changes so old caches get thrown out
+
+	//every level back to back, level 0 first. The full chain down to 1x1 if its mipped, just level 0 if not
+	struct CompressedImage
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levels = 0;
+		uint32_t first_level = 0; //levels before this weren't read, data starts at it
+		std::vector<unsigned char> data;
+	};
+
+	bool IsBlockCompressed(VkFormat format);
+	//rgba8 is 4 bytes a texel, block formats round up to whole 4x4 blocks
+	VkDeviceSize LevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level);
+	//bytes of levels [first, last)
+	VkDeviceSize ChainSize(VkFormat format, uint32_t width, uint32_t height, uint32_t first, uint32_t last);
+	uint32_t MipLevelCount(uint32_t width, uint32_t height);
+
+	//the block format for a usage, pixels decide BC1 vs BC3. VK_FORMAT_UNDEFINED for UNCOMPRESSED
+	VkFormat PickCompressedFormat(TEXTURE_USAGE usage, const unsigned char* pixels, uint32_t width, uint32_t height);
+	//encodes one rgba8 level, blocks hanging off the edge repeat the last row/column
+	void EncodeBlocks(VkFormat format, const unsigned char* pixels, uint32_t width, uint32_t height, std::vector<unsigned char>& out);
+
+	std::string CompressedCachePath(const std::string& filename, TEXTURE_USAGE usage, bool mipped);
+	//reads levels [first_level, end) of a cache file, false if its missing, stale, not what we wrote or doesn't have the levels mipped asks for
+	bool ReadCompressedCache(const std::string& path, const std::string& sourcefile, bool mipped, uint32_t first_level, CompressedImage& image);
+	bool WriteCompressedCache(const std::string& path, const std::string& sourcefile, const CompressedImage& image);
+	//the cache if its good, otherwise decode + mip + encode + write the cache
+	bool ImportCompressed(const std::string& filename, TEXTURE_USAGE usage, bool mipped, CompressedImage& image);
+
+}
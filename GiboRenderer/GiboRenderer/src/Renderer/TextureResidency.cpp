@@ -0,0 +1,555 @@
+#include "../pch.h"
+#include "TextureResidency.h"
+#include "../ThirdParty/stb_image.h"
+#include "vkcore/VulkanHelpers.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Gibo {
+
+	void TextureResidency::CleanUp()
+	{
+		for (int i = 0; i < requests.size(); i++)
+		{
+			jobsystemref.Wait(&requests[i]->counter);
+			FreeDecoded(*requests[i]);
+		}
+		requests.clear();
+		reserved_total = 0;
+
+		DestroyRetired(true);
+		for (int i = 0; i < textures.size(); i++)
+		{
+			//placeholder views belong to the placeholder
+			if (textures[i].image.image != VK_NULL_HANDLE)
+			{
+				deviceref.DestroyImage(textures[i].image);
+				vkDestroyImageView(deviceref.GetDevice(), textures[i].view, nullptr);
+			}
+		}
+		textures.clear();
+		resident_total = 0;
+	}
+
+	uint32_t TextureResidency::Add(const std::string& filename, VkFormat format, bool mipped, bool pinned, const unsigned char* pixels, uint32_t width, uint32_t height, AssetUploader& uploader)
+	{
+		StreamedTexture texture;
+		texture.filename = filename;
+		texture.usage = TEXTURE_USAGE::UNCOMPRESSED;
+		texture.format = format;
+		texture.mipped = mipped;
+		texture.pinned = pinned;
+		texture.width = width;
+		texture.height = height;
+		texture.levels = MipLevelCount(width, height);
+		texture.tail_level = TailLevel(width, height);
+		uint32_t tailwidth, tailheight;
+		texture.tail = Downsample(pixels, width, height, texture.tail_level, IsSRGB(format), tailwidth, tailheight);
+
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		textures.push_back(std::move(texture));
+
+		//we already paid for the decode so it goes in whole if theres room, otherwise it starts at the tail and streams in once its drawn
+		RefreshBudget();
+		StreamedTexture& added = textures[id];
+		if (pinned || resident_total + reserved_total + LevelBytes(added, 0) <= budget)
+		{
+			MakeResident(id, 0, pixels, width, height, uploader);
+		}
+		else
+		{
+			MakeResident(id, added.tail_level, added.tail.data(), tailwidth, tailheight, uploader);
+		}
+		return id;
+	}
+
+	uint32_t TextureResidency::AddCompressed(const std::string& filename, TEXTURE_USAGE usage, bool mipped, bool pinned, const CompressedImage& image, AssetUploader& uploader)
+	{
+		StreamedTexture texture;
+		texture.filename = filename;
+		texture.usage = usage;
+		texture.format = image.format;
+		texture.mipped = mipped;
+		texture.pinned = pinned;
+		texture.width = image.width;
+		texture.height = image.height;
+		texture.levels = image.levels;
+		texture.tail_level = std::min(TailLevel(image.width, image.height), image.levels - 1);
+		if (texture.tail_level > 0)
+		{
+			VkDeviceSize tailoffset = ChainSize(image.format, image.width, image.height, 0, texture.tail_level);
+			texture.tail.assign(image.data.begin() + static_cast<size_t>(tailoffset), image.data.end());
+		}
+
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		textures.push_back(std::move(texture));
+
+		RefreshBudget();
+		StreamedTexture& added = textures[id];
+		if (pinned || added.tail_level == 0 || resident_total + reserved_total + LevelBytes(added, 0) <= budget)
+		{
+			MakeResident(id, 0, image.data.data(), image.width, image.height, uploader);
+		}
+		else
+		{
+			MakeResident(id, added.tail_level, added.tail.data(), std::max(image.width >> added.tail_level, 1u), std::max(image.height >> added.tail_level, 1u), uploader);
+		}
+		return id;
+	}
+
+	uint32_t TextureResidency::AddDeferred(const std::string& filename, VkFormat format, bool mipped, uint32_t placeholder, TEXTURE_USAGE usage)
+	{
+		StreamedTexture texture;
+		texture.filename = filename;
+		texture.usage = usage;
+		texture.format = format;
+		texture.mipped = mipped;
+		texture.pinned = false;
+		texture.view = textures[placeholder].view;
+		texture.streaming = true;
+
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		textures.push_back(std::move(texture));
+
+		//size isn't known until its decoded so nothing gets reserved, FinishRequests checks what fits once its back
+		std::unique_ptr<StreamRequest> request(new StreamRequest());
+		request->id = id;
+		request->level = 0;
+		request->first_load = true;
+		request->usage = usage;
+		request->mipped = mipped;
+		request->srgb = IsSRGB(format);
+		request->reserved = 0;
+		StreamRequest* job = request.get();
+		jobsystemref.Submit([job, filename]() { Decode(*job, filename); }, &job->counter);
+		requests.push_back(std::move(request));
+
+		return id;
+	}
+
+	void TextureResidency::Update()
+	{
+		frame++;
+		DestroyRetired(false);
+		RefreshBudget();
+
+		AssetUploader uploader(deviceref);
+		FinishRequests(uploader);
+
+		//everything that could be dropped to its tail, least recently used first
+		std::vector<uint32_t> lru;
+		for (uint32_t i = 0; i < textures.size(); i++)
+		{
+			const StreamedTexture& texture = textures[i];
+			if (!texture.pinned && !texture.streaming && texture.resident_level < texture.tail_level)
+			{
+				lru.push_back(i);
+			}
+		}
+		std::sort(lru.begin(), lru.end(), [this](uint32_t a, uint32_t b) { return textures[a].last_used < textures[b].last_used; });
+		uint32_t lru_next = 0;
+
+		MakeRoom(0, lru, lru_next, uploader);
+		RequestLevels(lru, lru_next, uploader);
+
+		//the swaps above have to be on the gpu before this frame records with their views
+		uploader.Flush();
+	}
+
+	TextureResidency::Stats TextureResidency::GetStats() const
+	{
+		Stats stats;
+		stats.textures = static_cast<uint32_t>(textures.size());
+		for (int i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].resident_level == 0) stats.full++;
+		}
+		stats.streaming = static_cast<uint32_t>(requests.size());
+		stats.streamed_in = streamed_in;
+		stats.evicted = evicted;
+		stats.resident_bytes = resident_total;
+		stats.budget_bytes = budget;
+		return stats;
+	}
+
+	bool TextureResidency::IsSRGB(VkFormat format)
+	{
+		return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK ||
+			   format == VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+
+	static float ToSRGB(float linear)
+	{
+		return (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+	}
+
+	std::vector<unsigned char> TextureResidency::Downsample(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t levels, bool srgb, uint32_t& outwidth, uint32_t& outheight)
+	{
+		static const std::vector<float> tolinear = []() {
+			std::vector<float> table(256);
+			for (int i = 0; i < 256; i++)
+			{
+				float value = i / 255.0f;
+				table[i] = (value <= 0.04045f) ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+			return table;
+		}();
+
+		if (levels == 0)
+		{
+			outwidth = width;
+			outheight = height;
+			return std::vector<unsigned char>(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		}
+
+		//the first level reads straight from the source so a big texture never gets copied whole. Every level goes back to bytes before the next
+		//so a tail comes out the same as the chain the compressed import builds one level at a time
+		uint32_t colorchannels = (srgb) ? 3 : 0;
+		std::vector<unsigned char> current;
+		std::vector<unsigned char> next;
+		const unsigned char* source = pixels;
+		for (uint32_t l = 0; l < levels; l++)
+		{
+			uint32_t nextwidth = std::max(width / 2, 1u);
+			uint32_t nextheight = std::max(height / 2, 1u);
+			next.resize(static_cast<size_t>(nextwidth) * nextheight * 4);
+			for (uint32_t y = 0; y < nextheight; y++)
+			{
+				const unsigned char* row0 = source + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+				const unsigned char* row1 = source + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
+				unsigned char* out = next.data() + static_cast<size_t>(y) * nextwidth * 4;
+				for (uint32_t x = 0; x < nextwidth; x++)
+				{
+					uint32_t x0 = std::min(x * 2, width - 1) * 4;
+					uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+					for (uint32_t c = 0; c < colorchannels; c++)
+					{
+						float linear = (tolinear[row0[x0 + c]] + tolinear[row0[x1 + c]] + tolinear[row1[x0 + c]] + tolinear[row1[x1 + c]]) * 0.25f;
+						out[x * 4 + c] = static_cast<unsigned char>(std::min(ToSRGB(linear), 1.0f) * 255.0f + 0.5f);
+					}
+					for (uint32_t c = colorchannels; c < 4; c++)
+					{
+						out[x * 4 + c] = static_cast<unsigned char>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+					}
+				}
+			}
+			current.swap(next);
+			source = current.data();
+			width = nextwidth;
+			height = nextheight;
+		}
+
+		outwidth = width;
+		outheight = height;
+		return current;
+	}
+
+	void TextureResidency::Decode(StreamRequest& request, const std::string& filename)
+	{
+		if (request.usage != TEXTURE_USAGE::UNCOMPRESSED)
+		{
+			DecodeCompressed(request, filename);
+			return;
+		}
+
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			printf("STBI MESSAGE: %s  %s\n", stbi_failure_reason(), filename.c_str());
+			return;
+		}
+
+		request.decoded_width = static_cast<uint32_t>(width);
+		request.decoded_height = static_cast<uint32_t>(height);
+		if (request.first_load)
+		{
+			uint32_t tailwidth, tailheight;
+			request.tail_level = TailLevel(width, height);
+			request.tail = Downsample(pixels, width, height, request.tail_level, request.srgb, tailwidth, tailheight);
+		}
+
+		if (request.level == 0)
+		{
+			request.decoded = pixels;
+			request.width = request.decoded_width;
+			request.height = request.decoded_height;
+		}
+		else
+		{
+			request.data = Downsample(pixels, width, height, request.level, request.srgb, request.width, request.height);
+			stbi_image_free(pixels);
+		}
+		request.bytes = VkDeviceSize(request.width) * request.height * 4;
+		request.valid = true;
+	}
+
+	void TextureResidency::DecodeCompressed(StreamRequest& request, const std::string& filename)
+	{
+		//streaming in only needs its levels out of the cache, if the cache went missing it just gets imported again
+		CompressedImage image;
+		bool loaded = (request.first_load) ? ImportCompressed(filename, request.usage, request.mipped, image) :
+			ReadCompressedCache(CompressedCachePath(filename, request.usage, request.mipped), filename, request.mipped, request.level, image);
+		if (!loaded && (request.first_load || !ImportCompressed(filename, request.usage, request.mipped, image)))
+		{
+			return;
+		}
+		if (request.level >= image.levels)
+		{
+			return;
+		}
+
+		request.format = image.format;
+		request.decoded_width = image.width;
+		request.decoded_height = image.height;
+		request.width = std::max(image.width >> request.level, 1u);
+		request.height = std::max(image.height >> request.level, 1u);
+		if (request.first_load)
+		{
+			request.tail_level = std::min(TailLevel(image.width, image.height), image.levels - 1);
+			if (request.tail_level > 0)
+			{
+				VkDeviceSize tailoffset = ChainSize(image.format, image.width, image.height, image.first_level, request.tail_level);
+				request.tail.assign(image.data.begin() + static_cast<size_t>(tailoffset), image.data.end());
+			}
+		}
+
+		//an import always has every level it was made with, drop whatever is above the level
+		VkDeviceSize offset = ChainSize(image.format, image.width, image.height, image.first_level, request.level);
+		if (offset > 0)
+		{
+			image.data.erase(image.data.begin(), image.data.begin() + static_cast<size_t>(offset));
+		}
+		request.data = std::move(image.data);
+		request.bytes = request.data.size();
+		request.valid = true;
+	}
+
+	void TextureResidency::FreeDecoded(StreamRequest& request)
+	{
+		if (request.decoded)
+		{
+			stbi_image_free(request.decoded);
+			request.decoded = nullptr;
+		}
+	}
+
+	uint32_t TextureResidency::TailLevel(uint32_t width, uint32_t height)
+	{
+		uint32_t level = 0;
+		while (std::max(width >> level, 1u) > TAIL_SIZE || std::max(height >> level, 1u) > TAIL_SIZE)
+		{
+			level++;
+		}
+		return level;
+	}
+
+	VkDeviceSize TextureResidency::LevelBytes(const StreamedTexture& texture, uint32_t level) const
+	{
+		uint32_t last = (texture.mipped) ? texture.levels : level + 1;
+		return ChainSize(texture.format, texture.width, texture.height, level, last);
+	}
+
+	void TextureResidency::RefreshBudget()
+	{
+		if (budget_override != 0)
+		{
+			budget = budget_override;
+			return;
+		}
+
+		//everything else on the device is a fixed cost as far as we're concerned, the textures get a fraction of what it leaves
+		VkDeviceSize usage, available;
+		deviceref.GetDeviceLocalBudget(usage, available);
+		VkDeviceSize others = (usage > resident_total) ? usage - resident_total : 0;
+		budget = (available > others) ? static_cast<VkDeviceSize>((available - others) * BUDGET_FRACTION) : 0;
+	}
+
+	void TextureResidency::FinishRequests(AssetUploader& uploader)
+	{
+		VkDeviceSize uploaded = 0;
+		for (int i = 0; i < requests.size();)
+		{
+			StreamRequest& request = *requests[i];
+			if (!request.counter.Done() || (uploaded > 0 && uploaded + request.bytes > UPLOAD_BYTES_PER_FRAME))
+			{
+				i++;
+				continue;
+			}
+			//done already, this just makes sure the job let go of the counter before it gets destroyed
+			jobsystemref.Wait(&request.counter);
+
+			StreamedTexture& texture = textures[request.id];
+			texture.streaming = false;
+			reserved_total -= request.reserved;
+			const unsigned char* pixels = (request.decoded) ? request.decoded : request.data.data();
+
+			if (!request.valid)
+			{
+				Logger::LogError("couldn't stream texture ", texture.filename, "\n");
+			}
+			else if (request.first_load)
+			{
+				texture.width = request.decoded_width;
+				texture.height = request.decoded_height;
+				texture.levels = (texture.usage == TEXTURE_USAGE::UNCOMPRESSED || texture.mipped) ? MipLevelCount(texture.width, texture.height) : 1;
+				if (texture.usage != TEXTURE_USAGE::UNCOMPRESSED)
+				{
+					texture.format = request.format;
+				}
+				texture.tail_level = request.tail_level;
+				texture.tail = std::move(request.tail);
+				if (texture.tail_level == 0 || resident_total + reserved_total + LevelBytes(texture, 0) <= budget)
+				{
+					MakeResident(request.id, 0, pixels, request.width, request.height, uploader);
+				}
+				else
+				{
+					MakeResident(request.id, texture.tail_level, texture.tail.data(), std::max(texture.width >> texture.tail_level, 1u), std::max(texture.height >> texture.tail_level, 1u), uploader);
+				}
+				uploaded += request.bytes;
+			}
+			else if (request.decoded_width != texture.width || request.decoded_height != texture.height || (texture.usage != TEXTURE_USAGE::UNCOMPRESSED && request.format != texture.format))
+			{
+				Logger::LogWarning(texture.filename, " changed size on disk, not streaming it\n");
+			}
+			else
+			{
+				MakeResident(request.id, request.level, pixels, request.width, request.height, uploader);
+				uploaded += request.bytes;
+				streamed_in++;
+			}
+
+			FreeDecoded(request);
+			requests.erase(requests.begin() + i);
+		}
+	}
+
+	bool TextureResidency::MakeRoom(VkDeviceSize needed, std::vector<uint32_t>& lru, uint32_t& lru_next, AssetUploader& uploader)
+	{
+		while (resident_total + reserved_total + needed > budget)
+		{
+			//sorted by last use, once one is too recent to drop so is everything after it
+			if (lru_next == lru.size() || frame - textures[lru[lru_next]].last_used <= KEEP_FRAMES)
+			{
+				return false;
+			}
+
+			uint32_t id = lru[lru_next++];
+			StreamedTexture& texture = textures[id];
+			MakeResident(id, texture.tail_level, texture.tail.data(), std::max(texture.width >> texture.tail_level, 1u), std::max(texture.height >> texture.tail_level, 1u), uploader);
+			evicted++;
+		}
+		return true;
+	}
+
+	void TextureResidency::RequestLevels(std::vector<uint32_t>& lru, uint32_t& lru_next, AssetUploader& uploader)
+	{
+		//only what got drawn since the last update wants more than it has, blurriest first
+		std::vector<uint32_t> wanted;
+		for (uint32_t i = 0; i < textures.size(); i++)
+		{
+			const StreamedTexture& texture = textures[i];
+			if (!texture.pinned && !texture.streaming && texture.resident_level != 0 && texture.resident_level != NOT_RESIDENT && texture.last_used + 1 >= frame)
+			{
+				wanted.push_back(i);
+			}
+		}
+		std::sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b) { return textures[a].resident_level > textures[b].resident_level; });
+
+		for (int w = 0; w < wanted.size() && requests.size() < MAX_DECODES_IN_FLIGHT; w++)
+		{
+			uint32_t id = wanted[w];
+			StreamedTexture& texture = textures[id];
+
+			//what dropping every old texture could free, then the finest level that fits with that
+			VkDeviceSize droppable = 0;
+			for (uint32_t l = lru_next; l < lru.size() && frame - textures[lru[l]].last_used > KEEP_FRAMES; l++)
+			{
+				const StreamedTexture& old = textures[lru[l]];
+				droppable += old.resident_bytes - LevelBytes(old, old.tail_level);
+			}
+
+			uint32_t level = 0;
+			while (level < texture.resident_level && resident_total + reserved_total + LevelBytes(texture, level) - texture.resident_bytes > budget + droppable)
+			{
+				level++;
+			}
+			if (level == texture.resident_level)
+			{
+				continue;
+			}
+
+			VkDeviceSize extra = LevelBytes(texture, level) - texture.resident_bytes;
+			MakeRoom(extra, lru, lru_next, uploader);
+
+			std::unique_ptr<StreamRequest> request(new StreamRequest());
+			request->id = id;
+			request->level = level;
+			request->first_load = false;
+			request->usage = texture.usage;
+			request->mipped = texture.mipped;
+			request->srgb = IsSRGB(texture.format);
+			request->reserved = extra;
+			reserved_total += extra;
+			texture.streaming = true;
+
+			StreamRequest* job = request.get();
+			std::string filename = texture.filename;
+			jobsystemref.Submit([job, filename]() { Decode(*job, filename); }, &job->counter);
+			requests.push_back(std::move(request));
+		}
+	}
+
+	void TextureResidency::MakeResident(uint32_t id, uint32_t level, const unsigned char* pixels, uint32_t width, uint32_t height, AssetUploader& uploader)
+	{
+		StreamedTexture& texture = textures[id];
+		uint32_t miplevels = (texture.mipped) ? texture.levels - level : 1;
+		bool compressed = (texture.usage != TEXTURE_USAGE::UNCOMPRESSED);
+
+		//compressed chains come with their mips, rgba8 ones get blitted so they need to be a transfer source too
+		vkcoreImage image;
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | ((compressed) ? 0 : VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		deviceref.CreateImage(VK_IMAGE_TYPE_2D, texture.format, usage, VK_SAMPLE_COUNT_1_BIT, width, height, 1, miplevels, 1, VMA_MEMORY_USAGE_GPU_ONLY, 0, image);
+		VkImageView view = CreateImageView(deviceref.GetDevice(), image.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, miplevels, 1, VK_IMAGE_VIEW_TYPE_2D);
+		if (compressed)
+		{
+			uploader.UploadImageLevels(pixels, LevelBytes(texture, level), image.image, width, height, texture.format, miplevels);
+		}
+		else
+		{
+			uploader.UploadImage(pixels, VkDeviceSize(width) * height * 4, image.image, width, height, texture.format, miplevels, texture.mipped);
+		}
+
+		Retire(texture);
+		resident_total -= texture.resident_bytes;
+		texture.image = image;
+		texture.view = view;
+		texture.resident_level = level;
+		texture.resident_bytes = LevelBytes(texture, level);
+		texture.view_serial = ++serial;
+		resident_total += texture.resident_bytes;
+	}
+
+	void TextureResidency::Retire(StreamedTexture& texture)
+	{
+		if (texture.image.image != VK_NULL_HANDLE)
+		{
+			retired.push_back(RetiredImage{ texture.image, texture.view, frame });
+			texture.image = {};
+			texture.view = VK_NULL_HANDLE;
+		}
+	}
+
+	void TextureResidency::DestroyRetired(bool all)
+	{
+		//every frames sets get rewritten the next time that frame comes around, after framesinflight + 1 updates the gpu is done with all of them
+		while (!retired.empty() && (all || frame - retired.front().frame > frames_in_flight))
+		{
+			deviceref.DestroyImage(retired.front().image);
+			vkDestroyImageView(deviceref.GetDevice(), retired.front().view, nullptr);
+			retired.pop_front();
+		}
+	}
+
+}
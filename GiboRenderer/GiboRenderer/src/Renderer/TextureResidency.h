@@ -0,0 +1,180 @@
+#pragma once
+#include "vkcore/vkcoreDevice.h"
+#include "AssetUploader.h"
+#include "TextureCompression.h"
+#include "../Utilities/JobSystem.h"
+#include <memory>
+
+namespace Gibo {
+
+	/*
+	 Keeps the 2D textures inside a vram budget so the material libraries can be a lot bigger than the card. The TextureCache hands every 2D texture to this and
+	 asks it for the view to bind.
+
+	 A texture is resident from some level down: its image is just the mip chain from resident_level on, so dropping the top level frees 3/4 of it. The smallest levels
+	 (the tail, biggest side <= TAIL_SIZE) always stay on the gpu as the placeholder and their pixels stay on the cpu too, so falling back to them never touches the disk.
+	 Textures that were never loaded before someone asked for them show the placeholder texture until their first decode is back.
+
+	 Every frame the renderer marks the textures the camera draws with MarkUsed and calls Update, which
+		. uploads the decodes that finished and swaps them in (at most UPLOAD_BYTES_PER_FRAME a frame)
+		. drops the least recently used textures to their tail while over budget, never ones used in the last KEEP_FRAMES frames
+		. asks the workers to decode the finest level that fits for the textures that were just drawn, making room by dropping old ones the same way
+	 Decoding (stb_image + a box downsample to the level) runs on the job system, the main thread only records the copy. The budget is a fraction of what vma says the
+	 device local heaps have left after everything that isn't a texture.
+	 Block compressed textures stream the same way except a level is just read out of the textures .dds cache (see TextureCompression.h). Their mips come precomputed
+	 so the tail and every upload is the whole chain from that level on instead of one level + gpu blits.
+
+	 Changing the level means a new image and view, there's no sparse binding in 1.1 we can count on. The old ones are kept for framesinflight + 1 updates, the
+	 renderer rewrites each frames descriptor sets once that frame comes around again (anything with a view serial newer than its last rewrite) so by then nothing uses them.
+	*/
+	class TextureResidency
+	{
+	public:
+		static const uint32_t NOT_RESIDENT = UINT32_MAX;
+		static const uint32_t TAIL_SIZE = 64;
+		static const uint32_t KEEP_FRAMES = 8; //textures used this recently never get dropped to make room, so a camera turn doesn't thrash them
+		static const uint32_t MAX_DECODES_IN_FLIGHT = 4;
+		static constexpr VkDeviceSize UPLOAD_BYTES_PER_FRAME = 32 * 1024 * 1024; //at least one swap always goes out so a huge texture can't get stuck
+		static constexpr float BUDGET_FRACTION = 0.8f; //of whats left for textures, the rest is headroom for everything else allocating
+
+		struct Stats
+		{
+			uint32_t textures = 0;
+			uint32_t full = 0; //resident at level 0
+			uint32_t streaming = 0; //decodes in flight
+			uint32_t streamed_in = 0; //swaps since the last ResetStats
+			uint32_t evicted = 0;
+			VkDeviceSize resident_bytes = 0;
+			VkDeviceSize budget_bytes = 0;
+		};
+
+		TextureResidency(vkcoreDevice& device, JobSystem& jobsystem, uint32_t framesinflight) : deviceref(device), jobsystemref(jobsystem), frames_in_flight(framesinflight) {};
+		~TextureResidency() = default;
+
+		//no copying/moving should be allowed from this class
+		TextureResidency(TextureResidency const&) = delete;
+		TextureResidency(TextureResidency&&) = delete;
+		TextureResidency& operator=(TextureResidency const&) = delete;
+		TextureResidency& operator=(TextureResidency&&) = delete;
+
+		void CleanUp();
+
+		//takes decoded rgba8 pixels (the caller still frees them). Goes in full if it fits the budget or is pinned, pinned textures never stream. The upload goes out with the uploaders flush
+		uint32_t Add(const std::string& filename, VkFormat format, bool mipped, bool pinned, const unsigned char* pixels, uint32_t width, uint32_t height, AssetUploader& uploader);
+		//image is the full imported chain, the caller can throw it away after
+		uint32_t AddCompressed(const std::string& filename, TEXTURE_USAGE usage, bool mipped, bool pinned, const CompressedImage& image, AssetUploader& uploader);
+		//nothing decoded yet, shows placeholder (a pinned texture) until the workers are done with it. Any usage but UNCOMPRESSED gets imported compressed and
+		//ignores format, the import decides it
+		uint32_t AddDeferred(const std::string& filename, VkFormat format, bool mipped, uint32_t placeholder, TEXTURE_USAGE usage = TEXTURE_USAGE::UNCOMPRESSED);
+
+		//main thread only, between Updates
+		void MarkUsed(uint32_t id) { textures[id].last_used = frame; }
+		void Update();
+
+		VkImageView GetView(uint32_t id) const { return textures[id].view; }
+		VkImage GetImage(uint32_t id) const { return textures[id].image.image; }
+		//bumped every time a view gets swapped, GetViewSerial(id) is the serial of that textures last swap
+		uint64_t GetSerial() const { return serial; }
+		uint64_t GetViewSerial(uint32_t id) const { return textures[id].view_serial; }
+
+		//0 goes back to the vma budget
+		void SetBudgetOverride(VkDeviceSize bytes) { budget_override = bytes; }
+		Stats GetStats() const;
+		void ResetStats() { streamed_in = 0; evicted = 0; }
+
+		//halves rgba8 pixels levels times with a 2x2 box, odd sizes repeat the last row/column so it lands on the same sizes as the mip chain.
+		//srgb color gets averaged as linear light (the byte average comes out darker every level), alpha is always averaged as is
+		static std::vector<unsigned char> Downsample(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t levels, bool srgb, uint32_t& outwidth, uint32_t& outheight);
+		static bool IsSRGB(VkFormat format);
+	private:
+		struct StreamedTexture
+		{
+			std::string filename;
+			TEXTURE_USAGE usage; //UNCOMPRESSED is rgba8 decoded from the source, anything else is block compressed out of its cache
+			VkFormat format;
+			bool mipped;
+			bool pinned;
+			uint32_t width = 0; //0 until the first decode is back
+			uint32_t height = 0;
+			uint32_t levels = 0; //of the full chain. Not mipped rgba8 textures still stream by level, their image just never has more than the one
+			uint32_t tail_level = 0; //0 for compressed textures that aren't mipped, their cache only has level 0 so they never stream
+			std::vector<unsigned char> tail; //rgba8 pixels of the tail level, or the compressed chain from it on. Empty when its level 0
+
+			vkcoreImage image = {};
+			VkImageView view = VK_NULL_HANDLE;
+			uint32_t resident_level = NOT_RESIDENT;
+			VkDeviceSize resident_bytes = 0;
+			uint64_t view_serial = 0;
+			uint64_t last_used = 0;
+			bool streaming = false;
+		};
+
+		//one decode on the workers. Only the job touches it until the counter is done
+		struct StreamRequest
+		{
+			uint32_t id;
+			uint32_t level; //what it wants, a first load finds out what fits when its back
+			bool first_load;
+			TEXTURE_USAGE usage;
+			bool mipped;
+			bool srgb; //rgba8 only, how Downsample filters the levels and tail
+			VkDeviceSize reserved; //budget held for it while its in flight
+			JobSystem::Counter counter;
+
+			//written by the job
+			bool valid = false;
+			unsigned char* decoded = nullptr; //stb_image pixels, only kept if level is 0
+			std::vector<unsigned char> data; //rgba8 pixels downsampled to level, or the compressed chain from level on
+			VkDeviceSize bytes = 0; //what the upload stages
+			VkFormat format = VK_FORMAT_UNDEFINED; //compressed only
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t decoded_width = 0;
+			uint32_t decoded_height = 0;
+			std::vector<unsigned char> tail; //first loads only
+			uint32_t tail_level = 0;
+		};
+
+		struct RetiredImage
+		{
+			vkcoreImage image;
+			VkImageView view;
+			uint64_t frame;
+		};
+
+		static void Decode(StreamRequest& request, const std::string& filename);
+		static void DecodeCompressed(StreamRequest& request, const std::string& filename);
+		static void FreeDecoded(StreamRequest& request);
+		static uint32_t TailLevel(uint32_t width, uint32_t height);
+		VkDeviceSize LevelBytes(const StreamedTexture& texture, uint32_t level) const;
+
+		void RefreshBudget();
+		void FinishRequests(AssetUploader& uploader);
+		//drops least recently used textures to their tail until needed bytes fit, returns false if it ran out of ones it can drop
+		bool MakeRoom(VkDeviceSize needed, std::vector<uint32_t>& lru, uint32_t& lru_next, AssetUploader& uploader);
+		void RequestLevels(std::vector<uint32_t>& lru, uint32_t& lru_next, AssetUploader& uploader);
+		//new image for level with pixels already at that level (or the compressed chain from it), retires the old one
+		void MakeResident(uint32_t id, uint32_t level, const unsigned char* pixels, uint32_t width, uint32_t height, AssetUploader& uploader);
+		void Retire(StreamedTexture& texture);
+		void DestroyRetired(bool all);
+
+	private:
+		vkcoreDevice& deviceref;
+		JobSystem& jobsystemref;
+		uint32_t frames_in_flight;
+
+		std::vector<StreamedTexture> textures;
+		std::vector<std::unique_ptr<StreamRequest>> requests;
+		std::deque<RetiredImage> retired; //in retire order
+
+		uint64_t frame = 1;
+		uint64_t serial = 0;
+		VkDeviceSize resident_total = 0;
+		VkDeviceSize reserved_total = 0; //for the decodes in flight
+		VkDeviceSize budget = 0;
+		VkDeviceSize budget_override = 0;
+		uint32_t streamed_in = 0;
+		uint32_t evicted = 0;
+	};
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include "CullingBounds.h"
+#include "../Utilities/JobSystem.h"
+#include <glm/gtc/quaternion.hpp>
+#include <immintrin.h>
+#include <vector>
+
+namespace Gibo {
+	/*
+	Transforms of every renderobject as structure of arrays indexed by the objects slot (descriptor_id), same as the culling bounds. Each slot holds its local position/rotation/scale,
+	the world matrix built from them, and the model space sphere/aabb of its mesh, so refitting never has to go back to the meshcache by name or allocate anything.
+
+	SetTransformation on a renderobject writes its TRS here and pushes the slot on the dirty list. Once a frame Refit runs over only the dirty slots on the job system, 4 at a time with SSE:
+	each lane is a different object, so the TRS -> matrix and the sphere/aabb transforms (Arvo for the box) are straight line vector math with no shuffles. The slots get gathered into
+	the lanes and scattered back out since they aren't next to each other, but thats just loads/stores, all the math is SIMD. Short groups get padded with their last slot, which
+	just writes the same values twice.
+
+	World matrices are T * R * S so the columns of R*S are the rotation columns times the scale, and the largest column length is just the largest absolute scale.
+	*/
+	class TransformSystem
+	{
+	public:
+		static constexpr uint32_t LANES = 4;
+
+	public:
+		TransformSystem() = default;
+		~TransformSystem() = default;
+
+		void Resize(uint32_t count)
+		{
+			pos_x.resize(count, 0.0f); pos_y.resize(count, 0.0f); pos_z.resize(count, 0.0f);
+			rot_x.resize(count, 0.0f); rot_y.resize(count, 0.0f); rot_z.resize(count, 0.0f); rot_w.resize(count, 1.0f);
+			scale_x.resize(count, 1.0f); scale_y.resize(count, 1.0f); scale_z.resize(count, 1.0f);
+			world.resize(count, glm::mat4(1.0f));
+
+			local_center_x.resize(count, 0.0f); local_center_y.resize(count, 0.0f); local_center_z.resize(count, 0.0f); local_radius.resize(count, 0.0f);
+			local_boxcenter_x.resize(count, 0.0f); local_boxcenter_y.resize(count, 0.0f); local_boxcenter_z.resize(count, 0.0f);
+			local_extent_x.resize(count, 0.0f); local_extent_y.resize(count, 0.0f); local_extent_z.resize(count, 0.0f);
+
+			dirty_flags.resize(count, 0);
+			live.resize(count, 0);
+		}
+
+		uint32_t Size() const { return static_cast<uint32_t>(world.size()); }
+
+		//new object in the slot, gets refit right away so the bounds are there to insert into the tree
+		void Add(uint32_t slot, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const Sphere& local_sphere, const AABB& local_box, CullingBounds& bounds)
+		{
+			live[slot] = 1;
+			local_center_x[slot] = local_sphere.c.x; local_center_y[slot] = local_sphere.c.y; local_center_z[slot] = local_sphere.c.z; local_radius[slot] = local_sphere.r;
+			glm::vec3 boxcenter = (local_box.min + local_box.max) * 0.5f;
+			glm::vec3 extent = (local_box.max - local_box.min) * 0.5f;
+			local_boxcenter_x[slot] = boxcenter.x; local_boxcenter_y[slot] = boxcenter.y; local_boxcenter_z[slot] = boxcenter.z;
+			local_extent_x[slot] = extent.x; local_extent_y[slot] = extent.y; local_extent_z[slot] = extent.z;
+
+			SetLocal(slot, position, rotation, scale);
+			RefitGroup(&slot, 1, bounds);
+		}
+
+		//slot is empty now, if its still on the dirty list it gets dropped next refit
+		void Remove(uint32_t slot)
+		{
+			live[slot] = 0;
+		}
+
+		void Set(uint32_t slot, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			SetLocal(slot, position, rotation, scale);
+			if (!dirty_flags[slot])
+			{
+				dirty_flags[slot] = 1;
+				dirty.push_back(slot);
+			}
+		}
+
+		const glm::mat4& GetWorld(uint32_t slot) const { return world[slot]; }
+
+		//rebuilds the world matrix and bounds of every dirty slot. Afterwards GetRefitted has the slots that changed (so the tree can move their leaves) until the next refit.
+		void Refit(JobSystem& jobs, CullingBounds& bounds, uint32_t grainsize)
+		{
+			//drop anything removed after it was set, and round the grain to whole groups so only the last chunk has a short group
+			refitted.clear();
+			for (uint32_t i = 0; i < dirty.size(); i++)
+			{
+				dirty_flags[dirty[i]] = 0;
+				if (live[dirty[i]]) refitted.push_back(dirty[i]);
+			}
+			dirty.clear();
+
+			grainsize = std::max(LANES, (grainsize / LANES) * LANES);
+			jobs.ParallelFor(static_cast<uint32_t>(refitted.size()), grainsize, [this, &bounds](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; i += LANES)
+				{
+					RefitGroup(refitted.data() + i, std::min(LANES, end - i), bounds);
+				}
+			});
+		}
+
+		const std::vector<uint32_t>& GetRefitted() const { return refitted; }
+
+		void Clear()
+		{
+			std::fill(dirty_flags.begin(), dirty_flags.end(), 0);
+			std::fill(live.begin(), live.end(), 0);
+			dirty.clear();
+			refitted.clear();
+		}
+
+		//scalar version of what Refit builds, for objects that aren't in a TransformSystem yet
+		static glm::mat4 ComposeTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			glm::mat4 matrix = glm::mat4_cast(rotation);
+			matrix[0] *= scale.x;
+			matrix[1] *= scale.y;
+			matrix[2] *= scale.z;
+			matrix[3] = glm::vec4(position, 1.0f);
+			return matrix;
+		}
+
+	private:
+		void SetLocal(uint32_t slot, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			pos_x[slot] = position.x; pos_y[slot] = position.y; pos_z[slot] = position.z;
+			rot_x[slot] = rotation.x; rot_y[slot] = rotation.y; rot_z[slot] = rotation.z; rot_w[slot] = rotation.w;
+			scale_x[slot] = scale.x; scale_y[slot] = scale.y; scale_z[slot] = scale.z;
+		}
+
+		//loads the slots values of one array into the lanes, padding a short group with its last slot
+		static __m128 Gather(const std::vector<float>& values, const uint32_t* slots, uint32_t count)
+		{
+			return _mm_setr_ps(values[slots[0]], values[slots[std::min(1u, count - 1)]], values[slots[std::min(2u, count - 1)]], values[slots[std::min(3u, count - 1)]]);
+		}
+
+		static void Scatter(std::vector<float>& values, const uint32_t* slots, uint32_t count, __m128 lanes)
+		{
+			alignas(16) float out[LANES];
+			_mm_store_ps(out, lanes);
+			for (uint32_t l = 0; l < count; l++)
+			{
+				values[slots[l]] = out[l];
+			}
+		}
+
+		static __m128 Abs(__m128 v)
+		{
+			return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+		}
+
+		//up to 4 slots: world matrix from trs, then the world sphere and aabb from the local ones
+		void RefitGroup(const uint32_t* slots, uint32_t count, CullingBounds& bounds)
+		{
+			__m128 qx = Gather(rot_x, slots, count), qy = Gather(rot_y, slots, count), qz = Gather(rot_z, slots, count), qw = Gather(rot_w, slots, count);
+			__m128 sx = Gather(scale_x, slots, count), sy = Gather(scale_y, slots, count), sz = Gather(scale_z, slots, count);
+			__m128 tx = Gather(pos_x, slots, count), ty = Gather(pos_y, slots, count), tz = Gather(pos_z, slots, count);
+
+			//rotation matrix from the quaternion, m[column][row] like glm
+			__m128 one = _mm_set1_ps(1.0f);
+			__m128 two = _mm_set1_ps(2.0f);
+			__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+			__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+			__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+			__m128 m[3][3];
+			m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+			m[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+			m[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+			m[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+			m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+			m[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+			m[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+			m[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+			m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+			//write the matrices out per lane
+			alignas(16) float cols[3][3][LANES];
+			for (int c = 0; c < 3; c++)
+			{
+				for (int r = 0; r < 3; r++)
+				{
+					_mm_store_ps(cols[c][r], m[c][r]);
+				}
+			}
+			for (uint32_t l = 0; l < count; l++)
+			{
+				glm::mat4& matrix = world[slots[l]];
+				matrix[0] = glm::vec4(cols[0][0][l], cols[0][1][l], cols[0][2][l], 0.0f);
+				matrix[1] = glm::vec4(cols[1][0][l], cols[1][1][l], cols[1][2][l], 0.0f);
+				matrix[2] = glm::vec4(cols[2][0][l], cols[2][1][l], cols[2][2][l], 0.0f);
+				matrix[3] = glm::vec4(pos_x[slots[l]], pos_y[slots[l]], pos_z[slots[l]], 1.0f);
+			}
+
+			//sphere: move the center and scale the radius by the largest absolute scale so non-uniform scales stay conservative
+			__m128 cx = Gather(local_center_x, slots, count), cy = Gather(local_center_y, slots, count), cz = Gather(local_center_z, slots, count);
+			__m128 maxscale = _mm_max_ps(Abs(sx), _mm_max_ps(Abs(sy), Abs(sz)));
+			Scatter(bounds.center_x, slots, count, _mm_add_ps(tx, _mm_add_ps(_mm_mul_ps(m[0][0], cx), _mm_add_ps(_mm_mul_ps(m[1][0], cy), _mm_mul_ps(m[2][0], cz)))));
+			Scatter(bounds.center_y, slots, count, _mm_add_ps(ty, _mm_add_ps(_mm_mul_ps(m[0][1], cx), _mm_add_ps(_mm_mul_ps(m[1][1], cy), _mm_mul_ps(m[2][1], cz)))));
+			Scatter(bounds.center_z, slots, count, _mm_add_ps(tz, _mm_add_ps(_mm_mul_ps(m[0][2], cx), _mm_add_ps(_mm_mul_ps(m[1][2], cy), _mm_mul_ps(m[2][2], cz)))));
+			Scatter(bounds.radius, slots, count, _mm_mul_ps(Gather(local_radius, slots, count), maxscale));
+
+			//aabb: transform the center and project the extents onto the world axis with the absolute matrix (Arvo) so rotated boxes stay tight
+			__m128 bx = Gather(local_boxcenter_x, slots, count), by = Gather(local_boxcenter_y, slots, count), bz = Gather(local_boxcenter_z, slots, count);
+			__m128 ex = Gather(local_extent_x, slots, count), ey = Gather(local_extent_y, slots, count), ez = Gather(local_extent_z, slots, count);
+			__m128 t[3] = { tx, ty, tz };
+			std::vector<float>* mins[3] = { &bounds.min_x, &bounds.min_y, &bounds.min_z };
+			std::vector<float>* maxs[3] = { &bounds.max_x, &bounds.max_y, &bounds.max_z };
+			for (int r = 0; r < 3; r++)
+			{
+				__m128 center = _mm_add_ps(t[r], _mm_add_ps(_mm_mul_ps(m[0][r], bx), _mm_add_ps(_mm_mul_ps(m[1][r], by), _mm_mul_ps(m[2][r], bz))));
+				__m128 extent = _mm_add_ps(_mm_mul_ps(Abs(m[0][r]), ex), _mm_add_ps(_mm_mul_ps(Abs(m[1][r]), ey), _mm_mul_ps(Abs(m[2][r]), ez)));
+				Scatter(*mins[r], slots, count, _mm_sub_ps(center, extent));
+				Scatter(*maxs[r], slots, count, _mm_add_ps(center, extent));
+			}
+		}
+
+	private:
+		//local trs
+		std::vector<float> pos_x, pos_y, pos_z;
+		std::vector<float> rot_x, rot_y, rot_z, rot_w;
+		std::vector<float> scale_x, scale_y, scale_z;
+
+		std::vector<glm::mat4> world; //what the renderobjects copy into their per frame model matrices
+
+		//model space bounds of the slots mesh, cached when its added
+		std::vector<float> local_center_x, local_center_y, local_center_z, local_radius;
+		std::vector<float> local_boxcenter_x, local_boxcenter_y, local_boxcenter_z;
+		std::vector<float> local_extent_x, local_extent_y, local_extent_z;
+
+		std::vector<uint32_t> dirty; //slots set since the last refit
+		std::vector<uint8_t> dirty_flags; //so a slot set twice in a frame only goes on the list once
+		std::vector<uint8_t> live;
+		std::vector<uint32_t> refitted; //the dirty slots the last refit actually rebuilt
+	};
+
+}
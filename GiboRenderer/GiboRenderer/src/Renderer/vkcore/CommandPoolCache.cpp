@@ -88,6 +88,63 @@ namespace Gibo {
 				vkDestroyCommandPool(deviceref, Cache[2][0], nullptr);
 			}
 		}
+
+		for (int f = 0; f < thread_pools.size(); f++)
+		{
+			for (int t = 0; t < thread_pools[f].size(); t++)
+			{
+				vkDestroyCommandPool(deviceref, thread_pools[f][t].pool, nullptr);
+			}
+		}
+		thread_pools.clear();
+	}
+
+	void CommandPoolCache::CreateThreadPools(uint32_t threadcount, uint32_t framesinflight)
+	{
+		//transient since everything recorded from these lives for 1 frame. no reset bit because we reset the whole pool instead of single buffers
+		VkCommandPoolCreateInfo thread_info = {};
+		thread_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		thread_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		thread_info.queueFamilyIndex = family_indices[(int32_t)POOL_FAMILY::GRAPHICS];
+
+		thread_pools.resize(framesinflight);
+		for (uint32_t f = 0; f < framesinflight; f++)
+		{
+			thread_pools[f].resize(threadcount);
+			for (uint32_t t = 0; t < threadcount; t++)
+			{
+				VULKAN_CHECK(vkCreateCommandPool(deviceref, &thread_info, nullptr, &thread_pools[f][t].pool), "creating thread command pool");
+			}
+		}
+	}
+
+	VkCommandBuffer CommandPoolCache::GetSecondaryCommandBuffer(uint32_t thread, uint32_t frame)
+	{
+		ThreadPool& threadpool = thread_pools[frame][thread];
+		if (threadpool.used == threadpool.secondaries.size())
+		{
+			VkCommandBufferAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = threadpool.pool;
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			alloc_info.commandBufferCount = 1;
+
+			VkCommandBuffer secondary;
+			VULKAN_CHECK(vkAllocateCommandBuffers(deviceref, &alloc_info, &secondary), "allocating secondary command buffer");
+			threadpool.secondaries.push_back(secondary);
+		}
+
+		return threadpool.secondaries[threadpool.used++];
+	}
+
+	//gpu has to be done with every secondary from this frame
+	void CommandPoolCache::ResetThreadPools(uint32_t frame)
+	{
+		for (int t = 0; t < thread_pools[frame].size(); t++)
+		{
+			vkResetCommandPool(deviceref, thread_pools[frame][t].pool, 0);
+			thread_pools[frame][t].used = 0;
+		}
 	}
 
 	void CommandPoolCache::PrintInfo() const
@@ -109,6 +166,10 @@ namespace Gibo {
 				unique_pools += 3;
 			}
 		}
+		for (int f = 0; f < thread_pools.size(); f++)
+		{
+			unique_pools += thread_pools[f].size();
+		}
 		Logger::Log("-----CommandPoolCache-----\n", "pools created: ", unique_pools, "\n");
 	}
 
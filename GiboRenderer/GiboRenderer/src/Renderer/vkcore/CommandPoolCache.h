@@ -15,6 +15,10 @@ namespace Gibo {
 		helper pools are created with VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
 		dynamic pools are created with VK_COMMAND_POOL_CREATE_TRANSIENT_BIT and VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
 		static pools are created with no flags
+
+		Thread pools are for recording secondary command buffers in parallel. A pool can only be touched by one thread at a time, so every job system thread gets its own
+		graphics pool per frame in flight. Secondaries get handed out of those and the whole frames pools get reset at once when its fence comes back, so they get reused instead of freed.
+		Only the thread that owns the index should call GetSecondaryCommandBuffer with it.
 	*/
 	
 	enum class POOL_TYPE : int32_t { STATIC, DYNAMIC, HELPER };
@@ -36,8 +40,21 @@ namespace Gibo {
 		void Cleanup();
 		void PrintInfo() const;
 		VkCommandPool GetCommandPool(POOL_TYPE pooltype, POOL_FAMILY familyqueue);
+
+		void CreateThreadPools(uint32_t threadcount, uint32_t framesinflight);
+		VkCommandPool GetThreadCommandPool(uint32_t thread, uint32_t frame) { return thread_pools[frame][thread].pool; }
+		VkCommandBuffer GetSecondaryCommandBuffer(uint32_t thread, uint32_t frame);
+		void ResetThreadPools(uint32_t frame);
 	private:
+		struct ThreadPool
+		{
+			VkCommandPool pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> secondaries; //every secondary ever allocated from this pool
+			uint32_t used = 0; //how many of them were handed out since the last reset
+		};
+
 		std::array<std::array<VkCommandPool, 4>, 3> Cache;
+		std::vector<std::vector<ThreadPool>> thread_pools; //[frame][thread]
 		std::array<uint32_t, 4> family_indices;
 		VkDevice deviceref;
 	};
@@ -60,6 +60,83 @@ namespace Gibo {
 		}
 	};
 
+	//the QUANTIZED layout from VertexFormat.h. Locations match Vertex so the shaders declare one set of inputs, location 4 (bitangent) isn't stored so it just
+	//aliases the tangent and the shader ignores it and rebuilds the bitangent from the sign in position.w
+	struct QuantizedVertexDescription
+	{
+		static const uint32_t attribute_count = 5;
+
+		static VkVertexInputBindingDescription getBindingDescription()
+		{
+			VkVertexInputBindingDescription descript{};
+			descript.binding = 0;
+			descript.stride = sizeof(QuantizedVertex);
+			descript.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+			return descript;
+		}
+
+		static std::array<VkVertexInputAttributeDescription, attribute_count> getAttributeDescription()
+		{
+			//all of these are required vertex buffer formats so no support check is needed
+			std::array<VkVertexInputAttributeDescription, attribute_count> descripts = {};
+			descripts[0].binding = 0;
+			descripts[0].location = 0;
+			descripts[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+			descripts[0].offset = offsetof(QuantizedVertex, position);
+
+			descripts[1].binding = 0;
+			descripts[1].location = 1;
+			descripts[1].format = VK_FORMAT_R16G16_SNORM;
+			descripts[1].offset = offsetof(QuantizedVertex, normal);
+
+			descripts[2].binding = 0;
+			descripts[2].location = 2;
+			descripts[2].format = VK_FORMAT_R16G16_SFLOAT;
+			descripts[2].offset = offsetof(QuantizedVertex, uv);
+
+			descripts[3].binding = 0;
+			descripts[3].location = 3;
+			descripts[3].format = VK_FORMAT_R16G16_SNORM;
+			descripts[3].offset = offsetof(QuantizedVertex, tangent);
+
+			descripts[4].binding = 0;
+			descripts[4].location = 4;
+			descripts[4].format = VK_FORMAT_R16G16_SNORM;
+			descripts[4].offset = offsetof(QuantizedVertex, tangent);
+
+			return descripts;
+		}
+	};
+
+	//the de-interleaved position stream the depth and shadow passes read (MeshCache::Mesh::position_vbo). FULL meshes store xyz fp32, QUANTIZED ones the same
+	//4x16 unorm position as their interleaved vertex with w zeroed
+	struct PositionVertexDescription
+	{
+		static const uint32_t attribute_count = 1;
+
+		static VkVertexInputBindingDescription getBindingDescription(VERTEX_FORMAT format)
+		{
+			VkVertexInputBindingDescription descript{};
+			descript.binding = 0;
+			descript.stride = PositionStride(format);
+			descript.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+			return descript;
+		}
+
+		static std::array<VkVertexInputAttributeDescription, attribute_count> getAttributeDescription(VERTEX_FORMAT format)
+		{
+			std::array<VkVertexInputAttributeDescription, attribute_count> descripts = {};
+			descripts[0].binding = 0;
+			descripts[0].location = 0;
+			descripts[0].format = (format == VERTEX_FORMAT::QUANTIZED) ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+			descripts[0].offset = 0;
+
+			return descripts;
+		}
+	};
+
 	void PipelineCache::PrintDebug() const
 	{
 		Logger::Log("-----PipelineCache Info-----\n");
@@ -100,12 +177,25 @@ namespace Gibo {
 		VkPipelineLayout current_layout;
 
 		//specify the format of the vertex data like a vao
-		VkVertexInputBindingDescription bindingDescription                    = Vertex::getBindingDescription();
-		std::array<VkVertexInputAttributeDescription, Vertex::attribute_count> attributeDescription = Vertex::getAttributeDescription();
+		bool quantized = (data.VertexInputstate.format == VERTEX_FORMAT::QUANTIZED);
+		VkVertexInputBindingDescription bindingDescription;
+		std::vector<VkVertexInputAttributeDescription> attributeDescription;
+		if (data.VertexInputstate.position_only)
+		{
+			auto descripts = PositionVertexDescription::getAttributeDescription(data.VertexInputstate.format);
+			bindingDescription = PositionVertexDescription::getBindingDescription(data.VertexInputstate.format);
+			attributeDescription.assign(descripts.begin(), descripts.end());
+		}
+		else
+		{
+			auto descripts = (quantized) ? QuantizedVertexDescription::getAttributeDescription() : Vertex::getAttributeDescription();
+			bindingDescription = (quantized) ? QuantizedVertexDescription::getBindingDescription() : Vertex::getBindingDescription();
+			attributeDescription.assign(descripts.begin(), descripts.end());
+		}
 
 		VkPipelineVertexInputStateCreateInfo vertexinputinfo = {};
 		vertexinputinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexinputinfo.vertexAttributeDescriptionCount = Vertex::attribute_count;
+		vertexinputinfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
 		vertexinputinfo.pVertexAttributeDescriptions = attributeDescription.data(); //describe attributes, bindings, offsets
 		vertexinputinfo.vertexBindingDescriptionCount = 1;
 		vertexinputinfo.pVertexBindingDescriptions = &bindingDescription; //spacing between data
@@ -216,11 +306,32 @@ namespace Gibo {
 
 		VULKAN_CHECK(vkCreatePipelineLayout(deviceref, &layoutinfo, nullptr, &current_layout), "creating pipeline layout");
 
+		//quantized pipelines tell the vertex shader to decode through a specialization constant. Only set for them so shaders that use constant id 0 for something else
+		//keep working, and a shader that doesn't declare it just ignores the entry
+		std::vector<VkPipelineShaderStageCreateInfo> stages = moduleinfo;
+		VkBool32 quantized_constant = VK_TRUE;
+		VkSpecializationMapEntry specialization_entry = { VERTEX_FORMAT_CONSTANT_ID, 0, sizeof(VkBool32) };
+		VkSpecializationInfo specialization = {};
+		specialization.mapEntryCount = 1;
+		specialization.pMapEntries = &specialization_entry;
+		specialization.dataSize = sizeof(VkBool32);
+		specialization.pData = &quantized_constant;
+		if (quantized)
+		{
+			for (auto& stage : stages)
+			{
+				if (stage.stage == VK_SHADER_STAGE_VERTEX_BIT)
+				{
+					stage.pSpecializationInfo = &specialization;
+				}
+			}
+		}
+
 		//create the graphicspipelinecreateinfo and add everything to the monolithic struct
 		VkGraphicsPipelineCreateInfo pipelineInfo = {};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = moduleinfo.size();
-		pipelineInfo.pStages = moduleinfo.data();
+		pipelineInfo.stageCount = stages.size();
+		pipelineInfo.pStages = stages.data();
 
 		pipelineInfo.pVertexInputState = &vertexinputinfo;
 		pipelineInfo.pInputAssemblyState = &assemblyinfo;
@@ -1,5 +1,6 @@
 #pragma once
 #include "../../pch.h"
+#include "VertexFormat.h"
 
 namespace Gibo {
 	/*
@@ -7,7 +8,9 @@ namespace Gibo {
 		This cache handles building graphics/compute pipelines and storing them in just a vector. It also has a nice interfact of structs to pass in information you want.
 		It also handles all the memory management.
 
-		This is also where the shader vertex attributes are defined which every shader needs to follow for now (in the cpp file)
+		This is also where the shader vertex attributes are defined which every shader needs to follow for now (in the cpp file). VertexInput picks between the FULL and QUANTIZED
+		layouts, quantized pipelines also get the VERTEX_FORMAT_CONSTANT_ID specialization constant set on their vertex stage so the shader knows to decode.
+		position_only pipelines read just the position stream (location 0) in either format
 		dynamic states are not supported for pipelines right now
 		todo - research more about pipeline caches to reduce start_time
 
@@ -61,6 +64,10 @@ namespace Gibo {
 	struct InputAssembly {
 		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	};
+	struct VertexInput {
+		VERTEX_FORMAT format = VERTEX_FORMAT::FULL;
+		bool position_only = false; //only location 0 from the meshes separate position stream, for passes that don't shade
+	};
 	struct PipelineData
 	{
 		RasterizationState Rasterizationstate;
@@ -69,6 +76,7 @@ namespace Gibo {
 		ColorBlendState ColorBlendstate;
 		ViewPortState ViewPortstate;
 		InputAssembly Inputassembly;
+		VertexInput VertexInputstate;
 
 		PipelineData(float swapchainwidth, float swapchainheight)
 		{
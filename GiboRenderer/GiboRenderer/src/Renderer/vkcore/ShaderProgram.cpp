@@ -268,6 +268,22 @@ namespace Gibo {
 		}
 	}
 	
+	void ShaderProgram::UpdateLocalDescriptor(uint32_t descriptor_id, int frameinflight, std::vector<vkcoreBuffer>& uniformbuffers, std::vector<uint64_t>& buffersizes,
+		                                  std::vector<VkImageView>& imageviews, std::vector<VkSampler>& samplers, std::vector<VkBufferView>& bufferviews)
+	{
+#ifdef _DEBUG
+		if (DescriptorSets.count(descriptor_id) == 0)
+		{
+			Logger::LogError("updating local descriptor that doesn't exist\n");
+		}
+#endif
+		if (uniformbuffers.size() + imageviews.size() != LocalDescriptorInfo.size())
+		{
+			Logger::LogWarning("local descriptor arrays don't match size of programs descriptorlayout\n");
+		}
+		UpdateDescriptorSet(DescriptorSets[descriptor_id][frameinflight], LocalDescriptorInfo, uniformbuffers.data(), buffersizes.data(), imageviews.data(), samplers.data(), bufferviews.data());
+	}
+
 	void ShaderProgram::RemoveLocalDescriptor(uint32_t descriptor_id)
 	{
 #ifdef _DEBUG
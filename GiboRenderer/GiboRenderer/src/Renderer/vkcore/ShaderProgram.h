@@ -74,6 +74,9 @@ namespace Gibo {
 		void AddLocalDescriptor(uint32_t descriptor_id, std::vector<std::vector<vkcoreBuffer>>& uniformbuffers, std::vector<std::vector<uint64_t>>& buffersizes,
 			               std::vector<std::vector<VkImageView>>& imageviews, std::vector<std::vector<VkSampler>>& samplers, std::vector<std::vector<VkBufferView>>& bufferviews);
 		void RemoveLocalDescriptor(uint32_t descriptor_id);
+		//rewrites one frames set of an id thats already added, only once that frame is done on the gpu
+		void UpdateLocalDescriptor(uint32_t descriptor_id, int frameinflight, std::vector<vkcoreBuffer>& uniformbuffers, std::vector<uint64_t>& buffersizes, std::vector<VkImageView>& imageviews,
+			                       std::vector<VkSampler>& samplers, std::vector<VkBufferView>& bufferviews);
 
 		VkDescriptorSetLayout& GetLocalLayout() { return LocalLayout; }
 		VkDescriptorSetLayout& GetGlobalLayout() { return GlobalLayout; }
@@ -82,7 +85,13 @@ namespace Gibo {
 		std::vector<VkShaderModule> GetShaderModules() { return ShaderModules; }
 		std::vector<VkPipelineShaderStageCreateInfo> GetShaderStageInfo() { return ShaderStageInfo; }
 		VkDescriptorSet& GetGlobalDescriptor(int frameinflight) { return GlobalSet[frameinflight]; }
-		VkDescriptorSet& GetLocalDescriptor(uint32_t descriptor_id, int frameinflight) { return DescriptorSets[descriptor_id][frameinflight]; }
+		//lookups never insert, workers call these at once while recording secondaries. The id has to be added for Get, Find gives nullptr when it isn't
+		const VkDescriptorSet& GetLocalDescriptor(uint32_t descriptor_id, int frameinflight) const { return DescriptorSets.at(descriptor_id)[frameinflight]; }
+		const VkDescriptorSet* FindLocalDescriptor(uint32_t descriptor_id, int frameinflight) const
+		{
+			auto sets = DescriptorSets.find(descriptor_id);
+			return (sets != DescriptorSets.end()) ? &sets->second[frameinflight] : nullptr;
+		}
 		int GetLocalDescriptorSize() { return DescriptorSets.size(); }
 		std::vector<VkPushConstantRange>& GetPushRanges() { return Push_ConstantRanges; }
 
@@ -0,0 +1,111 @@
+#pragma once
+#include <glm/gtc/packing.hpp>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace Gibo {
+
+	/*
+	 Vertex layouts a mesh can be stored in on the gpu, picked per mesh when its imported.
+
+	 FULL      56 bytes - position, normal, uv, tangent, bitangent all fp32. What assimp gives us and what the .gmesh cache stores.
+	 QUANTIZED 20 bytes - position  4x16 unorm relative to the meshes aabb, w holds the bitangent sign (0 = -1, 1 = +1)
+						  normal    2x16 snorm octahedral
+						  tangent   2x16 snorm octahedral, the bitangent is cross(normal, tangent) * sign
+						  uv        2x16 half float
+	 Quantized is ~2.8x smaller and every pass fetches less, the error is ~1/65535 of the aabb for positions and well under a degree for the frame. Half uvs lose precision
+	 above ~2048 so meshes with big tiled uvs should stay FULL.
+
+	 Every mesh pass has a pipeline per format (PipelineData::VertexInput picks the attribute descriptions) and the vertex shaders decode with a specialization constant, so
+	 both pipelines run the same spv. The shaders always rebuild position as position_min + in_position * position_extent from the VertexDecodeConstants push constant,
+	 FULL meshes push min 0 extent 1 so that's a no-op for them.
+	*/
+	enum class VERTEX_FORMAT : uint32_t { FULL = 0, QUANTIZED = 1 };
+	static const uint32_t VERTEX_FORMAT_COUNT = 2;
+
+	//specialization constant id the vertex shaders read the format from
+	static const uint32_t VERTEX_FORMAT_CONSTANT_ID = 0;
+
+	struct QuantizedVertex
+	{
+		uint16_t position[4];
+		int16_t normal[2];
+		int16_t tangent[2];
+		uint16_t uv[2];
+	};
+	static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex has to match the attribute descriptions in PipelineCache");
+
+	//pushed at offset 0 of the vertex stage before every mesh draw
+	struct VertexDecodeConstants
+	{
+		glm::vec4 position_min = glm::vec4(0.0f);
+		glm::vec4 position_extent = glm::vec4(1.0f);
+	};
+
+	inline uint32_t VertexStride(VERTEX_FORMAT format)
+	{
+		return (format == VERTEX_FORMAT::QUANTIZED) ? sizeof(QuantizedVertex) : sizeof(float) * 14;
+	}
+
+	//stride of the position only stream the depth and shadow passes bind, xyz fp32 for FULL and the 4x16 unorm position for QUANTIZED
+	inline uint32_t PositionStride(VERTEX_FORMAT format)
+	{
+		return (format == VERTEX_FORMAT::QUANTIZED) ? sizeof(uint16_t) * 4 : sizeof(float) * 3;
+	}
+
+	//octahedral encoding, folds the unit sphere onto a square so 2 values keep a direction with even precision everywhere
+	inline void EncodeOctahedral(glm::vec3 n, int16_t out[2])
+	{
+		float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (length > 0.0f) n /= length;
+		else n = glm::vec3(0.0f, 0.0f, 1.0f);
+
+		glm::vec2 e(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			e.x = (1.0f - std::abs(n.y)) * ((n.x >= 0.0f) ? 1.0f : -1.0f);
+			e.y = (1.0f - std::abs(n.x)) * ((n.y >= 0.0f) ? 1.0f : -1.0f);
+		}
+		out[0] = static_cast<int16_t>(glm::packSnorm1x16(e.x));
+		out[1] = static_cast<int16_t>(glm::packSnorm1x16(e.y));
+	}
+
+	//aabb the positions get quantized against. flat axes get a tiny extent so the divide stays finite
+	inline VertexDecodeConstants MakeVertexDecodeConstants(const glm::vec3& boxmin, const glm::vec3& boxmax)
+	{
+		VertexDecodeConstants constants;
+		constants.position_min = glm::vec4(boxmin, 0.0f);
+		constants.position_extent = glm::vec4(glm::max(boxmax - boxmin, glm::vec3(1e-6f)), 0.0f);
+		return constants;
+	}
+
+	//fullvertices is the 14 float FULL layout, out has to have room for vertexcount vertices
+	inline void QuantizeVertices(const float* fullvertices, size_t vertexcount, const VertexDecodeConstants& decode, QuantizedVertex* out)
+	{
+		glm::vec3 boxmin(decode.position_min);
+		glm::vec3 inverse_extent = 1.0f / glm::vec3(decode.position_extent);
+		for (size_t i = 0; i < vertexcount; i++)
+		{
+			const float* v = fullvertices + i * 14;
+			QuantizedVertex& q = out[i];
+
+			glm::vec3 p = glm::clamp((glm::vec3(v[0], v[1], v[2]) - boxmin) * inverse_extent, 0.0f, 1.0f);
+			q.position[0] = static_cast<uint16_t>(std::lround(p.x * 65535.0f));
+			q.position[1] = static_cast<uint16_t>(std::lround(p.y * 65535.0f));
+			q.position[2] = static_cast<uint16_t>(std::lround(p.z * 65535.0f));
+
+			glm::vec3 normal(v[3], v[4], v[5]);
+			glm::vec3 tangent(v[8], v[9], v[10]);
+			glm::vec3 bitangent(v[11], v[12], v[13]);
+			q.position[3] = (glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f) ? 0 : 65535;
+
+			EncodeOctahedral(normal, q.normal);
+			EncodeOctahedral(tangent, q.tangent);
+
+			q.uv[0] = static_cast<uint16_t>(glm::packHalf1x16(v[6]));
+			q.uv[1] = static_cast<uint16_t>(glm::packHalf1x16(v[7]));
+		}
+	}
+
+}
@@ -36,7 +36,8 @@ namespace Gibo {
 		}
 	}
 
-	static VkImageView CreateImageView(VkDevice LogicalDevice, VkImage image, VkFormat format, VkImageAspectFlags aspectmask, uint32_t miplevels, int layercount, VkImageViewType viewtype)
+	static VkImageView CreateImageView(VkDevice LogicalDevice, VkImage image, VkFormat format, VkImageAspectFlags aspectmask, uint32_t miplevels, int layercount, VkImageViewType viewtype,
+		                               uint32_t basemiplevel = 0)
 	{
 		VkImageView view;
 		VkImageViewCreateInfo viewInfo = {};
@@ -45,7 +46,7 @@ namespace Gibo {
 		viewInfo.viewType = viewtype;
 		viewInfo.format = format;
 		viewInfo.subresourceRange.aspectMask = aspectmask;
-		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.baseMipLevel = basemiplevel;
 		viewInfo.subresourceRange.levelCount = miplevels;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
 		viewInfo.subresourceRange.layerCount = layercount;
@@ -118,9 +119,13 @@ namespace Gibo {
 	//make sure buffer we are copying from has VK_BUFFER_USAGE_TRANSFER_SRC_BIT and the buffer we are copying into has VK_BUFFER_USAGE_TRANSFER_DST_BIT
 	//dstbufferaccess is what the memory is currently being accesed for, dstpipelinestage is what stage it is last being used by, maybe just do bottom_bit, or vertex_input_bit
 	static void CopyBufferToBuffer(vkcoreDevice& device, VkBuffer srcbuffer, VkBuffer dstbuffer, VkAccessFlags dstcurrentacces, VkPipelineStageFlags dstcurrentpipelinestage,
-											VkDeviceSize srcoffset, VkDeviceSize dstoffset, VkDeviceSize sizetocopy)
+											VkDeviceSize srcoffset, VkDeviceSize dstoffset, VkDeviceSize sizetocopy, VkCommandBuffer incmdbuffer = VK_NULL_HANDLE)
 	{
-		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		VkCommandBuffer commandBuffer = incmdbuffer;
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			commandBuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		}
 
 		//transition dst buffer from whatever it was to a transfer write
 		VkBufferMemoryBarrier barrier = {};
@@ -130,7 +135,7 @@ namespace Gibo {
 		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		barrier.buffer = dstbuffer;
-		barrier.offset = 0;
+		barrier.offset = dstoffset;
 		barrier.size = sizetocopy;
 		VkPipelineStageFlags srcstage = dstcurrentpipelinestage;
 		VkPipelineStageFlags dststage = VK_PIPELINE_STAGE_TRANSFER_BIT;
@@ -153,7 +158,10 @@ namespace Gibo {
 		vkCmdPipelineBarrier(commandBuffer, srcstage, dststage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
 
 
-		device.submitSingleTimeCommands(commandBuffer, POOL_FAMILY::TRANSFER);
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			device.submitSingleTimeCommands(commandBuffer, POOL_FAMILY::TRANSFER);
+		}
 	}
 
 	//make sure image has usage VK_BUFFER_USAGE_TRANSFER_SRC_BIT and image layout is VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL and buffer has VK_BUFFER_USAGE_TRANSFER_DST_BIT
@@ -207,9 +215,14 @@ namespace Gibo {
 
 	//make sure buffer has VK_BUFFER_USAGE_TRANSFER_SRC_BIT and image has VK_BUFFER_USAGE_TRANSFER_DST_BIT and VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 	static void CopyBufferToImage(vkcoreDevice& device, VkImage dstimage, VkBuffer srcbuffer, VkImageLayout dstlayoutcurrent, VkImageLayout dstlayoutfinaldesired, VkAccessFlags dstimageaccess, VkAccessFlags srcimageaccess, VkPipelineStageFlags dstpipelinestage,
-		                                   uint32_t width, uint32_t height, VkImageAspectFlags aspectflags, uint32_t miplevels, int layercount)
+		                                   uint32_t width, uint32_t height, VkImageAspectFlags aspectflags, uint32_t miplevels, int layercount,
+		                                   VkDeviceSize bufferoffset = 0, VkCommandBuffer incmdbuffer = VK_NULL_HANDLE)
 	{
-		VkCommandBuffer commandBuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		VkCommandBuffer commandBuffer = incmdbuffer;
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			commandBuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		}
 
 		VkImageMemoryBarrier imagebarrier = {};
 		imagebarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -229,7 +242,7 @@ namespace Gibo {
 		VkPipelineStageFlags dststage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
 		VkBufferImageCopy copy = {};
-		copy.bufferOffset = 0;
+		copy.bufferOffset = bufferoffset;
 		copy.bufferRowLength = 0;
 		copy.bufferImageHeight = 0;
 		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -256,7 +269,10 @@ namespace Gibo {
 
 		vkCmdPipelineBarrier(commandBuffer, srcstage, dststage, 0, 0, nullptr, 0, nullptr, 1, &imagebarrier);
 
-		device.submitSingleTimeCommands(commandBuffer, POOL_FAMILY::TRANSFER);
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			device.submitSingleTimeCommands(commandBuffer, POOL_FAMILY::TRANSFER);
+		}
 	}
 
 	//make sure image we are copying from has VK_BUFFER_USAGE_TRANSFER_SRC_BIT and VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL 
@@ -328,9 +344,13 @@ namespace Gibo {
 	}
 
 	//make sure image is supported with VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
-	static void generateMipmaps(vkcoreDevice& device, VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkImageLayout finallayout)
+	static void generateMipmaps(vkcoreDevice& device, VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkImageLayout finallayout, VkCommandBuffer incmdbuffer = VK_NULL_HANDLE)
 	{
-		VkCommandBuffer commandbuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		VkCommandBuffer commandbuffer = incmdbuffer;
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			commandbuffer = device.beginSingleTimeCommands(POOL_FAMILY::TRANSFER);
+		}
 
 		VkImageMemoryBarrier barrier = {};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -390,7 +410,10 @@ namespace Gibo {
 
 		vkCmdPipelineBarrier(commandbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-		device.submitSingleTimeCommands(commandbuffer, POOL_FAMILY::TRANSFER);
+		if (incmdbuffer == VK_NULL_HANDLE)
+		{
+			device.submitSingleTimeCommands(commandbuffer, POOL_FAMILY::TRANSFER);
+		}
 	}
 
 	//vkCmdResolveImage - Resolves a multisamplingimage to a non-multisampling image
@@ -84,6 +84,10 @@ namespace Gibo {
 		allocatorInfo.pHeapSizeLimit;
 		allocatorInfo.preferredLargeHeapBlockSize;
 		//allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+		if (memorybudget)
+		{
+			allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
 
 		auto result = vmaCreateAllocator(&allocatorInfo, &Allocator);
 		VULKAN_CHECK(result, "creating vma allocator");
@@ -301,10 +305,65 @@ namespace Gibo {
 		if (features.fragmentStoresAndAtomics == FALSE) { Logger::LogWarning("device doesn't have fragmentStoresAndAtomics"); }
 		if (features.imageCubeArray == FALSE) { Logger::LogWarning("device doesn't have imageCubeArray"); }
 
+		//gpu driven drawing wants the indirect count draws (core only from 1.2) plus more than one draw per indirect call and a firstInstance in them. All optional,
+		//without them the renderer just keeps culling and batching on the cpu
+		deviceFeatures.multiDrawIndirect = features.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = features.drawIndirectFirstInstance;
+		//block compressed textures, without it the texture cache keeps everything rgba8
+		deviceFeatures.textureCompressionBC = features.textureCompressionBC;
+		blockcompression = (features.textureCompressionBC == VK_TRUE);
+		if (!blockcompression) { Logger::LogWarning("device doesn't have textureCompressionBC"); }
+
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &extensionCount, extensions.data());
+		bool indirectcount = false;
+		bool descriptorindexingext = false;
+		for (int i = 0; i < extensions.size(); i++) {
+			if (strcmp(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, extensions[i].extensionName) == 0) {
+				indirectcount = true;
+			}
+			//lets vma ask the driver how much vram we can actually use, the texture streaming sizes itself off it
+			if (strcmp(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, extensions[i].extensionName) == 0) {
+				memorybudget = true;
+			}
+			if (strcmp(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, extensions[i].extensionName) == 0) {
+				descriptorindexingext = true;
+			}
+		}
+		if (!indirectcount) { Logger::LogWarning("device doesn't have VK_KHR_draw_indirect_count"); }
+		if (!memorybudget) { Logger::LogWarning("device doesn't have VK_EXT_memory_budget"); }
+		if (features.multiDrawIndirect == FALSE) { Logger::LogWarning("device doesn't have multiDrawIndirect"); }
+		if (features.drawIndirectFirstInstance == FALSE) { Logger::LogWarning("device doesn't have drawIndirectFirstInstance"); }
+
+		//bindless materials index one big partially bound sampler array with a per instance material id, so they need runtime sized arrays and non uniform indexing.
+		//Optional too, without it every object keeps its own pbr descriptor set
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		if (descriptorindexingext)
+		{
+			VkPhysicalDeviceFeatures2 features2 = {};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &indexingFeatures;
+			vkGetPhysicalDeviceFeatures2(PhysicalDevice, &features2);
+			descriptorindexing = indexingFeatures.runtimeDescriptorArray && indexingFeatures.shaderSampledImageArrayNonUniformIndexing && indexingFeatures.descriptorBindingPartiallyBound;
+		}
+		if (!descriptorindexing) { Logger::LogWarning("device doesn't have VK_EXT_descriptor_indexing with runtime arrays, non uniform indexing and partially bound"); }
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabledIndexing = {};
+		enabledIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		enabledIndexing.runtimeDescriptorArray = VK_TRUE;
+		enabledIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		enabledIndexing.descriptorBindingPartiallyBound = VK_TRUE;
+		if (descriptorindexing) resetFeatures.pNext = &enabledIndexing;
+
 		//pick which physical device extension we need to support
-		const std::vector<const char*> deviceExtensions = {
+		std::vector<const char*> deviceExtensions = {
 			"VK_KHR_swapchain"
 		};
+		if (indirectcount) deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		if (memorybudget) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (descriptorindexing) deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
 
 		VkDeviceCreateInfo info{};
 		info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -339,6 +398,12 @@ namespace Gibo {
 		vkGetDeviceQueue(LogicalDevice, computefamily, 0, &ComputeQueue);
 		vkGetDeviceQueue(LogicalDevice, transferfamily, 0, &TransferQueue);
 
+		//extension functions aren't exported by the loader, grab it from the device
+		if (indirectcount && features.multiDrawIndirect && features.drawIndirectFirstInstance)
+		{
+			cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(LogicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+		}
+
 		return true;
 	}
 
@@ -680,6 +745,25 @@ namespace Gibo {
 		return info;
 	}
 
+	void vkcoreDevice::GetDeviceLocalBudget(VkDeviceSize& usage, VkDeviceSize& budget)
+	{
+		const VkPhysicalDeviceMemoryProperties* properties;
+		vmaGetMemoryProperties(Allocator, &properties);
+		VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+		vmaGetBudget(Allocator, budgets);
+
+		usage = 0;
+		budget = 0;
+		for (uint32_t i = 0; i < properties->memoryHeapCount; i++)
+		{
+			if (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			{
+				usage += budgets[i].usage;
+				budget += budgets[i].budget;
+			}
+		}
+	}
+
 	bool vkcoreDevice::CreateImage(VkImageType image_type, VkFormat Format, VkImageUsageFlags usage, VkSampleCountFlagBits samplecount, uint32_t width, uint32_t height, uint32_t depth,
 		uint32_t mip_levels, uint32_t array_layers, VmaMemoryUsage memusage, VmaAllocationCreateFlags mapped_bit_flag, vkcoreImage& vkimage)
 	{
@@ -81,6 +81,8 @@ namespace Gibo {
 		void* GetBufferData(VmaAllocation allocation, size_t size);
 		void UnMapBuffer(VmaAllocation allocation);
 		VmaAllocationInfo GetAllocationInfo(VmaAllocation allocation);
+		//vma budget summed over the device local heaps. Real numbers from the driver with VK_EXT_memory_budget, vmas estimate (80% of the heaps) without it
+		void GetDeviceLocalBudget(VkDeviceSize& usage, VkDeviceSize& budget);
 
 		VkCommandBuffer beginSingleTimeCommands(POOL_FAMILY familyoperation);
 		void submitSingleTimeCommands(VkCommandBuffer buffer, POOL_FAMILY familyoperation);
@@ -103,6 +105,16 @@ namespace Gibo {
 		VkImage GetswapchainImage(int x) { return swapChainImages[x]; }
 		VkImageView GetswapchainView(int x) { return swapChainImageViews[x]; }
 		int GetSwapChainImageCount() { return swapChainImages.size(); }
+		//vkCmdDrawIndexedIndirectCount with multi draw and firstInstance, false if any of it is missing
+		bool SupportsDrawIndirectCount() const { return cmdDrawIndexedIndirectCount != nullptr; }
+		bool SupportsMemoryBudget() const { return memorybudget; }
+		bool SupportsBC() const { return blockcompression; }
+		//VK_EXT_descriptor_indexing with runtime arrays, non uniform sampler indexing and partially bound bindings
+		bool SupportsBindless() const { return descriptorindexing; }
+		void CmdDrawIndexedIndirectCount(VkCommandBuffer cmd, VkBuffer buffer, VkDeviceSize offset, VkBuffer countbuffer, VkDeviceSize countoffset, uint32_t maxdrawcount, uint32_t stride)
+		{
+			cmdDrawIndexedIndirectCount(cmd, buffer, offset, countbuffer, countoffset, maxdrawcount, stride);
+		}
 		VkQueue GetQueue(POOL_FAMILY family)
 		{
 			switch (family)
@@ -147,6 +159,11 @@ namespace Gibo {
 		VkQueue ComputeQueue;
 		VkQueue TransferQueue;
 
+		PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+		bool memorybudget = false;
+		bool blockcompression = false;
+		bool descriptorindexing = false;
+
 		uint32_t buffer_allocations = 0;
 		uint32_t image_allocations = 0;
 	};
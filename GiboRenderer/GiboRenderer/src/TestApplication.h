@@ -28,45 +28,71 @@ public:
 
 	void mainloop()
 	{
-		//preload mesh and texture data
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/uvsphere.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/teapot.fbx");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/cyborg/cyborg.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/cube.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/stanford-bunny.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/monkeyhead.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/torus.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/cyber/0.stl");
-
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/fence.fbx");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/fence2.fbx");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/mount.blend1.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/fence_01_obj.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/mountain.obj");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/Stair.fbx");
-		Renderer.GetMeshCache()->LoadMeshFromFile("Models/house.obj");
+		//preload mesh and texture data. everything decodes on the job system workers and uploads in a couple of batched transfer submits
+		AssetLoader loader(*Renderer.GetDevice(), Renderer.GetJobSystem(), *Renderer.GetMeshCache(), *Renderer.GetTextureCache());
+		loader.QueueMesh("Models/uvsphere.obj");
+		loader.QueueMesh("Models/teapot.fbx");
+		loader.QueueMesh("Models/cyborg/cyborg.obj");
+		loader.QueueMesh("Models/cube.obj");
+		loader.QueueMesh("Models/stanford-bunny.obj", VERTEX_FORMAT::QUANTIZED);
+		loader.QueueMesh("Models/monkeyhead.obj");
+		loader.QueueMesh("Models/torus.obj");
+		loader.QueueMesh("Models/cyber/0.stl", VERTEX_FORMAT::QUANTIZED);
+
+		loader.QueueMesh("Models/fence.fbx");
+		loader.QueueMesh("Models/fence2.fbx");
+		loader.QueueMesh("Models/mount.blend1.obj");
+		loader.QueueMesh("Models/fence_01_obj.obj");
+		loader.QueueMesh("Models/mountain.obj", VERTEX_FORMAT::QUANTIZED);
+		loader.QueueMesh("Models/Stair.fbx");
+		loader.QueueMesh("Models/house.obj");
+
+		loader.QueueTexture("Images/missingtexture.png", true);
+		loader.QueueTexture("Images/uvmap2.png", true);
+		loader.QueueTexture("Images/HexNormal.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/Rocks.png", true);
+		loader.QueueTexture("Images/RocksHeight.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/brickwall.jpg", true);
+		loader.QueueTexture("Images/brick_normalup.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/stones.png", true);
+		loader.QueueTexture("Images/stones_NM_height.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/Triangles.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/Pattern.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/concrete_d.jpg", true);
+		loader.QueueTexture("Images/concrete_n.jpg", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Images/concrete_s.jpg", false, TEXTURE_USAGE::GRAYSCALE);
+		loader.QueueTexture("Images/bucaneers.png", true);
+		loader.QueueTexture("Images/window1.png", true);
+		loader.QueueTexture("Images/grass1.png", true);
+
+		loader.QueueTexture("Models/cyborg/cyborg_normal.png", false, TEXTURE_USAGE::NORMAL);
+		loader.QueueTexture("Models/cyborg/cyborg_diffuse.png", false);
+		loader.QueueTexture("Models/cyborg/cyborg_specular.png", false, TEXTURE_USAGE::GRAYSCALE);
+
+		loader.Submit();
+		loader.Wait();
 
 		vkcoreTexture defaulttexture = Renderer.GetTextureCache()->Get2DTexture("Images/missingtexture.png", true);
 		vkcoreTexture uvmap2texture = Renderer.GetTextureCache()->Get2DTexture("Images/uvmap2.png", true);
-		vkcoreTexture hexnormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/HexNormal.png", false);
+		vkcoreTexture hexnormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/HexNormal.png", false, TEXTURE_USAGE::NORMAL);
 		vkcoreTexture rocktexture = Renderer.GetTextureCache()->Get2DTexture("Images/Rocks.png", true);
-		vkcoreTexture rocknormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/RocksHeight.png", false);
+		vkcoreTexture rocknormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/RocksHeight.png", false, TEXTURE_USAGE::NORMAL);
 		vkcoreTexture bricktexture = Renderer.GetTextureCache()->Get2DTexture("Images/brickwall.jpg", true);
-		vkcoreTexture bricknormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/brick_normalup.png", false);
+		vkcoreTexture bricknormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/brick_normalup.png", false, TEXTURE_USAGE::NORMAL);
 		vkcoreTexture stonetexture = Renderer.GetTextureCache()->Get2DTexture("Images/stones.png", true);
-		vkcoreTexture stonenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/stones_NM_height.png", false);
-		vkcoreTexture trianglenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/Triangles.png", false);
-		vkcoreTexture patternnormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/Pattern.png", false);
+		vkcoreTexture stonenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/stones_NM_height.png", false, TEXTURE_USAGE::NORMAL);
+		vkcoreTexture trianglenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/Triangles.png", false, TEXTURE_USAGE::NORMAL);
+		vkcoreTexture patternnormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/Pattern.png", false, TEXTURE_USAGE::NORMAL);
 		vkcoreTexture concretetexture = Renderer.GetTextureCache()->Get2DTexture("Images/concrete_d.jpg", true);
-		vkcoreTexture concretenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/concrete_n.jpg", false);
-		vkcoreTexture concretespeculartexture = Renderer.GetTextureCache()->Get2DTexture("Images/concrete_s.jpg", false);
+		vkcoreTexture concretenormaltexture = Renderer.GetTextureCache()->Get2DTexture("Images/concrete_n.jpg", false, TEXTURE_USAGE::NORMAL);
+		vkcoreTexture concretespeculartexture = Renderer.GetTextureCache()->Get2DTexture("Images/concrete_s.jpg", false, TEXTURE_USAGE::GRAYSCALE);
 		vkcoreTexture bucaneertexture = Renderer.GetTextureCache()->Get2DTexture("Images/bucaneers.png", true);
 		vkcoreTexture windowtexture = Renderer.GetTextureCache()->Get2DTexture("Images/window1.png", true);
 		vkcoreTexture grasstexture = Renderer.GetTextureCache()->Get2DTexture("Images/grass1.png", true);
 
-		vkcoreTexture cyborgnormal = Renderer.GetTextureCache()->Get2DTexture("Models/cyborg/cyborg_normal.png", false);
+		vkcoreTexture cyborgnormal = Renderer.GetTextureCache()->Get2DTexture("Models/cyborg/cyborg_normal.png", false, TEXTURE_USAGE::NORMAL);
 		vkcoreTexture cyborgabledo = Renderer.GetTextureCache()->Get2DTexture("Models/cyborg/cyborg_diffuse.png", false);
-		vkcoreTexture cyborgspecular = Renderer.GetTextureCache()->Get2DTexture("Models/cyborg/cyborg_specular.png", false);
+		vkcoreTexture cyborgspecular = Renderer.GetTextureCache()->Get2DTexture("Models/cyborg/cyborg_specular.png", false, TEXTURE_USAGE::GRAYSCALE);
 
 		//OBJECTS
 		RenderObject* teapot = Renderer.GetObjectManager()->CreateRenderObject(Renderer.GetDevice(), uvmap2texture);
@@ -97,6 +123,7 @@ public:
 		floor->GetMaterial().SetReflectance(.4);
 		floor->GetMaterial().SetRoughness(0.4f);
 		floor->SetTransformation(glm::vec3(0, 0, 0), glm::vec3(100, 100, 100), RenderObject::ROTATE_DIMENSION::XANGLE, -90);
+		floor->SetOccluder(true);
 
 		RenderObject* plane1 = Renderer.GetObjectManager()->CreateRenderObject(Renderer.GetDevice(), rocktexture);
 		Renderer.GetMeshCache()->SetQuadMesh(plane1->GetMesh());
@@ -185,6 +212,7 @@ public:
 		Renderer.GetMeshCache()->SetObjectMesh("Models/mountain.obj", mountain1->GetMesh());
 		mountain1->GetMaterial().SetAlbedo(glm::vec3(.8, .8, .8));
 		mountain1->SetTransformation(glm::vec3(-60, 1, 70), glm::vec3(2, 2, 2), RenderObject::ROTATE_DIMENSION::XANGLE, 0);
+		mountain1->SetOccluder(true);
 
 		RenderObject* sphere_metal = Renderer.GetObjectManager()->CreateRenderObject(Renderer.GetDevice(), rocktexture);
 		Renderer.GetMeshCache()->SetObjectMesh("Models/uvsphere.obj", sphere_metal->GetMesh());
@@ -288,6 +316,7 @@ public:
 		Renderer.GetMeshCache()->SetObjectMesh("Models/house.obj", house->GetMesh());
 		house->GetMaterial().SetAlbedo(glm::vec3(.8, .8, .8));
 		house->SetTransformation(glm::vec3(0, 0, -65), glm::vec3(0.05, 0.05, 0.05), RenderObject::ROTATE_DIMENSION::XANGLE, -90);
+		house->SetOccluder(true);
 		
 		Renderer.AddRenderObject(teapot, RenderObjectManager::BIN_TYPE::REGULAR);
 		Renderer.AddRenderObject(sphere, RenderObjectManager::BIN_TYPE::REGULAR);
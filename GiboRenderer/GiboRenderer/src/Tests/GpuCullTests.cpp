@@ -0,0 +1,144 @@
+#include "../pch.h"
+#include "UnitTests.h"
+#include "../Renderer/GpuCulling.h"
+
+namespace Gibo {
+
+	//camera at the origin looking down -z, a 20x20 box around the axis from the near plane at 0.1 to 100. planes[4] is the near plane, the lod depth is measured from it
+	static GpuCullPass MakeTestPass(uint32_t stream, bool camera, float pixels_per_unit)
+	{
+		GpuCullPass pass;
+		pass.planes[0] = glm::vec4(1, 0, 0, 10);
+		pass.planes[1] = glm::vec4(-1, 0, 0, 10);
+		pass.planes[2] = glm::vec4(0, 1, 0, 10);
+		pass.planes[3] = glm::vec4(0, -1, 0, 10);
+		pass.planes[4] = glm::vec4(0, 0, -1, -0.1f);
+		pass.planes[5] = glm::vec4(0, 0, 1, 100);
+		pass.lod = glm::vec4(pixels_per_unit, 1.0f, 8.0f, 0.0f);
+		pass.info = glm::uvec4(stream, (camera) ? 1 : 0, 0, 0);
+		return pass;
+	}
+
+	static GpuCullBounds MakeTestBounds(float x, float y, float z, float radius, float extent)
+	{
+		GpuCullBounds b;
+		b.center[0] = x; b.center[1] = y; b.center[2] = z; b.radius = radius;
+		b.min[0] = x - extent; b.min[1] = y - extent; b.min[2] = z - extent; b.pad0 = 0.0f;
+		b.max[0] = x + extent; b.max[1] = y + extent; b.max[2] = z + extent; b.pad1 = 0.0f;
+		return b;
+	}
+
+	static bool SameCommand(const VkDrawIndexedIndirectCommand& command, uint32_t indexcount, uint32_t firstindex, int32_t vertexoffset, uint32_t firstinstance)
+	{
+		return command.indexCount == indexcount && command.instanceCount == 1 && command.firstIndex == firstindex && command.vertexOffset == vertexoffset &&
+			   command.firstInstance == firstinstance;
+	}
+
+	void GpuCullTests()
+	{
+		//mesh 0 has a coarse lod with an error of 1 (relative to its radius), mesh 1 only the one. Every stream starts somewhere else in its arena
+		GpuMeshRecord meshes[2] = {};
+		meshes[0].lod_count = 2;
+		meshes[0].vertex_offset[GPU_CULL_STREAM_POSITION] = 100;
+		meshes[0].vertex_offset[GPU_CULL_STREAM_FULL] = 200;
+		meshes[0].first_index[GPU_CULL_STREAM_POSITION] = 1000;
+		meshes[0].first_index[GPU_CULL_STREAM_FULL] = 2000;
+		meshes[0].lods[0] = GpuCullLod{ 0, 36, 0.0f, 0 };
+		meshes[0].lods[1] = GpuCullLod{ 36, 12, 1.0f, 0 };
+		meshes[1].lod_count = 1;
+		meshes[1].vertex_offset[GPU_CULL_STREAM_POSITION] = 300;
+		meshes[1].vertex_offset[GPU_CULL_STREAM_FULL] = 400;
+		meshes[1].first_index[GPU_CULL_STREAM_POSITION] = 3000;
+		meshes[1].first_index[GPU_CULL_STREAM_FULL] = 4000;
+		meshes[1].lods[0] = GpuCullLod{ 0, 6, 0.0f, 0 };
+
+		//records 0 and 1 share mesh 0 and bucket 0 (slots 0-1), 2 and 3 share mesh 1 and bucket 1 (slots 2-3) in both streams
+		GpuDrawRecord records[4] = {};
+		for (uint32_t r = 0; r < 4; r++)
+		{
+			uint32_t bucket = r / 2;
+			records[r].mesh = bucket;
+			records[r].bucket[0] = bucket;
+			records[r].bucket[1] = bucket;
+			records[r].first[0] = bucket * 2;
+			records[r].first[1] = bucket * 2;
+		}
+
+		//0 close enough for lod 0 even with lods on, 1 far enough for lod 1, 2 inside, 3's sphere pokes into the frustrum but its box is past the right plane
+		GpuCullBounds bounds[4] = {
+			MakeTestBounds(0.0f, 0.0f, -5.0f, 1.0f, 0.5f),
+			MakeTestBounds(0.0f, 0.0f, -50.0f, 1.0f, 0.5f),
+			MakeTestBounds(-5.0f, 5.0f, -20.0f, 1.0f, 0.5f),
+			MakeTestBounds(15.0f, 0.0f, -5.0f, 6.0f, 1.0f)
+		};
+
+		//0 the camera with lods on the full stream, 1 a shadow pass on the position stream always at lod 0, 2 the late depth pass
+		GpuCullPass passes[3] = { MakeTestPass(GPU_CULL_STREAM_FULL, true, 100.0f), MakeTestPass(GPU_CULL_STREAM_POSITION, false, 0.0f),
+								  MakeTestPass(GPU_CULL_STREAM_POSITION, true, 0.0f) };
+
+		GpuCullParams params = {};
+		params.draw_count = 4;
+		params.pass_count = 3;
+		params.bucket_stride = 2;
+		params.command_stride = 4;
+		params.phase = GPU_CULL_PHASE_EARLY;
+		params.occlusion = 0;
+		params.late_pass = 2;
+		params.pbr_pass = 0;
+
+		GpuDrawList list;
+		for (uint32_t s = 0; s < 2; s++)
+		{
+			list.buckets[s].push_back(GpuDrawBucket{ nullptr, 0, 2 });
+			list.buckets[s].push_back(GpuDrawBucket{ nullptr, 2, 2 });
+		}
+
+		//the late pass is skipped, its commands have to be left the way they were
+		uint32_t counts[3 * 2] = {};
+		VkDrawIndexedIndirectCommand commands[3 * 4];
+		memset(commands, 0xFF, sizeof(commands));
+		GpuCullReference(records, bounds, meshes, passes, params, counts, commands);
+
+		CHECK(counts[0] == 2 && counts[1] == 1);
+		CHECK(SameCommand(commands[0], 36, 2000, 200, 0));
+		CHECK(SameCommand(commands[1], 12, 2036, 200, 1));
+		CHECK(SameCommand(commands[2], 6, 4000, 400, 2));
+
+		CHECK(counts[2] == 2 && counts[3] == 1);
+		CHECK(SameCommand(commands[4], 36, 1000, 100, 0));
+		CHECK(SameCommand(commands[5], 36, 1000, 100, 1));
+		CHECK(SameCommand(commands[6], 6, 3000, 300, 2));
+
+		CHECK(counts[4] == 0 && counts[5] == 0);
+		VkDrawIndexedIndirectCommand untouched;
+		memset(&untouched, 0xFF, sizeof(untouched));
+		bool skipped = true;
+		for (uint32_t c = 8; c < 12; c++) skipped = skipped && memcmp(&commands[c], &untouched, sizeof(untouched)) == 0;
+		CHECK(skipped);
+
+		//the gpu appends in whatever order its atomics hand out, the same draws swapped inside a bucket still compare equal. A different draw doesn't
+		uint32_t gpucounts[3 * 2];
+		VkDrawIndexedIndirectCommand gpucommands[3 * 4];
+		memcpy(gpucounts, counts, sizeof(counts));
+		memcpy(gpucommands, commands, sizeof(commands));
+		std::swap(gpucommands[4], gpucommands[5]);
+		CHECK(CompareGpuCull(list, passes, params, counts, commands, gpucounts, gpucommands));
+		gpucommands[1].indexCount = 36;
+		CHECK(!CompareGpuCull(list, passes, params, counts, commands, gpucounts, gpucommands));
+		gpucommands[1].indexCount = 12;
+		gpucounts[3] = 2;
+		CHECK(!CompareGpuCull(list, passes, params, counts, commands, gpucounts, gpucommands));
+
+		//with occlusion on the camera pass depends on last frames visibility so the reference leaves it alone too, the shadow pass comes out the same
+		params.occlusion = 1;
+		uint32_t occludedcounts[3 * 2] = {};
+		VkDrawIndexedIndirectCommand occludedcommands[3 * 4];
+		memset(occludedcommands, 0xFF, sizeof(occludedcommands));
+		GpuCullReference(records, bounds, meshes, passes, params, occludedcounts, occludedcommands);
+		CHECK(occludedcounts[0] == 0 && occludedcounts[1] == 0);
+		CHECK(memcmp(&occludedcommands[0], &untouched, sizeof(untouched)) == 0);
+		CHECK(occludedcounts[2] == 2 && occludedcounts[3] == 1);
+		CHECK(memcmp(&occludedcommands[4], &commands[4], sizeof(VkDrawIndexedIndirectCommand) * 4) == 0);
+	}
+
+}
@@ -0,0 +1,129 @@
+#include "../pch.h"
+#include "UnitTests.h"
+#include "../Renderer/MaskedOcclusion.h"
+#include <cmath>
+
+namespace Gibo {
+
+	//the occluders are already in ndc with an identity transform, so ndc x maps to (x * 0.5 + 0.5) * 64 pixels and ndc y to (y * 0.5 + 0.5) * 32
+	static const uint32_t TEST_WIDTH = 64;
+	static const uint32_t TEST_HEIGHT = 32;
+
+	//quad from x0 to x1 over the whole height, depth goes from z0 at x0 to z1 at x1
+	static void RenderQuad(MaskedOcclusionBuffer& buffer, float x0, float x1, float z0, float z1, bool flipwinding = false)
+	{
+		const float positions[] = { x0, -1.0f, z0,  x1, -1.0f, z1,  x1, 1.0f, z1,  x0, 1.0f, z0 };
+		const uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+		const uint32_t flipped[] = { 0, 2, 1, 0, 3, 2 };
+		buffer.RenderTriangles(positions, 4, 3, (flipwinding) ? flipped : indices, 6, glm::mat4(1.0f));
+	}
+
+	static bool ColumnDepth(const MaskedOcclusionBuffer& buffer, uint32_t x, float depth)
+	{
+		for (uint32_t y = 0; y < TEST_HEIGHT; y++)
+		{
+			if (std::abs(buffer.GetPixelDepth(x, y) - depth) > 1e-5f) return false;
+		}
+		return true;
+	}
+
+	static bool TestBox(const MaskedOcclusionBuffer& buffer, float minx, float miny, float minz, float maxx, float maxy, float maxz)
+	{
+		return buffer.TestAABB(glm::vec3(minx, miny, minz), glm::vec3(maxx, maxy, maxz), glm::mat4(1.0f));
+	}
+
+	void MaskedOcclusionTests()
+	{
+		MaskedOcclusionBuffer buffer;
+		buffer.Resize(TEST_WIDTH, TEST_HEIGHT);
+
+		//nothing drawn, everything is visible
+		CHECK(ColumnDepth(buffer, 0, 1.0f) && ColumnDepth(buffer, TEST_WIDTH - 1, 1.0f));
+		CHECK(buffer.TestRect(0, 0, TEST_WIDTH - 1, TEST_HEIGHT - 1, 0.99f));
+
+		//a full screen occluder fills every tile, its depth becomes the reference layer everywhere
+		RenderQuad(buffer, -1.0f, 1.0f, 0.5f, 0.5f);
+		CHECK(buffer.GetStats().triangles == 2);
+		bool filled = true;
+		for (uint32_t x = 0; x < TEST_WIDTH; x++) filled = filled && ColumnDepth(buffer, x, 0.5f);
+		CHECK(filled);
+		CHECK(!buffer.TestRect(10, 10, 20, 20, 0.6f));
+		CHECK(buffer.TestRect(10, 10, 20, 20, 0.4f));
+		CHECK(!TestBox(buffer, -0.2f, -0.2f, 0.6f, 0.2f, 0.2f, 0.7f));
+		CHECK(TestBox(buffer, -0.2f, -0.2f, 0.3f, 0.2f, 0.2f, 0.7f));
+		//crossing the near plane can't be bounded on screen, it's visible even though most of it is behind
+		CHECK(TestBox(buffer, -0.2f, -0.2f, -0.1f, 0.2f, 0.2f, 0.9f));
+		//off screen is left to the frustrum culling
+		CHECK(buffer.TestRect(-10, -10, -1, -1, 0.9f));
+
+		//the other winding draws the same
+		buffer.Clear();
+		RenderQuad(buffer, -1.0f, 1.0f, 0.5f, 0.5f, true);
+		CHECK(ColumnDepth(buffer, 0, 0.5f) && ColumnDepth(buffer, TEST_WIDTH - 1, 0.5f));
+
+		//left half, its edge lands right on the tile border at pixel 32
+		buffer.Clear();
+		RenderQuad(buffer, -1.0f, 0.0f, 0.5f, 0.5f);
+		CHECK(ColumnDepth(buffer, 31, 0.5f));
+		CHECK(ColumnDepth(buffer, 32, 1.0f));
+		CHECK(!buffer.TestRect(0, 0, 31, TEST_HEIGHT - 1, 0.9f));
+		CHECK(buffer.TestRect(31, 0, 32, 0, 0.9f));
+		CHECK(!TestBox(buffer, -0.8f, -0.5f, 0.6f, -0.2f, 0.5f, 0.7f));
+		CHECK(TestBox(buffer, -0.5f, -0.5f, 0.6f, 0.5f, 0.5f, 0.7f));
+
+		//edge in the middle of tile 2 (pixels 16-23) at pixel 20, that tile only gets a working layer over its first 4 columns
+		buffer.Clear();
+		RenderQuad(buffer, -1.0f, 20.0f / 32.0f - 1.0f, 0.5f, 0.5f);
+		CHECK(ColumnDepth(buffer, 19, 0.5f));
+		CHECK(ColumnDepth(buffer, 20, 1.0f));
+		CHECK(!buffer.TestRect(18, 0, 19, TEST_HEIGHT - 1, 0.9f));
+		CHECK(buffer.TestRect(19, 0, 20, 0, 0.9f));
+		//closer than the working layer is visible even inside the mask
+		CHECK(buffer.TestRect(18, 0, 19, 0, 0.4f));
+
+		//a far working layer gets thrown away for a much closer occluder over the same pixels, a slightly closer one just merges into it
+		buffer.Clear();
+		RenderQuad(buffer, -1.0f, 20.0f / 32.0f - 1.0f, 0.9f, 0.9f);
+		RenderQuad(buffer, -1.0f, 20.0f / 32.0f - 1.0f, 0.1f, 0.1f);
+		CHECK(ColumnDepth(buffer, 19, 0.1f));
+		CHECK(!buffer.TestRect(18, 0, 19, 0, 0.3f));
+		RenderQuad(buffer, -1.0f, 20.0f / 32.0f - 1.0f, 0.05f, 0.05f);
+		CHECK(ColumnDepth(buffer, 19, 0.1f));
+
+		//depth goes from -1 on the left to 1 on the right, the near plane clips off the left half and the rest keeps the farthest depth over each tile
+		buffer.Clear();
+		RenderQuad(buffer, -1.0f, 1.0f, -1.0f, 1.0f);
+		CHECK(ColumnDepth(buffer, 10, 1.0f));
+		CHECK(ColumnDepth(buffer, 40, 0.5f));
+		CHECK(!buffer.TestRect(40, 0, 47, TEST_HEIGHT - 1, 0.6f));
+		CHECK(buffer.TestRect(40, 0, 47, TEST_HEIGHT - 1, 0.4f));
+
+		//all of it in front of the near plane gets dropped
+		buffer.Clear();
+		buffer.ResetStats();
+		RenderQuad(buffer, -1.0f, 1.0f, -0.5f, -0.1f);
+		CHECK(buffer.GetStats().triangles == 0);
+		CHECK(ColumnDepth(buffer, 32, 1.0f));
+
+		//degenerate triangles (no area, or between pixel centers) don't cover anything
+		const float line[] = { -1.0f, -1.0f, 0.5f,  0.0f, 0.0f, 0.5f,  1.0f, 1.0f, 0.5f };
+		const float point[] = { 0.1f, 0.1f, 0.5f,  0.1f, 0.1f, 0.5f,  0.1f, 0.1f, 0.5f };
+		const float sliver[] = { 0.0f, 0.0f, 0.5f,  1.0f / 128.0f, 0.0f, 0.5f,  0.0f, 1.0f / 64.0f, 0.5f };
+		const uint32_t triangle[] = { 0, 1, 2 };
+		buffer.RenderTriangles(line, 3, 3, triangle, 3, glm::mat4(1.0f));
+		buffer.RenderTriangles(point, 3, 3, triangle, 3, glm::mat4(1.0f));
+		CHECK(buffer.GetStats().triangles == 0);
+		buffer.RenderTriangles(sliver, 3, 3, triangle, 3, glm::mat4(1.0f));
+		bool empty = true;
+		for (uint32_t x = 0; x < TEST_WIDTH; x++) empty = empty && ColumnDepth(buffer, x, 1.0f);
+		CHECK(empty);
+
+		//a buffer thats not a whole number of tiles still covers its last pixels
+		buffer.Resize(TEST_WIDTH - 3, TEST_HEIGHT - 1);
+		const float full[] = { -1.0f, -1.0f, 0.5f,  3.0f, -1.0f, 0.5f,  -1.0f, 3.0f, 0.5f };
+		buffer.RenderTriangles(full, 3, 3, triangle, 3, glm::mat4(1.0f));
+		CHECK(std::abs(buffer.GetPixelDepth(TEST_WIDTH - 4, TEST_HEIGHT - 2) - 0.5f) < 1e-5f);
+		CHECK(!buffer.TestRect(0, 0, TEST_WIDTH, TEST_HEIGHT, 0.6f));
+	}
+
+}
@@ -0,0 +1,33 @@
+#include "../pch.h"
+#include "UnitTests.h"
+
+namespace Gibo {
+
+	namespace UnitTests {
+		int failures = 0;
+	}
+
+	int RunUnitTests()
+	{
+		struct Test
+		{
+			const char* name;
+			void(*run)();
+		};
+		static const Test tests[] = {
+			{ "gpu cull", GpuCullTests },
+			{ "masked occlusion", MaskedOcclusionTests },
+		};
+
+		UnitTests::failures = 0;
+		for (const Test& test : tests)
+		{
+			int before = UnitTests::failures;
+			test.run();
+			printf("%s %s\n", (UnitTests::failures == before) ? "passed" : "FAILED", test.name);
+		}
+		printf("%d failed checks\n", UnitTests::failures);
+		return UnitTests::failures;
+	}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdio>
+
+namespace Gibo {
+
+	/*
+	 CPU only tests for the parts of the renderer that are plain math on plain data (the gpu cull reference, the software occlusion buffer). Nothing in here
+	 creates a window or a device, run the exe with --tests and it runs every test, prints the failures and exits with the failure count.
+
+	 A test is a void function that CHECKs what it expects, a failed CHECK prints where it was and the test keeps going.
+	*/
+	namespace UnitTests {
+
+		extern int failures;
+
+		inline void Check(bool passed, const char* expression, const char* file, int line)
+		{
+			if (passed) return;
+			failures++;
+			printf("FAILED %s:%d  %s\n", file, line, expression);
+		}
+
+	}
+
+	#define CHECK(expression) UnitTests::Check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+	void GpuCullTests();
+	void MaskedOcclusionTests();
+
+	//runs every test above, returns the number of failed CHECKs
+	int RunUnitTests();
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace Gibo {
+
+	/*
+	 64 bit FNV-1a. The asset caches use it to tell whether a source changed since its cache was written, the materials to key their templates and records.
+	 Pass the previous result back in as hash to keep going over more than one block. Equal hashes don't mean equal data, anything that shares on a match
+	 still has to compare the real bytes.
+	*/
+	inline uint64_t HashBytes(const void* data, size_t count, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < count; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+}
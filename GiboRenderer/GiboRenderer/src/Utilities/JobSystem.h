@@ -0,0 +1,296 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+namespace Gibo {
+	/*
+	 Work stealing job system so the per frame cpu work in RenderManager::Render can spread over every core instead of pegging the render thread.
+
+	 Every thread (the thread that calls Initialize is thread 0, the workers are 1..N) owns a deque. New jobs get pushed to the back of the deque of whoever submitted them
+	 and the owner pops from the back too (newest first so its data is still in cache). When a thread runs dry it steals from the front of somebody elses deque, so big batches
+	 get spread out without a central queue everyone fights over. The deques are just a mutex + std::deque each, the lock is only held for the push/pop so it barely ever contends.
+
+	 Jobs report to a Counter. Submit bumps it, finishing a job drops it, and Wait(counter) returns when it hits 0. The waiting thread doesn't sleep, it runs jobs while it waits
+	 so the render thread is just another worker during a ParallelFor. SubmitAfter lets a job wait on another counter: it gets parked on that counter and pushed when it hits 0.
+
+	 Rules:
+		. a counter has to outlive every job submitted to it and anything parked on it, so keep them on the stack of whoever Waits on them
+		. jobs can submit and wait on more jobs (nested ParallelFor is fine)
+		. with 0 workers everything just runs inline on the calling thread
+	*/
+	class JobSystem
+	{
+	public:
+		using JobFunction = std::function<void()>;
+
+		struct Counter;
+		struct Job
+		{
+			JobFunction function;
+			Counter* counter = nullptr;
+		};
+
+		struct Counter
+		{
+			std::atomic<int32_t> value{ 0 };
+			std::mutex lock;
+			std::vector<Job> continuations; //jobs parked by SubmitAfter until value hits 0
+
+			bool Done() const { return value.load(std::memory_order_acquire) == 0; }
+		};
+
+	public:
+		JobSystem() = default;
+		~JobSystem() { Shutdown(); }
+
+		JobSystem(JobSystem const&) = delete;
+		JobSystem(JobSystem&&) = delete;
+		JobSystem& operator=(JobSystem const&) = delete;
+		JobSystem& operator=(JobSystem&&) = delete;
+
+		//workercount of -1 means one worker per core minus the calling thread
+		void Initialize(int32_t workercount = -1)
+		{
+			if (workercount < 0)
+			{
+				workercount = std::max(static_cast<int32_t>(std::thread::hardware_concurrency()) - 1, 0);
+			}
+
+			running = true;
+			queues = std::vector<WorkQueue>(workercount + 1);
+			ThreadIndex() = 0;
+			for (int32_t i = 0; i < workercount; i++)
+			{
+				workers.emplace_back(&JobSystem::WorkerLoop, this, static_cast<uint32_t>(i + 1));
+			}
+		}
+
+		void Shutdown()
+		{
+			{
+				std::lock_guard<std::mutex> guard(wake_lock);
+				running = false;
+			}
+			wake.notify_all();
+
+			for (int i = 0; i < workers.size(); i++)
+			{
+				workers[i].join();
+			}
+			workers.clear();
+			queues.clear();
+		}
+
+		//threads including the one that called Initialize. Use this to size per thread scratch data and index it with GetThreadIndex()
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers.size()) + 1; }
+		static uint32_t GetThreadIndex() { return ThreadIndex(); }
+
+		void Submit(JobFunction function, Counter* counter)
+		{
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+			Push(Job{ std::move(function), counter });
+		}
+
+		//function won't start until dependency hits 0. counter counts it as pending right away so waiting on it also waits for the dependency
+		void SubmitAfter(Counter* dependency, JobFunction function, Counter* counter)
+		{
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+			{
+				std::lock_guard<std::mutex> guard(dependency->lock);
+				if (!dependency->Done())
+				{
+					dependency->continuations.push_back(Job{ std::move(function), counter });
+					return;
+				}
+			}
+			Push(Job{ std::move(function), counter });
+		}
+
+		//runs other jobs until the counter hits 0
+		void Wait(Counter* counter)
+		{
+			while (!counter->Done())
+			{
+				if (!RunOneJob())
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			//whoever dropped it to 0 might still be holding the lock flushing continuations. once we get it they're done touching the counter and its safe to destroy
+			std::lock_guard<std::mutex> guard(counter->lock);
+		}
+
+		//splits [0, count) into chunks of grainsize and calls function(begin, end) on each. Doesn't wait, the chunks report to counter.
+		template<typename F>
+		void ParallelForAsync(uint32_t count, uint32_t grainsize, F function, Counter* counter)
+		{
+			grainsize = std::max(grainsize, 1u);
+			for (uint32_t begin = 0; begin < count; begin += grainsize)
+			{
+				uint32_t end = std::min(begin + grainsize, count);
+				Submit([function, begin, end]() { function(begin, end); }, counter);
+			}
+		}
+
+		//same as above but the calling thread runs the first chunk itself and waits for the rest
+		template<typename F>
+		void ParallelFor(uint32_t count, uint32_t grainsize, F function)
+		{
+			grainsize = std::max(grainsize, 1u);
+			if (count <= grainsize || queues.size() <= 1)
+			{
+				if (count > 0) function(0, count);
+				return;
+			}
+
+			Counter counter;
+			for (uint32_t begin = grainsize; begin < count; begin += grainsize)
+			{
+				uint32_t end = std::min(begin + grainsize, count);
+				Submit([&function, begin, end]() { function(begin, end); }, &counter);
+			}
+			function(0, grainsize);
+			Wait(&counter);
+		}
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex lock;
+			std::deque<Job> jobs;
+		};
+
+		static uint32_t& ThreadIndex()
+		{
+			thread_local uint32_t index = 0;
+			return index;
+		}
+
+		void Push(Job job)
+		{
+			//no workers so there's nobody to hand it to
+			if (queues.size() <= 1)
+			{
+				Execute(job);
+				return;
+			}
+
+			uint32_t index = std::min<uint32_t>(ThreadIndex(), static_cast<uint32_t>(queues.size()) - 1);
+			{
+				std::lock_guard<std::mutex> guard(queues[index].lock);
+				queues[index].jobs.push_back(std::move(job));
+			}
+			{
+				std::lock_guard<std::mutex> guard(wake_lock);
+				queued_jobs++;
+			}
+			wake.notify_one();
+		}
+
+		//pop the newest job off our own deque, else steal the oldest one off someone else
+		bool RunOneJob()
+		{
+			uint32_t count = static_cast<uint32_t>(queues.size());
+			uint32_t self = std::min(ThreadIndex(), count - 1);
+			Job job;
+			bool found = false;
+
+			{
+				std::lock_guard<std::mutex> guard(queues[self].lock);
+				if (!queues[self].jobs.empty())
+				{
+					job = std::move(queues[self].jobs.back());
+					queues[self].jobs.pop_back();
+					found = true;
+				}
+			}
+
+			//start at a random victim so the thieves don't all pile onto the same deque
+			uint32_t start = NextRandom() % count;
+			for (uint32_t i = 0; i < count && !found; i++)
+			{
+				uint32_t victim = (start + i) % count;
+				if (victim == self) continue;
+
+				std::lock_guard<std::mutex> guard(queues[victim].lock);
+				if (!queues[victim].jobs.empty())
+				{
+					job = std::move(queues[victim].jobs.front());
+					queues[victim].jobs.pop_front();
+					found = true;
+				}
+			}
+
+			if (!found) return false;
+
+			queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+			Execute(job);
+			return true;
+		}
+
+		void Execute(Job& job)
+		{
+			job.function();
+			Finish(job.counter);
+		}
+
+		//drops the counter and if it hit 0 pushes everything that was parked on it
+		void Finish(Counter* counter)
+		{
+			std::vector<Job> ready;
+			{
+				std::lock_guard<std::mutex> guard(counter->lock);
+				if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					ready.swap(counter->continuations);
+				}
+			}
+
+			for (int i = 0; i < ready.size(); i++)
+			{
+				Push(std::move(ready[i]));
+			}
+		}
+
+		void WorkerLoop(uint32_t index)
+		{
+			ThreadIndex() = index;
+			while (true)
+			{
+				if (RunOneJob()) continue;
+
+				std::unique_lock<std::mutex> guard(wake_lock);
+				wake.wait(guard, [this]() { return queued_jobs.load(std::memory_order_relaxed) > 0 || !running; });
+				if (!running) return;
+			}
+		}
+
+		static uint32_t NextRandom()
+		{
+			//xorshift, seeded off the stack address so every thread gets a different sequence
+			thread_local uint32_t state = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state)) | 1u;
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+	private:
+		std::vector<WorkQueue> queues; //one per thread, index 0 is the thread that called Initialize
+		std::vector<std::thread> workers;
+
+		std::mutex wake_lock;
+		std::condition_variable wake; //idle workers sleep here until something gets pushed
+		std::atomic<int32_t> queued_jobs{ 0 };
+		bool running = false;
+	};
+
+}
@@ -0,0 +1,96 @@
+#include "../pch.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Gibo {
+
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		HANDLE filehandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (filehandle == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER filesize;
+		if (!GetFileSizeEx(filehandle, &filesize) || filesize.QuadPart == 0)
+		{
+			CloseHandle(filehandle);
+			return false;
+		}
+
+		HANDLE mappinghandle = CreateFileMappingA(filehandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappinghandle == nullptr)
+		{
+			CloseHandle(filehandle);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mappinghandle, FILE_MAP_READ, 0, 0, 0);
+		if (view == nullptr)
+		{
+			CloseHandle(mappinghandle);
+			CloseHandle(filehandle);
+			return false;
+		}
+
+		file = filehandle;
+		mapping = mappinghandle;
+		data = static_cast<const uint8_t*>(view);
+		size = static_cast<size_t>(filesize.QuadPart);
+#else
+		int filedescriptor = open(path.c_str(), O_RDONLY);
+		if (filedescriptor < 0) return false;
+
+		struct stat info;
+		if (fstat(filedescriptor, &info) != 0 || info.st_size == 0)
+		{
+			close(filedescriptor);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, filedescriptor, 0);
+		if (view == MAP_FAILED)
+		{
+			close(filedescriptor);
+			return false;
+		}
+
+		fd = filedescriptor;
+		data = static_cast<const uint8_t*>(view);
+		size = static_cast<size_t>(info.st_size);
+#endif
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file) CloseHandle(file);
+		mapping = nullptr;
+		file = nullptr;
+#else
+		if (data) munmap(const_cast<uint8_t*>(data), size);
+		if (fd >= 0) close(fd);
+		fd = -1;
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+}
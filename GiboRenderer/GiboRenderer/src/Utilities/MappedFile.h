@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace Gibo {
+
+	/*
+	 Read only memory mapped file. The os pages it in as its touched so opening is basically free, and copying out of Data() reads straight from the page cache with no
+	 extra read buffer in between. The mapping lives until Close or the destructor so anything pointing into Data() has to be done with it by then.
+	 The platform handles are stored as void pointers (or an fd) so windows.h doesn't leak out of MappedFile.cpp.
+	*/
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(MappedFile const&) = delete;
+		MappedFile(MappedFile&&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile&&) = delete;
+
+		bool Open(const std::string& path);
+		void Close();
+
+		const uint8_t* Data() const { return data; }
+		size_t Size() const { return size; }
+		bool IsOpen() const { return data != nullptr; }
+
+	private:
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+}
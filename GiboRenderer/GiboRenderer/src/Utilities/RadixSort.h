@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+
+namespace Gibo {
+	/*
+	 LSD radix sort for anything with an integer key. Goes 8 bits at a time from the lowest byte up, scattering between data and scratch, so its O(n * keybytes) with no comparisons
+	 and it's stable (equal keys keep their input order). All the histograms get counted in one pass up front, and any byte where every key has the same value gets skipped,
+	 which happens a lot with draw keys (one pipeline, a handful of meshes) so most sorts only end up doing 3 or 4 passes.
+
+	 key(element) returns the uint64_t to sort by, keybytes is how many low bytes of it actually matter.
+	 scratch has to hold count elements. The result always ends up back in data.
+	*/
+	template<typename T, typename KeyFunc>
+	void RadixSort(T* data, T* scratch, uint32_t count, KeyFunc key, uint32_t keybytes = 8)
+	{
+		if (count <= 1) return;
+		keybytes = std::min(keybytes, 8u);
+
+		uint32_t histograms[8][256] = {};
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint64_t k = key(data[i]);
+			for (uint32_t b = 0; b < keybytes; b++)
+			{
+				histograms[b][(k >> (b * 8)) & 0xFF]++;
+			}
+		}
+
+		T* src = data;
+		T* dst = scratch;
+		uint64_t first_key = key(data[0]);
+		for (uint32_t b = 0; b < keybytes; b++)
+		{
+			//every key has the same digit here so this pass wouldn't move anything
+			uint32_t shift = b * 8;
+			if (histograms[b][(first_key >> shift) & 0xFF] == count) continue;
+
+			uint32_t offsets[256];
+			uint32_t sum = 0;
+			for (int d = 0; d < 256; d++)
+			{
+				offsets[d] = sum;
+				sum += histograms[b][d];
+			}
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				dst[offsets[(key(src[i]) >> shift) & 0xFF]++] = src[i];
+			}
+			std::swap(src, dst);
+		}
+
+		//odd number of passes leaves it in scratch
+		if (src != data)
+		{
+			std::copy(src, src + count, data);
+		}
+	}
+
+	//maps a float to a uint32_t that sorts in the same order, negatives included. Positive floats just need the sign bit set, negative ones get every bit flipped
+	inline uint32_t FloatSortKey(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(float));
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	template<typename T, typename KeyFunc>
+	void RadixSort(std::vector<T>& data, std::vector<T>& scratch, KeyFunc key, uint32_t keybytes = 8)
+	{
+		scratch.resize(data.size());
+		RadixSort(data.data(), scratch.data(), static_cast<uint32_t>(data.size()), key, keybytes);
+	}
+
+}
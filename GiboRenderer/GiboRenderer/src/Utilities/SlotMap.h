@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace Gibo {
+
+	//index into a slot maps sparse array plus the generation that slot had when it was handed out. Once the slot gets removed the generation moves on so old handles just stop resolving.
+	struct SlotHandle
+	{
+		static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		bool IsNull() const { return index == INVALID_INDEX; }
+		bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+	};
+
+	/*
+	 Generational slot map. The values live packed in a dense array so looping over them is just a vector walk, and a sparse array of slots maps a handle to where its value is in the dense array.
+	 Insert, Remove and Get are all O(1):
+		. insert pops a slot off the free list (or grows the sparse array) and pushes the value on the end of the dense array
+		. remove swaps the last dense value into the hole and pops, then fixes up the sparse slot of whatever got moved
+		. get checks the generation so a handle to something removed returns nullptr instead of whatever took its place
+
+	 The sparse index never changes for the life of a value so it can be used as a stable id for other arrays (descriptors, culling slots, tree leaves).
+	 Remove(handle, false) keeps the slot off the free list until Recycle is called, for when other systems still have the index in flight for a few frames.
+	*/
+	template<typename T>
+	class SlotMap
+	{
+	public:
+		SlotMap() = default;
+		~SlotMap() = default;
+
+		void Reserve(uint32_t count)
+		{
+			dense.reserve(count);
+			dense_to_sparse.reserve(count);
+			sparse.reserve(count);
+		}
+
+		SlotHandle Insert(const T& value)
+		{
+			uint32_t index;
+			if (free_head != SlotHandle::INVALID_INDEX)
+			{
+				index = free_head;
+				free_head = sparse[index].next_free;
+			}
+			else
+			{
+				index = static_cast<uint32_t>(sparse.size());
+				sparse.push_back(Slot());
+			}
+
+			Slot& slot = sparse[index];
+			slot.dense_index = static_cast<uint32_t>(dense.size());
+			slot.next_free = SlotHandle::INVALID_INDEX;
+			dense.push_back(value);
+			dense_to_sparse.push_back(index);
+
+			SlotHandle handle;
+			handle.index = index;
+			handle.generation = slot.generation;
+			return handle;
+		}
+
+		//returns false if the handle was already stale
+		bool Remove(SlotHandle handle, bool recycle = true)
+		{
+			if (!Valid(handle)) return false;
+
+			Slot& slot = sparse[handle.index];
+			uint32_t hole = slot.dense_index;
+			uint32_t last = static_cast<uint32_t>(dense.size()) - 1;
+			if (hole != last)
+			{
+				dense[hole] = std::move(dense[last]);
+				dense_to_sparse[hole] = dense_to_sparse[last];
+				sparse[dense_to_sparse[hole]].dense_index = hole;
+			}
+			dense.pop_back();
+			dense_to_sparse.pop_back();
+
+			slot.dense_index = SlotHandle::INVALID_INDEX;
+			slot.generation++;
+			if (recycle)
+			{
+				Recycle(handle.index);
+			}
+			return true;
+		}
+
+		//puts a removed slot back on the free list so Insert can hand it out again
+		void Recycle(uint32_t index)
+		{
+			sparse[index].next_free = free_head;
+			free_head = index;
+		}
+
+		bool Valid(SlotHandle handle) const
+		{
+			return handle.index < sparse.size() && sparse[handle.index].generation == handle.generation && sparse[handle.index].dense_index != SlotHandle::INVALID_INDEX;
+		}
+
+		T* Get(SlotHandle handle)
+		{
+			return Valid(handle) ? &dense[sparse[handle.index].dense_index] : nullptr;
+		}
+
+		void Clear()
+		{
+			dense.clear();
+			dense_to_sparse.clear();
+			sparse.clear();
+			free_head = SlotHandle::INVALID_INDEX;
+		}
+
+		std::vector<T>& Dense() { return dense; }
+		uint32_t SparseIndex(uint32_t dense_index) const { return dense_to_sparse[dense_index]; }
+		uint32_t Size() const { return static_cast<uint32_t>(dense.size()); }
+		uint32_t Capacity() const { return static_cast<uint32_t>(sparse.size()); } //highest sparse index handed out + 1, what index keyed side arrays need to be sized to
+
+	private:
+		struct Slot
+		{
+			uint32_t dense_index = SlotHandle::INVALID_INDEX;
+			uint32_t generation = 0;
+			uint32_t next_free = SlotHandle::INVALID_INDEX;
+		};
+
+		std::vector<T> dense;
+		std::vector<uint32_t> dense_to_sparse;
+		std::vector<Slot> sparse;
+		uint32_t free_head = SlotHandle::INVALID_INDEX;
+	};
+
+}
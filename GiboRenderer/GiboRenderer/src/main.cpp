@@ -1,12 +1,19 @@
 #include "pch.h"
 #include "TestApplication.h"
 #include "TestApplication2.h"
+#include "Tests/UnitTests.h"
 
 #define TESTAPPLICATION_1 1
 #define TESTAPPLICATION_2 0
 
-int main()
+int main(int argc, char** argv)
 {
+	//cpu only tests, never opens a window or touches the device
+	if (argc > 1 && std::string(argv[1]) == "--tests")
+	{
+		return (Gibo::RunUnitTests() == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 #if TESTAPPLICATION_1
 	TestApplication mainapp;
 #elif TESTAPPLICATION_2